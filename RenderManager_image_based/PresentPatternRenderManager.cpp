@@ -28,6 +28,9 @@
 #include <osvr/ClientKit/InterfaceStateC.h>
 #include <osvr/Client/RenderManagerConfig.h>
 #include "osvr/RenderKit/RenderManager.h"
+#include "sphere_batch.h"
+#include "frame_timer.h"
+#include "pattern_stream.h"
 
 // Needed for render buffer calls.  OSVR will have called glewInit() for us
 // when we open the display.
@@ -43,10 +46,13 @@
 
 // Standard includes
 #include <iostream>
+#include <fstream>
 #include <string>
 #include <stdlib.h> // For exit()
 #include <chrono>
 #include <thread>
+#include <mutex>
+#include <atomic>
 
 //This must come after we include <GL/GL.h> so its pointer types are defined.
 #include "osvr/RenderKit/GraphicsLibraryOpenGL.h"
@@ -64,8 +70,32 @@ static osvr::clientkit::ClientContext context(
 
 static osvr::renderkit::RenderManager *render = nullptr;
 
-// Quadric and sphere to use for rendering.
-static GLUquadric *sphere = nullptr;
+// With -update_thread, a worker thread calls context.update() over and
+// over so that the render loop does not wait for it.  The context is not
+// thread-safe, so the lock keeps the worker out while the render loop
+// uses the context through RenderManager (in GetRenderInfo() and
+// PresentRenderBuffers()).
+static std::atomic<bool> updateStop(false);
+static std::mutex contextLock;
+
+// How long the worker waits between updates, so that it does not keep
+// the lock all the time.
+static const int UPDATE_SLEEP_MS = 1;
+
+static void update_context()
+{
+  while (!updateStop) {
+    {
+      std::lock_guard<std::mutex> guard(contextLock);
+      context.update();
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(UPDATE_SLEEP_MS));
+  }
+}
+
+// Sphere to use for rendering, which also holds the locations of the
+// pattern's spheres so they can all be drawn at once.
+static Sphere_Batch *sphere = nullptr;
 
 // X,Y location
 typedef struct {
@@ -166,9 +196,65 @@ bool SetupRendering(osvr::renderkit::GraphicsLibrary library)
 
   glEnable(GL_COLOR_MATERIAL);
 
-  // Construct the quadric for the sphere primitive to draw to show spacing
-  sphere = gluNewQuadric();
+  // Construct the sphere primitive to draw to show spacing
+  sphere = new Sphere_Batch(40, 40);
+
+  return true;
+}
+
+// Make a framebuffer object that renders into the specified color and
+// depth buffers.  Each eye in each set of buffers gets its own, made
+// once, so that rendering only needs to bind it.  Returns 0 (after
+// saying why) if it is not complete.
+static GLuint MakeFrameBuffer(GLuint colorBuffer, GLuint depthBuffer)
+{
+  GLuint frameBuffer;
+  glGenFramebuffers(1, &frameBuffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
+
+  // Set color and depth buffers for the frame buffer
+  glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+    colorBuffer, 0);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+    GL_RENDERBUFFER, depthBuffer);
+
+  // Set the list of draw buffers.
+  GLenum DrawBuffers[1] = { GL_COLOR_ATTACHMENT0 };
+  glDrawBuffers(1, DrawBuffers); // "1" is the size of DrawBuffers
+
+  // Always check that our framebuffer is ok
+  bool ok = (glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  if (!ok) {
+    std::cerr << "MakeFrameBuffer: Incomplete Framebuffer" << std::endl;
+    glDeleteFramebuffers(1, &frameBuffer);
+    return 0;
+  }
+  return frameBuffer;
+}
 
+// Read the names of the pattern images, one per line, from a list file.
+// Blank lines and lines starting with # are skipped.  Returns false
+// (after saying why) if the file can't be read or names no images.
+static bool ReadPatternList(const std::string &fileName,
+  std::vector<std::string> &names)
+{
+  std::ifstream in(fileName.c_str());
+  if (!in) {
+    std::cerr << "ReadPatternList: Can't open " << fileName << std::endl;
+    return false;
+  }
+  std::string line;
+  while (std::getline(in, line)) {
+    size_t first = line.find_first_not_of(" \t\r");
+    if ((first == std::string::npos) || (line[first] == '#')) { continue; }
+    size_t last = line.find_last_not_of(" \t\r");
+    names.push_back(line.substr(first, last - first + 1));
+  }
+  if (names.empty()) {
+    std::cerr << "ReadPatternList: No images in " << fileName << std::endl;
+    return false;
+  }
   return true;
 }
 
@@ -178,14 +264,12 @@ void RenderView(
   const OSVRDisplayConfiguration &displayConfiguration, //< Info we need about display
   const osvr::client::RenderManagerConfigPtr renderManagerConfig, //< Info we need about overfill
   const osvr::renderkit::RenderInfo &renderInfo,  //< Info needed to render
-  GLuint frameBuffer, //< Frame buffer object to bind our buffers to
-  GLuint colorBuffer, //< Color buffer to render into
-  GLuint depthBuffer, //< Depth buffer to render into
+  GLuint frameBuffer, //< Frame buffer object for this eye's buffers
   XY const &xSphere,  //< Where to draw the X-axis-marking sphere
   XY const &ySphere,  //< Where to draw the Y-axis-marking sphere
-  std::vector<XY> const &spheres,  //< Spheres to draw
   float const *color, //< Color to draw the main spheres
-  float radius  //< Radius of the spheres
+  float radius,  //< Radius of the spheres
+  GLuint pattern  //< Texture holding the pattern image to draw instead, or 0
   )
 {
   // Make sure our pointers are filled in correctly.  The config file selects
@@ -195,24 +279,8 @@ void RenderView(
     return;
   }
 
-  // Render to our framebuffer
+  // Render to our framebuffer, which already has the buffers attached.
   glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
-
-  // Set color and depth buffers for the frame buffer
-  glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
-    colorBuffer, 0);
-  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
-    GL_RENDERBUFFER, depthBuffer);
-
-  // Set the list of draw buffers.
-  GLenum DrawBuffers[1] = { GL_COLOR_ATTACHMENT0 };
-  glDrawBuffers(1, DrawBuffers); // "1" is the size of DrawBuffers
-
-  // Always check that our framebuffer is ok
-  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-    std::cerr << "RenderView: Incomplete Framebuffer" << std::endl;
-    return;
-  }
 
   // Set the viewport to cover our entire render texture.
   glViewport(0, 0,
@@ -262,40 +330,59 @@ void RenderView(
   glMatrixMode(GL_MODELVIEW);
   glLoadIdentity();
 
-  // Draw a set of spheres at the specified locations in viewport space.
-  // They are offset so that (0,0) is at the center of projection for
-  // the eye.
+  // A pattern image fills the part of the viewport that is on the
+  // screen, in place of the spheres.
+  if (pattern != 0) {
+    glPushAttrib(GL_ENABLE_BIT | GL_TEXTURE_BIT | GL_CURRENT_BIT);
+    glDisable(GL_LIGHTING);
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, pattern);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+    glColor3f(1, 1, 1);
+    glBegin(GL_QUADS);
+      glTexCoord2f(0, 0); glVertex2d(-width / 2, -height / 2);
+      glTexCoord2f(1, 0); glVertex2d(width / 2, -height / 2);
+      glTexCoord2f(1, 1); glVertex2d(width / 2, height / 2);
+      glTexCoord2f(0, 1); glVertex2d(-width / 2, height / 2);
+    glEnd();
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glPopAttrib();
+    return;
+  }
+
+  // Draw the set of spheres at the locations stored in the sphere batch,
+  // which are in viewport space.  They are offset so that (0,0) is at the
+  // center of projection for the eye.
   glColor3f(color[0], color[1], color[2]);
   double xCOP = displayConfiguration.getEyes()[whichEye].m_CenterProjX;
   double yCOP = displayConfiguration.getEyes()[whichEye].m_CenterProjY;
   double xOffset = xCOP - 0.5;
   double yOffset = yCOP - 0.5;
-  for (size_t i = 0; i < spheres.size(); i++) {
-    glPushMatrix();
-    glTranslated(spheres[i].x + xOffset, spheres[i].y + yOffset, 0);
-    gluSphere(sphere, radius, 40, 40);
-    glPopMatrix();
-  }
+  glPushMatrix();
+    glTranslated(xOffset, yOffset, 0);
+    sphere->draw(radius);
+  glPopMatrix();
 
   // Draw the axis spheres at the specified locations in viewport space.
   // They are offset so that (0,0) is at the center of projection for
   // the eye.
   // Draw the x sphere in red and the y in green.
-  glPushMatrix();
-    glColor3f(red_col[0], red_col[1], red_col[2]);
-    glTranslated(xSphere.x + xOffset, xSphere.y + yOffset, 0);
-    gluSphere(sphere, radius/2, 40, 40);
-  glPopMatrix();
-  glPushMatrix();
-    glColor3f(grn_col[0], grn_col[1], grn_col[2]);
-    glTranslated(ySphere.x + xOffset, ySphere.y + yOffset, 0);
-    gluSphere(sphere, radius/2, 40, 40);
-  glPopMatrix();
+  glColor3f(red_col[0], red_col[1], red_col[2]);
+  sphere->drawOne(xSphere.x + xOffset, xSphere.y + yOffset, radius/2);
+  glColor3f(grn_col[0], grn_col[1], grn_col[2]);
+  sphere->drawOne(ySphere.x + xOffset, ySphere.y + yOffset, radius/2);
 }
 
 void Usage(std::string name)
 {
   std::cerr << "Usage: " << name
+    << " [-timing file.csv] (show frame timing and write it to the file on exit)"
+    << " [-buffers N] (render into a ring of N sets of buffers, so that a frame"
+    << " can be rendered while the one before it is presented, default 2)"
+    << " [-update_thread] (update the OSVR context on a separate thread)"
+    << " [-patterns list.txt] (show the PGM or PPM images named in the file,"
+    << " one per line, in turn, instead of spheres)"
+    << " [-pattern_frames N] (frames to show each pattern for, default 60)"
     << " [color (one of red, green, blue, white, cyan, magenta, yellow)]"
     << std::endl;
   exit(-1);
@@ -306,9 +393,37 @@ int main(int argc, char *argv[])
     // Parse the command line
     std::string colorName = "red";
     const float *color = red_col;
+    std::string timingFileName;
+    size_t numBufferSets = 2;
+    bool useUpdateThread = false;
+    std::string patternListName;
+    int framesPerPattern = 60;
     int realParams = 0;
     for (int i = 1; i < argc; i++) {
-      if (argv[i][0] == '-') {
+      if (std::string("-timing") == argv[i]) {
+        if (++i >= argc) { Usage(argv[0]); }
+        timingFileName = argv[i];
+      } else if (std::string("-buffers") == argv[i]) {
+        if (++i >= argc) { Usage(argv[0]); }
+        int n = atoi(argv[i]);
+        if (n < 1) {
+          std::cerr << "Bad value for -buffers: " << argv[i] << std::endl;
+          Usage(argv[0]);
+        }
+        numBufferSets = static_cast<size_t>(n);
+      } else if (std::string("-update_thread") == argv[i]) {
+        useUpdateThread = true;
+      } else if (std::string("-patterns") == argv[i]) {
+        if (++i >= argc) { Usage(argv[0]); }
+        patternListName = argv[i];
+      } else if (std::string("-pattern_frames") == argv[i]) {
+        if (++i >= argc) { Usage(argv[0]); }
+        framesPerPattern = atoi(argv[i]);
+        if (framesPerPattern < 1) {
+          std::cerr << "Bad value for -pattern_frames: " << argv[i] << std::endl;
+          Usage(argv[0]);
+        }
+      } else if (argv[i][0] == '-') {
         Usage(argv[0]);
       }
       else switch (++realParams) {
@@ -411,12 +526,40 @@ int main(int argc, char *argv[])
         return 3;
     }
 
+    // Start decoding the pattern images, if we're showing them.
+    std::vector<std::string> patternNames;
+    Pattern_Stream *patterns = nullptr;
+    if (!patternListName.empty()) {
+      if (!ReadPatternList(patternListName, patternNames)) {
+        return 4;
+      }
+      patterns = new Pattern_Stream(patternNames);
+      if (!patterns->ok()) {
+        std::cerr << "Could not use the pattern images" << std::endl;
+        delete patterns;
+        return 4;
+      }
+    }
+    int shownPattern = -1;
+    int patternFramesShown = 0;
+
+    // Time each frame, against the 60 Hz refresh of the HDK.
+    Frame_Timer *timer = new Frame_Timer(60, !timingFileName.empty());
+
     // Do a call to get the information we need to construct our
     // color and depth render-to-texture buffers.
     std::vector<osvr::renderkit::RenderInfo> renderInfo;
     context.update();
     renderInfo = render->GetRenderInfo();
-    std::vector<osvr::renderkit::RenderBuffer> colorBuffers;
+    size_t numEyes = renderInfo.size();
+
+    // A ring of sets of color buffers, each with one per eye and a
+    // framebuffer object for each.  Frame N renders into set N modulo
+    // the number of sets, so it does not overwrite the buffers that
+    // frame N - 1 handed to PresentRenderBuffers().  Depth is not
+    // presented, so each eye has only one depth buffer.
+    std::vector<std::vector<osvr::renderkit::RenderBuffer> > colorBuffers(numBufferSets);
+    std::vector<std::vector<GLuint> > frameBuffers(numBufferSets);
     std::vector<GLuint> depthBuffers; //< Depth/stencil buffers to render into
 
     // Use the width of the first eye to figure out the spacing for the
@@ -439,6 +582,13 @@ int main(int argc, char *argv[])
         spheres.push_back(sphere);
       }
     }
+    // Send them to the graphics card once, rather than on every frame.
+    std::vector<float> centers;
+    for (size_t i = 0; i < spheres.size(); i++) {
+      centers.push_back(static_cast<float>(spheres[i].x));
+      centers.push_back(static_cast<float>(spheres[i].y));
+    }
+    sphere->setCenters(centers);
     XY xSphere, ySphere;
     xSphere.x = sphereSpace / 2;
     xSphere.y = 0;
@@ -447,11 +597,26 @@ int main(int argc, char *argv[])
 
     // Construct the buffers we're going to need for our render-to-texture
     // code.
-    GLuint frameBuffer;               //< Groups a color buffer and a depth buffer
-    glGenFramebuffers(1, &frameBuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
+    for (size_t i = 0; i < numEyes; i++) {
+      // Determine the appropriate size for the frame buffer to be used for
+      // this eye.
+      int width = static_cast<int>(renderInfo[i].viewport.width);
+      int height = static_cast<int>(renderInfo[i].viewport.height);
 
-    for (size_t i = 0; i < renderInfo.size(); i++) {
+      // The depth buffer
+      GLuint depthrenderbuffer;
+      glGenRenderbuffers(1, &depthrenderbuffer);
+      glBindRenderbuffer(GL_RENDERBUFFER, depthrenderbuffer);
+      glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT,
+        width,
+        height);
+      depthBuffers.push_back(depthrenderbuffer);
+    }
+
+    std::vector<osvr::renderkit::RenderBuffer> allColorBuffers;
+    for (size_t b = 0; b < numBufferSets * numEyes; b++) {
+      size_t set = b / numEyes;
+      size_t i = b % numEyes;
 
       // The color buffer for this eye.  We need to put this into
       // a generic structure for the Present function, but we only need
@@ -468,7 +633,8 @@ int main(int argc, char *argv[])
       osvr::renderkit::RenderBuffer rb;
       rb.OpenGL = new osvr::renderkit::RenderBufferOpenGL;
       rb.OpenGL->colorBufferName = colorBufferName;
-      colorBuffers.push_back(rb);
+      colorBuffers[set].push_back(rb);
+      allColorBuffers.push_back(rb);
 
       // "Bind" the newly created texture : all future texture
       // functions will modify this texture glActiveTexture(GL_TEXTURE0);
@@ -492,56 +658,114 @@ int main(int argc, char *argv[])
       glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
       glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
-      // The depth buffer
-      GLuint depthrenderbuffer;
-      glGenRenderbuffers(1, &depthrenderbuffer);
-      glBindRenderbuffer(GL_RENDERBUFFER, depthrenderbuffer);
-      glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT,
-        width,
-        height);
-      depthBuffers.push_back(depthrenderbuffer);
+      GLuint frameBuffer = MakeFrameBuffer(colorBufferName, depthBuffers[i]);
+      if (frameBuffer == 0) {
+        quit = true;
+      }
+      frameBuffers[set].push_back(frameBuffer);
     }
 
-    // Register our constructed buffers so that we can use them for
-    // presentation.
-    if (!render->RegisterRenderBuffers(colorBuffers)) {
+    // Register all of our constructed buffers so that we can use them
+    // for presentation.  With more than one set, we never render into
+    // a set until the one after it has been presented, so RenderManager
+    // does not need to copy them.
+    if (!render->RegisterRenderBuffers(allColorBuffers, numBufferSets > 1)) {
       std::cerr << "RegisterRenderBuffers() returned false, cannot continue" << std::endl;
       quit = true;
     }
 
+    std::thread updater;
+    if (useUpdateThread) {
+      updater = std::thread(update_context);
+    }
+
     // Continue rendering until it is time to quit.
+    size_t set = 0;
     while (!quit) {
+        timer->beginFrame();
+        timer->beginPhase(Frame_Timer::UPDATE);
+
         // Update the context so we get our callbacks called and
-        // update analog and button states.
-        context.update();
+        // update analog and button states, unless the update thread
+        // is doing it for us.
+        if (updater.joinable()) {
+          std::lock_guard<std::mutex> guard(contextLock);
+          renderInfo = render->GetRenderInfo();
+        } else {
+          context.update();
+          renderInfo = render->GetRenderInfo();
+        }
 
-        renderInfo = render->GetRenderInfo();
+        // Move on to the next pattern once this one has been shown for
+        // long enough.  It changes once its upload has finished, which
+        // we check for without waiting.
+        if (patterns) {
+          patterns->update();
+          if (patterns->shown() != shownPattern) {
+            shownPattern = patterns->shown();
+            patternFramesShown = 0;
+            std::cout << "Showing pattern " << shownPattern << ": "
+              << patternNames[shownPattern] << std::endl;
+          }
+          if ((shownPattern >= 0) && (++patternFramesShown == framesPerPattern)) {
+            patterns->next();
+          }
+        }
+        timer->endPhase(Frame_Timer::UPDATE);
 
         // Render into each buffer using the specified information.
         // @todo Pass the color as a command-line argument
+        timer->beginPhase(Frame_Timer::RENDER);
         for (size_t i = 0; i < renderInfo.size(); i++) {
+          timer->beginEyePass(i);
           RenderView(i, displayConfiguration, renderManagerConfig,
-            renderInfo[i], frameBuffer,
-            colorBuffers[i].OpenGL->colorBufferName,
-            depthBuffers[i],
+            renderInfo[i], frameBuffers[set][i],
             xSphere, ySphere,
-            spheres, color, sphereSpace / 4);
+            color, sphereSpace / 4,
+            patterns ? patterns->texture() : 0);
+          timer->endEyePass();
+          if (!timingFileName.empty()) {
+            timer->drawOverlay();
+          }
         }
+        timer->endPhase(Frame_Timer::RENDER);
 
         // Send the rendered results to the screen
-        if (!render->PresentRenderBuffers(colorBuffers, renderInfo)) {
-          std::cerr << "PresentRenderBuffers() returned false, maybe because it was asked to quit" << std::endl;
-          quit = true;
+        timer->beginPhase(Frame_Timer::PRESENT);
+        {
+          std::unique_lock<std::mutex> guard(contextLock, std::defer_lock);
+          if (updater.joinable()) { guard.lock(); }
+          if (!render->PresentRenderBuffers(colorBuffers[set], renderInfo)) {
+            std::cerr << "PresentRenderBuffers() returned false, maybe because it was asked to quit" << std::endl;
+            quit = true;
+          }
         }
+        timer->endPhase(Frame_Timer::PRESENT);
+        timer->endFrame();
+        set = (set + 1) % numBufferSets;
+    }
+    if (updater.joinable()) {
+      updateStop = true;
+      updater.join();
+    }
+    if (!timingFileName.empty()) {
+      timer->writeCSV(timingFileName);
     }
 
     // Clean up after ourselves.
-    glDeleteFramebuffers(1, &frameBuffer);
-    for (size_t i = 0; i < renderInfo.size(); i++) {
-      glDeleteTextures(1, &colorBuffers[i].OpenGL->colorBufferName);
-      delete colorBuffers[i].OpenGL;
+    for (size_t set = 0; set < numBufferSets; set++) {
+      for (size_t i = 0; i < numEyes; i++) {
+        glDeleteFramebuffers(1, &frameBuffers[set][i]);
+        glDeleteTextures(1, &colorBuffers[set][i].OpenGL->colorBufferName);
+        delete colorBuffers[set][i].OpenGL;
+      }
+    }
+    for (size_t i = 0; i < numEyes; i++) {
       glDeleteRenderbuffers(1, &depthBuffers[i]);
     }
+    delete patterns;
+    delete sphere;
+    delete timer;
 
     // Close the Renderer interface cleanly.
     delete render;
@@ -29,6 +29,7 @@
 #include <osvr/Client/RenderManagerConfig.h>
 #include "osvr/RenderKit/RenderManager.h"
 #include "font.h" // Simple helper functions to generate and draw OpenGL bitmapped text
+#include "frame_timer.h"
 
 // Needed for render buffer calls.  OSVR will have called glewInit() for us
 // when we open the display.
@@ -48,6 +49,7 @@
 #include <stdlib.h> // For exit()
 #include <chrono>
 #include <thread>
+#include <cmath>
 
 //This must come after we include <GL/GL.h> so its pointer types are defined.
 #include "osvr/RenderKit/GraphicsLibraryOpenGL.h"
@@ -80,6 +82,30 @@ typedef struct {
 static std::vector<float> params;  //< Distortion parameters
 static int activeParam = 0;  //< Which parameter are we adjusting?
 
+// Distortion parameters waiting to be turned into meshes.  The button
+// callbacks run inside context.update(), so rather than building the
+// meshes there they store the latest request here and the main loop
+// sends it to RenderManager between frames.  A request that arrives
+// before the previous one was applied replaces it, so a burst of
+// button presses causes only one rebuild.
+static std::vector<osvr::renderkit::DistortionParameters> pendingDistortion;
+static bool distortionPending = false;
+
+// Mesh resolution to use for button presses and once the thumbstick
+// comes to rest, and the coarser one to use while it is scrubbing a
+// parameter so that the rebuilds don't slow down the display.
+static const int FULL_MESH_TRIANGLES = 200 * 64;
+static const int SCRUB_MESH_TRIANGLES = 200 * 4;
+
+// Most coarse meshes to build per second while scrubbing.
+static const double SCRUB_REBUILDS_PER_SECOND = 15;
+
+// Thumbstick values closer to zero than this are treated as zero.
+static const double STICK_DEAD_ZONE = 0.15;
+
+// When true, the right thumbstick scrubs the active parameter.
+static bool stickMode = false;
+
 static std::string osvrGetString(OSVR_ClientContext context, const std::string& path)
 {
   size_t len;
@@ -148,6 +174,71 @@ void nextParam(void * /*userdata*/, const OSVR_TimeValue * /*timestamp*/,
   }
 }
 
+void toggleStickMode(void * /*userdata*/, const OSVR_TimeValue * /*timestamp*/,
+  const OSVR_ButtonReport *report)
+{
+  if (report->state == 1) {
+    stickMode = !stickMode;
+    std::cout << "Thumbstick scrubbing " << (stickMode ? "on" : "off")
+      << std::endl;
+  }
+}
+
+// Print the parameters to the console, so we can know what was set.
+static void printParams()
+{
+  std::cout << "Params: ";
+  if (params.size() > 0) {
+    std::cout << params[0];
+  }
+  for (size_t i = 1; i < params.size(); i++) {
+    std::cout << ", " << params[i];
+  }
+  std::cout << std::endl;
+}
+
+// Queue distortion meshes with the specified number of triangles for
+// the current parameters.
+static void queueDistortion(const OSVRDisplayConfiguration *displayConfiguration,
+  int desiredTriangles)
+{
+  // Create a new set of distortion parameters that has the
+  // specified parameters, but using the center of projection
+  // from the read-in values.
+
+  // Get the original distortion correction
+  osvr::renderkit::DistortionParameters distortionLeft;
+  distortionLeft.m_desiredTriangles = desiredTriangles;
+  std::vector<float> Ds;
+  Ds.push_back(1.0);
+  Ds.push_back(1.0);
+  distortionLeft.m_distortionD = Ds;
+  distortionLeft.m_distortionPolynomialRed = params;
+  distortionLeft.m_distortionPolynomialGreen = params;
+  distortionLeft.m_distortionPolynomialBlue = params;
+  distortionLeft.m_distortionCOP[0] =
+    static_cast<float>(displayConfiguration->getEyes()[0].m_CenterProjX);
+  distortionLeft.m_distortionCOP[1] =
+    static_cast<float>(displayConfiguration->getEyes()[0].m_CenterProjY);
+
+  osvr::renderkit::DistortionParameters distortionRight;
+  distortionRight = distortionLeft;
+  distortionRight.m_distortionCOP[0] =
+    static_cast<float>(displayConfiguration->getEyes()[1].m_CenterProjX);
+  distortionRight.m_distortionCOP[1] =
+    static_cast<float>(displayConfiguration->getEyes()[1].m_CenterProjY);
+
+  // Push the same distortion back for each eye.
+  std::vector<osvr::renderkit::DistortionParameters> distortionParams;
+  distortionParams.push_back(distortionLeft);
+  distortionParams.push_back(distortionRight);
+
+  // Queue the new set of parameters to construct a distortion mesh,
+  // replacing any that have not yet been applied.
+  pendingDistortion = distortionParams;
+  distortionPending = true;
+}
+
 void setParams(void *userdata, const OSVR_TimeValue * /*timestamp*/,
     const OSVR_ButtonReport *report)
 {
@@ -155,52 +246,21 @@ void setParams(void *userdata, const OSVR_TimeValue * /*timestamp*/,
     reinterpret_cast<OSVRDisplayConfiguration *>(userdata);
 
   if (report->state == 1) {
+    queueDistortion(displayConfiguration, FULL_MESH_TRIANGLES);
+    printParams();
+  }
+}
 
-    // Create a new set of distortion parameters that has the
-    // specified parameters, but using the center of projection
-    // from the read-in values.
-
-    // Get the original distortion correction
-    osvr::renderkit::DistortionParameters distortionLeft;
-    distortionLeft.m_desiredTriangles = 200 * 64;
-    std::vector<float> Ds;
-    Ds.push_back(1.0);
-    Ds.push_back(1.0);
-    distortionLeft.m_distortionD = Ds;
-    distortionLeft.m_distortionPolynomialRed = params;
-    distortionLeft.m_distortionPolynomialGreen = params;
-    distortionLeft.m_distortionPolynomialBlue = params;
-    distortionLeft.m_distortionCOP[0] =
-      static_cast<float>(displayConfiguration->getEyes()[0].m_CenterProjX);
-    distortionLeft.m_distortionCOP[1] =
-      static_cast<float>(displayConfiguration->getEyes()[0].m_CenterProjY);
-
-    osvr::renderkit::DistortionParameters distortionRight;
-    distortionRight = distortionLeft;
-    distortionRight.m_distortionCOP[0] =
-      static_cast<float>(displayConfiguration->getEyes()[1].m_CenterProjX);
-    distortionRight.m_distortionCOP[1] =
-      static_cast<float>(displayConfiguration->getEyes()[1].m_CenterProjY);
-
-    // Push the same distortion back for each eye.
-    std::vector<osvr::renderkit::DistortionParameters> distortionParams;
-    distortionParams.push_back(distortionLeft);
-    distortionParams.push_back(distortionRight);
-
-    // Send a new set of parameters to construct a distortion mesh.
-    render->UpdateDistortionMeshes(osvr::renderkit::DistortionMeshType::SQUARE,
-      distortionParams);
-
-    // Print the parameters to the console, so we can know what was set.
-    std::cout << "Params: ";
-    if (params.size() > 0) {
-      std::cout << params[0];
-    }
-    for (size_t i = 1; i < params.size(); i++) {
-      std::cout << ", " << params[i];
-    }
-    std::cout << std::endl;
+// Build the distortion meshes for the most recent request, if there
+// is one.  Called between frames so that the meshes change all at once.
+static void applyPendingDistortion()
+{
+  if (!distortionPending) {
+    return;
   }
+  distortionPending = false;
+  render->UpdateDistortionMeshes(osvr::renderkit::DistortionMeshType::SQUARE,
+    pendingDistortion);
 }
 
 void resetParams(void *userdata, const OSVR_TimeValue *timestamp,
@@ -246,7 +306,7 @@ void RenderView(
   GLuint frameBuffer, //< Frame buffer object to bind our buffers to
   GLuint colorBuffer, //< Color buffer to render into
   GLuint depthBuffer,  //< Depth buffer to render into
-  std::vector<XY> spheres //< Where to draw the spheres
+  std::vector<XY> const &spheres //< Where to draw the spheres
   )
 {
   // Make sure our pointers are filled in correctly.  The config file selects
@@ -384,8 +444,27 @@ void RenderView(
 
 }
 
+void Usage(std::string name)
+{
+  std::cerr << "Usage: " << name
+    << " [-timing file.csv] (show frame timing and write it to the file on exit)"
+    << std::endl;
+  exit(-1);
+}
+
 int main(int argc, char *argv[])
 {
+    // Parse the command line
+    std::string timingFileName;
+    for (int i = 1; i < argc; i++) {
+      if (std::string("-timing") == argv[i]) {
+        if (++i >= argc) { Usage(argv[0]); }
+        timingFileName = argv[i];
+      } else {
+        Usage(argv[0]);
+      }
+    }
+
     // Open RenderManager and set up the context for rendering to
     // an HMD.  Do this using the OSVR RenderManager interface,
     // which maps to the nVidia or other vendor direct mode
@@ -444,7 +523,8 @@ int main(int argc, char *argv[])
     // button "8" on the controller is pressed.  Also that will
     // decrement the param to be adjusted when "5" is pressed
     // and increment it when "6" is pressed.  Also reset when
-    // "7" is pressed.
+    // "7" is pressed, and switch thumbstick scrubbing on and off
+    // when "4" is pressed.
     osvr::clientkit::Interface button8 =
       context.getInterface("/controller/8");
     button8.registerCallback(&setParams, &displayConfiguration);
@@ -459,12 +539,20 @@ int main(int argc, char *argv[])
     osvr::clientkit::Interface button6 =
       context.getInterface("/controller/6");
     button6.registerCallback(&nextParam, nullptr);
+    osvr::clientkit::Interface button4 =
+      context.getInterface("/controller/4");
+    button4.registerCallback(&toggleStickMode, nullptr);
 
     // Read the analog trigger, which will let us increase
     // or decrease our D parameters for distortion correction.
     osvr::clientkit::Interface analogTrigger =
       context.getInterface("/controller/trigger");
 
+    // Read the right thumbstick, which scrubs the active parameter
+    // when in thumbstick mode.
+    osvr::clientkit::Interface analogStick =
+      context.getInterface("/controller/rightStickY");
+
     // Set up a handler to cause us to exit cleanly.
 #ifdef _WIN32
     SetConsoleCtrlHandler((PHANDLER_ROUTINE)CtrlHandler, TRUE);
@@ -483,6 +571,9 @@ int main(int argc, char *argv[])
         return 3;
     }
 
+    // Time each frame, against the 60 Hz refresh of the HDK.
+    Frame_Timer *timer = new Frame_Timer(60, !timingFileName.empty());
+
     // Do a call to get the information we need to construct our
     // color and depth render-to-texture buffers.
     std::vector<osvr::renderkit::RenderInfo> renderInfo;
@@ -592,8 +683,16 @@ int main(int argc, char *argv[])
     std::chrono::time_point<std::chrono::system_clock> lastTime;
     lastTime = std::chrono::system_clock::now();
 
+    // Keep track of when we last rebuilt the meshes while scrubbing and
+    // whether the stick was moving last frame, so we know when it stops.
+    std::chrono::time_point<std::chrono::system_clock> lastScrubRebuild = lastTime;
+    bool stickWasMoving = false;
+
     // Continue rendering until it is time to quit.
     while (!quit) {
+        timer->beginFrame();
+        timer->beginPhase(Frame_Timer::UPDATE);
+
         // Update the context so we get our callbacks called and
         // update analog and button states.
         context.update();
@@ -620,22 +719,68 @@ int main(int argc, char *argv[])
           }
         }
 
+        // While the thumbstick is off center, move the active parameter at
+        // a rate set by how far it is pushed and rebuild coarse meshes to
+        // show the result, no faster than SCRUB_REBUILDS_PER_SECOND.  When
+        // it comes back to center (or scrubbing is turned off while it is
+        // moving), build full-resolution meshes for where it stopped.
+        if (stickMode || stickWasMoving) {
+          OSVR_AnalogState stickValue = 0;
+          osvrGetAnalogState(analogStick.get(), &ignore, &stickValue);
+          bool moving = stickMode && (std::fabs(stickValue) > STICK_DEAD_ZONE);
+          if (moving) {
+            if (activeParam < params.size()) {
+              params[activeParam] += static_cast<float>(
+                elapsed_sec.count() * stickValue / 10);
+            }
+            std::chrono::duration<double> sinceRebuild = now - lastScrubRebuild;
+            if (sinceRebuild.count() >= 1.0 / SCRUB_REBUILDS_PER_SECOND) {
+              queueDistortion(&displayConfiguration, SCRUB_MESH_TRIANGLES);
+              lastScrubRebuild = now;
+            }
+          } else if (stickWasMoving) {
+            queueDistortion(&displayConfiguration, FULL_MESH_TRIANGLES);
+            printParams();
+          }
+          stickWasMoving = moving;
+        }
+
         renderInfo = render->GetRenderInfo();
+        timer->endPhase(Frame_Timer::UPDATE);
 
         // Render into each buffer using the specified information.
+        timer->beginPhase(Frame_Timer::RENDER);
         for (size_t i = 0; i < renderInfo.size(); i++) {
+          timer->beginEyePass(i);
           RenderView(i, displayConfiguration, renderManagerConfig,
             renderInfo[i], frameBuffer,
             colorBuffers[i].OpenGL->colorBufferName,
             depthBuffers[i],
             spheres);
+          timer->endEyePass();
+          if (!timingFileName.empty()) {
+            timer->drawOverlay();
+          }
         }
+        timer->endPhase(Frame_Timer::RENDER);
 
         // Send the rendered results to the screen
+        timer->beginPhase(Frame_Timer::PRESENT);
         if (!render->PresentRenderBuffers(colorBuffers, renderInfo)) {
           std::cerr << "PresentRenderBuffers() returned false, maybe because it was asked to quit" << std::endl;
           quit = true;
         }
+        timer->endPhase(Frame_Timer::PRESENT);
+
+        // Now that this frame is done, switch to new distortion
+        // meshes if any were asked for while we were rendering it.
+        timer->beginPhase(Frame_Timer::MESH_UPDATE);
+        applyPendingDistortion();
+        timer->endPhase(Frame_Timer::MESH_UPDATE);
+        timer->endFrame();
+    }
+    if (!timingFileName.empty()) {
+      timer->writeCSV(timingFileName);
     }
 
     // Clean up after ourselves.
@@ -645,6 +790,7 @@ int main(int argc, char *argv[])
       delete colorBuffers[i].OpenGL;
       glDeleteRenderbuffers(1, &depthBuffers[i]);
     }
+    delete timer;
 
     // Close the Renderer interface cleanly.
     delete render;
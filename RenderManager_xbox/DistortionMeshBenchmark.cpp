@@ -0,0 +1,576 @@
+/** @file
+    @brief Measures how long it takes RenderManager to build distortion
+           meshes of different sizes, and to upload and render them,
+           without needing an HMD.
+
+    @date 2016
+
+    @author
+    Russ Taylor working through ReliaSolve.com for Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Internal Includes
+#include "osvr/RenderKit/osvr_display_configuration.h"
+#include "osvr/RenderKit/DistortionParameters.h"
+#include "osvr/RenderKit/ComputeDistortionMesh.h"
+
+// Library/third-party includes
+#include <GL/glew.h>
+#include <SDL.h>
+#include <json/json.h>
+
+// Standard includes
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <stdlib.h> // For exit()
+
+using osvr::renderkit::DistortionParameters;
+using osvr::renderkit::DistortionMesh;
+using osvr::renderkit::DistortionMeshVertex;
+
+// A resolution to render each eye at.
+typedef struct {
+  int width;
+  int height;
+} Resolution;
+
+typedef std::chrono::steady_clock Clock;
+
+static double elapsedMs(Clock::time_point start, Clock::time_point end)
+{
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void Usage(std::string name)
+{
+  std::cerr << "Usage: " << name
+    << " [-frames N] (default 300)"
+    << " [-triangles T1,T2,...] (default 800,3200,12800,51200)"
+    << " [-resolutions W1xH1,W2xH2,...] (default the per-eye resolution in the file)"
+    << " config.json"
+    << std::endl
+    << "  Reads the display description from an OSVR server configuration file"
+    << std::endl
+    << "or from the output of AnglesToConfig, then for each resolution and"
+    << std::endl
+    << "number of triangles has RenderManager build the distortion mesh for"
+    << std::endl
+    << "each eye and renders frames through them offscreen with RenderManager's"
+    << std::endl
+    << "distortion shaders.  It reports the time to build the meshes, the time"
+    << std::endl
+    << "to copy them to the graphics card, and the 50th and 99th percentile"
+    << std::endl
+    << "frame times, all in milliseconds."
+    << std::endl;
+  exit(-1);
+}
+
+// Split a comma-separated list.
+static std::vector<std::string> splitList(const std::string &list)
+{
+  std::vector<std::string> ret;
+  size_t start = 0;
+  while (start <= list.size()) {
+    size_t end = list.find(',', start);
+    if (end == std::string::npos) { end = list.size(); }
+    if (end > start) { ret.push_back(list.substr(start, end - start)); }
+    start = end + 1;
+  }
+  return ret;
+}
+
+// Read the display description and the render overfill factor.  The
+// distortion for each eye is parsed by RenderManager, the same way it is
+// when RenderManager opens a display.  Returns false (after saying why)
+// on failure.
+static bool readConfig(const std::string &fileName,
+  std::vector<DistortionParameters> &eyes, Resolution &eyeResolution,
+  double &overfill)
+{
+  std::ifstream in(fileName.c_str(), std::ios::in | std::ios::binary);
+  if (!in) {
+    std::cerr << "Could not open " << fileName << std::endl;
+    return false;
+  }
+  Json::Value root;
+  Json::Reader reader;
+  if (!reader.parse(in, root)) {
+    std::cerr << "Could not parse " << fileName << ": "
+      << reader.getFormattedErrorMessages() << std::endl;
+    return false;
+  }
+
+  // A server configuration holds the display description in its display
+  // entry; AnglesToConfig writes it as the whole file.
+  const Json::Value &display = root["display"].isObject() ? root["display"]
+    : root;
+  if (!display.isMember("hmd")) {
+    std::cerr << "No display/hmd entry in " << fileName << std::endl;
+    return false;
+  }
+  overfill = root["renderManagerConfig"]["renderManagerConfig"]
+    .get("renderOverfillFactor", 1.0).asDouble();
+
+  try {
+    Json::FastWriter writer;
+    OSVRDisplayConfiguration config(writer.write(display));
+
+    // Split the panel between the eyes the way the file says to.
+    eyeResolution.width = config.getDisplayWidth();
+    eyeResolution.height = config.getDisplayHeight();
+    switch (config.getDisplayMode()) {
+    case OSVRDisplayConfiguration::DisplayMode::HORIZONTAL_SIDE_BY_SIDE:
+      eyeResolution.width /= 2;
+      break;
+    case OSVRDisplayConfiguration::DisplayMode::VERTICAL_SIDE_BY_SIDE:
+      eyeResolution.height /= 2;
+      break;
+    default:
+      break;
+    }
+
+    eyes.clear();
+    for (size_t eye = 0; eye < config.getEyes().size(); eye++) {
+      eyes.push_back(DistortionParameters(config, eye));
+    }
+  }
+  catch (std::exception &e) {
+    std::cerr << "Could not use the display description in " << fileName
+      << ": " << e.what() << std::endl;
+    return false;
+  }
+  if (eyes.empty()) {
+    std::cerr << "No eyes in " << fileName << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// A distortion mesh from RenderManager, and the buffers on the graphics
+// card that hold it.
+typedef struct {
+  DistortionMesh mesh;
+  GLuint vertexBuffer;
+  GLuint indexBuffer;
+  GLsizei numIndices;
+} Mesh;
+
+// Copy a mesh to the graphics card.
+static void uploadMesh(Mesh &mesh)
+{
+  std::vector<GLuint> indices(mesh.mesh.indices.begin(),
+    mesh.mesh.indices.end());
+  glGenBuffers(1, &mesh.vertexBuffer);
+  glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBuffer);
+  glBufferData(GL_ARRAY_BUFFER,
+    mesh.mesh.vertices.size() * sizeof(DistortionMeshVertex),
+    &mesh.mesh.vertices[0], GL_STATIC_DRAW);
+  glGenBuffers(1, &mesh.indexBuffer);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBuffer);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint),
+    &indices[0], GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  mesh.numIndices = static_cast<GLsizei>(indices.size());
+}
+
+static void deleteMesh(Mesh &mesh)
+{
+  glDeleteBuffers(1, &mesh.vertexBuffer);
+  glDeleteBuffers(1, &mesh.indexBuffer);
+}
+
+// The shaders that RenderManager's OpenGL back end draws its distortion
+// meshes with, which it does not export: each vertex carries a texture
+// coordinate per color, and each color is looked up separately.
+static const GLchar *distortionVertexShader =
+  "#version 120\n"
+  "attribute vec4 position;\n"
+  "attribute vec2 textureCoordinateR;\n"
+  "attribute vec2 textureCoordinateG;\n"
+  "attribute vec2 textureCoordinateB;\n"
+  "varying vec2 warpedCoordinateR;\n"
+  "varying vec2 warpedCoordinateG;\n"
+  "varying vec2 warpedCoordinateB;\n"
+  "uniform mat4 projectionMatrix;\n"
+  "uniform mat4 modelViewMatrix;\n"
+  "uniform mat4 textureMatrix;\n"
+  "void main()\n"
+  "{\n"
+  "  gl_Position = projectionMatrix * modelViewMatrix * position;\n"
+  "  warpedCoordinateR = vec2(textureMatrix * vec4(textureCoordinateR, 0, 1));\n"
+  "  warpedCoordinateG = vec2(textureMatrix * vec4(textureCoordinateG, 0, 1));\n"
+  "  warpedCoordinateB = vec2(textureMatrix * vec4(textureCoordinateB, 0, 1));\n"
+  "}\n";
+
+static const GLchar *distortionFragmentShader =
+  "#version 120\n"
+  "uniform sampler2D tex;\n"
+  "varying vec2 warpedCoordinateR;\n"
+  "varying vec2 warpedCoordinateG;\n"
+  "varying vec2 warpedCoordinateB;\n"
+  "void main()\n"
+  "{\n"
+  "  gl_FragColor.r = texture2D(tex, warpedCoordinateR).r;\n"
+  "  gl_FragColor.g = texture2D(tex, warpedCoordinateG).g;\n"
+  "  gl_FragColor.b = texture2D(tex, warpedCoordinateB).b;\n"
+  "  gl_FragColor.a = 1.0;\n"
+  "}\n";
+
+// Vertex attribute locations, bound before linking.
+enum {
+  ATTRIB_POSITION = 0,
+  ATTRIB_TEX_RED = 1,
+  ATTRIB_TEX_GREEN = 2,
+  ATTRIB_TEX_BLUE = 3
+};
+
+static bool compileShader(GLuint shader, const GLchar *source)
+{
+  glShaderSource(shader, 1, &source, nullptr);
+  glCompileShader(shader);
+  GLint ok = GL_FALSE;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+  if (!ok) {
+    GLchar log[1024];
+    glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+    std::cerr << "Could not compile distortion shader: " << log << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// Build the distortion program with identity matrices, which is what
+// RenderManager uses when it does not rotate or flip the display.
+// Returns 0 on failure.
+static GLuint makeDistortionProgram()
+{
+  GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
+  GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+  GLuint program = 0;
+  if (compileShader(vertexShader, distortionVertexShader) &&
+      compileShader(fragmentShader, distortionFragmentShader)) {
+    program = glCreateProgram();
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    glBindAttribLocation(program, ATTRIB_POSITION, "position");
+    glBindAttribLocation(program, ATTRIB_TEX_RED, "textureCoordinateR");
+    glBindAttribLocation(program, ATTRIB_TEX_GREEN, "textureCoordinateG");
+    glBindAttribLocation(program, ATTRIB_TEX_BLUE, "textureCoordinateB");
+    glLinkProgram(program);
+    GLint ok = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &ok);
+    if (!ok) {
+      GLchar log[1024];
+      glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+      std::cerr << "Could not link distortion program: " << log << std::endl;
+      glDeleteProgram(program);
+      program = 0;
+    }
+  }
+  glDeleteShader(vertexShader);
+  glDeleteShader(fragmentShader);
+  if (program == 0) {
+    return 0;
+  }
+
+  static const GLfloat identity[16] =
+    { 1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0,  0, 0, 0, 1 };
+  glUseProgram(program);
+  glUniformMatrix4fv(glGetUniformLocation(program, "projectionMatrix"),
+    1, GL_FALSE, identity);
+  glUniformMatrix4fv(glGetUniformLocation(program, "modelViewMatrix"),
+    1, GL_FALSE, identity);
+  glUniformMatrix4fv(glGetUniformLocation(program, "textureMatrix"),
+    1, GL_FALSE, identity);
+  glUniform1i(glGetUniformLocation(program, "tex"), 0);
+  glUseProgram(0);
+  return program;
+}
+
+static void setAttribute(GLuint index, size_t offset)
+{
+  glEnableVertexAttribArray(index);
+  glVertexAttribPointer(index, 2, GL_FLOAT, GL_FALSE,
+    sizeof(DistortionMeshVertex), reinterpret_cast<const GLvoid *>(offset));
+}
+
+// Draw a mesh with the distortion program, which must be in use.
+static void drawMesh(const Mesh &mesh)
+{
+  glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBuffer);
+  setAttribute(ATTRIB_POSITION, offsetof(DistortionMeshVertex, m_pos));
+  setAttribute(ATTRIB_TEX_RED, offsetof(DistortionMeshVertex, m_texRed));
+  setAttribute(ATTRIB_TEX_GREEN, offsetof(DistortionMeshVertex, m_texGreen));
+  setAttribute(ATTRIB_TEX_BLUE, offsetof(DistortionMeshVertex, m_texBlue));
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBuffer);
+  glDrawElements(GL_TRIANGLES, mesh.numIndices, GL_UNSIGNED_INT, 0);
+  for (GLuint i = ATTRIB_POSITION; i <= ATTRIB_TEX_BLUE; i++) {
+    glDisableVertexAttribArray(i);
+  }
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Make an RGBA texture of the specified size, filled with a checkerboard
+// so that the texture lookups have something to do.
+static GLuint makeTexture(int width, int height, bool checkerboard)
+{
+  std::vector<GLubyte> pixels;
+  if (checkerboard) {
+    pixels.resize(4 * width * height);
+    for (int y = 0; y < height; y++) {
+      for (int x = 0; x < width; x++) {
+        GLubyte v = (((x / 32) + (y / 32)) % 2) ? 255 : 0;
+        GLubyte *p = &pixels[4 * (y * width + x)];
+        p[0] = p[1] = p[2] = v;
+        p[3] = 255;
+      }
+    }
+  }
+  GLuint texture;
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0,
+    GL_RGBA, GL_UNSIGNED_BYTE, checkerboard ? &pixels[0] : 0);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  return texture;
+}
+
+// Return the value at the specified fraction of the way through
+// the sorted list.
+static double percentile(std::vector<double> values, double fraction)
+{
+  if (values.empty()) {
+    return 0;
+  }
+  std::sort(values.begin(), values.end());
+  size_t index = static_cast<size_t>(fraction * (values.size() - 1) + 0.5);
+  return values[index];
+}
+
+int main(int argc, char *argv[])
+{
+    // Parse the command line
+    std::string configName;
+    int numFrames = 300;
+    std::vector<int> triangleCounts;
+    std::vector<Resolution> resolutions;
+    int realParams = 0;
+    for (int i = 1; i < argc; i++) {
+      if (std::string("-frames") == argv[i]) {
+        if (++i >= argc) { Usage(argv[0]); }
+        numFrames = atoi(argv[i]);
+        if (numFrames < 1) { Usage(argv[0]); }
+      } else if (std::string("-triangles") == argv[i]) {
+        if (++i >= argc) { Usage(argv[0]); }
+        std::vector<std::string> list = splitList(argv[i]);
+        for (size_t j = 0; j < list.size(); j++) {
+          int count = atoi(list[j].c_str());
+          if (count < 2) { Usage(argv[0]); }
+          triangleCounts.push_back(count);
+        }
+      } else if (std::string("-resolutions") == argv[i]) {
+        if (++i >= argc) { Usage(argv[0]); }
+        std::vector<std::string> list = splitList(argv[i]);
+        for (size_t j = 0; j < list.size(); j++) {
+          Resolution r;
+          if ((sscanf(list[j].c_str(), "%dx%d", &r.width, &r.height) != 2) ||
+              (r.width < 1) || (r.height < 1)) {
+            Usage(argv[0]);
+          }
+          resolutions.push_back(r);
+        }
+      } else if (argv[i][0] == '-') {
+        Usage(argv[0]);
+      } else switch (++realParams) {
+      case 1:
+        configName = argv[i];
+        break;
+      default:
+        Usage(argv[0]);
+      }
+    }
+    if (realParams != 1) { Usage(argv[0]); }
+    if (triangleCounts.empty()) {
+      // Going by factors of four from 200*4 up past the 200*64 that the
+      // tools use by default.
+      for (int t = 200 * 4; t <= 200 * 256; t *= 4) {
+        triangleCounts.push_back(t);
+      }
+    }
+
+    std::vector<DistortionParameters> eyes;
+    Resolution fileResolution;
+    double overfill;
+    if (!readConfig(configName, eyes, fileResolution, overfill)) {
+      return 1;
+    }
+    if (resolutions.empty()) {
+      resolutions.push_back(fileResolution);
+    }
+
+    // Make a hidden window so that we have an OpenGL context to render with.
+    // We only render into offscreen buffers and never swap, so vertical sync
+    // does not limit the frame rate.
+    if (SDL_Init(SDL_INIT_VIDEO) != 0) {
+      std::cerr << "Could not initialize SDL: " << SDL_GetError() << std::endl;
+      return 2;
+    }
+    SDL_Window *window = SDL_CreateWindow("DistortionMeshBenchmark",
+      SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 64, 64,
+      SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+    if (window == nullptr) {
+      std::cerr << "Could not create window: " << SDL_GetError() << std::endl;
+      SDL_Quit();
+      return 2;
+    }
+    SDL_GLContext glContext = SDL_GL_CreateContext(window);
+    if (glContext == nullptr) {
+      std::cerr << "Could not create OpenGL context: " << SDL_GetError() << std::endl;
+      SDL_DestroyWindow(window);
+      SDL_Quit();
+      return 2;
+    }
+    glewExperimental = GL_TRUE;
+    if ((glewInit() != GLEW_OK) || !GLEW_VERSION_3_0) {
+      std::cerr << "Need OpenGL 3.0 for framebuffer objects" << std::endl;
+      SDL_GL_DeleteContext(glContext);
+      SDL_DestroyWindow(window);
+      SDL_Quit();
+      return 3;
+    }
+    std::cout << "# Renderer: " << glGetString(GL_RENDERER) << std::endl;
+
+    GLuint program = makeDistortionProgram();
+    if (program == 0) {
+      SDL_GL_DeleteContext(glContext);
+      SDL_DestroyWindow(window);
+      SDL_Quit();
+      return 3;
+    }
+    GLuint frameBuffer;
+    glGenFramebuffers(1, &frameBuffer);
+    glDisable(GL_DEPTH_TEST);
+
+    std::cout << "width,height,triangles,build_ms,upload_ms,p50_ms,p99_ms"
+      << std::endl;
+    for (size_t r = 0; r < resolutions.size(); r++) {
+      const Resolution &res = resolutions[r];
+
+      // The image rendered for each eye is larger than the screen
+      // by the overfill factor, and is the texture the mesh reads.
+      GLuint source = makeTexture(static_cast<int>(res.width * overfill),
+        static_cast<int>(res.height * overfill), true);
+      GLuint target = makeTexture(res.width, res.height, false);
+      glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
+      glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+        GL_TEXTURE_2D, target, 0);
+      if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Incomplete framebuffer at " << res.width << "x"
+          << res.height << std::endl;
+        return 4;
+      }
+      glViewport(0, 0, res.width, res.height);
+
+      for (size_t t = 0; t < triangleCounts.size(); t++) {
+        // Time RenderManager building the meshes for both eyes, as
+        // UpdateDistortionMeshes() does, then time copying them to the
+        // card, waiting until they are there.
+        std::vector<Mesh> meshes(eyes.size());
+        Clock::time_point start = Clock::now();
+        for (size_t e = 0; e < eyes.size(); e++) {
+          DistortionParameters distortion = eyes[e];
+          distortion.m_desiredTriangles = triangleCounts[t];
+          meshes[e].mesh = osvr::renderkit::ComputeDistortionMesh(e,
+            osvr::renderkit::DistortionMeshType::SQUARE, distortion,
+            static_cast<float>(overfill));
+          if (meshes[e].mesh.vertices.empty() ||
+              meshes[e].mesh.indices.empty()) {
+            std::cerr << "RenderManager could not build a mesh with "
+              << triangleCounts[t] << " triangles for eye " << e << std::endl;
+            return 5;
+          }
+        }
+        double buildMs = elapsedMs(start, Clock::now());
+
+        glFinish();
+        start = Clock::now();
+        for (size_t e = 0; e < meshes.size(); e++) {
+          uploadMesh(meshes[e]);
+        }
+        glFinish();
+        double uploadMs = elapsedMs(start, Clock::now());
+
+        // Render each frame through both meshes, waiting for it
+        // to finish.  The first few frames warm up the driver and
+        // are not counted.
+        const int warmup = 10;
+        std::vector<double> frameMs;
+        glUseProgram(program);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, source);
+        for (int f = 0; f < warmup + numFrames; f++) {
+          Clock::time_point frameStart = Clock::now();
+          for (size_t e = 0; e < meshes.size(); e++) {
+            glClear(GL_COLOR_BUFFER_BIT);
+            drawMesh(meshes[e]);
+          }
+          glFinish();
+          if (f >= warmup) {
+            frameMs.push_back(elapsedMs(frameStart, Clock::now()));
+          }
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glUseProgram(0);
+
+        printf("%d,%d,%d,%.3f,%.3f,%.3f,%.3f\n", res.width, res.height,
+          triangleCounts[t], buildMs, uploadMs,
+          percentile(frameMs, 0.5), percentile(frameMs, 0.99));
+        fflush(stdout);
+
+        for (size_t e = 0; e < meshes.size(); e++) {
+          deleteMesh(meshes[e]);
+        }
+      }
+
+      glBindFramebuffer(GL_FRAMEBUFFER, 0);
+      glDeleteTextures(1, &target);
+      glDeleteTextures(1, &source);
+    }
+
+    // Clean up after ourselves.
+    glDeleteFramebuffers(1, &frameBuffer);
+    glDeleteProgram(program);
+    SDL_GL_DeleteContext(glContext);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+
+    return 0;
+}
@@ -29,9 +29,16 @@
 #include <string>
 #include <iostream>
 #include <iomanip>
-#include <fstream>
 #include <cmath>
 #include <vector>
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <cstdio>
+#include <stdint.h>
 #include <stdlib.h> // For exit()
 
 // Global constants and variables
@@ -42,33 +49,36 @@ static int testAlgorithms();
 
 #include "types.h"
 #include "helper.h"
-
-static void writeMesh(std::ostream &s, MeshDescription const &mesh)
+#include "parallel.h"
+#include "resample.h"
+#include "distortion_config.h"
+
+// Read the mapping for one input file (or standard input) and hand it to
+// the library's load_mapping(), which verifies its angles and handles its
+// cache file if asked.  Standard input is never cached.
+//   Returns 0 on success and the program's exit code on failure.
+static int load_mapping(std::string const &fileName, size_t index,
+  bool useStandardInput, MappingLoadOptions const &load,
+  DistortionConfigOptions const &opts,
+  std::vector<Mapping> &mapping, std::vector<AngleTerms> &terms)
 {
-  s << "[" << std::endl;
-  for (size_t i = 0; i < mesh.size(); i++) {
-    if (i == 0) { s << " "; }
-    else { s << ","; }
-    s << std::setprecision(4)
-      << "[ [" << mesh[i][0][0] << "," << mesh[i][0][1] << "], ["
-      << mesh[i][1][0] << "," << mesh[i][1][1] << "] ]"
-      << std::endl;
+  std::vector<char> contents;
+  if (useStandardInput) {
+    std::ostringstream in;
+    in << std::cin.rdbuf();
+    std::string s = in.str();
+    contents.assign(s.begin(), s.end());
+  } else {
+    if (g_verbose) {
+      std::cerr << "Opening file " << fileName << std::endl;
+    }
+    if (!read_file_contents(fileName, contents)) {
+      std::cerr << "Error: Could not open " << fileName << std::endl;
+      return 1;
+    }
   }
-  s << "]" << std::endl;
-}
-
-// Produce a mapping that is reflected around X=0 in both angles and
-// screen coordinates.
-static std::vector<Mapping> reflect_mapping(std::vector<Mapping> mapping)
-{
-  std::vector<Mapping> ret;
-  for (size_t i = 0; i < mapping.size(); i++) {
-    ret.push_back(mapping[i]);
-    ret[i].xyLatLong.longitude *= -1;
-    ret[i].xyLatLong.x *= -1;
-  }
-
-  return ret;
+  return load_mapping(contents.data(), contents.size(), fileName, index,
+    !useStandardInput, load, opts, mapping, terms);
 }
 
 void Usage(std::string name)
@@ -85,8 +95,18 @@ void Usage(std::string name)
     << "   The vector (xx, xy) points in screen space in the direction of +longitude (left)"
     << "   The vector (yx, yy) points in screen space in the direction of +latitude (up)"
     << "   The max_degrees tells how far the screen-space neighbor vector can differ from it corresponding angle-space vector"
+    << " [-outlier_mode greedy|local] (how -verify_angles picks points to remove, default is greedy)"
     << " [-mono in_config_mono_file_name ] (default standard input)"
     << " [-rgb in_config_red_file_name in_config_green_file_name in_config_blue_file_name]"
+    << " [-cache] (read and write a binary cache file next to each input file, default is not)"
+    << " [-threads N] (handle colors and eyes on N threads, 0 for one per core, default is 1)"
+    << " [-resample N M] (resample each mesh onto a regular N by M grid, default is to use the input points)"
+    << " [-simplify tolerance] (remove samples where the mesh is affine to within tolerance, default is not)"
+    << " [-mesh_format text|base64] (how to write the meshes, default is text)"
+    << " [-mesh_precision double|float32|uint16] (how to store the finished meshes, default is double)"
+    << " [-displacement_map file_name N M] (also bake each mesh into an N by M per-pixel displacement map, default is not)"
+    << " [-displacement_format rg16f|rg32f] (how to store the displacement maps, default is rg16f)"
+    << " [-batch manifest_file_name] (produce one output file per manifest line, default is not)"
     << std::endl
     << "  This program reads one or three configurations with lists of" << std::endl
     << "x,y screen coordinates in meters followed by long,lat angles in" << std::endl
@@ -95,410 +115,553 @@ void Usage(std::string name)
     << "  A single color from standard input is the default, input files" << std::endl
     << "can be optionally specified." << std::endl
     << "  It produces on standard output a partial OSVR display configuration file." << std::endl
+    << "  In batch mode, each line of the manifest holds an output file name" << std::endl
+    << "followed by the arguments for that file, which add to those on the" << std::endl
+    << "command line.  A summary of the results is printed on standard output." << std::endl
     << std::endl;
   exit(1);
 }
 
-int main(int argc, char *argv[])
+// The settings for producing one configuration file.  Those that control
+// how the screens and meshes are built come from DistortionConfigOptions.
+class ConfigOptions : public DistortionConfigOptions, public MappingLoadOptions {
+public:
+  std::vector<std::string> inputFileNames;  //< Empty means standard input
+  MeshFormat meshFormat = MESH_TEXT;
+  std::string displacementMapFileName;  //< Empty means don't bake maps
+  Displacement_Map_Format displacementFormat = DISPLACEMENT_RG16F;
+  std::string batchFileName;  //< Empty means not running a batch
+};
+
+// Parse arguments into a set of options, adding to what is already there.
+// Arguments that only make sense for the whole program (-batch, -threads
+// and -verbose) are rejected unless allowProgramArgs is true.
+//   Returns false if the arguments are bad, after printing any message
+// that is more specific than the usage message.
+static bool parse_options(std::vector<std::string> const &args,
+  bool allowProgramArgs, ConfigOptions &opts)
 {
-  // Parse the command line
-  std::vector<std::string> inputFileNames;
-  bool useRightEye = true;
-  bool computeBounds = true;
-  bool useFieldAngles = true;
-  bool verifyAngles = false;
-  double xx, xy, yx, yy;
-  double maxAngleDiffDegrees;
-  double left, right, bottom, top;
-  double depth = 2.0;
-  double toMeters = 1.0;
   int realParams = 0;
-  for (int i = 1; i < argc; i++) {
-    if (std::string("-mm") == argv[i]) {
-      toMeters = 1e-3;  // Convert input in millimeters to meters
-    } else if (std::string("-verbose") == argv[i]) {
-      g_verbose = true;
-    } else if (std::string("-latlong") == argv[i]) {
-      useFieldAngles = false;
-    } else if (std::string("-depth_meters") == argv[i]) {
-      if (++i >= argc) { Usage(argv[0]); }
-      depth = atof(argv[i]);
-    } else if (std::string("-mono") == argv[i]) {
-      if (++i >= argc) { Usage(argv[0]); }
-      inputFileNames.push_back(argv[i]);
-    } else if (std::string("-rgb") == argv[i]) {
-      if (++i >= argc) { Usage(argv[0]); }
-      inputFileNames.push_back(argv[i]);
-      if (++i >= argc) { Usage(argv[0]); }
-      inputFileNames.push_back(argv[i]);
-      if (++i >= argc) { Usage(argv[0]); }
-      inputFileNames.push_back(argv[i]);
-    } else if (std::string("-screen") == argv[i]) {
-      computeBounds = false;
-      if (++i >= argc) { Usage(argv[0]); }
-      left = atof(argv[i]);
-      if (++i >= argc) { Usage(argv[0]); }
-      bottom = atof(argv[i]);
-      if (++i >= argc) { Usage(argv[0]); }
-      right = atof(argv[i]);
-      if (++i >= argc) { Usage(argv[0]); }
-      top = atof(argv[i]);
-    } else if (std::string("-eye") == argv[i]) {
-      if (++i >= argc) { Usage(argv[0]); }
-      std::string eye = argv[i];
+  for (size_t i = 0; i < args.size(); i++) {
+    if ((!allowProgramArgs) && ((args[i] == "-batch") ||
+          (args[i] == "-threads") || (args[i] == "-verbose"))) {
+      std::cerr << "Error: " << args[i] << " can only be given on the command line"
+        << std::endl;
+      return false;
+    }
+    if (std::string("-mm") == args[i]) {
+      opts.toMeters = 1e-3;  // Convert input in millimeters to meters
+    } else if (std::string("-verbose") == args[i]) {
+      opts.verbose = true;
+    } else if (std::string("-latlong") == args[i]) {
+      opts.useFieldAngles = false;
+    } else if (std::string("-cache") == args[i]) {
+      opts.useCache = true;
+    } else if (std::string("-batch") == args[i]) {
+      if (++i >= args.size()) { return false; }
+      opts.batchFileName = args[i];
+    } else if (std::string("-resample") == args[i]) {
+      if (++i >= args.size()) { return false; }
+      int nx = atoi(args[i].c_str());
+      if (++i >= args.size()) { return false; }
+      int ny = atoi(args[i].c_str());
+      if ((nx < 2) || (ny < 2)) {
+        std::cerr << "Bad value for -resample: " << args[i - 1] << " "
+          << args[i] << ", expected two counts of at least 2" << std::endl;
+        return false;
+      }
+      opts.resampleX = nx;
+      opts.resampleY = ny;
+    } else if (std::string("-simplify") == args[i]) {
+      if (++i >= args.size()) { return false; }
+      double tolerance = atof(args[i].c_str());
+      if (!(tolerance > 0)) {
+        std::cerr << "Bad value for -simplify: " << args[i]
+          << ", expected a positive tolerance" << std::endl;
+        return false;
+      }
+      opts.simplifyTolerance = tolerance;
+    } else if (std::string("-mesh_format") == args[i]) {
+      if (++i >= args.size()) { return false; }
+      if (std::string("text") == args[i]) {
+        opts.meshFormat = MESH_TEXT;
+      } else if (std::string("base64") == args[i]) {
+        opts.meshFormat = MESH_BASE64;
+      } else {
+        std::cerr << "Bad value for -mesh_format: " << args[i]
+          << ", expected text or base64" << std::endl;
+        return false;
+      }
+    } else if (std::string("-displacement_map") == args[i]) {
+      if (++i >= args.size()) { return false; }
+      opts.displacementMapFileName = args[i];
+      if (++i >= args.size()) { return false; }
+      int nx = atoi(args[i].c_str());
+      if (++i >= args.size()) { return false; }
+      int ny = atoi(args[i].c_str());
+      if ((nx < 2) || (ny < 2)) {
+        std::cerr << "Bad value for -displacement_map: " << args[i - 1] << " "
+          << args[i] << ", expected two counts of at least 2" << std::endl;
+        return false;
+      }
+      opts.displacementMapX = nx;
+      opts.displacementMapY = ny;
+    } else if (std::string("-displacement_format") == args[i]) {
+      if (++i >= args.size()) { return false; }
+      if (std::string("rg16f") == args[i]) {
+        opts.displacementFormat = DISPLACEMENT_RG16F;
+      } else if (std::string("rg32f") == args[i]) {
+        opts.displacementFormat = DISPLACEMENT_RG32F;
+      } else {
+        std::cerr << "Bad value for -displacement_format: " << args[i]
+          << ", expected rg16f or rg32f" << std::endl;
+        return false;
+      }
+    } else if (std::string("-mesh_precision") == args[i]) {
+      if (++i >= args.size()) { return false; }
+      if (std::string("double") == args[i]) {
+        opts.meshPrecision = MESH_DOUBLE;
+      } else if (std::string("float32") == args[i]) {
+        opts.meshPrecision = MESH_FLOAT32;
+      } else if (std::string("uint16") == args[i]) {
+        opts.meshPrecision = MESH_UINT16;
+      } else {
+        std::cerr << "Bad value for -mesh_precision: " << args[i]
+          << ", expected double, float32 or uint16" << std::endl;
+        return false;
+      }
+    } else if (std::string("-threads") == args[i]) {
+      if (++i >= args.size()) { return false; }
+      int n = atoi(args[i].c_str());
+      opts.numThreads = (n > 0) ? n : default_thread_count();
+    } else if (std::string("-depth_meters") == args[i]) {
+      if (++i >= args.size()) { return false; }
+      opts.depth = atof(args[i].c_str());
+    } else if (std::string("-mono") == args[i]) {
+      if (++i >= args.size()) { return false; }
+      opts.inputFileNames.push_back(args[i]);
+    } else if (std::string("-rgb") == args[i]) {
+      if (++i >= args.size()) { return false; }
+      opts.inputFileNames.push_back(args[i]);
+      if (++i >= args.size()) { return false; }
+      opts.inputFileNames.push_back(args[i]);
+      if (++i >= args.size()) { return false; }
+      opts.inputFileNames.push_back(args[i]);
+    } else if (std::string("-screen") == args[i]) {
+      opts.computeBounds = false;
+      if (++i >= args.size()) { return false; }
+      opts.left = atof(args[i].c_str());
+      if (++i >= args.size()) { return false; }
+      opts.bottom = atof(args[i].c_str());
+      if (++i >= args.size()) { return false; }
+      opts.right = atof(args[i].c_str());
+      if (++i >= args.size()) { return false; }
+      opts.top = atof(args[i].c_str());
+    } else if (std::string("-eye") == args[i]) {
+      if (++i >= args.size()) { return false; }
+      std::string eye = args[i];
       if (eye == "left") {
-        useRightEye = false;
+        opts.useRightEye = false;
       } else if (eye == "right") {
-        useRightEye = true;
+        opts.useRightEye = true;
       } else {
         std::cerr << "Bad value for -eye: " << eye << ", expected left or right" << std::endl;
-        Usage(argv[0]);
+        return false;
+      }
+    } else if (std::string("-outlier_mode") == args[i]) {
+      if (++i >= args.size()) { return false; }
+      if (std::string("greedy") == args[i]) {
+        opts.outlierMode = OUTLIERS_GREEDY;
+      } else if (std::string("local") == args[i]) {
+        opts.outlierMode = OUTLIERS_LOCAL;
+      } else {
+        std::cerr << "Bad value for -outlier_mode: " << args[i]
+          << ", expected greedy or local" << std::endl;
+        return false;
       }
-    } else if (std::string("-verify_angles") == argv[i]) {
-      verifyAngles = true;
-      if (++i >= argc) { Usage(argv[0]); }
-      xx = atof(argv[i]);
-      if (++i >= argc) { Usage(argv[0]); }
-      xy = atof(argv[i]);
-      if (++i >= argc) { Usage(argv[0]); }
-      yx = atof(argv[i]);
-      if (++i >= argc) { Usage(argv[0]); }
-      yy = atof(argv[i]);
-      if (++i >= argc) { Usage(argv[0]); }
-      maxAngleDiffDegrees = atof(argv[i]);
+    } else if (std::string("-verify_angles") == args[i]) {
+      opts.verifyAngles = true;
+      if (++i >= args.size()) { return false; }
+      opts.xx = atof(args[i].c_str());
+      if (++i >= args.size()) { return false; }
+      opts.xy = atof(args[i].c_str());
+      if (++i >= args.size()) { return false; }
+      opts.yx = atof(args[i].c_str());
+      if (++i >= args.size()) { return false; }
+      opts.yy = atof(args[i].c_str());
+      if (++i >= args.size()) { return false; }
+      opts.maxAngleDiffDegrees = atof(args[i].c_str());
     }
-    else if ((argv[i][0] == '-') && (atof(argv[i]) == 0.0)) {
-      Usage(argv[0]);
+    else if ((args[i][0] == '-') && (atof(args[i].c_str()) == 0.0)) {
+      return false;
     }
     else switch (++realParams) {
     case 1:
     default:
       std::cerr << "Error: Expected no non-flag parameters, got "
-        << argv[i] << std::endl;
-      Usage(argv[0]);
+        << args[i] << std::endl;
+      return false;
     }
   }
-  if (realParams != 0) { Usage(argv[0]); }
+  return realParams == 0;
+}
 
-  //====================================================================
-  // Run our algorithm test to make sure things are working properly.
-  int ret;
-  if ((ret = testAlgorithms()) != 0) {
-    std::cerr << "Error testing basic algorithms, code " << ret << std::endl;
-    return 100;
+// Mappings that have been read and verified during a batch.  Jobs that
+// use the same input file with the same -verify_angles settings share a
+// single copy of its points and their angle terms, so each is read and
+// verified only once however many jobs use it.  Entries are kept until
+// the batch is done.
+class SharedMappings {
+public:
+  /// Get the mapping and angle terms for an input file, loading them
+  /// if this is the first request for them (see load_mapping()).  Later
+  /// requests wait for the first to finish.  The pointers remain valid
+  /// as long as this object does.
+  ///   Returns 0 on success and the program's exit code on failure.
+  int get(std::string const &fileName, size_t index, ConfigOptions const &opts,
+    std::vector<Mapping> const *&mapping, std::vector<AngleTerms> const *&terms);
+
+private:
+  class Entry {
+  public:
+    std::mutex lock;
+    bool loaded = false;
+    int result = 0;
+    std::vector<Mapping> mapping;
+    std::vector<AngleTerms> terms;
+  };
+  std::mutex m_lock;  //< Protects the maps, but not what they point to
+  std::map<std::string, std::unique_ptr<Entry> > m_entries;
+
+  // One per input file; held while loading any entry for it so that
+  // two settings for the same file don't write its cache file at once.
+  std::map<std::string, std::unique_ptr<std::mutex> > m_fileLocks;
+};
+
+int SharedMappings::get(std::string const &fileName, size_t index,
+  ConfigOptions const &opts,
+  std::vector<Mapping> const *&mapping, std::vector<AngleTerms> const *&terms)
+{
+  // The points that survive depend on the verification settings.
+  std::ostringstream key;
+  key << std::setprecision(17) << fileName;
+  if (opts.verifyAngles) {
+    key << " " << opts.xx << " " << opts.xy << " " << opts.yx << " "
+      << opts.yy << " " << opts.maxAngleDiffDegrees
+      << " " << opts.outlierMode;
+  }
+
+  Entry *entry;
+  std::mutex *fileLock;
+  {
+    std::lock_guard<std::mutex> guard(m_lock);
+    std::unique_ptr<Entry> &e = m_entries[key.str()];
+    if (!e) { e.reset(new Entry); }
+    entry = e.get();
+    std::unique_ptr<std::mutex> &f = m_fileLocks[fileName];
+    if (!f) { f.reset(new std::mutex); }
+    fileLock = f.get();
+  }
+
+  std::lock_guard<std::mutex> guard(entry->lock);
+  if (!entry->loaded) {
+    std::lock_guard<std::mutex> fileGuard(*fileLock);
+    entry->result = load_mapping(fileName, index, false, opts, opts,
+      entry->mapping, entry->terms);
+    // Every job using this entry will need the angle terms, so they are
+    // computed here once if they didn't come from a cache file.
+    if ((entry->result == 0) && entry->terms.empty()) {
+      compute_angle_terms(entry->mapping, entry->terms);
+    }
+    entry->loaded = true;
   }
+  mapping = &entry->mapping;
+  terms = &entry->terms;
+  return entry->result;
+}
+
+// What a batch reports about each configuration it produces.
+typedef struct {
+  double hFOVDegrees;
+  double vFOVDegrees;
+  double overlapPercent;
+  double leftXCOP, leftYCOP;
+  double rightXCOP, rightYCOP;
+} ConfigSummary;
+
+// Produce one configuration file, writing it to the specified stream and
+// filling in its summary.  If shared is not NULL, the mappings come from
+// it rather than being read here.
+//   Returns 0 on success and the program's exit code on failure.
+static int run_config(ConfigOptions const &opts, SharedMappings *shared,
+  std::ostream &out, ConfigSummary &summary)
+{
+  size_t numThreads = opts.numThreads;
 
   //====================================================================
-  // The output screens and meshes.  There is one mesh per color, so one
-  // for mono and three for RGB.
-  ScreenDescription leftScreen, rightScreen;
-  std::vector<MeshDescription> leftMeshes, rightMeshes;
+  // The output screens and meshes, along with what goes into them.
+  DistortionConfig config;
 
   //====================================================================
   // Parse the angle-configuration information from standard or from the set
-  // of input files specified.  Expect white-space separation between numbers
-  // and also between entries (which may be on separate lines).
-  std::vector<std::istream *> inFiles;
-  if (inputFileNames.size() == 0) {
-    inFiles.push_back(&std::cin);
+  // of input files specified, verifying the angles if we've been asked to.
+  // Each color is handled independently, so they can all be done at once.
+  //   The mappings are used through pointers so that they can be ones
+  // shared with other jobs; otherwise they point at our own copies.
+  std::vector<std::string> inputFileNames(opts.inputFileNames);
+  bool useStandardInput = (inputFileNames.size() == 0);
+  if (useStandardInput) {
     inputFileNames.push_back("standard input");
-  } else {
-    for (size_t i = 0; i < inputFileNames.size(); i++) {
-      if (g_verbose) {
-        std::cerr << "Opening file " << inputFileNames[i] << std::endl;
-      }
-      std::ifstream *inFile = new std::ifstream;
-      inFile->open(inputFileNames[i].c_str(), std::ifstream::in);
-      if (!inFile->good()) {
-        std::cerr << "Error: Could not open " << inputFileNames[i] << std::endl;
-        return 1;
-      }
-      inFiles.push_back(inFile);
-    }
   }
-  std::vector< std::vector<Mapping> > mappings;
-  for (size_t i = 0; i < inFiles.size(); i++) {
-    std::vector<Mapping> mapping = read_from_infile(*inFiles[i]);
-    if (g_verbose) {
-      std::cerr << "Found " << mapping.size() << " points in "
-        << inputFileNames[i] << std::endl;
-    }
-    if (mapping.size() == 0) {
-      std::cerr << "Error: No input points found in " << inputFileNames[i]
-        << std::endl;
-      return 2;
+  size_t numColors = inputFileNames.size();
+  std::vector< std::vector<Mapping> > ownMappings(numColors);
+  std::vector< std::vector<AngleTerms> > ownTerms(numColors);
+  std::vector<std::vector<Mapping> const *> mappings(numColors);
+  std::vector<std::vector<AngleTerms> const *> mappingTerms(numColors);
+  std::vector<int> results(numColors, 0);
+  std::atomic<bool> failed(false);
+  run_in_parallel(numColors, numThreads, [&](size_t i) {
+    // Don't bother with the rest once one of them has failed.
+    if (failed) { return; }
+    if (shared && !useStandardInput) {
+      results[i] = shared->get(inputFileNames[i], i, opts,
+        mappings[i], mappingTerms[i]);
+    } else {
+      results[i] = load_mapping(inputFileNames[i], i, useStandardInput,
+        opts, opts, ownMappings[i], ownTerms[i]);
+      mappings[i] = &ownMappings[i];
+      mappingTerms[i] = &ownTerms[i];
     }
-    mappings.push_back(mapping);
+    if (results[i] != 0) { failed = true; }
+  });
+  for (size_t i = 0; i < results.size(); i++) {
+    if (results[i] != 0) { return results[i]; }
   }
 
   //====================================================================
-  // If we've been asked to verify the angles on the meshes, do so now.
-  // This makes sure that the direction between neighbors in angle space
-  // is consistent with their direction in screen space, removing points
-  // that don't satisfy the criterion.  This removes inconsistent points
-  // from the simulation (caused by multiple ray bounces or other
-  // singularities in the simulation).
-  if (verifyAngles) {
-    for (size_t m = 0; m < mappings.size(); m++) {
-      int ret = remove_invalid_points_based_on_angle(
-        mappings[m], xx, xy, yx, yy, maxAngleDiffDegrees);
-      if (ret < 0) {
-        std::cerr << "Error verifying angles for mesh "
-          << m << std::endl;
-        return 60;
-      }
-      if (g_verbose) {
-        std::cerr << "Removed " << ret
-          << " points from mesh " << m << std::endl;
-      }
-    }
-  }
+  // Make the mappings for each eye; our own copies of the original
+  // mappings are freed once both eyes have been made.
+  int ret = prepare_eye_mappings(mappings, mappingTerms, opts, config);
+  mappings.clear();
+  mappingTerms.clear();
+  std::vector< std::vector<Mapping> >().swap(ownMappings);
+  std::vector< std::vector<AngleTerms> >().swap(ownTerms);
+  if (ret != 0) { return ret; }
 
   //====================================================================
-  // If we've been asked to auto-range the screen coordinates, compute
-  // them here.  Look at all of the points from all of the colors and
-  // make a bound on all of them.
-  if (computeBounds) {
-    left = right = mappings[0][0].xyLatLong.x;
-    bottom = top = mappings[0][0].xyLatLong.y;
-    for (size_t m = 0; m < mappings.size(); m++) {
-      for (size_t i = 1; i < mappings[m].size(); i++) {
-        double x = mappings[m][i].xyLatLong.x;
-        double y = mappings[m][i].xyLatLong.y;
-        if (x < left) { left = x; }
-        if (x > right) { right = x; }
-        if (y < bottom) { bottom = y; }
-        if (y > top) { top = y; }
-      }
+  // Find the screens and then the meshes for both eyes.
+  if ((ret = find_eye_screens(opts, config)) != 0) { return ret; }
+  if ((ret = find_eye_meshes(opts, config)) != 0) { return ret; }
+
+  //====================================================================
+  // Report how well the resampled grids match the original samples.
+  size_t resampleX = opts.resampleX, resampleY = opts.resampleY;
+  if (resampleX > 0) {
+    for (size_t job = 0; job < config.resampleReports.size(); job++) {
+      ResampleReport const &r = config.resampleReports[job];
+      std::cerr << "Resampled " << (job % 2 == 0 ? "left" : "right")
+        << " mesh " << job / 2 << ": " << r.gridPoints << " of "
+        << resampleX * resampleY << " grid points, max error " << r.maxError
+        << ", RMS error " << r.rmsError << " over " << r.samplesChecked
+        << " samples (" << r.samplesSkipped << " outside the grid)"
+        << std::endl;
     }
-    left *= toMeters;
-    right *= toMeters;
-    bottom *= toMeters;
-    top *= toMeters;
-  }
-  if (g_verbose) {
-    std::cerr << "Left, bottom, right, top = " << left << ", "
-      << bottom << ", " << right << ", " << top << std::endl;
   }
 
   //====================================================================
-  // Compute left and right screen boundaries that are mirror images
-  // of each other.
-  double leftScreenLeft, leftScreenRight, leftScreenBottom, leftScreenTop;
-  double rightScreenLeft, rightScreenRight, rightScreenBottom, rightScreenTop;
-  rightScreenBottom = leftScreenBottom = bottom;
-  rightScreenTop = leftScreenTop = top;
-  if (useRightEye) {
-    rightScreenLeft = left;
-    rightScreenRight = right;
-
-    leftScreenLeft = -right;
-    leftScreenRight = -left;
-  } else {
-    leftScreenLeft = left;
-    leftScreenRight = right;
-
-    rightScreenLeft = -right;
-    rightScreenRight = -left;
+  // Report how much the simplified meshes shrank and what that cost.
+  for (size_t job = 0; job < config.simplifyReports.size(); job++) {
+    SimplifyReport const &r = config.simplifyReports[job];
+    std::cerr << "Simplified " << (job % 2 == 0 ? "left" : "right")
+      << " mesh " << job / 2 << ": " << r.outputSamples << " of "
+      << r.inputSamples << " samples kept, " << r.mergedCells
+      << " cells merged, per-cell fit error of the removed samples max "
+      << r.maxError << ", RMS " << r.rmsError << std::endl;
   }
 
   //====================================================================
-  // Compute a left- and right-eye mappings that are mirrors of each
-  // other, so that we can produce distortion maps for both eyes.
-  std::vector< std::vector<Mapping> > leftMappings;
-  std::vector< std::vector<Mapping> > rightMappings;
-  for (size_t i = 0; i < mappings.size(); i++) {
-    // Do each mapping in turn, one per color.
-    std::vector<Mapping> &mapping = mappings[i];
-
-    //====================================================================
-    // Make an inverse mapping for the opposite eye.  Invert around X in
-    // angle and viewing direction.  Depending on whether we are using the
-    // left or right eye, set the eyes appropriately.
-    //  Also make a different set of screen boundaries for each, again
-    // inverting around X = 0.
-    std::vector<Mapping> leftMapping;
-    std::vector<Mapping> rightMapping;
-    rightScreenBottom = leftScreenBottom = bottom;
-    rightScreenTop = leftScreenTop = top;
-    if (useRightEye) {
-      rightMapping = mapping;
-      leftMapping = reflect_mapping(mapping);
-    } else {
-      leftMapping = mapping;
-      rightMapping = reflect_mapping(mapping);
+  // Write the displacement maps, reporting how well each one matches the
+  // samples it was baked from.
+  if (!opts.displacementMapFileName.empty()) {
+    size_t mapX = opts.displacementMapX, mapY = opts.displacementMapY;
+    std::vector<std::vector<float> const *> maps;
+    for (size_t job = 0; job < config.displacementReports.size(); job++) {
+      ResampleReport const &r = config.displacementReports[job];
+      std::cerr << "Baked " << (job % 2 == 0 ? "left" : "right")
+        << " displacement map " << job / 2 << ": " << r.gridPoints << " of "
+        << mapX * mapY << " texels, max error " << r.maxError
+        << ", RMS error " << r.rmsError << " over " << r.samplesChecked
+        << " samples" << std::endl;
+    }
+    for (size_t i = 0; i < config.leftDisplacementMaps.size(); i++) {
+      maps.push_back(&config.leftDisplacementMaps[i]);
     }
+    for (size_t i = 0; i < config.rightDisplacementMaps.size(); i++) {
+      maps.push_back(&config.rightDisplacementMaps[i]);
+    }
+    if (!write_displacement_maps(opts.displacementMapFileName,
+          opts.displacementFormat, mapX, mapY, maps)) {
+      return 91;
+    }
+  }
 
-    //====================================================================
-    // Convert the input values into normalized coordinates and into 3D
-    // locations.
-    convert_to_normalized_and_meters(leftMapping, toMeters, depth,
-      leftScreenLeft, leftScreenBottom, leftScreenRight, leftScreenTop,
-      useFieldAngles);
-    convert_to_normalized_and_meters(rightMapping, toMeters, depth,
-      rightScreenLeft, rightScreenBottom, rightScreenRight, rightScreenTop,
-      useFieldAngles);
+  summary.hFOVDegrees = config.rightScreen.hFOVDegrees;
+  summary.vFOVDegrees = config.rightScreen.vFOVDegrees;
+  summary.overlapPercent = config.rightScreen.overlapPercent;
+  summary.leftXCOP = config.leftScreen.xCOP;
+  summary.leftYCOP = config.leftScreen.yCOP;
+  summary.rightXCOP = config.rightScreen.xCOP;
+  summary.rightYCOP = config.rightScreen.yCOP;
 
-    //====================================================================
-    // Store the mappings.
-    leftMappings.push_back(leftMapping);
-    rightMappings.push_back(rightMapping);
-  }
+  return write_distortion_config(out, config, opts.meshFormat);
+}
 
-  //====================================================================
-  // Construct mappings that include all points for all colors that
-  // we will use to determine the screen boundaries in a manner that
-  // encompasses all of them.
-  std::vector<Mapping> leftFullMapping, rightFullMapping;
-  for (size_t i = 0; i < mappings.size(); i++) {
-    for (size_t j = 0; j < leftMappings[i].size(); j++) {
-      leftFullMapping.push_back(leftMappings[i][j]);
+// One line of a batch manifest.
+typedef struct {
+  size_t line;              //< Line number in the manifest
+  std::string outFileName;
+  ConfigOptions opts;
+} BatchJob;
+
+// Run all of the jobs in a batch manifest, writing each configuration to
+// its own file and then printing a summary of all of them on standard
+// output.  Each job starts from the command-line options.  The jobs are
+// spread across the command line's threads, each running its own stages
+// on a single thread, and share the mappings they read.
+//   Returns 0 if every job succeeded and the exit code of the first one
+// to fail otherwise.
+static int run_batch(ConfigOptions const &commandLine)
+{
+  std::ifstream manifest(commandLine.batchFileName.c_str());
+  if (!manifest) {
+    std::cerr << "Error: Could not open batch manifest "
+      << commandLine.batchFileName << std::endl;
+    return 1;
+  }
+
+  // Parse all of the jobs before running any of them, so that a typo
+  // doesn't waste the time it takes to run the ones before it.
+  std::vector<BatchJob> jobs;
+  std::string lineText;
+  size_t lineNumber = 0;
+  while (std::getline(manifest, lineText)) {
+    lineNumber++;
+    std::istringstream words(lineText);
+    std::vector<std::string> args;
+    std::string word;
+    while (words >> word) { args.push_back(word); }
+    if (args.empty() || (args[0][0] == '#')) { continue; }
+
+    BatchJob job;
+    job.line = lineNumber;
+    job.outFileName = args[0];
+    job.opts = commandLine;
+    job.opts.numThreads = 1;
+    args.erase(args.begin());
+    if (!parse_options(args, false, job.opts)) {
+      std::cerr << "Error: Bad arguments on line " << lineNumber
+        << " of " << commandLine.batchFileName << std::endl;
+      return 1;
     }
-    for (size_t j = 0; j < rightMappings[i].size(); j++) {
-      rightFullMapping.push_back(rightMappings[i][j]);
+    if (job.opts.inputFileNames.empty()) {
+      std::cerr << "Error: No -mono or -rgb input on line " << lineNumber
+        << " of " << commandLine.batchFileName << std::endl;
+      return 1;
     }
-  }
-  if (!findScreen(leftFullMapping, leftScreenLeft, leftScreenBottom,
-    leftScreenRight, leftScreenTop, leftScreen, g_verbose)) {
-    std::cerr << "Error: Could not find left screen" << std::endl;
-    return 3;
+    jobs.push_back(job);
   }
   if (g_verbose) {
-    std::cerr << "Left screen L B R T: " << leftScreenLeft
-      << ", " << leftScreenBottom
-      << ", " << leftScreenRight
-      << ", " << leftScreenTop << std::endl;
-  }
-
-  if (!findScreen(rightFullMapping, rightScreenLeft, rightScreenBottom,
-    rightScreenRight, rightScreenTop, rightScreen, g_verbose)) {
-    std::cerr << "Error: Could not find right screen" << std::endl;
-    return 5;
-  }
-
-  //====================================================================
-  // Compute the three colored mappings based on the screen boundaries
-  // we found above.
-  for (size_t i = 0; i < mappings.size(); i++) {
-    // Do each pair of mappings in turn, one per color.
-    std::vector<Mapping> &leftMapping = leftMappings[i];
-    std::vector<Mapping> &rightMapping = rightMappings[i];
-
-    //====================================================================
-    // Determine the screen description and distortion mesh based on the
-    // input points and screen parameters.
-    // This will re-compute the screen each time, but it will get the same
-    // answer because we're using the same bounds for each of them.
-    MeshDescription leftMesh, rightMesh;
-    if (!findMesh(leftMapping, leftScreenLeft, leftScreenBottom,
-      leftScreenRight, leftScreenTop, leftScreen, leftMesh, g_verbose)) {
-      std::cerr << "Error: Could not find left mesh" << std::endl;
-      return 30;
+    std::cerr << "Running " << jobs.size() << " jobs from "
+      << commandLine.batchFileName << std::endl;
+  }
+
+  SharedMappings shared;
+  std::vector<int> results(jobs.size(), 0);
+  std::vector<ConfigSummary> summaries(jobs.size());
+  run_in_parallel(jobs.size(), commandLine.numThreads, [&](size_t j) {
+    BatchJob const &job = jobs[j];
+    {
+      std::ofstream out(job.outFileName.c_str());
+      if (!out) {
+        std::cerr << "Error: Could not open " << job.outFileName
+          << " for writing" << std::endl;
+        results[j] = 80;
+        return;
+      }
+      results[j] = run_config(job.opts, &shared, out, summaries[j]);
+      if ((results[j] == 0) && !out) {
+        std::cerr << "Error: Could not write " << job.outFileName << std::endl;
+        results[j] = 81;
+      }
     }
-    if (leftMesh.size() != leftMapping.size()) {
-      std::cerr << "Error: Left mesh size " << leftMesh.size()
-        << " does not match mapping size" << leftMapping.size() << std::endl;
-      return 4;
+    // Don't leave partial configurations around to be mistaken for good ones.
+    if (results[j] != 0) {
+      std::cerr << "Error: Line " << job.line << " of "
+        << commandLine.batchFileName << " failed with code " << results[j]
+        << std::endl;
+      remove(job.outFileName.c_str());
     }
-    leftMeshes.push_back(leftMesh);
+  });
 
-    if (!findMesh(rightMapping, rightScreenLeft, rightScreenBottom,
-      rightScreenRight, rightScreenTop, rightScreen, rightMesh, g_verbose)) {
-      std::cerr << "Error: Could not find right mesh" << std::endl;
-      return 50;
-    }
-    if (rightMesh.size() != rightMapping.size()) {
-      std::cerr << "Error: Right mesh size " << rightMesh.size()
-        << " does not match mapping size" << rightMapping.size() << std::endl;
-      return 6;
+  //====================================================================
+  // Print the summary table, one row per job in manifest order.
+  int ret = 0;
+  std::cout << std::left << std::setw(6) << "line" << std::setw(8) << "status"
+    << std::right << std::setprecision(4)
+    << std::setw(10) << "h_fov" << std::setw(10) << "v_fov"
+    << std::setw(10) << "overlap"
+    << std::setw(10) << "left_x" << std::setw(10) << "left_y"
+    << std::setw(10) << "right_x" << std::setw(10) << "right_y"
+    << "  output" << "\n";
+  for (size_t j = 0; j < jobs.size(); j++) {
+    std::cout << std::left << std::setw(6) << jobs[j].line;
+    if (results[j] != 0) {
+      std::cout << std::setw(8) << results[j] << std::right;
+      for (int c = 0; c < 7; c++) { std::cout << std::setw(10) << "-"; }
+      std::cout << "  " << jobs[j].outFileName << "\n";
+      if (ret == 0) { ret = results[j]; }
+      continue;
     }
-    rightMeshes.push_back(rightMesh);
+    ConfigSummary const &s = summaries[j];
+    std::cout << std::setw(8) << "ok" << std::right
+      << std::setw(10) << s.hFOVDegrees << std::setw(10) << s.vFOVDegrees
+      << std::setw(10) << s.overlapPercent
+      << std::setw(10) << s.leftXCOP << std::setw(10) << s.leftYCOP
+      << std::setw(10) << s.rightXCOP << std::setw(10) << s.rightYCOP
+      << "  " << jobs[j].outFileName << "\n";
   }
+  std::cout.flush();
 
-  //====================================================================
-  // Construct Json screen description.
-  // We do this by hand rather than using JsonCPP because we need
-  // to control the printed precision of the numbers to avoid making
-  // a huge file.
-  std::cout << "{" << std::endl;
-  std::cout << " \"display\": {" << std::endl;
-  std::cout << "  \"hmd\": {" << std::endl;
-
-  std::cout << "   \"field_of_view\": {" << std::endl;
-  std::cout << "    \"monocular_horizontal\": "
-    << rightScreen.hFOVDegrees
-    << "," << std::endl;
-  std::cout << "    \"monocular_vertical\": "
-    << rightScreen.vFOVDegrees
-    << "," << std::endl;
-  std::cout << "    \"overlap_percent\": "
-    << rightScreen.overlapPercent
-    << "," << std::endl;
-  std::cout << "    \"pitch_tilt\": 0" << std::endl;
-  std::cout << "   }," << std::endl; // field_of_view
-
-  std::cout << "   \"distortion\": {" << std::endl;
-  switch (leftMeshes.size()) {
-  case 1:
-    std::cout << "    \"type\": \"mono_point_samples\"," << std::endl;
-    std::cout << "    \"mono_point_samples\": [" << std::endl;
-    writeMesh(std::cout, leftMeshes[0]);
-    std::cout << "," << std::endl;
-    writeMesh(std::cout, rightMeshes[0]);
-    std::cout << "    ]" << std::endl; // mono_point_samples
-    std::cout << "   }," << std::endl; // distortion
-    break;
-  case 3:
-    std::cout << "    \"type\": \"rgb_point_samples\"," << std::endl;
-    std::cout << "    \"red_point_samples\": [" << std::endl;
-      writeMesh(std::cout, leftMeshes[0]);
-      std::cout << "," << std::endl;
-      writeMesh(std::cout, rightMeshes[0]);
-    std::cout << "    ]," << std::endl; // red_point_samples
-    std::cout << "    \"green_point_samples\": [" << std::endl;
-      writeMesh(std::cout, leftMeshes[1]);
-      std::cout << "," << std::endl;
-      writeMesh(std::cout, rightMeshes[1]);
-    std::cout << "    ]," << std::endl; // green_point_samples
-    std::cout << "    \"blue_point_samples\": [" << std::endl;
-      writeMesh(std::cout, leftMeshes[2]);
-      std::cout << "," << std::endl;
-      writeMesh(std::cout, rightMeshes[2]);
-    std::cout << "    ]" << std::endl; // blue_point_samples
-    std::cout << "   }," << std::endl; // distortion
-    break;
-  default:
-    std::cerr << "Error: Unexpected number of meshes: " << leftMeshes.size()
+  return ret;
+}
+
+int main(int argc, char *argv[])
+{
+  // Parse the command line
+  ConfigOptions opts;
+  std::vector<std::string> args(argv + 1, argv + argc);
+  if (!parse_options(args, true, opts)) { Usage(argv[0]); }
+  g_verbose = opts.verbose;
+  if (!opts.batchFileName.empty() && !opts.inputFileNames.empty()) {
+    std::cerr << "Error: -mono and -rgb go in the manifest when using -batch"
       << std::endl;
-    return 3;
-  }
-
-  std::cout << "   \"eyes\": [" << std::endl;
-  std::cout << "    {" << std::endl;
-  std::cout << "     \"center_proj_x\": "
-    << leftScreen.xCOP
-    << "," << std::endl;
-  std::cout << "     \"center_proj_y\": "
-    << leftScreen.yCOP
-    << "," << std::endl;
-  std::cout << "     \"rotate_180\": 0" << std::endl;
-  std::cout << "    }," << std::endl;
-  std::cout << "    {" << std::endl;
-  std::cout << "     \"center_proj_x\": "
-    << rightScreen.xCOP
-    << "," << std::endl;
-  std::cout << "     \"center_proj_y\": "
-    << rightScreen.yCOP
-    << "," << std::endl;
-  std::cout << "     \"rotate_180\": 0" << std::endl;
-  std::cout << "    }" << std::endl;
-  std::cout << "   ]" << std::endl; // eyes
-
-  std::cout << "  }" << std::endl;  // hmd
-  std::cout << " }" << std::endl;   // display
-  std::cout << "}" << std::endl;    // Closes outer object
+    Usage(argv[0]);
+  }
 
-  return 0;
+  //====================================================================
+  // Run our algorithm test to make sure things are working properly.
+  // This happens once, however many configurations we produce.
+  int ret;
+  if ((ret = testAlgorithms()) != 0) {
+    std::cerr << "Error testing basic algorithms, code " << ret << std::endl;
+    return 100;
+  }
+
+  if (!opts.batchFileName.empty()) {
+    return run_batch(opts);
+  }
+  ConfigSummary summary;
+  return run_config(opts, NULL, std::cout, summary);
 }
 
 static bool small(double d)
@@ -0,0 +1,352 @@
+/** @file
+    @brief Times the stages of the AnglesToConfig pipeline on synthetic
+           meshes of increasing size and on measured data files, to show
+           how each of them scales with the number of points.
+
+    @date 2016
+
+    @author
+    Russ Taylor working through ReliaSolve.com for Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Internal Includes
+#include "helper.h"
+#include "distortion_config.h"
+#include "parallel.h"
+
+// Standard includes
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <vector>
+#include <string>
+#include <stdlib.h> // For exit()
+
+// Global constants and variables
+#define MY_PI (4.0*atan(1.0))
+
+// The stages of the pipeline that are timed, in the order they are run.
+enum Stage {
+  READ,
+  VERIFY_LOCAL,
+  VERIFY,
+  CONVERT,
+  SCREEN,
+  MESH,
+  NUM_STAGES
+};
+static const char *STAGE_NAMES[NUM_STAGES] = {
+  "read_from_infile",
+  "remove_invalid_points_locally",
+  "remove_invalid_points_based_on_angle",
+  "convert_to_normalized_and_meters",
+  "findScreen",
+  "findMesh"
+};
+
+// Timing results for one input.
+typedef struct {
+  std::string name;
+  size_t points;                  //< Number of points read
+  double ms[NUM_STAGES];          //< Median time for each stage
+} BenchmarkResult;
+
+void Usage(std::string name)
+{
+  std::cerr << "Usage: " << name
+    << " [-points N1,N2,...] (default 1000,10000,100000)"
+    << " [-repeat R] (default 3)"
+    << " [-threads N] (for remove_invalid_points_locally, default 1)"
+    << " [-mm] (data files are in millimeters)"
+    << " [-verify_angles xx xy yx yy max_degrees_difference] (default 1 0 0 1 80)"
+    << " [data_file ...]"
+    << std::endl
+    << "  Runs each stage of the AnglesToConfig pipeline on synthetic"
+    << " meshes with about the requested numbers of points (produced the"
+    << " way MakeExampleMesh does, 90 degree field of view with no"
+    << " distortion) and then on each data file, such as those in the"
+    << " HDK13 directory.  Each stage is run R times and the median is"
+    << " reported."
+    << std::endl
+    << "  Writes one CSV line per input with the time in milliseconds for"
+    << " each stage, then the time per point in microseconds and the"
+    << " scaling exponent between successive synthetic sizes (1 is linear,"
+    << " 2 is quadratic)."
+    << std::endl;
+  exit(1);
+}
+
+// Produce the text of a MakeExampleMesh-style table with a square grid
+// of about the requested number of points.
+static std::string make_synthetic_mesh(size_t points)
+{
+  int count = static_cast<int>(sqrt(static_cast<double>(points)) + 0.5);
+  if (count < 2) { count = 2; }
+  double fovDeg = 90.0;
+  double minDeg = - fovDeg / 2;
+  double step = fovDeg / (count - 1);
+
+  std::ostringstream out;
+  for (int x = 0; x < count; x++) {
+    double xDeg = minDeg + x * step;
+    double xRad = xDeg * MY_PI / 180;
+    for (int y = 0; y < count; y++) {
+      double yDeg = minDeg + y * step;
+      double yRad = yDeg * MY_PI / 180;
+      out << xDeg << " " << yDeg << " "
+        << tan(xRad) << " " << tan(yRad) << "\n";
+    }
+  }
+  return out.str();
+}
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double, std::milli>(
+    std::chrono::steady_clock::now() - start).count();
+}
+
+static double median(std::vector<double> v)
+{
+  std::sort(v.begin(), v.end());
+  return v[v.size() / 2];
+}
+
+// Run the whole pipeline on the text of a table, the way AnglesToConfig
+// does for a single color and eye with the screen bounds computed from
+// the points, timing each stage.
+//   Returns false (after saying why) if any stage fails.
+static bool run_pipeline(std::string const &name, std::string const &text,
+  double toMeters, double xx, double xy, double yx, double yy,
+  double maxAngleDiffDegrees, size_t numThreads, int repeat,
+  BenchmarkResult &result)
+{
+  const double depth = 2.0;
+  std::vector<double> times[NUM_STAGES];
+  result.name = name;
+  result.points = 0;
+
+  for (int r = 0; r < repeat; r++) {
+    std::chrono::steady_clock::time_point start;
+
+    std::istringstream in(text);
+    start = std::chrono::steady_clock::now();
+    std::vector<Mapping> mapping = read_from_infile(in);
+    times[READ].push_back(elapsed_ms(start));
+    if (mapping.empty()) {
+      std::cerr << "Error: Could not read " << name << std::endl;
+      return false;
+    }
+    result.points = mapping.size();
+
+    // The local filter gets its own copy, so that the rest of the
+    // pipeline sees what the greedy one leaves.
+    std::vector<Mapping> local(mapping);
+    start = std::chrono::steady_clock::now();
+    int ret = remove_invalid_points_locally(
+      local, xx, xy, yx, yy, maxAngleDiffDegrees, numThreads);
+    times[VERIFY_LOCAL].push_back(elapsed_ms(start));
+    if (ret < 0) {
+      std::cerr << "Error verifying angles locally for " << name << std::endl;
+      return false;
+    }
+
+    start = std::chrono::steady_clock::now();
+    ret = remove_invalid_points_based_on_angle(
+      mapping, xx, xy, yx, yy, maxAngleDiffDegrees);
+    times[VERIFY].push_back(elapsed_ms(start));
+    if (ret < 0) {
+      std::cerr << "Error verifying angles for " << name << std::endl;
+      return false;
+    }
+
+    double left, right, bottom, top;
+    std::vector<std::vector<Mapping> const *> mappings(1, &mapping);
+    compute_mapping_bounds(mappings, toMeters, left, bottom, right, top);
+
+    MappingSet set(mapping);
+    start = std::chrono::steady_clock::now();
+    bool ok = convert_to_normalized_and_meters(set, toMeters, depth,
+      left, bottom, right, top);
+    times[CONVERT].push_back(elapsed_ms(start));
+    if (!ok) {
+      std::cerr << "Error converting " << name << std::endl;
+      return false;
+    }
+
+    ScreenDescription screen;
+    start = std::chrono::steady_clock::now();
+    ok = findScreen(set, left, bottom, right, top, screen);
+    times[SCREEN].push_back(elapsed_ms(start));
+    if (!ok) {
+      std::cerr << "Error: Could not find screen for " << name << std::endl;
+      return false;
+    }
+
+    MeshDescription mesh;
+    start = std::chrono::steady_clock::now();
+    ok = findMesh(set, left, bottom, right, top, screen, mesh);
+    times[MESH].push_back(elapsed_ms(start));
+    if (!ok) {
+      std::cerr << "Error: Could not find mesh for " << name << std::endl;
+      return false;
+    }
+  }
+
+  for (size_t s = 0; s < NUM_STAGES; s++) {
+    result.ms[s] = median(times[s]);
+  }
+  return true;
+}
+
+int main(int argc, char *argv[])
+{
+  // Set defaults
+  std::vector<size_t> sizes;
+  sizes.push_back(1000);
+  sizes.push_back(10000);
+  sizes.push_back(100000);
+  int repeat = 3;
+  size_t numThreads = 1;
+  double toMeters = 1.0;
+  double xx = 1, xy = 0, yx = 0, yy = 1;
+  double maxAngleDiffDegrees = 80;
+  std::vector<std::string> dataFileNames;
+
+  // Parse the command line
+  for (int i = 1; i < argc; i++) {
+    if (std::string("-points") == argv[i]) {
+      if (++i >= argc) { Usage(argv[0]); }
+      sizes.clear();
+      std::istringstream list(argv[i]);
+      std::string item;
+      while (std::getline(list, item, ',')) {
+        long n = atol(item.c_str());
+        if (n < 4) {
+          std::cerr << "Bad value for -points: " << item
+            << ", expected at least 4" << std::endl;
+          Usage(argv[0]);
+        }
+        sizes.push_back(static_cast<size_t>(n));
+      }
+    } else if (std::string("-repeat") == argv[i]) {
+      if (++i >= argc) { Usage(argv[0]); }
+      repeat = atoi(argv[i]);
+      if (repeat < 1) { Usage(argv[0]); }
+    } else if (std::string("-threads") == argv[i]) {
+      if (++i >= argc) { Usage(argv[0]); }
+      int n = atoi(argv[i]);
+      numThreads = (n > 0) ? n : default_thread_count();
+    } else if (std::string("-mm") == argv[i]) {
+      toMeters = 1e-3;  // Convert input in millimeters to meters
+    } else if (std::string("-verify_angles") == argv[i]) {
+      if (i + 5 >= argc) { Usage(argv[0]); }
+      xx = atof(argv[++i]);
+      xy = atof(argv[++i]);
+      yx = atof(argv[++i]);
+      yy = atof(argv[++i]);
+      maxAngleDiffDegrees = atof(argv[++i]);
+    } else if (argv[i][0] == '-') {
+      Usage(argv[0]);
+    } else {
+      dataFileNames.push_back(argv[i]);
+    }
+  }
+
+  // The synthetic meshes are always in meters, whatever -mm says.
+  std::vector<BenchmarkResult> synthetic;
+  for (size_t i = 0; i < sizes.size(); i++) {
+    std::ostringstream name;
+    name << "synthetic_" << sizes[i];
+    BenchmarkResult result;
+    if (!run_pipeline(name.str(), make_synthetic_mesh(sizes[i]), 1.0,
+          xx, xy, yx, yy, maxAngleDiffDegrees, numThreads, repeat, result)) {
+      return 2;
+    }
+    synthetic.push_back(result);
+  }
+
+  std::vector<BenchmarkResult> measured;
+  for (size_t i = 0; i < dataFileNames.size(); i++) {
+    std::ifstream file(dataFileNames[i].c_str(), std::ios::binary);
+    if (!file) {
+      std::cerr << "Error: Could not open " << dataFileNames[i] << std::endl;
+      return 3;
+    }
+    std::ostringstream text;
+    text << file.rdbuf();
+    BenchmarkResult result;
+    if (!run_pipeline(dataFileNames[i], text.str(), toMeters,
+          xx, xy, yx, yy, maxAngleDiffDegrees, numThreads, repeat, result)) {
+      return 4;
+    }
+    measured.push_back(result);
+  }
+
+  // Raw times, one line per input.
+  std::cout << std::fixed << std::setprecision(3);
+  std::cout << "input,points";
+  for (size_t s = 0; s < NUM_STAGES; s++) {
+    std::cout << "," << STAGE_NAMES[s] << "_ms";
+  }
+  std::cout << std::endl;
+  std::vector<BenchmarkResult> all(synthetic);
+  all.insert(all.end(), measured.begin(), measured.end());
+  for (size_t i = 0; i < all.size(); i++) {
+    std::cout << "\"" << all[i].name << "\"," << all[i].points;
+    for (size_t s = 0; s < NUM_STAGES; s++) {
+      std::cout << "," << all[i].ms[s];
+    }
+    std::cout << std::endl;
+  }
+
+  // Scaling curves for the synthetic meshes: the time per point and the
+  // exponent k in time ~ points^k between each size and the one before.
+  std::cout << std::endl << "points";
+  for (size_t s = 0; s < NUM_STAGES; s++) {
+    std::cout << "," << STAGE_NAMES[s] << "_us_per_point";
+  }
+  for (size_t s = 0; s < NUM_STAGES; s++) {
+    std::cout << "," << STAGE_NAMES[s] << "_exponent";
+  }
+  std::cout << std::endl;
+  for (size_t i = 0; i < synthetic.size(); i++) {
+    BenchmarkResult const &r = synthetic[i];
+    std::cout << r.points;
+    for (size_t s = 0; s < NUM_STAGES; s++) {
+      std::cout << "," << 1000.0 * r.ms[s] / r.points;
+    }
+    for (size_t s = 0; s < NUM_STAGES; s++) {
+      std::cout << ",";
+      if (i == 0) { continue; }
+      BenchmarkResult const &p = synthetic[i - 1];
+      if ((p.points == r.points) || (p.ms[s] <= 0) || (r.ms[s] <= 0)) {
+        continue;
+      }
+      std::cout << log(r.ms[s] / p.ms[s])
+        / log(static_cast<double>(r.points) / p.points);
+    }
+    std::cout << std::endl;
+  }
+
+  return 0;
+}
@@ -30,6 +30,10 @@
 #include "osvr/RenderKit/RenderManager.h"
 #include "types.h"
 #include "helper.h"
+#include "distortion_config.h"
+#include "gpu_mesh.h"
+#include "sphere_batch.h"
+#include "frame_timer.h"
 
 // Needed for render buffer calls.  OSVR will have called glewInit() for us
 // when we open the display.
@@ -42,13 +46,22 @@
 #endif
 #include <GL/GL.h>
 #include <GL/GLu.h>
+#include <json/json.h>
 
 // Standard includes
 #include <iostream>
+#include <sstream>
 #include <string>
+#include <vector>
+#include <cmath>
+#include <algorithm>
 #include <stdlib.h> // For exit()
 #include <chrono>
 #include <thread>
+#include <mutex>
+#include <atomic>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 //This must come after we include <GL/GL.h> so its pointer types are defined.
 #include "osvr/RenderKit/GraphicsLibraryOpenGL.h"
@@ -66,8 +79,24 @@ static osvr::clientkit::ClientContext context(
 
 static osvr::renderkit::RenderManager *render = nullptr;
 
-// Quadric and sphere to use for rendering.
-static GLUquadric *sphere = nullptr;
+// Sphere to use for rendering.
+static Sphere_Batch *sphere = nullptr;
+
+// Display lists holding the geometry that does not change from frame
+// to frame: a unit cube for the environment and the grid of lines drawn
+// in the right eye, which is rebuilt only if the viewport width changes.
+static GLuint cubeList = 0;
+static GLuint gridList = 0;
+static double gridWidth = 0;
+
+// Finds and resamples the watched meshes when -gpu_mesh is given.  It
+// lives on the render thread with the OpenGL context.
+static GpuMeshBuilder *gpuMesh = nullptr;
+
+// How far (in normalized screen coordinates) the GPU meshes may be from
+// the CPU ones before we stop using the GPU.  This is about a pixel on
+// the HDK's screens, and is well above the single-precision differences.
+static const double GPU_MESH_TOLERANCE = 1e-3;
 
 // X,Y location
 typedef struct {
@@ -75,6 +104,249 @@ typedef struct {
   double y;
 } XY;
 
+// Locate the normalized screen coordinates for the "forwards"
+// direction in the left and right screens; this is the direction
+// where the angles are both 0.  The mapping is converted in place.
+// @todo if exact sample not found, interpolate between nearest three
+// non-collinear points.
+static void find_forwards(std::vector<Mapping> &mapping,
+  DistortionConfigOptions const &opts, double left, double bottom,
+  double right, double top, XY &leftForward, XY &rightForward)
+{
+  convert_to_normalized_and_meters(mapping, opts.toMeters, opts.depth,
+    left, bottom, right, top, opts.useFieldAngles);
+  XY forward;
+  forward.x = -1e5;    // Start out off-screen
+  forward.y = -1e5;  // Start out off-screen
+  for (size_t i = 0; i < mapping.size(); i++) {
+    if ((mapping[i].xyLatLong.latitude == 0) &&
+        (mapping[i].xyLatLong.longitude == 0)) {
+      forward.x = mapping[i].xyLatLong.x;
+      forward.y = mapping[i].xyLatLong.y;
+    }
+  }
+
+  leftForward.y = rightForward.y = forward.y;
+  if (opts.useRightEye) {
+    rightForward.x = forward.x;
+    leftForward.x = 1 - forward.x;
+  } else {
+    leftForward.x = forward.x;
+    rightForward.x = 1 - forward.x;
+  }
+}
+
+//====================================================================
+// Watch mode.  A worker thread polls the input file and, whenever its
+// contents change, rebuilds the screens and meshes from it the way
+// AnglesToConfig would.  The result is handed to the render loop, which
+// owns the OpenGL context and so is the one that pushes the new meshes
+// to RenderManager, between frames.  When the GPU is finding the meshes,
+// the watcher only gets as far as the screens and the render loop does
+// the rest.
+
+typedef struct {
+  std::string config;       //< What AnglesToConfig would have written
+  XY leftForward;
+  XY rightForward;
+  bool needMeshes;          //< The render loop must fill in config from...
+  DistortionConfig screens; //< ...these screens and mappings
+} WatchResult;
+
+static std::atomic<bool> watchStop(false);
+static std::atomic<bool> watchUseGpu(false);
+static std::mutex watchLock;              //< Protects the two below
+static bool watchResultReady = false;
+static WatchResult watchResult;
+
+// How often to look at the watched file.
+static const int WATCH_POLL_MS = 250;
+
+static void watch_input(std::string fileName, MappingLoadOptions load,
+  DistortionConfigOptions opts)
+{
+  time_t lastTime = 0;
+  long long lastSize = -1;
+  std::vector<char> lastContents;
+  while (!watchStop) {
+    // Only read the file when its time or size changes, and only rebuild
+    // when its contents do.  A file that is still being written usually
+    // fails to parse; we'll try it again once the writer is done.
+    struct stat info;
+    if ((stat(fileName.c_str(), &info) != 0) ||
+        ((info.st_mtime == lastTime) && (info.st_size == lastSize))) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(WATCH_POLL_MS));
+      continue;
+    }
+    lastTime = info.st_mtime;
+    lastSize = info.st_size;
+    std::vector<char> contents;
+    if (!read_file_contents(fileName, contents) || (contents == lastContents)) {
+      continue;
+    }
+    lastContents.swap(contents);
+
+    std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+    std::vector<Mapping> mapping;
+    std::vector<AngleTerms> mappingTerms;
+    if (load_mapping(lastContents.data(), lastContents.size(), fileName, 0,
+          true, load, opts, mapping, mappingTerms) != 0) {
+      std::cerr << "Watch: Could not read " << fileName
+        << ", keeping the previous mesh" << std::endl;
+      continue;
+    }
+    std::vector<std::vector<Mapping> const *> mappings(1, &mapping);
+    std::vector<std::vector<AngleTerms> const *> terms(1, &mappingTerms);
+    WatchResult result;
+    result.needMeshes = watchUseGpu;
+    DistortionConfig &config = result.screens;
+    if (result.needMeshes ? (prepare_eye_mappings(mappings, terms, opts, config)
+            != 0) || (find_eye_screens(opts, config) != 0)
+          : build_distortion_config(mappings, terms, opts, config) != 0) {
+      std::cerr << "Watch: Could not build meshes from " << fileName
+        << ", keeping the previous mesh" << std::endl;
+      continue;
+    }
+    if (!result.needMeshes) {
+      std::ostringstream out;
+      write_distortion_config(out, config);
+      result.config = out.str();
+      config = DistortionConfig();
+    }
+    double left = opts.left, right = opts.right;
+    double bottom = opts.bottom, top = opts.top;
+    if (opts.computeBounds) {
+      compute_mapping_bounds(mappings, opts.toMeters, left, bottom, right, top);
+    }
+    find_forwards(mapping, opts, left, bottom, right, top,
+      result.leftForward, result.rightForward);
+
+    {
+      std::lock_guard<std::mutex> guard(watchLock);
+      watchResult = result;
+      watchResultReady = true;
+    }
+    std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+    std::cerr << "Watch: Rebuilt " << (result.needMeshes ? "screens" : "meshes")
+      << " from " << mapping.size() << " points in " << elapsed.count()
+      << " ms" << std::endl;
+  }
+}
+
+// Find the meshes for a watch result on the GPU.  The first time, also
+// find them on the CPU and compare; if they don't match, warn and have
+// the watcher build everything on the CPU from then on.
+//   Returns false if the meshes could not be found.
+static bool find_watch_meshes_on_gpu(DistortionConfigOptions const &opts,
+  WatchResult &result)
+{
+  static bool verified = false;
+  DistortionConfig &config = result.screens;
+  DistortionConfig cpu;
+  if (!verified) { cpu = config; }
+
+  std::chrono::steady_clock::time_point start =
+    std::chrono::steady_clock::now();
+  int ret = find_eye_meshes(opts, config, gpuMesh);
+  std::chrono::duration<double, std::milli> gpuTime =
+    std::chrono::steady_clock::now() - start;
+  if (!verified) {
+    start = std::chrono::steady_clock::now();
+    if (find_eye_meshes(opts, cpu) != 0) { return false; }
+    std::chrono::duration<double, std::milli> cpuTime =
+      std::chrono::steady_clock::now() - start;
+    double diff = (ret == 0) ? 0 : HUGE_VAL;
+    for (size_t i = 0; (ret == 0) && (i < cpu.leftMeshes.size()); i++) {
+      diff = std::max(diff, max_mesh_difference(cpu.leftMeshes[i],
+        config.leftMeshes[i]));
+      diff = std::max(diff, max_mesh_difference(cpu.rightMeshes[i],
+        config.rightMeshes[i]));
+    }
+    std::cerr << "Watch: Meshes took " << gpuTime.count() << " ms on the GPU and "
+      << cpuTime.count() << " ms on the CPU, differing by at most " << diff
+      << std::endl;
+    verified = true;
+    if (!(diff <= GPU_MESH_TOLERANCE)) {
+      std::cerr << "Watch: Warning: GPU meshes differ from the CPU ones by more"
+        " than " << GPU_MESH_TOLERANCE << ", using the CPU from now on"
+        << std::endl;
+      watchUseGpu = false;
+      config = cpu;
+      ret = 0;
+    }
+  }
+  if (ret != 0) {
+    std::cerr << "Watch: Could not find meshes on the GPU, keeping the previous"
+      " mesh" << std::endl;
+    return false;
+  }
+
+  std::ostringstream out;
+  write_distortion_config(out, config);
+  result.config = out.str();
+  return true;
+}
+
+// If the watcher has produced new meshes, send them to RenderManager and
+// update the forwards directions.  Only the distortion and centers of
+// projection in the server's display description are replaced; the
+// field of view RenderManager opened with stays the same.
+//   Returns true if the meshes were updated.
+static bool apply_watch_result(std::string const &displayInfo,
+  DistortionConfigOptions const &opts, XY &leftForward, XY &rightForward)
+{
+  WatchResult result;
+  {
+    std::lock_guard<std::mutex> guard(watchLock);
+    if (!watchResultReady) { return false; }
+    result = watchResult;
+    watchResultReady = false;
+  }
+  if (result.needMeshes && !find_watch_meshes_on_gpu(opts, result)) {
+    return false;
+  }
+
+  Json::Reader reader;
+  Json::Value display, ours;
+  if (!reader.parse(displayInfo, display) ||
+      !reader.parse(result.config, ours)) {
+    std::cerr << "Watch: Could not parse display description" << std::endl;
+    return false;
+  }
+  Json::Value &hmd = display.isMember("display") ? display["display"]["hmd"]
+    : display["hmd"];
+  Json::Value const &newHmd = ours["display"]["hmd"];
+  hmd["distortion"] = newHmd["distortion"];
+  for (Json::ArrayIndex e = 0;
+       (e < newHmd["eyes"].size()) && (e < hmd["eyes"].size()); e++) {
+    hmd["eyes"][e]["center_proj_x"] = newHmd["eyes"][e]["center_proj_x"];
+    hmd["eyes"][e]["center_proj_y"] = newHmd["eyes"][e]["center_proj_y"];
+  }
+
+  std::vector<osvr::renderkit::DistortionParameters> distortionParams;
+  try {
+    Json::FastWriter writer;
+    OSVRDisplayConfiguration newConfiguration(writer.write(display));
+    for (size_t eye = 0; eye < newConfiguration.getEyes().size(); eye++) {
+      osvr::renderkit::DistortionParameters distortion(newConfiguration, eye);
+      distortion.m_desiredTriangles = 200 * 64;
+      distortionParams.push_back(distortion);
+    }
+  }
+  catch (std::exception &e) {
+    std::cerr << "Watch: Could not use the new meshes: " << e.what()
+      << std::endl;
+    return false;
+  }
+  render->UpdateDistortionMeshes(
+    osvr::renderkit::DistortionMeshType::SQUARE, distortionParams);
+  leftForward = result.leftForward;
+  rightForward = result.rightForward;
+  return true;
+}
+
 static std::string osvrGetString(OSVR_ClientContext context, const std::string& path)
 {
   size_t len;
@@ -135,8 +407,15 @@ bool SetupRendering(osvr::renderkit::GraphicsLibrary library)
   // Turn on depth testing, so we get correct ordering.
   glEnable(GL_DEPTH_TEST);
 
-  // Construct the quadric for the sphere primitive to draw to show spacing
-  sphere = gluNewQuadric();
+  // Construct the sphere primitive to draw to show spacing
+  sphere = new Sphere_Batch(30, 30);
+
+  // Record the environment cube once.
+  cubeList = glGenLists(1);
+  glNewList(cubeList, GL_COMPILE);
+  draw_cube(1.0);
+  glEndList();
+  gridList = glGenLists(1);
 
   return true;
 }
@@ -210,11 +489,15 @@ void RenderView(
   // interface and handle the coordinate tranforms ourselves.
 
   // Draw a cube with a 5-meter radius as the room we are floating in.
-  draw_cube(5.0);
+  glPushMatrix();
+  glScaled(5.0, 5.0, 5.0);
+  glCallList(cubeList);
+  glPopMatrix();
 
   // Draw another cube 1 meter along the -Z axis
   glTranslated(0, 0, -1);
-  draw_cube(0.1);
+  glScaled(0.1, 0.1, 0.1);
+  glCallList(cubeList);
 
   // =================================================================
   // Now we want to draw things in screen space, so we construct new
@@ -260,23 +543,29 @@ void RenderView(
   double xScale = width;
   double yScale = height;
 
-  glPushMatrix();
-    glTranslated((xForward + xOffset) * xScale, (yForward + yOffset) * yScale, 0);
-    gluSphere(sphere, width*0.01, 30, 30);
-  glPopMatrix();
+  sphere->drawOne((xForward + xOffset) * xScale, (yForward + yOffset) * yScale,
+    width*0.01);
   
   // Draw a set of horizontal and vertical lines in the right eye
   // Draw into the original viewport space, not the oversized viewport.
-  glColor3d(0, 0, 0);
-  glBegin(GL_LINES);
-  if (whichEye == 1) for (double ofs = -width; ofs <= width; ofs += width/50) {
-    glVertex2d(-width, ofs);
-    glVertex2d(width, ofs);
+  if (whichEye == 1) {
+    if (width != gridWidth) {
+      glNewList(gridList, GL_COMPILE);
+      glBegin(GL_LINES);
+      for (double ofs = -width; ofs <= width; ofs += width/50) {
+        glVertex2d(-width, ofs);
+        glVertex2d(width, ofs);
 
-    glVertex2d(ofs, -width);
-    glVertex2d(ofs,  width);
+        glVertex2d(ofs, -width);
+        glVertex2d(ofs,  width);
+      }
+      glEnd();
+      glEndList();
+      gridWidth = width;
+    }
+    glColor3d(0, 0, 0);
+    glCallList(gridList);
   }
-  glEnd();
 }
 
 void Usage(std::string name)
@@ -288,6 +577,15 @@ void Usage(std::string name)
     << " [-mm] (screen distance units in the config file, default is meters)"
     << " [-screen screen_left_meters screen_bottom_meters screen_right_meters screen_top_meters]"
     << " (default auto-compute based on ranges seen)"
+    << " [-timing file.csv] (show frame timing and write it to the file on exit)"
+    << " [-watch file] (read from the file rather than standard input and show"
+    << " the meshes built from it, rebuilding them whenever it changes)"
+    << " [-resample nx ny] (resample the watched meshes onto a grid)"
+    << " [-gpu_mesh] (find and resample the watched meshes with compute shaders,"
+    << " checking them against the CPU the first time)"
+    << " [-verify_angles xx xy yx yy max_degrees] [-outlier_mode greedy|local]"
+    << " [-cache] [-verbose] (as for AnglesToConfig, also used when rebuilding"
+    << " watched meshes)"
     << std::endl
     << "  This program reads from standard input a configuration that has a list of" << std::endl
     << "x,y screen coordinates in meters followed by long,lat angles in" << std::endl
@@ -308,6 +606,12 @@ int main(int argc, char *argv[])
   double left, right, bottom, top;
   double depth = 2.0;
   double toMeters = 1.0;
+  std::string timingFileName;
+  std::string watchFileName;
+  size_t resampleX = 0, resampleY = 0;
+  bool useGpuMesh = false;
+  bool verbose = false;
+  MappingLoadOptions load;
   int realParams = 0;
   for (int i = 1; i < argc; i++) {
     if (std::string("-mm") == argv[i]) {
@@ -317,6 +621,53 @@ int main(int argc, char *argv[])
       depth = atof(argv[i]);
     } else if (std::string("-latlong") == argv[i]) {
       useFieldAngles = false;
+    } else if (std::string("-timing") == argv[i]) {
+      if (++i >= argc) { Usage(argv[0]); }
+      timingFileName = argv[i];
+    } else if (std::string("-watch") == argv[i]) {
+      if (++i >= argc) { Usage(argv[0]); }
+      watchFileName = argv[i];
+    } else if (std::string("-resample") == argv[i]) {
+      if (++i >= argc) { Usage(argv[0]); }
+      int nx = atoi(argv[i]);
+      if (++i >= argc) { Usage(argv[0]); }
+      int ny = atoi(argv[i]);
+      if ((nx < 2) || (ny < 2)) {
+        std::cerr << "Bad value for -resample: " << nx << " " << ny
+          << ", expected at least 2 2" << std::endl;
+        Usage(argv[0]);
+      }
+      resampleX = nx;
+      resampleY = ny;
+    } else if (std::string("-gpu_mesh") == argv[i]) {
+      useGpuMesh = true;
+    } else if (std::string("-verbose") == argv[i]) {
+      verbose = true;
+    } else if (std::string("-cache") == argv[i]) {
+      load.useCache = true;
+    } else if (std::string("-outlier_mode") == argv[i]) {
+      if (++i >= argc) { Usage(argv[0]); }
+      if (std::string("greedy") == argv[i]) {
+        load.outlierMode = OUTLIERS_GREEDY;
+      } else if (std::string("local") == argv[i]) {
+        load.outlierMode = OUTLIERS_LOCAL;
+      } else {
+        std::cerr << "Bad value for -outlier_mode: " << argv[i]
+          << ", expected greedy or local" << std::endl;
+        Usage(argv[0]);
+      }
+    } else if (std::string("-verify_angles") == argv[i]) {
+      load.verifyAngles = true;
+      if (++i >= argc) { Usage(argv[0]); }
+      load.xx = atof(argv[i]);
+      if (++i >= argc) { Usage(argv[0]); }
+      load.xy = atof(argv[i]);
+      if (++i >= argc) { Usage(argv[0]); }
+      load.yx = atof(argv[i]);
+      if (++i >= argc) { Usage(argv[0]); }
+      load.yy = atof(argv[i]);
+      if (++i >= argc) { Usage(argv[0]); }
+      load.maxAngleDiffDegrees = atof(argv[i]);
     } else if (std::string("-screen") == argv[i]) {
       computeBounds = false;
       if (++i >= argc) { Usage(argv[0]); }
@@ -349,34 +700,50 @@ int main(int argc, char *argv[])
   }
   if (realParams != 0) { Usage(argv[0]); }
 
+  DistortionConfigOptions opts;
+  opts.verbose = verbose;
+  opts.useRightEye = useRightEye;
+  opts.computeBounds = computeBounds;
+  opts.useFieldAngles = useFieldAngles;
+  if (!computeBounds) {
+    opts.left = left;
+    opts.bottom = bottom;
+    opts.right = right;
+    opts.top = top;
+  }
+  opts.depth = depth;
+  opts.toMeters = toMeters;
+  opts.resampleX = resampleX;
+  opts.resampleY = resampleY;
+
   //====================================================================
-  // Parse the angle-configuration information from standard input.  Expect white-space
-  // separation between numbers and also between entries (which may be on separate
-  // lines).
-  std::vector<Mapping> mapping = read_from_infile(std::cin);
-  if (mapping.size() == 0) {
-    std::cerr << "Error: No input points found" << std::endl;
-    return 2;
+  // Parse the angle-configuration information from standard input or the
+  // watched file, cleaning it up the same way that AnglesToConfig does and
+  // that the watcher will when it rebuilds.
+  std::vector<Mapping> mapping;
+  std::vector<AngleTerms> mappingTerms;
+  std::vector<char> contents;
+  std::string sourceName = watchFileName;
+  if (watchFileName.empty()) {
+    std::ostringstream in;
+    in << std::cin.rdbuf();
+    std::string s = in.str();
+    contents.assign(s.begin(), s.end());
+    sourceName = "standard input";
+  } else if (!read_file_contents(watchFileName, contents)) {
+    std::cerr << "Error: Could not open " << watchFileName << std::endl;
+    return 1;
   }
+  int loadRet = load_mapping(contents.data(), contents.size(), sourceName, 0,
+    !watchFileName.empty(), load, opts, mapping, mappingTerms);
+  if (loadRet != 0) { return loadRet; }
 
   //====================================================================
   // If we've been asked to auto-range the screen coordinates, compute
   // them here.
   if (computeBounds) {
-    left = right = mapping[0].xyLatLong.x;
-    bottom = top = mapping[0].xyLatLong.y;
-    for (size_t i = 1; i < mapping.size(); i++) {
-      double x = mapping[i].xyLatLong.x;
-      double y = mapping[i].xyLatLong.y;
-      if (x < left) { left = x; }
-      if (x > right) { right = x; }
-      if (y < bottom) { bottom = y; }
-      if (y > top) { top = y; }
-    }
-    left *= toMeters;
-    right *= toMeters;
-    bottom *= toMeters;
-    top *= toMeters;
+    std::vector<std::vector<Mapping> const *> mappings(1, &mapping);
+    compute_mapping_bounds(mappings, toMeters, left, bottom, right, top);
   }
 
   // Open RenderManager and set up the context for rendering to
@@ -455,6 +822,9 @@ int main(int argc, char *argv[])
     return 3;
   }
 
+  // Time each frame, against the 60 Hz refresh of the HDK.
+  Frame_Timer *timer = new Frame_Timer(60, !timingFileName.empty());
+
   // Do a call to get the information we need to construct our
   // color and depth render-to-texture buffers.
   std::vector<osvr::renderkit::RenderInfo> renderInfo;
@@ -527,33 +897,27 @@ int main(int argc, char *argv[])
     quit = true;
   }
 
-  // Locate the normalized screen coordinates for the "forwards"
-  // direction in the left and right screens; this is the direction
-  // where the angles are both 0.
-  // @todo if exact sample not found, interpolate between nearest three
-  // non-collinear points.
-  convert_to_normalized_and_meters(mapping, toMeters, depth,
-    left, bottom, right, top, useFieldAngles);
-  XY forward;
-  forward.x = -1e5;    // Start out off-screen
-  forward.y = -1e5;  // Start out off-screen
-  for (size_t i = 0; i < mapping.size(); i++) {
-    if ((mapping[i].xyLatLong.latitude == 0) &&
-        (mapping[i].xyLatLong.longitude == 0)) {
-      forward.x = mapping[i].xyLatLong.x;
-      forward.y = mapping[i].xyLatLong.y;
-    }
-  }
-
+  // Find the forwards direction in each eye.
   XY leftForward;
   XY rightForward;
-  leftForward.y = rightForward.y = forward.y;
-  if (useRightEye) {
-    rightForward.x = forward.x;
-    leftForward.x = 1 - forward.x;
-  } else {
-    leftForward.x = forward.x;
-    rightForward.x = 1 - forward.x;
+  find_forwards(mapping, opts, left, bottom, right, top,
+    leftForward, rightForward);
+
+  // When watching, the meshes come from the file (starting with what is
+  // in it now), so we don't turn off distortion correction.
+  std::thread watcher;
+  if (!watchFileName.empty()) {
+    testingForwards = false;
+    if (useGpuMesh) {
+      gpuMesh = new GpuMeshBuilder;
+      if (gpuMesh->ok()) {
+        watchUseGpu = true;
+      } else {
+        std::cerr << "Warning: Could not use the GPU for meshes, using the CPU"
+          << std::endl;
+      }
+    }
+    watcher = std::thread(watch_input, watchFileName, load, opts);
   }
 
     // If we're debugging the forwards direction, we need to turn off
@@ -598,6 +962,9 @@ int main(int argc, char *argv[])
 
     // Continue rendering until it is time to quit.
     while (!quit) {
+        timer->beginFrame();
+        timer->beginPhase(Frame_Timer::UPDATE);
+
         // Update the context so we get our callbacks called and
         // update analog and button states.
         context.update();
@@ -608,21 +975,46 @@ int main(int argc, char *argv[])
         osvrGetAnalogState(analogTrigger.get(), &ignore, &triggerValue);
 
         renderInfo = render->GetRenderInfo();
+        timer->endPhase(Frame_Timer::UPDATE);
 
         // Render into each buffer using the specified information.
+        timer->beginPhase(Frame_Timer::RENDER);
         for (size_t i = 0; i < renderInfo.size(); i++) {
+          timer->beginEyePass(i);
           RenderView(i, displayConfiguration, renderManagerConfig,
             renderInfo[i], frameBuffer,
             colorBuffers[i].OpenGL->colorBufferName,
             depthBuffers[i],
             leftForward, rightForward);
+          timer->endEyePass();
+          if (!timingFileName.empty()) {
+            timer->drawOverlay();
+          }
         }
+        timer->endPhase(Frame_Timer::RENDER);
 
         // Send the rendered results to the screen
+        timer->beginPhase(Frame_Timer::PRESENT);
         if (!render->PresentRenderBuffers(colorBuffers, renderInfo)) {
           std::cerr << "PresentRenderBuffers() returned false, maybe because it was asked to quit" << std::endl;
           quit = true;
         }
+        timer->endPhase(Frame_Timer::PRESENT);
+
+        // Between frames, switch to any meshes the watcher has built.
+        if (watcher.joinable()) {
+          timer->beginPhase(Frame_Timer::MESH_UPDATE);
+          apply_watch_result(displayInfo, opts, leftForward, rightForward);
+          timer->endPhase(Frame_Timer::MESH_UPDATE);
+        }
+        timer->endFrame();
+    }
+    if (watcher.joinable()) {
+      watchStop = true;
+      watcher.join();
+    }
+    if (!timingFileName.empty()) {
+      timer->writeCSV(timingFileName);
     }
 
     // Clean up after ourselves.
@@ -632,6 +1024,11 @@ int main(int argc, char *argv[])
       delete colorBuffers[i].OpenGL;
       glDeleteRenderbuffers(1, &depthBuffers[i]);
     }
+    glDeleteLists(gridList, 1);
+    glDeleteLists(cubeList, 1);
+    delete gpuMesh;
+    delete sphere;
+    delete timer;
 
     // Close the Renderer interface cleanly.
     delete render;
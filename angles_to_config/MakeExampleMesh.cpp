@@ -29,64 +29,253 @@
 #include <iostream>
 #include <iomanip>
 #include <fstream>
+#include <sstream>
 #include <cmath>
 #include <vector>
 #include <string>
+#include <random>
 #include <stdlib.h> // For exit()
 
 // Global constants and variables
 static bool g_verbose = false;
 #define MY_PI (4.0*atan(1.0))
 
+static const char *COLOR_NAMES[3] = { "red", "green", "blue" };
+
+// Size of the buffer used for each output file, so that millions of
+// lines are written in large blocks rather than one at a time.
+static const size_t OUTPUT_BUFFER_SIZE = 1 << 20;
+
 void Usage(std::string name)
 {
   std::cerr << "Usage: " << name
+    << " [-fov x_degrees y_degrees] (default 90 90)"
+    << " [-grid x_count y_count] (default 11 11)"
+    << " [-distortion k1,k2,...] (radial polynomial for all colors, default none)"
+    << " [-distortion_red|-distortion_green|-distortion_blue k1,k2,...]"
+    << " [-noise sigma] (screen-space Gaussian noise, default 0)"
+    << " [-outliers fraction] (default 0)"
+    << " [-seed N] (default 1)"
+    << " [-rgb red_file green_file blue_file]"
+    << " [-verbose]"
     << std::endl
     << "  This program produces on standard output an example angles"
-    << " to display location file with a 90 degree field of view and."
-    << " no distortion."
+    << " to display location file with the specified field of view"
+    << " sampled on a regular grid of x_count by y_count points."
+    << std::endl
+    << "  The screen location of each point is moved radially from where"
+    << " it would be with no distortion by the factor"
+    << " 1 + k1 r^2 + k2 r^4 + ..., where r is its undistorted distance"
+    << " from the center.  Gaussian noise with the specified standard"
+    << " deviation is then added to each screen coordinate, and the"
+    << " specified fraction of the points is moved to random locations"
+    << " within the distorted screen to simulate bad samples."
+    << std::endl
+    << "  With -rgb, one file is written for each color using that color's"
+    << " distortion, rather than a single table on standard output."
     << std::endl;
   exit(1);
 }
 
+// Parse a comma-separated list of coefficients.
+static bool parse_coefficients(const std::string &list,
+  std::vector<double> &coefs)
+{
+  coefs.clear();
+  std::istringstream in(list);
+  std::string item;
+  while (std::getline(in, item, ',')) {
+    char *end;
+    double value = strtod(item.c_str(), &end);
+    if (item.empty() || (*end != '\0')) {
+      return false;
+    }
+    coefs.push_back(value);
+  }
+  return true;
+}
+
+// Write the table for one color to the stream.
+static void write_mesh(std::ostream &out, double xFOVDeg, double yFOVDeg,
+  long xCount, long yCount, std::vector<double> const &coefs,
+  double noise, double outlierFraction, unsigned seed)
+{
+  // Produce a mesh with the specified number of elements in X and
+  // Y that cover the specified total FOV in X and Y.
+  double xMin = - xFOVDeg / 2;
+  double xStep = xFOVDeg / (xCount - 1);
+  double yMin = - yFOVDeg / 2;
+  double yStep = yFOVDeg / (yCount - 1);
+
+  // Distortion is radial, so the largest screen coordinates are found
+  // at the edges of the field of view along each axis.  Outliers are
+  // placed anywhere within these bounds.
+  double xMax = tan(xFOVDeg / 2 * MY_PI / 180);
+  double yMax = tan(yFOVDeg / 2 * MY_PI / 180);
+  double rr = xMax * xMax + yMax * yMax;
+  double scale = 1, power = 1;
+  for (size_t i = 0; i < coefs.size(); i++) {
+    power *= rr;
+    scale += coefs[i] * power;
+  }
+  xMax *= fabs(scale);
+  yMax *= fabs(scale);
+
+  std::mt19937 rng(seed);
+  std::normal_distribution<double> gauss(0.0, noise > 0 ? noise : 1.0);
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+  for (long x = 0; x < xCount; x++) {
+    double xDeg = xMin + x * xStep;
+    double xRad = xDeg * MY_PI / 180;
+    for (long y = 0; y < yCount; y++) {
+      double yDeg = yMin + y * yStep;
+      double yRad = yDeg * MY_PI / 180;
+      double sx = tan(xRad);
+      double sy = tan(yRad);
+
+      if (!coefs.empty()) {
+        double r2 = sx * sx + sy * sy;
+        double factor = 1, p = 1;
+        for (size_t i = 0; i < coefs.size(); i++) {
+          p *= r2;
+          factor += coefs[i] * p;
+        }
+        sx *= factor;
+        sy *= factor;
+      }
+      if (noise > 0) {
+        sx += gauss(rng);
+        sy += gauss(rng);
+      }
+      if ((outlierFraction > 0) && (unit(rng) < outlierFraction)) {
+        sx = xMax * (2 * unit(rng) - 1);
+        sy = yMax * (2 * unit(rng) - 1);
+      }
+
+      out << xDeg << " " << yDeg << " " << sx << " " << sy << "\n";
+    }
+  }
+}
+
 int main(int argc, char *argv[])
 {
   // Set defaults
   double xFOVDeg = 90.0;
   double yFOVDeg = 90.0;
-  int xCount = 11;
-  int yCount = 11;
+  long xCount = 11;
+  long yCount = 11;
+  std::vector<double> coefs[3];
+  double noise = 0;
+  double outlierFraction = 0;
+  unsigned seed = 1;
+  std::vector<std::string> rgbFileNames;
 
   // Parse the command line
-  int realParams = 0;
   for (int i = 1; i < argc; i++) {
     if (std::string("-verbose") == argv[i]) {
       g_verbose = true;
-    } else if ((argv[i][0] == '-') && (atof(argv[i]) == 0.0)) {
+    } else if (std::string("-fov") == argv[i]) {
+      if (i + 2 >= argc) { Usage(argv[0]); }
+      xFOVDeg = atof(argv[++i]);
+      yFOVDeg = atof(argv[++i]);
+      if ((xFOVDeg <= 0) || (xFOVDeg >= 180) || (yFOVDeg <= 0) || (yFOVDeg >= 180)) {
+        std::cerr << "Bad value for -fov: each must be between 0 and 180 degrees"
+          << std::endl;
+        Usage(argv[0]);
+      }
+    } else if (std::string("-grid") == argv[i]) {
+      if (i + 2 >= argc) { Usage(argv[0]); }
+      xCount = atol(argv[++i]);
+      yCount = atol(argv[++i]);
+      if ((xCount < 2) || (yCount < 2)) {
+        std::cerr << "Bad value for -grid: each count must be at least 2"
+          << std::endl;
+        Usage(argv[0]);
+      }
+    } else if ((std::string("-distortion") == argv[i]) ||
+               (std::string("-distortion_red") == argv[i]) ||
+               (std::string("-distortion_green") == argv[i]) ||
+               (std::string("-distortion_blue") == argv[i])) {
+      std::string flag = argv[i];
+      if (++i >= argc) { Usage(argv[0]); }
+      std::vector<double> values;
+      if (!parse_coefficients(argv[i], values)) {
+        std::cerr << "Bad value for " << flag << ": " << argv[i]
+          << ", expected comma-separated numbers" << std::endl;
+        Usage(argv[0]);
+      }
+      for (int c = 0; c < 3; c++) {
+        if ((flag == "-distortion") ||
+            (flag == std::string("-distortion_") + COLOR_NAMES[c])) {
+          coefs[c] = values;
+        }
+      }
+    } else if (std::string("-noise") == argv[i]) {
+      if (++i >= argc) { Usage(argv[0]); }
+      noise = atof(argv[i]);
+      if (noise < 0) { Usage(argv[0]); }
+    } else if (std::string("-outliers") == argv[i]) {
+      if (++i >= argc) { Usage(argv[0]); }
+      outlierFraction = atof(argv[i]);
+      if ((outlierFraction < 0) || (outlierFraction > 1)) {
+        std::cerr << "Bad value for -outliers: must be between 0 and 1"
+          << std::endl;
+        Usage(argv[0]);
+      }
+    } else if (std::string("-seed") == argv[i]) {
+      if (++i >= argc) { Usage(argv[0]); }
+      seed = static_cast<unsigned>(atol(argv[i]));
+    } else if (std::string("-rgb") == argv[i]) {
+      if (i + 3 >= argc) { Usage(argv[0]); }
+      rgbFileNames.clear();
+      for (int c = 0; c < 3; c++) {
+        rgbFileNames.push_back(argv[++i]);
+      }
+    } else {
       Usage(argv[0]);
     }
-    else switch (++realParams) {
-    case 1:
-    default:
-      Usage(argv[0]);
+  }
+  if (g_verbose) {
+    std::cerr << "Writing " << xCount * yCount << " points per table"
+      << std::endl;
+  }
+
+  // Without -rgb, we write the green table (which is the same as the
+  // others unless only some colors were given distortion).  Standard
+  // output keeps its own buffer once it no longer has to stay in step
+  // with C stdio; giving it ours would leave it pointing at freed
+  // memory when it is flushed at exit.
+  if (rgbFileNames.empty()) {
+    std::ios::sync_with_stdio(false);
+    write_mesh(std::cout, xFOVDeg, yFOVDeg, xCount, yCount, coefs[1],
+      noise, outlierFraction, seed);
+    std::cout.flush();
+    if (!std::cout) {
+      std::cerr << "Error writing to standard output" << std::endl;
+      return 2;
     }
+    return 0;
   }
-  if (realParams != 0) { Usage(argv[0]); }
 
-  // Produce a mesh with the specified number of elements in X and
-  // Y that cover the specified total FOV in X and Y.
-  double xMin = - xFOVDeg / 2;
-  double xStep = xFOVDeg / (xCount - 1);
-  double yMin = - yFOVDeg / 2;
-  double yStep = yFOVDeg / (yCount - 1);
-  for (int x = 0; x < xCount; x++) {
-    double xDeg = xMin + x * xStep;
-    double xRad = xDeg * MY_PI / 180;
-    for (int y = 0; y < yCount; y++) {
-      double yDeg = yMin + y * yStep;
-      double yRad = yDeg * MY_PI / 180;
-      std::cout << xDeg << " " << yDeg << " "
-        << tan(xRad) << " " << tan(yRad) << std::endl;
+  // Each color gets its own noise and outliers.  Each file's stream is
+  // closed before the buffer goes away.
+  std::vector<char> buffer(OUTPUT_BUFFER_SIZE);
+  for (int c = 0; c < 3; c++) {
+    std::ofstream out;
+    out.rdbuf()->pubsetbuf(&buffer[0], buffer.size());
+    out.open(rgbFileNames[c].c_str());
+    if (!out) {
+      std::cerr << "Error: Could not open " << rgbFileNames[c]
+        << " for writing" << std::endl;
+      return 3;
+    }
+    write_mesh(out, xFOVDeg, yFOVDeg, xCount, yCount, coefs[c],
+      noise, outlierFraction, seed + c);
+    out.close();
+    if (!out) {
+      std::cerr << "Error writing " << rgbFileNames[c] << std::endl;
+      return 4;
     }
   }
 
@@ -0,0 +1,82 @@
+/** @file
+    @brief Reduced-precision storage for distortion meshes.
+
+    @date 2016
+
+    @author
+    Russ Taylor working through ReliaSolve.com for Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Internal Includes
+#include "compact_mesh.h"
+
+// Standard includes
+#include <cmath>
+
+void CompactMesh::assign(MeshDescription const &mesh, MeshPrecision p)
+{
+  precision = p;
+  floats.clear();
+  quantized.clear();
+  if (precision != MESH_UINT16) {
+    precision = MESH_FLOAT32;
+    floats.resize(4 * mesh.size());
+    for (size_t i = 0; i < mesh.size(); i++) {
+      for (size_t j = 0; j < 4; j++) {
+        floats[4 * i + j] = static_cast<float>(mesh[i][j / 2][j % 2]);
+      }
+    }
+    return;
+  }
+
+  // Find the range of each coordinate, so that we can spread the steps
+  // over it.  A coordinate with a single value gets a step of 0.
+  for (size_t j = 0; j < 4; j++) {
+    double lo = 0, hi = 0;
+    for (size_t i = 0; i < mesh.size(); i++) {
+      double v = mesh[i][j / 2][j % 2];
+      if ((i == 0) || (v < lo)) { lo = v; }
+      if ((i == 0) || (v > hi)) { hi = v; }
+    }
+    offset[j] = lo;
+    step[j] = (hi - lo) / 65535;
+  }
+
+  quantized.resize(4 * mesh.size());
+  for (size_t i = 0; i < mesh.size(); i++) {
+    for (size_t j = 0; j < 4; j++) {
+      double q = 0;
+      if (step[j] > 0) {
+        q = floor((mesh[i][j / 2][j % 2] - offset[j]) / step[j] + 0.5);
+        if (q < 0) { q = 0; }
+        if (q > 65535) { q = 65535; }
+      }
+      quantized[4 * i + j] = static_cast<uint16_t>(q);
+    }
+  }
+}
+
+void CompactMesh::copyTo(MeshDescription &mesh) const
+{
+  mesh.resize(size());
+  for (size_t i = 0; i < mesh.size(); i++) {
+    for (size_t j = 0; j < 4; j++) {
+      mesh[i][j / 2][j % 2] = value(i, j);
+    }
+  }
+}
@@ -0,0 +1,76 @@
+/** @file
+    @brief Reduced-precision storage for distortion meshes.
+
+    @date 2016
+
+    @author
+    Russ Taylor working through ReliaSolve.com for Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "types.h"
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+/// How the values in a finished mesh are stored.
+enum MeshPrecision {
+  MESH_DOUBLE,    //!< As the MeshDescription holds them
+  MESH_FLOAT32,   //!< 32-bit floats, half the size
+  MESH_UINT16     //!< 16-bit values spread over each coordinate's range
+};
+
+/// Holds the same information as a MeshDescription, but in 32-bit floats
+/// or in 16-bit integers.  The mesh is written at four significant digits
+/// and used by the GPU as floats, so MESH_FLOAT32 only changes a printed
+/// value that falls almost exactly halfway between two four-digit
+/// numbers.  MESH_UINT16 spreads 65536 steps over the range of each
+/// of the four coordinates (in x, in y, out x, out y) in the mesh, which
+/// is about five significant digits for the normalized coordinates but
+/// can change the last printed digit of some values.
+///   Entry (i, j) is coordinate j of sample i, in the order in x, in y,
+/// out x, out y.
+class CompactMesh {
+public:
+  MeshPrecision precision = MESH_FLOAT32;
+  std::vector<float> floats;          //< Four per sample for MESH_FLOAT32
+  std::vector<uint16_t> quantized;    //< Four per sample for MESH_UINT16
+  double offset[4] = { 0, 0, 0, 0 };  //< Value of 0 for each coordinate
+  double step[4] = { 0, 0, 0, 0 };    //< Value of each step above that
+
+  size_t size() const {
+    return (precision == MESH_UINT16 ? quantized.size() : floats.size()) / 4;
+  }
+  bool empty() const { return size() == 0; }
+
+  /// Replace the contents with a mesh stored at the specified precision,
+  /// which must not be MESH_DOUBLE.
+  void assign(MeshDescription const &mesh, MeshPrecision p);
+
+  /// Copy the contents into a mesh, replacing what was there.
+  void copyTo(MeshDescription &mesh) const;
+
+  /// Coordinate j of sample i.
+  double value(size_t i, size_t j) const {
+    if (precision == MESH_UINT16) {
+      return offset[j] + step[j] * quantized[4 * i + j];
+    }
+    return floats[4 * i + j];
+  }
+};
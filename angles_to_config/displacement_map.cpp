@@ -0,0 +1,169 @@
+/** @file
+    @brief Bakes distortion meshes into per-pixel displacement maps and
+           writes them as a packed binary file.
+
+    @date 2016
+
+    @author
+    Russ Taylor working through ReliaSolve.com for Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Internal Includes
+#include "displacement_map.h"
+#include "file_util.h"
+
+// Standard includes
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+
+bool bake_displacement_map(const MeshDescription &mesh,
+  size_t width, size_t height, std::vector<float> &texels,
+  ResampleReport &report)
+{
+  texels.clear();
+  MeshDescription grid;
+  if (!resample_mesh(mesh, width, height, grid, report)) {
+    return false;
+  }
+
+  // The grid holds only the points that were filled in, with their
+  // locations exactly at i / (width - 1), j / (height - 1).
+  texels.assign(2 * width * height, DISPLACEMENT_MAP_OUTSIDE);
+  for (size_t g = 0; g < grid.size(); g++) {
+    size_t i = static_cast<size_t>(floor(grid[g][0][0] * (width - 1) + 0.5));
+    size_t j = static_cast<size_t>(floor(grid[g][0][1] * (height - 1) + 0.5));
+    size_t t = 2 * (j * width + i);
+    texels[t + 0] = static_cast<float>(grid[g][1][0] - grid[g][0][0]);
+    texels[t + 1] = static_cast<float>(grid[g][1][1] - grid[g][0][1]);
+  }
+  return true;
+}
+
+uint16_t float_to_half(float f)
+{
+  uint32_t u;
+  memcpy(&u, &f, sizeof(u));
+  uint32_t sign = (u >> 16) & 0x8000;
+  uint32_t biased = (u >> 23) & 0xff;
+  uint32_t mantissa = u & 0x7fffff;
+  if (biased == 0xff) {
+    // Infinity stays infinity and NaN stays NaN.
+    return static_cast<uint16_t>(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+  }
+  int exponent = static_cast<int>(biased) - 127 + 15;
+  if (exponent >= 31) {
+    return static_cast<uint16_t>(sign | 0x7c00);
+  }
+
+  // Normal halves keep 10 of the 23 mantissa bits; subnormal ones shift
+  // the mantissa (with its leading 1) further.  Rounding up can carry
+  // into the exponent, which gives the right answer.
+  uint32_t half, shift;
+  if (exponent > 0) {
+    half = (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+    shift = 13;
+  } else {
+    if (exponent < -10) { return static_cast<uint16_t>(sign); }
+    mantissa |= 0x800000;
+    shift = static_cast<uint32_t>(14 - exponent);
+    half = mantissa >> shift;
+  }
+  uint32_t rest = mantissa & ((1u << shift) - 1);
+  uint32_t halfway = 1u << (shift - 1);
+  if ((rest > halfway) || ((rest == halfway) && (half & 1))) {
+    half++;
+  }
+  return static_cast<uint16_t>(sign | half);
+}
+
+bool write_displacement_maps(const std::string &fileName,
+  Displacement_Map_Format format, size_t width, size_t height,
+  std::vector<std::vector<float> const *> const &maps)
+{
+  if (((maps.size() != 2) && (maps.size() != 6)) || (width < 2) || (height < 2)) {
+    std::cerr << "write_displacement_maps(): Error: Need 2 or 6 maps of at"
+      " least 2x2, got " << maps.size() << " of " << width << "x" << height
+      << std::endl;
+    return false;
+  }
+  for (size_t m = 0; m < maps.size(); m++) {
+    if (maps[m]->size() != 2 * width * height) {
+      std::cerr << "write_displacement_maps(): Error: Map " << m << " has "
+        << maps[m]->size() / 2 << " texels, expected " << width * height
+        << std::endl;
+      return false;
+    }
+  }
+
+  Displacement_Map_Header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, DISPLACEMENT_MAP_MAGIC, sizeof(header.magic));
+  header.byteOrder = DISPLACEMENT_MAP_BYTE_ORDER;
+  header.format = format;
+  header.width = static_cast<uint32_t>(width);
+  header.height = static_cast<uint32_t>(height);
+  header.eyes = 2;
+  header.colors = static_cast<uint32_t>(maps.size() / 2);
+  size_t texelBytes = displacement_map_texel_bytes(format);
+  header.mapBytes = static_cast<uint64_t>(width) * height * texelBytes;
+
+  std::string tempName;
+  FILE *f = open_replacement_file(fileName, tempName);
+  if (f == NULL) {
+    std::cerr << "write_displacement_maps(): Error: Could not open "
+      << tempName << " for writing" << std::endl;
+    return false;
+  }
+
+  // The header, then each map in turn, converted a row at a time and
+  // padded out to where the next one starts.
+  std::vector<unsigned char> padding(DISPLACEMENT_MAP_ALIGNMENT, 0);
+  bool ok = (fwrite(&header, sizeof(header), 1, f) == 1);
+  uint64_t written = sizeof(header);
+  std::vector<unsigned char> row(width * texelBytes);
+  for (size_t m = 0; ok && (m < maps.size()); m++) {
+    uint64_t start = displacement_map_offset(header,
+      static_cast<unsigned>(m / header.colors),
+      static_cast<unsigned>(m % header.colors));
+    ok = (fwrite(padding.data(), 1, static_cast<size_t>(start - written), f)
+      == start - written);
+    written = start;
+    std::vector<float> const &texels = *maps[m];
+    for (size_t j = 0; ok && (j < height); j++) {
+      const float *src = &texels[2 * j * width];
+      if (format == DISPLACEMENT_RG16F) {
+        for (size_t v = 0; v < 2 * width; v++) {
+          uint16_t h = float_to_half(src[v]);
+          memcpy(&row[2 * v], &h, sizeof(h));
+        }
+      } else {
+        memcpy(row.data(), src, row.size());
+      }
+      ok = (fwrite(row.data(), 1, row.size(), f) == row.size());
+      written += row.size();
+    }
+  }
+  if (!finish_replacement_file(f, ok, tempName, fileName)) {
+    std::cerr << "write_displacement_maps(): Error: Could not write "
+      << fileName << std::endl;
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,59 @@
+/** @file
+    @brief Bakes distortion meshes into per-pixel displacement maps and
+           writes them as a packed binary file.
+
+    @date 2016
+
+    @author
+    Russ Taylor working through ReliaSolve.com for Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "types.h"
+#include "resample.h"
+#include "displacement_map_file.h"
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+/// Bake a mesh into a width by height displacement map, laid out as
+/// described in displacement_map_file.h: two floats (out - in, in x and
+/// y) per texel, in rows from the bottom.  The value at each texel comes
+/// from resample_mesh(), so texels that the mesh's samples don't surround
+/// get DISPLACEMENT_MAP_OUTSIDE, and the report tells how well the map
+/// reproduces the samples.
+/// @return false (after describing the problem on std::cerr) if the map
+/// is smaller than 2 by 2 or there are not enough samples.
+extern bool bake_displacement_map(const MeshDescription &mesh,
+  size_t width, size_t height, std::vector<float> &texels,
+  ResampleReport &report);
+
+/// The IEEE half-precision value nearest to f, rounding ties to even.
+extern uint16_t float_to_half(float f);
+
+/// Write baked maps to a displacement map file, converting them to the
+/// format as they are written.  The maps are the left eye's for each
+/// color and then the right eye's, all width by height.  The file is
+/// written under a temporary name and then renamed, so readers never
+/// see a partial file.
+/// @return false (after describing the problem on std::cerr) on failure.
+extern bool write_displacement_maps(const std::string &fileName,
+  Displacement_Map_Format format, size_t width, size_t height,
+  std::vector<std::vector<float> const *> const &maps);
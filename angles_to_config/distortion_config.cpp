@@ -0,0 +1,683 @@
+/** @file
+    @brief Builds the screens and distortion meshes for both eyes from
+           mappings that are already in memory, and writes them as a
+           partial OSVR display configuration.
+
+    @date 2016
+
+    @author
+    Russ Taylor working through ReliaSolve.com for Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Internal Includes
+#include "distortion_config.h"
+#include "mapping_cache.h"
+#include "parallel.h"
+
+// Standard includes
+#include <string>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+
+// Append the base-64 encoding of the bytes to a string.
+static void appendBase64(std::string &out, std::vector<unsigned char> const &bytes)
+{
+  static const char digits[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  out.reserve(out.size() + 4 * ((bytes.size() + 2) / 3));
+  for (size_t i = 0; i < bytes.size(); i += 3) {
+    size_t left = bytes.size() - i;
+    unsigned long v = static_cast<unsigned long>(bytes[i]) << 16;
+    if (left > 1) { v |= static_cast<unsigned long>(bytes[i + 1]) << 8; }
+    if (left > 2) { v |= bytes[i + 2]; }
+    out += digits[(v >> 18) & 0x3f];
+    out += digits[(v >> 12) & 0x3f];
+    out += (left > 1) ? digits[(v >> 6) & 0x3f] : '=';
+    out += (left > 2) ? digits[v & 0x3f] : '=';
+  }
+}
+
+// Coordinate j of sample i in a mesh, in the order in x, in y, out x,
+// out y, so that writeMesh() can read either kind of mesh.
+static inline double meshValue(MeshDescription const &mesh, size_t i, size_t j)
+{
+  return mesh[i][j / 2][j % 2];
+}
+static inline double meshValue(CompactMesh const &mesh, size_t i, size_t j)
+{
+  return mesh.value(i, j);
+}
+
+// Write a mesh into the configuration file.  The text version prints
+// each number the way an ostream with precision 4 does, but formats the
+// whole mesh into one buffer and writes it at once rather than streaming
+// (and flushing) each line.  The base-64 version writes a single string
+// holding the in x, in y, out x, out y values for each entry in order.
+template <class MESH>
+static void writeMesh(std::ostream &s, MESH const &mesh,
+  MeshFormat format = MESH_TEXT)
+{
+  // The rest of the configuration file is printed at this precision.
+  s << std::setprecision(4);
+
+  std::string buffer;
+  if (format == MESH_BASE64) {
+    std::vector<unsigned char> bytes;
+    bytes.reserve(mesh.size() * 4 * 4);
+    for (size_t i = 0; i < mesh.size(); i++) {
+      for (size_t j = 0; j < 4; j++) {
+        float f = static_cast<float>(meshValue(mesh, i, j));
+        uint32_t u;
+        memcpy(&u, &f, sizeof(u));
+        for (int b = 0; b < 4; b++) {
+          bytes.push_back(static_cast<unsigned char>((u >> (8 * b)) & 0xff));
+        }
+      }
+    }
+    buffer = "\"";
+    appendBase64(buffer, bytes);
+    buffer += "\"\n";
+  } else {
+    // Each line is at most 4 numbers of at most 11 characters plus 16
+    // characters of punctuation.
+    buffer.reserve(4 + 64 * mesh.size());
+    buffer = "[\n";
+    char line[128];
+    for (size_t i = 0; i < mesh.size(); i++) {
+      int len = snprintf(line, sizeof(line), "%s[ [%.4g,%.4g], [%.4g,%.4g] ]\n",
+        (i == 0) ? " " : ",",
+        meshValue(mesh, i, 0), meshValue(mesh, i, 1),
+        meshValue(mesh, i, 2), meshValue(mesh, i, 3));
+      buffer.append(line, len);
+    }
+    buffer += "]\n";
+  }
+  s.write(buffer.data(), buffer.size());
+}
+
+int load_mapping(const char *data, size_t length,
+  std::string const &fileName, size_t index, bool cacheable,
+  const MappingLoadOptions &load, const DistortionConfigOptions &opts,
+  std::vector<Mapping> &mapping, std::vector<AngleTerms> &terms)
+{
+  //====================================================================
+  // Expect white-space separation between numbers and also between
+  // entries (which may be on separate lines).
+  //   If we're using cache files, one whose key matches the input
+  // file contents and settings holds the same points that we'd get from
+  // parsing and verifying, and also their angle terms, so we use it
+  // instead.
+  bool useCache = load.useCache && cacheable;
+  bool cached = false;
+  uint64_t key = 0;
+  terms.clear();
+  if (useCache) {
+    key = mapping_cache_key(data, length, load.verifyAngles,
+      load.xx, load.xy, load.yx, load.yy, load.maxAngleDiffDegrees,
+      load.outlierMode == OUTLIERS_LOCAL);
+    std::string cacheName = mapping_cache_name(fileName);
+    cached = read_mapping_cache(cacheName, key, mapping, terms);
+    if (opts.verbose) {
+      std::cerr << (cached ? "Using" : "Not using")
+        << " cache file " << cacheName << std::endl;
+    }
+  }
+  if (!cached) {
+    mapping = parse_mapping(data, length, fileName);
+  }
+  if (opts.verbose) {
+    std::cerr << "Found " << mapping.size() << " points in "
+      << fileName << std::endl;
+  }
+  if (mapping.size() == 0) {
+    std::cerr << "Error: No input points found in " << fileName
+      << std::endl;
+    return 2;
+  }
+  if (cached) { return 0; }
+
+  //====================================================================
+  // If we've been asked to verify the angles on the meshes, do so now.
+  // This makes sure that the direction between neighbors in angle space
+  // is consistent with their direction in screen space, removing points
+  // that don't satisfy the criterion.  This removes inconsistent points
+  // from the simulation (caused by multiple ray bounces or other
+  // singularities in the simulation).
+  if (load.verifyAngles) {
+    int ret;
+    if (load.outlierMode == OUTLIERS_LOCAL) {
+      ret = remove_invalid_points_locally(mapping, load.xx, load.xy,
+        load.yx, load.yy, load.maxAngleDiffDegrees, opts.numThreads);
+    } else {
+      ret = remove_invalid_points_based_on_angle(mapping, load.xx, load.xy,
+        load.yx, load.yy, load.maxAngleDiffDegrees);
+    }
+    if (ret < 0) {
+      std::cerr << "Error verifying angles for mesh "
+        << index << std::endl;
+      return 60;
+    }
+    if (opts.verbose) {
+      std::cerr << "Removed " << ret
+        << " points from mesh " << index << std::endl;
+    }
+  }
+
+  //====================================================================
+  // Fill in the cache file if the mapping didn't come from one.
+  // Failing to write it doesn't keep us from producing our output.
+  if (useCache) {
+    compute_angle_terms(mapping, terms);
+    std::string cacheName = mapping_cache_name(fileName);
+    if (!write_mapping_cache(cacheName, key, mapping, terms)) {
+      std::cerr << "Warning: Could not write cache file " << cacheName
+        << std::endl;
+    } else if (opts.verbose) {
+      std::cerr << "Wrote cache file " << cacheName << std::endl;
+    }
+  }
+
+  return 0;
+}
+
+void compute_mapping_bounds(
+  const std::vector<std::vector<Mapping> const *> &mappings, double toMeters,
+  double &left, double &bottom, double &right, double &top)
+{
+  left = right = (*mappings[0])[0].xyLatLong.x;
+  bottom = top = (*mappings[0])[0].xyLatLong.y;
+  for (size_t m = 0; m < mappings.size(); m++) {
+    std::vector<Mapping> const &mapping = *mappings[m];
+    for (size_t i = 1; i < mapping.size(); i++) {
+      double x = mapping[i].xyLatLong.x;
+      double y = mapping[i].xyLatLong.y;
+      if (x < left) { left = x; }
+      if (x > right) { right = x; }
+      if (y < bottom) { bottom = y; }
+      if (y > top) { top = y; }
+    }
+  }
+  left *= toMeters;
+  right *= toMeters;
+  bottom *= toMeters;
+  top *= toMeters;
+}
+
+// Negating the longitude negates its sine and tangent and leaves its
+// cosine unchanged.
+std::vector<AngleTerms> reflect_angle_terms(
+  std::vector<AngleTerms> const &terms)
+{
+  std::vector<AngleTerms> ret(terms);
+  for (size_t i = 0; i < ret.size(); i++) {
+    ret[i].tanLong *= -1;
+    ret[i].sinTheta *= -1;
+  }
+
+  return ret;
+}
+
+int prepare_eye_mappings(
+  const std::vector<std::vector<Mapping> const *> &mappings,
+  const std::vector<std::vector<AngleTerms> const *> &terms,
+  const DistortionConfigOptions &opts, DistortionConfig &config)
+{
+  size_t numColors = mappings.size();
+  if ((numColors == 0) || (terms.size() != numColors)) {
+    std::cerr << "Error: Expected one set of angle terms per mapping"
+      << std::endl;
+    return 3;
+  }
+  bool useRightEye = opts.useRightEye;
+
+  //====================================================================
+  // Compute a left- and right-eye mappings that are mirrors of each
+  // other, so that we can produce distortion maps for both eyes.
+  // Each color for each eye is independent, so we do them all at once:
+  // job 2*i is the left eye for color i and job 2*i+1 is the right eye.
+  //   The original mappings are converted directly into the structure of
+  // arrays for each eye, mirroring in place for the opposite eye.  The
+  // conversion needs the screen boundaries, which when we auto-range
+  // depend on the points in all of the colors.  So each job copies its
+  // mapping and finds its bounds in one pass, and the conversion (which
+  // also checks the results) is a second pass once the bounds are known.
+  // Without auto-ranging, each job does both passes right away.
+  config.leftMappings.assign(numColors, MappingSet());
+  config.rightMappings.assign(numColors, MappingSet());
+  std::vector<double> colorBounds(4 * numColors, 0);
+  auto convertJob = [&](size_t job) {
+    size_t i = job / 2;
+    bool doLeft = (job % 2 == 0);
+
+    //====================================================================
+    // Make an inverse mapping for the opposite eye.  Invert around X in
+    // angle and viewing direction.  Depending on whether we are using the
+    // left or right eye, set the eyes appropriately.
+    //  The screen boundaries for each are inverted around X = 0 by
+    // setScreens().
+    //  The angle terms (if we have them) for the eye we were given are
+    // used as they are; only the opposite eye needs a mirrored copy.
+    MappingSet &eyeMapping = doLeft ? config.leftMappings[i]
+      : config.rightMappings[i];
+    const std::vector<AngleTerms> *eyeTerms = NULL;
+    std::vector<AngleTerms> reflectedTerms;
+    bool haveTerms = (terms[i] != NULL) && !terms[i]->empty();
+    if (doLeft != useRightEye) {
+      eyeTerms = terms[i];
+    } else if (haveTerms) {
+      reflectedTerms = reflect_angle_terms(*terms[i]);
+      eyeTerms = &reflectedTerms;
+    }
+
+    //====================================================================
+    // Convert the input values into normalized coordinates and into 3D
+    // locations.  Use the cached angle terms when we have them.
+    if (!haveTerms) {
+      eyeTerms = NULL;
+    }
+    if (doLeft) {
+      convert_to_normalized_and_meters(eyeMapping, opts.toMeters, opts.depth,
+        config.leftScreenLeft, config.leftScreenBottom,
+        config.leftScreenRight, config.leftScreenTop,
+        opts.useFieldAngles, eyeTerms);
+    } else {
+      convert_to_normalized_and_meters(eyeMapping, opts.toMeters, opts.depth,
+        config.rightScreenLeft, config.rightScreenBottom,
+        config.rightScreenRight, config.rightScreenTop,
+        opts.useFieldAngles, eyeTerms);
+    }
+  };
+
+  auto setScreens = [&](double left, double bottom, double right, double top) {
+    if (opts.verbose) {
+      std::cerr << "Left, bottom, right, top = " << left << ", "
+        << bottom << ", " << right << ", " << top << std::endl;
+    }
+
+    //====================================================================
+    // Compute left and right screen boundaries that are mirror images
+    // of each other.
+    config.rightScreenBottom = config.leftScreenBottom = bottom;
+    config.rightScreenTop = config.leftScreenTop = top;
+    if (useRightEye) {
+      config.rightScreenLeft = left;
+      config.rightScreenRight = right;
+
+      config.leftScreenLeft = -right;
+      config.leftScreenRight = -left;
+    } else {
+      config.leftScreenLeft = left;
+      config.leftScreenRight = right;
+
+      config.rightScreenLeft = -right;
+      config.rightScreenRight = -left;
+    }
+  };
+
+  if (!opts.computeBounds) {
+    setScreens(opts.left, opts.bottom, opts.right, opts.top);
+  }
+  run_in_parallel(2 * numColors, opts.numThreads, [&](size_t job) {
+    size_t i = job / 2;
+    bool doLeft = (job % 2 == 0);
+    bool reflect = (doLeft == useRightEye);
+    MappingSet &eyeMapping = doLeft ? config.leftMappings[i]
+      : config.rightMappings[i];
+    double minX, minY, maxX, maxY;
+    eyeMapping.assign(*mappings[i], reflect, 1, minX, minY, maxX, maxY);
+    if (!reflect && (mappings[i]->size() > 1)) {
+      colorBounds[4 * i + 0] = minX;
+      colorBounds[4 * i + 1] = minY;
+      colorBounds[4 * i + 2] = maxX;
+      colorBounds[4 * i + 3] = maxY;
+    }
+    if (!opts.computeBounds) {
+      convertJob(job);
+    }
+  });
+
+  //====================================================================
+  // If we've been asked to auto-range the screen coordinates, compute
+  // them here.  Combine the bounds from all of the colors to make a bound
+  // on all of them, the same way that compute_mapping_bounds() does:
+  // start from the first point of the first color and then include all
+  // but the first point of each color.  Then convert.
+  if (opts.computeBounds) {
+    double left = 0, bottom = 0, right = 0, top = 0;
+    if (!mappings[0]->empty()) {
+      left = right = (*mappings[0])[0].xyLatLong.x;
+      bottom = top = (*mappings[0])[0].xyLatLong.y;
+    }
+    for (size_t i = 0; i < numColors; i++) {
+      if (mappings[i]->size() < 2) { continue; }
+      const double *b = &colorBounds[4 * i];
+      if (b[0] < left) { left = b[0]; }
+      if (b[1] < bottom) { bottom = b[1]; }
+      if (b[2] > right) { right = b[2]; }
+      if (b[3] > top) { top = b[3]; }
+    }
+    setScreens(left * opts.toMeters, bottom * opts.toMeters,
+      right * opts.toMeters, top * opts.toMeters);
+    run_in_parallel(2 * numColors, opts.numThreads, convertJob);
+  }
+
+  return 0;
+}
+
+int find_eye_screens(const DistortionConfigOptions &opts,
+  DistortionConfig &config)
+{
+  //====================================================================
+  // Determine the screen boundaries using all points for all colors, in
+  // a manner that encompasses all of them.  This is where the colors come
+  // together; the two eyes are still independent of each other.
+  MappingSetList leftFullMapping, rightFullMapping;
+  for (size_t i = 0; i < config.leftMappings.size(); i++) {
+    leftFullMapping.push_back(&config.leftMappings[i]);
+    rightFullMapping.push_back(&config.rightMappings[i]);
+  }
+  bool screenFound[2];
+  run_in_parallel(2, opts.numThreads, [&](size_t job) {
+    if (job == 0) {
+      screenFound[0] = findScreen(leftFullMapping, config.leftScreenLeft,
+        config.leftScreenBottom, config.leftScreenRight, config.leftScreenTop,
+        config.leftScreen, opts.verbose);
+    } else {
+      screenFound[1] = findScreen(rightFullMapping, config.rightScreenLeft,
+        config.rightScreenBottom, config.rightScreenRight,
+        config.rightScreenTop, config.rightScreen, opts.verbose);
+    }
+  });
+  if (!screenFound[0]) {
+    std::cerr << "Error: Could not find left screen" << std::endl;
+    return 3;
+  }
+  if (opts.verbose) {
+    std::cerr << "Left screen L B R T: " << config.leftScreenLeft
+      << ", " << config.leftScreenBottom
+      << ", " << config.leftScreenRight
+      << ", " << config.leftScreenTop << std::endl;
+  }
+
+  if (!screenFound[1]) {
+    std::cerr << "Error: Could not find right screen" << std::endl;
+    return 5;
+  }
+
+  return 0;
+}
+
+int find_eye_meshes(const DistortionConfigOptions &opts,
+  DistortionConfig &config, MeshBackend *backend)
+{
+  size_t numColors = config.leftMappings.size();
+  size_t resampleX = opts.resampleX, resampleY = opts.resampleY;
+  std::vector<MappingSet> const &leftMappings = config.leftMappings;
+  std::vector<MappingSet> const &rightMappings = config.rightMappings;
+  std::vector<MeshDescription> &leftMeshes = config.leftMeshes;
+  std::vector<MeshDescription> &rightMeshes = config.rightMeshes;
+
+  //====================================================================
+  // Compute the three colored mappings based on the screen boundaries
+  // we found above, again one job per color per eye.
+  //   Determine the screen description and distortion mesh based on the
+  // input points and screen parameters.
+  // This will re-compute the screen each time, but it will get the same
+  // answer because we're using the same bounds for each of them.
+  leftMeshes.assign(numColors, MeshDescription());
+  rightMeshes.assign(numColors, MeshDescription());
+  //   If we've been asked to resample the meshes onto a grid, that's done
+  // here as well and the grid replaces the mesh.
+  std::vector<int> meshResults(2 * numColors, 0);
+  config.resampleReports.assign((resampleX > 0) ? 2 * numColors : 0,
+    ResampleReport());
+  //   Displacement maps are baked from the full mesh, before any of that.
+  size_t mapX = opts.displacementMapX, mapY = opts.displacementMapY;
+  size_t numMaps = (mapX > 0) ? numColors : 0;
+  config.leftDisplacementMaps.assign(numMaps, std::vector<float>());
+  config.rightDisplacementMaps.assign(numMaps, std::vector<float>());
+  config.displacementReports.assign(2 * numMaps, ResampleReport());
+  //   Simplifying comes after that, so it can thin out a resampled grid.
+  bool simplify = (opts.simplifyTolerance > 0);
+  config.simplifyReports.assign(simplify ? 2 * numColors : 0,
+    SimplifyReport());
+  size_t numCompact = (opts.meshPrecision != MESH_DOUBLE) ? numColors : 0;
+  config.leftCompactMeshes.assign(numCompact, CompactMesh());
+  config.rightCompactMeshes.assign(numCompact, CompactMesh());
+  size_t numThreads = backend ? 1 : opts.numThreads;
+  run_in_parallel(2 * numColors, numThreads, [&](size_t job) {
+    size_t i = job / 2;
+    MeshDescription *mesh;
+    if (job % 2 == 0) {
+      mesh = &leftMeshes[i];
+      if (backend ? !backend->findMesh(leftMappings[i], config.leftScreen,
+            leftMeshes[i])
+          : !findMesh(leftMappings[i], config.leftScreenLeft,
+        config.leftScreenBottom, config.leftScreenRight, config.leftScreenTop,
+        config.leftScreen, leftMeshes[i], opts.verbose)) {
+        meshResults[job] = 30;
+      } else if (leftMeshes[i].size() != leftMappings[i].size()) {
+        meshResults[job] = 4;
+      }
+    } else {
+      mesh = &rightMeshes[i];
+      if (backend ? !backend->findMesh(rightMappings[i], config.rightScreen,
+            rightMeshes[i])
+          : !findMesh(rightMappings[i], config.rightScreenLeft,
+        config.rightScreenBottom, config.rightScreenRight,
+        config.rightScreenTop, config.rightScreen, rightMeshes[i],
+        opts.verbose)) {
+        meshResults[job] = 50;
+      } else if (rightMeshes[i].size() != rightMappings[i].size()) {
+        meshResults[job] = 6;
+      }
+    }
+    if ((meshResults[job] == 0) && (mapX > 0)) {
+      std::vector<float> &texels = (job % 2 == 0) ?
+        config.leftDisplacementMaps[i] : config.rightDisplacementMaps[i];
+      if (!bake_displacement_map(*mesh, mapX, mapY, texels,
+            config.displacementReports[job])) {
+        meshResults[job] = 90;
+      }
+    }
+    if ((meshResults[job] == 0) && (resampleX > 0)) {
+      MeshDescription grid;
+      ResampleReport &report = config.resampleReports[job];
+      if (backend ? !backend->resampleMesh(*mesh, resampleX, resampleY, grid,
+            report)
+          : !resample_mesh(*mesh, resampleX, resampleY, grid, report)) {
+        meshResults[job] = 70;
+      } else {
+        mesh->swap(grid);
+      }
+    }
+    if ((meshResults[job] == 0) && simplify) {
+      MeshDescription simplified;
+      if (!simplify_mesh(*mesh, opts.simplifyTolerance, simplified,
+            config.simplifyReports[job])) {
+        meshResults[job] = 80;
+      } else {
+        mesh->swap(simplified);
+      }
+    }
+
+    // Keep only the compact copy of the finished mesh if we've been
+    // asked to.
+    if ((meshResults[job] == 0) && (opts.meshPrecision != MESH_DOUBLE)) {
+      CompactMesh &compact = (job % 2 == 0) ? config.leftCompactMeshes[i]
+        : config.rightCompactMeshes[i];
+      compact.assign(*mesh, opts.meshPrecision);
+      MeshDescription().swap(*mesh);
+    }
+  });
+
+  // Report the first failure in the order the jobs would have run.
+  for (size_t job = 0; job < meshResults.size(); job++) {
+    size_t i = job / 2;
+    switch (meshResults[job]) {
+    case 30:
+      std::cerr << "Error: Could not find left mesh" << std::endl;
+      return 30;
+    case 4:
+      std::cerr << "Error: Left mesh size " << leftMeshes[i].size()
+        << " does not match mapping size" << leftMappings[i].size() << std::endl;
+      return 4;
+    case 50:
+      std::cerr << "Error: Could not find right mesh" << std::endl;
+      return 50;
+    case 6:
+      std::cerr << "Error: Right mesh size " << rightMeshes[i].size()
+        << " does not match mapping size" << rightMappings[i].size() << std::endl;
+      return 6;
+    case 70:
+      std::cerr << "Error: Could not resample " << (job % 2 == 0 ? "left" : "right")
+        << " mesh " << i << std::endl;
+      return 70;
+    case 80:
+      std::cerr << "Error: Could not simplify " << (job % 2 == 0 ? "left" : "right")
+        << " mesh " << i << std::endl;
+      return 80;
+    case 90:
+      std::cerr << "Error: Could not bake displacement map for "
+        << (job % 2 == 0 ? "left" : "right") << " mesh " << i << std::endl;
+      return 90;
+    }
+  }
+
+  return 0;
+}
+
+int build_distortion_config(
+  const std::vector<std::vector<Mapping> const *> &mappings,
+  const std::vector<std::vector<AngleTerms> const *> &terms,
+  const DistortionConfigOptions &opts, DistortionConfig &config)
+{
+  int ret;
+  if ((ret = prepare_eye_mappings(mappings, terms, opts, config)) != 0) {
+    return ret;
+  }
+  if ((ret = find_eye_screens(opts, config)) != 0) {
+    return ret;
+  }
+  return find_eye_meshes(opts, config);
+}
+
+int write_distortion_config(std::ostream &out,
+  const DistortionConfig &config, MeshFormat meshFormat)
+{
+  ScreenDescription const &leftScreen = config.leftScreen;
+  ScreenDescription const &rightScreen = config.rightScreen;
+  bool compact = !config.leftCompactMeshes.empty();
+  size_t numMeshes = compact ? config.leftCompactMeshes.size()
+    : config.leftMeshes.size();
+
+  //====================================================================
+  // Construct Json screen description.
+  // We do this by hand rather than using JsonCPP because we need
+  // to control the printed precision of the numbers to avoid making
+  // a huge file.
+  out << "{" << "\n";
+  out << " \"display\": {" << "\n";
+  out << "  \"hmd\": {" << "\n";
+
+  out << "   \"field_of_view\": {" << "\n";
+  out << "    \"monocular_horizontal\": "
+    << rightScreen.hFOVDegrees
+    << ",\n";
+  out << "    \"monocular_vertical\": "
+    << rightScreen.vFOVDegrees
+    << ",\n";
+  out << "    \"overlap_percent\": "
+    << rightScreen.overlapPercent
+    << ",\n";
+  out << "    \"pitch_tilt\": 0" << "\n";
+  out << "   }," << "\n"; // field_of_view
+
+  out << "   \"distortion\": {" << "\n";
+  //   The base-64 format stores each pair of meshes under a different
+  // name so that readers expecting arrays of numbers don't misread it.
+  static const char *rgbNames[] = { "red", "green", "blue" };
+  const char *suffix = (meshFormat == MESH_BASE64) ? "_point_samples_base64"
+    : "_point_samples";
+  // Write the meshes for color c for both eyes, separated by a comma.
+  auto writeMeshes = [&](size_t c) {
+    if (compact) {
+      writeMesh(out, config.leftCompactMeshes[c], meshFormat);
+      out << ",\n";
+      writeMesh(out, config.rightCompactMeshes[c], meshFormat);
+    } else {
+      writeMesh(out, config.leftMeshes[c], meshFormat);
+      out << ",\n";
+      writeMesh(out, config.rightMeshes[c], meshFormat);
+    }
+  };
+  switch (numMeshes) {
+  case 1:
+    out << "    \"type\": \"mono_point_samples\"," << "\n";
+    out << "    \"mono" << suffix << "\": [" << "\n";
+    writeMeshes(0);
+    out << "    ]" << "\n"; // mono_point_samples
+    out << "   }," << "\n"; // distortion
+    break;
+  case 3:
+    out << "    \"type\": \"rgb_point_samples\"," << "\n";
+    for (size_t c = 0; c < 3; c++) {
+      out << "    \"" << rgbNames[c] << suffix << "\": [" << "\n";
+        writeMeshes(c);
+      out << "    ]" << (c < 2 ? "," : "") << "\n"; // color_point_samples
+    }
+    out << "   }," << "\n"; // distortion
+    break;
+  default:
+    std::cerr << "Error: Unexpected number of meshes: " << numMeshes
+      << std::endl;
+    return 3;
+  }
+
+  out << "   \"eyes\": [" << "\n";
+  out << "    {" << "\n";
+  out << "     \"center_proj_x\": "
+    << leftScreen.xCOP
+    << ",\n";
+  out << "     \"center_proj_y\": "
+    << leftScreen.yCOP
+    << ",\n";
+  out << "     \"rotate_180\": 0" << "\n";
+  out << "    }," << "\n";
+  out << "    {" << "\n";
+  out << "     \"center_proj_x\": "
+    << rightScreen.xCOP
+    << ",\n";
+  out << "     \"center_proj_y\": "
+    << rightScreen.yCOP
+    << ",\n";
+  out << "     \"rotate_180\": 0" << "\n";
+  out << "    }" << "\n";
+  out << "   ]" << "\n"; // eyes
+
+  out << "  }" << "\n";  // hmd
+  out << " }" << "\n";   // display
+  out << "}" << "\n";    // Closes outer object
+  out.flush();
+
+  return 0;
+}
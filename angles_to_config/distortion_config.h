@@ -0,0 +1,202 @@
+/** @file
+    @brief Builds the screens and distortion meshes for both eyes from
+           mappings that are already in memory, and writes them as a
+           partial OSVR display configuration.
+
+    @date 2016
+
+    @author
+    Russ Taylor working through ReliaSolve.com for Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "types.h"
+#include "helper.h"
+#include "mapping_set.h"
+#include "resample.h"
+#include "simplify.h"
+#include "compact_mesh.h"
+#include "displacement_map.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstddef>
+
+//  These are the stages that AnglesToConfig runs after it reads and
+// verifies its input files, so that other programs can produce the same
+// configuration without writing the mappings out as text and running it.
+// In order:
+//   load_mapping() parses a mapping and cleans it, using its cache file
+//     if asked (or read_from_infile() or parse_mapping() and then
+//     remove_invalid_points_based_on_angle() from helper.h do this
+//     piece by piece),
+//   prepare_eye_mappings() makes the mappings for each eye,
+//   find_eye_screens() finds the screen for each eye,
+//   find_eye_meshes() builds the meshes for each eye, and
+//   write_distortion_config() serializes the result.
+// build_distortion_config() runs the middle three in one call.
+//   There is one mapping per color, so one for mono and three for RGB.
+// The functions that can fail return 0 on success and otherwise the code
+// that AnglesToConfig exits with, after describing the problem on
+// std::cerr.
+
+/// How to write the meshes into the configuration file.
+enum MeshFormat {
+  MESH_TEXT,    //!< Json arrays of numbers
+  MESH_BASE64   //!< Base64-encoded little-endian float32 values
+};
+
+/// The settings that control how the screens and meshes are built.
+class DistortionConfigOptions {
+public:
+  bool verbose = false;
+  bool useRightEye = true;      //< The mappings are for the right eye
+  bool computeBounds = true;    //< Ignore left..top and use the points
+  bool useFieldAngles = true;   //< Otherwise latitude and longitude
+  size_t numThreads = 1;
+  size_t resampleX = 0, resampleY = 0;  //< 0 means don't resample
+  double simplifyTolerance = 0; //< 0 means don't simplify
+  size_t displacementMapX = 0, displacementMapY = 0;  //< 0 means don't bake
+  double left = 0, right = 0, bottom = 0, top = 0;  //< Screen, in meters
+  double depth = 2.0;
+  double toMeters = 1.0;        //< Converts the mappings' units to meters
+  MeshPrecision meshPrecision = MESH_DOUBLE;  //< How to keep finished meshes
+};
+
+/// The settings that control which points of an input mapping are kept
+/// and whether a cache file is used for them.
+class MappingLoadOptions {
+public:
+  bool useCache = false;        //< Read and write a cache file next to the input
+  bool verifyAngles = false;
+  OutlierMode outlierMode = OUTLIERS_GREEDY;
+  double xx = 0, xy = 0, yx = 0, yy = 0;  //< See -verify_angles
+  double maxAngleDiffDegrees = 0;
+};
+
+/// Parse the contents of an input file (see parse_mapping()), verify its
+/// angles if asked and handle its cache file if asked.  The cache file
+/// goes next to fileName, so pass cacheable = false for contents that did
+/// not come from a file.  The angle terms are filled in only when the
+/// cache is used.  opts.verbose says whether to describe what is done,
+/// and the local outlier filter uses up to opts.numThreads threads.
+extern int load_mapping(const char *data, size_t length,
+  std::string const &fileName, size_t index, bool cacheable,
+  const MappingLoadOptions &load, const DistortionConfigOptions &opts,
+  std::vector<Mapping> &mapping, std::vector<AngleTerms> &terms);
+
+/// The screens and meshes for both eyes, along with the intermediate
+/// results that are needed to produce them.
+class DistortionConfig {
+public:
+  /// Screen boundaries in meters for each eye, mirror images of each other.
+  double leftScreenLeft = 0, leftScreenBottom = 0;
+  double leftScreenRight = 0, leftScreenTop = 0;
+  double rightScreenLeft = 0, rightScreenBottom = 0;
+  double rightScreenRight = 0, rightScreenTop = 0;
+
+  /// The mappings converted for each eye, one per color.
+  std::vector<MappingSet> leftMappings, rightMappings;
+
+  ScreenDescription leftScreen, rightScreen;
+  std::vector<MeshDescription> leftMeshes, rightMeshes;
+
+  /// When the options ask for a reduced mesh precision, the meshes for
+  /// each eye are stored here instead and the ones above are left empty.
+  std::vector<CompactMesh> leftCompactMeshes, rightCompactMeshes;
+
+  /// When resampling, one report per mesh: left and right for each
+  /// color in turn.
+  std::vector<ResampleReport> resampleReports;
+
+  /// When simplifying, one report per mesh in the same order.
+  std::vector<SimplifyReport> simplifyReports;
+
+  /// When baking displacement maps, the map for each color for each eye
+  /// (see bake_displacement_map()) and one report per map in the same
+  /// order as the others.
+  std::vector<std::vector<float> > leftDisplacementMaps, rightDisplacementMaps;
+  std::vector<ResampleReport> displacementReports;
+};
+
+/// Find the bounds in meters of the screen-space points in all of the
+/// mappings, which must not be empty.  As the original AnglesToConfig
+/// did, the bounds start at the first point of the first mapping and then
+/// take in every point but the first of each mapping, so the first point
+/// of each later mapping is not included.  prepare_eye_mappings() finds
+/// the same bounds.
+extern void compute_mapping_bounds(
+  const std::vector<std::vector<Mapping> const *> &mappings, double toMeters,
+  double &left, double &bottom, double &right, double &top);
+
+/// Produce angle terms that go with a mapping that has been reflected
+/// around X=0 (see MappingSet::assign()).
+extern std::vector<AngleTerms> reflect_angle_terms(
+  std::vector<AngleTerms> const &terms);
+
+/// Compute the screen boundaries for each eye (from the points if
+/// opts.computeBounds is set) and fill in the mappings for each eye in
+/// normalized coordinates and meters, reflecting them for the eye the
+/// mappings are not for.  If a color's entry in terms is not NULL and not
+/// empty, it holds the angle terms for that mapping.  The mappings
+/// themselves are not needed after this returns.
+extern int prepare_eye_mappings(
+  const std::vector<std::vector<Mapping> const *> &mappings,
+  const std::vector<std::vector<AngleTerms> const *> &terms,
+  const DistortionConfigOptions &opts, DistortionConfig &config);
+
+/// Find the screen for each eye that encloses the points in all colors.
+extern int find_eye_screens(const DistortionConfigOptions &opts,
+  DistortionConfig &config);
+
+/// Something other than the CPU code in helper.h and resample.h that can
+/// do the per-point work of finding and resampling meshes, such as a GPU
+/// that needs to be used from a particular thread.  Each method returns
+/// false (after describing the problem on std::cerr) on failure.
+class MeshBackend {
+public:
+  virtual ~MeshBackend() {}
+
+  /// Do what findMesh() does.
+  virtual bool findMesh(const MappingSet &set, ScreenDescription const &screen,
+    MeshDescription &mesh) = 0;
+
+  /// Do what resample_mesh() does.
+  virtual bool resampleMesh(const MeshDescription &mesh, size_t nx, size_t ny,
+    MeshDescription &grid, ResampleReport &report) = 0;
+};
+
+/// Find the mesh for each color for each eye, baking it into a
+/// displacement map, resampling and then simplifying it if asked and
+/// storing it at the requested precision.
+/// If backend is not NULL, it finds and resamples the meshes, one at a
+/// time on the calling thread.
+extern int find_eye_meshes(const DistortionConfigOptions &opts,
+  DistortionConfig &config, MeshBackend *backend = NULL);
+
+/// Run prepare_eye_mappings(), find_eye_screens() and find_eye_meshes().
+extern int build_distortion_config(
+  const std::vector<std::vector<Mapping> const *> &mappings,
+  const std::vector<std::vector<AngleTerms> const *> &terms,
+  const DistortionConfigOptions &opts, DistortionConfig &config);
+
+/// Write the screens and meshes as the Json configuration fragment that
+/// AnglesToConfig produces.  Uses the compact meshes if there are any.
+extern int write_distortion_config(std::ostream &out,
+  const DistortionConfig &config, MeshFormat meshFormat = MESH_TEXT);
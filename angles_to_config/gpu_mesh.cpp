@@ -0,0 +1,479 @@
+/** @file
+    @brief Finds and resamples distortion meshes with OpenGL compute
+           shaders, for the interactive tools that have a context.
+
+    @date 2016
+
+    @author
+    Russ Taylor working through ReliaSolve.com for Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Internal Includes
+#include "gpu_mesh.h"
+
+// Standard includes
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+// Invocations per work group for the projection shader, and the largest
+// number of work groups we dispatch at once (the smallest maximum that
+// OpenGL allows).
+static const size_t PROJECT_GROUP_SIZE = 64;
+static const size_t MAX_GROUPS = 65535;
+
+// Width and height of the work groups for the resampling shader.
+static const size_t RESAMPLE_GROUP_SIZE = 8;
+
+// Storage buffer binding points.
+enum {
+  SAMPLES_BINDING = 0,
+  BUCKETS_BINDING = 1,
+  ORDER_BINDING = 2,
+  RESULTS_BINDING = 3
+};
+
+// Projects each point's 3D location onto the screen plane and converts it
+// to normalized screen coordinates, as findMesh() does.
+static const char *PROJECT_SHADER =
+  "#version 430\n"
+  "layout(local_size_x = 64) in;\n"
+  "layout(std430, binding = 0) readonly buffer Points { vec4 points[]; };\n"
+  "layout(std430, binding = 3) writeonly buffer Results { vec2 results[]; };\n"
+  "uniform uint first;\n"
+  "uniform uint count;\n"
+  "uniform vec4 plane;\n"         // A, B, C, D
+  "uniform vec4 outTransform;\n"  // X offset and scale, Y offset and scale
+  "void main()\n"
+  "{\n"
+  "  uint i = first + gl_GlobalInvocationID.x;\n"
+  "  if (i >= count) { return; }\n"
+  "  vec3 p = points[i].xyz;\n"
+  "  float s = -plane.w / dot(plane.xyz, p);\n"
+  "  results[i] = vec2((s * p.x + outTransform.x) * outTransform.y,\n"
+  "                    (s * p.y + outTransform.z) * outTransform.w);\n"
+  "}\n";
+
+// Fills in one grid point the way resample_mesh() does: find its nearest
+// samples, make sure they surround it, and fit an affine mapping to them
+// weighted by inverse square distance.  The samples are sorted into a
+// uniform grid of buckets covering them, and the buckets are searched in
+// rings around the grid point until nothing closer can be left.  Ties
+// in distance go to the lower sample index, as in NeighborIndex.
+//   Each result is the output location and whether it was filled in.
+static const char *RESAMPLE_SHADER_BODY =
+  "layout(local_size_x = 8, local_size_y = 8) in;\n"
+  "layout(std430, binding = 0) readonly buffer Samples { vec4 samples[]; };\n"
+  "layout(std430, binding = 1) readonly buffer Buckets { uint bucketStart[]; };\n"
+  "layout(std430, binding = 2) readonly buffer Order { uint sampleIndex[]; };\n"
+  "layout(std430, binding = 3) writeonly buffer Results { vec4 results[]; };\n"
+  "uniform uvec2 gridSize;\n"
+  "uniform ivec2 bucketCount;\n"
+  "uniform vec2 bucketMin;\n"
+  "uniform float bucketSize;\n"
+  "\n"
+  "// How close the nearest sample could be in the buckets outside the\n"
+  "// ones within r - 1 of home.\n"
+  "float lowerBound(vec2 p, ivec2 home, int r)\n"
+  "{\n"
+  "  ivec2 lo = home - ivec2(r - 1);\n"
+  "  ivec2 hi = home + ivec2(r - 1);\n"
+  "  float bound = 1e30;\n"
+  "  if (lo.x > 0) { bound = min(bound, p.x - (bucketMin.x + float(lo.x) * bucketSize)); }\n"
+  "  if (lo.y > 0) { bound = min(bound, p.y - (bucketMin.y + float(lo.y) * bucketSize)); }\n"
+  "  if (hi.x < bucketCount.x - 1) {\n"
+  "    bound = min(bound, bucketMin.x + float(hi.x + 1) * bucketSize - p.x);\n"
+  "  }\n"
+  "  if (hi.y < bucketCount.y - 1) {\n"
+  "    bound = min(bound, bucketMin.y + float(hi.y + 1) * bucketSize - p.y);\n"
+  "  }\n"
+  "  return max(bound, 0.0);\n"
+  "}\n"
+  "\n"
+  "void main()\n"
+  "{\n"
+  "  uvec2 g = gl_GlobalInvocationID.xy;\n"
+  "  if ((g.x >= gridSize.x) || (g.y >= gridSize.y)) { return; }\n"
+  "  uint gi = g.y * gridSize.x + g.x;\n"
+  "  vec2 p = vec2(g) / vec2(gridSize - uvec2(1));\n"
+  "\n"
+  "  // Find the K nearest samples, nearest first.\n"
+  "  float bestD[K];\n"
+  "  uint bestI[K];\n"
+  "  uint bestS[K];\n"
+  "  int found = 0;\n"
+  "  ivec2 home = clamp(ivec2(floor((p - bucketMin) / bucketSize)),\n"
+  "    ivec2(0), bucketCount - ivec2(1));\n"
+  "  int maxRing = max(max(home.x, bucketCount.x - 1 - home.x),\n"
+  "    max(home.y, bucketCount.y - 1 - home.y));\n"
+  "  for (int r = 0; r <= maxRing; r++) {\n"
+  "    if ((found == K) && (r > 0)) {\n"
+  "      float b = lowerBound(p, home, r);\n"
+  "      if (b * b > bestD[K - 1]) { break; }\n"
+  "    }\n"
+  "    for (int by = home.y - r; by <= home.y + r; by++) {\n"
+  "      if ((by < 0) || (by >= bucketCount.y)) { continue; }\n"
+  "      bool edgeRow = (by == home.y - r) || (by == home.y + r);\n"
+  "      int step = edgeRow ? 1 : 2 * r;\n"
+  "      for (int bx = home.x - r; bx <= home.x + r; bx += step) {\n"
+  "        if ((bx < 0) || (bx >= bucketCount.x)) { continue; }\n"
+  "        uint b = uint(by * bucketCount.x + bx);\n"
+  "        for (uint s = bucketStart[b]; s < bucketStart[b + 1]; s++) {\n"
+  "          vec2 d = samples[s].xy - p;\n"
+  "          float d2 = dot(d, d);\n"
+  "          uint idx = sampleIndex[s];\n"
+  "          if ((found < K) || (d2 < bestD[K - 1]) ||\n"
+  "              ((d2 == bestD[K - 1]) && (idx < bestI[K - 1]))) {\n"
+  "            int pos = (found < K) ? found : K - 1;\n"
+  "            if (found < K) { found++; }\n"
+  "            while ((pos > 0) && ((d2 < bestD[pos - 1]) ||\n"
+  "                   ((d2 == bestD[pos - 1]) && (idx < bestI[pos - 1])))) {\n"
+  "              bestD[pos] = bestD[pos - 1];\n"
+  "              bestI[pos] = bestI[pos - 1];\n"
+  "              bestS[pos] = bestS[pos - 1];\n"
+  "              pos--;\n"
+  "            }\n"
+  "            bestD[pos] = d2;\n"
+  "            bestI[pos] = idx;\n"
+  "            bestS[pos] = s;\n"
+  "          }\n"
+  "        }\n"
+  "      }\n"
+  "    }\n"
+  "  }\n"
+  "\n"
+  "  // Use a sample that is exactly on the grid point, and otherwise make\n"
+  "  // sure there are samples in all four quadrants around it.\n"
+  "  int quadrants = 0;\n"
+  "  for (int n = 0; n < found; n++) {\n"
+  "    vec4 s = samples[bestS[n]];\n"
+  "    vec2 d = s.xy - p;\n"
+  "    if ((d.x == 0.0) && (d.y == 0.0)) {\n"
+  "      results[gi] = vec4(s.zw, 1.0, 0.0);\n"
+  "      return;\n"
+  "    }\n"
+  "    quadrants |= 1 << ((d.x >= 0.0 ? 1 : 0) + (d.y >= 0.0 ? 2 : 0));\n"
+  "  }\n"
+  "  if (quadrants != 15) {\n"
+  "    results[gi] = vec4(0.0);\n"
+  "    return;\n"
+  "  }\n"
+  "\n"
+  "  // Weighted normal equations, solved for the value at the grid point\n"
+  "  // with Cramer's rule, falling back to a weighted average.\n"
+  "  mat3 M = mat3(0.0);\n"
+  "  vec3 R0 = vec3(0.0), R1 = vec3(0.0);\n"
+  "  float wSum = 0.0;\n"
+  "  vec2 avg = vec2(0.0);\n"
+  "  for (int n = 0; n < found; n++) {\n"
+  "    vec4 s = samples[bestS[n]];\n"
+  "    vec3 v = vec3(1.0, s.x - p.x, s.y - p.y);\n"
+  "    float w = 1.0 / (v.y * v.y + v.z * v.z);\n"
+  "    M += w * outerProduct(v, v);\n"
+  "    R0 += w * v * s.z;\n"
+  "    R1 += w * v * s.w;\n"
+  "    wSum += w;\n"
+  "    avg += w * s.zw;\n"
+  "  }\n"
+  "  float det = determinant(M);\n"
+  "  vec2 out_;\n"
+  "  if (abs(det) <= 1e-6 * abs(M[0][0] * M[1][1] * M[2][2])) {\n"
+  "    out_ = avg / wSum;\n"
+  "  } else {\n"
+  "    mat3 A0 = M;\n"
+  "    A0[0] = R0;\n"  // M is symmetric, so replacing a column is the same
+  "    mat3 A1 = M;\n" // as replacing the row in the CPU version.
+  "    A1[0] = R1;\n"
+  "    out_ = vec2(determinant(A0), determinant(A1)) / det;\n"
+  "  }\n"
+  "  results[gi] = vec4(out_, 1.0, 0.0);\n"
+  "}\n";
+
+// Compile and link a compute program, returning 0 (after reporting why)
+// on failure.
+static GLuint makeComputeProgram(const std::string &source)
+{
+  GLuint shader = glCreateShader(GL_COMPUTE_SHADER);
+  const char *text = source.c_str();
+  glShaderSource(shader, 1, &text, NULL);
+  glCompileShader(shader);
+  GLint status;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+  if (status == GL_FALSE) {
+    char log[1024];
+    glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+    std::cerr << "GpuMeshBuilder: Could not compile shader: " << log << std::endl;
+    glDeleteShader(shader);
+    return 0;
+  }
+
+  GLuint program = glCreateProgram();
+  glAttachShader(program, shader);
+  glLinkProgram(program);
+  glDeleteShader(shader);
+  glGetProgramiv(program, GL_LINK_STATUS, &status);
+  if (status == GL_FALSE) {
+    char log[1024];
+    glGetProgramInfoLog(program, sizeof(log), NULL, log);
+    std::cerr << "GpuMeshBuilder: Could not link shader: " << log << std::endl;
+    glDeleteProgram(program);
+    return 0;
+  }
+  return program;
+}
+
+GpuMeshBuilder::GpuMeshBuilder()
+  : m_projectProgram(0)
+  , m_resampleProgram(0)
+{
+  for (size_t i = 0; i < 4; i++) { m_buffers[i] = 0; }
+  if (!GLEW_VERSION_4_3 &&
+      !(GLEW_ARB_compute_shader && GLEW_ARB_shader_storage_buffer_object)) {
+    std::cerr << "GpuMeshBuilder: Compute shaders are not available"
+      << std::endl;
+    return;
+  }
+  std::ostringstream resample;
+  resample << "#version 430\n#define K " << RESAMPLE_FIT_NEIGHBORS << "\n"
+    << RESAMPLE_SHADER_BODY;
+  m_projectProgram = makeComputeProgram(PROJECT_SHADER);
+  m_resampleProgram = makeComputeProgram(resample.str());
+  glGenBuffers(4, m_buffers);
+}
+
+GpuMeshBuilder::~GpuMeshBuilder()
+{
+  if (m_projectProgram) { glDeleteProgram(m_projectProgram); }
+  if (m_resampleProgram) { glDeleteProgram(m_resampleProgram); }
+  if (m_buffers[0]) { glDeleteBuffers(4, m_buffers); }
+}
+
+void GpuMeshBuilder::upload(GLuint buffer, GLuint binding, size_t bytes,
+  const void *data)
+{
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, bytes, data, GL_DYNAMIC_DRAW);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, buffer);
+}
+
+bool GpuMeshBuilder::findMesh(const MappingSet &set,
+  ScreenDescription const &screen, MeshDescription &mesh)
+{
+  mesh.clear();
+  if (!ok()) {
+    std::cerr << "GpuMeshBuilder::findMesh(): Error: Not available" << std::endl;
+    return false;
+  }
+  if (set.size() == 0) {
+    std::cerr << "GpuMeshBuilder::findMesh(): Error: No points in mapping"
+      << std::endl;
+    return false;
+  }
+  const XYZ &leftProj = screen.screenLeft;
+  const XYZ &rightProj = screen.screenRight;
+  if (leftProj.x == rightProj.x) {
+    std::cerr << "Error computing mesh: screen has no X extent" << std::endl;
+    return false;
+  }
+
+  // The same scale and offset that findMesh() uses.
+  size_t count = set.size();
+  std::vector<GLfloat> points(4 * count);
+  for (size_t i = 0; i < count; i++) {
+    points[4 * i + 0] = static_cast<GLfloat>(set.X[i]);
+    points[4 * i + 1] = static_cast<GLfloat>(set.Y[i]);
+    points[4 * i + 2] = static_cast<GLfloat>(set.Z[i]);
+    points[4 * i + 3] = 0;
+  }
+  upload(m_buffers[SAMPLES_BINDING], SAMPLES_BINDING,
+    points.size() * sizeof(GLfloat), &points[0]);
+  upload(m_buffers[RESULTS_BINDING], RESULTS_BINDING,
+    2 * count * sizeof(GLfloat), NULL);
+
+  glUseProgram(m_projectProgram);
+  glUniform1ui(glGetUniformLocation(m_projectProgram, "count"),
+    static_cast<GLuint>(count));
+  glUniform4f(glGetUniformLocation(m_projectProgram, "plane"),
+    static_cast<GLfloat>(screen.A), static_cast<GLfloat>(screen.B),
+    static_cast<GLfloat>(screen.C), static_cast<GLfloat>(screen.D));
+  glUniform4f(glGetUniformLocation(m_projectProgram, "outTransform"),
+    static_cast<GLfloat>(-leftProj.x),
+    static_cast<GLfloat>(1 / (rightProj.x - leftProj.x)),
+    static_cast<GLfloat>(screen.maxY),
+    static_cast<GLfloat>(1 / (2 * screen.maxY)));
+  GLint firstParam = glGetUniformLocation(m_projectProgram, "first");
+  const size_t perDispatch = MAX_GROUPS * PROJECT_GROUP_SIZE;
+  for (size_t first = 0; first < count; first += perDispatch) {
+    size_t n = std::min(perDispatch, count - first);
+    glUniform1ui(firstParam, static_cast<GLuint>(first));
+    glDispatchCompute(static_cast<GLuint>(
+      (n + PROJECT_GROUP_SIZE - 1) / PROJECT_GROUP_SIZE), 1, 1);
+  }
+  glUseProgram(0);
+
+  std::vector<GLfloat> results(2 * count);
+  glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_buffers[RESULTS_BINDING]);
+  glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0,
+    results.size() * sizeof(GLfloat), &results[0]);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+  mesh.resize(count);
+  for (size_t i = 0; i < count; i++) {
+    mesh[i][0][0] = set.x[i];
+    mesh[i][0][1] = set.y[i];
+    mesh[i][1][0] = results[2 * i + 0];
+    mesh[i][1][1] = results[2 * i + 1];
+  }
+  return true;
+}
+
+bool GpuMeshBuilder::resampleMesh(const MeshDescription &mesh,
+  size_t nx, size_t ny, MeshDescription &grid, ResampleReport &report)
+{
+  grid.clear();
+  report.gridPoints = report.samplesChecked = report.samplesSkipped = 0;
+  report.maxError = report.rmsError = 0;
+  if (!ok()) {
+    std::cerr << "GpuMeshBuilder::resampleMesh(): Error: Not available"
+      << std::endl;
+    return false;
+  }
+  if ((nx < 2) || (ny < 2)) {
+    std::cerr << "GpuMeshBuilder::resampleMesh(): Error: Grid must be at least"
+      " 2x2, got " << nx << "x" << ny << std::endl;
+    return false;
+  }
+  if (mesh.size() < RESAMPLE_FIT_NEIGHBORS) {
+    std::cerr << "GpuMeshBuilder::resampleMesh(): Error: Need at least "
+      << RESAMPLE_FIT_NEIGHBORS << " samples, got " << mesh.size() << std::endl;
+    return false;
+  }
+
+  //====================================================================
+  // Sort the samples into square buckets covering them, about two per
+  // bucket, keeping them in index order within each bucket.
+  double minX = mesh[0][0][0], maxX = minX;
+  double minY = mesh[0][0][1], maxY = minY;
+  for (size_t i = 1; i < mesh.size(); i++) {
+    minX = std::min(minX, mesh[i][0][0]);
+    maxX = std::max(maxX, mesh[i][0][0]);
+    minY = std::min(minY, mesh[i][0][1]);
+    maxY = std::max(maxY, mesh[i][0][1]);
+  }
+  double width = maxX - minX, height = maxY - minY;
+  double area = std::max(width, 1e-9) * std::max(height, 1e-9);
+  double size = sqrt(area / (mesh.size() / 2.0));
+  if (!(size > 0)) { size = 1; }
+  size_t bx = static_cast<size_t>(width / size) + 1;
+  size_t by = static_cast<size_t>(height / size) + 1;
+  std::vector<size_t> bucketOf(mesh.size());
+  std::vector<GLuint> bucketStart(bx * by + 1, 0);
+  for (size_t i = 0; i < mesh.size(); i++) {
+    size_t cx = std::min(static_cast<size_t>((mesh[i][0][0] - minX) / size), bx - 1);
+    size_t cy = std::min(static_cast<size_t>((mesh[i][0][1] - minY) / size), by - 1);
+    bucketOf[i] = cy * bx + cx;
+    bucketStart[bucketOf[i] + 1]++;
+  }
+  for (size_t b = 0; b < bx * by; b++) {
+    bucketStart[b + 1] += bucketStart[b];
+  }
+  std::vector<GLuint> next(bucketStart.begin(), bucketStart.end() - 1);
+  std::vector<GLfloat> samples(4 * mesh.size());
+  std::vector<GLuint> order(mesh.size());
+  for (size_t i = 0; i < mesh.size(); i++) {
+    size_t s = next[bucketOf[i]]++;
+    for (size_t j = 0; j < 4; j++) {
+      samples[4 * s + j] = static_cast<GLfloat>(mesh[i][j / 2][j % 2]);
+    }
+    order[s] = static_cast<GLuint>(i);
+  }
+
+  //====================================================================
+  // Fill in the grid points on the GPU.
+  upload(m_buffers[SAMPLES_BINDING], SAMPLES_BINDING,
+    samples.size() * sizeof(GLfloat), &samples[0]);
+  upload(m_buffers[BUCKETS_BINDING], BUCKETS_BINDING,
+    bucketStart.size() * sizeof(GLuint), &bucketStart[0]);
+  upload(m_buffers[ORDER_BINDING], ORDER_BINDING,
+    order.size() * sizeof(GLuint), &order[0]);
+  upload(m_buffers[RESULTS_BINDING], RESULTS_BINDING,
+    4 * nx * ny * sizeof(GLfloat), NULL);
+
+  glUseProgram(m_resampleProgram);
+  glUniform2ui(glGetUniformLocation(m_resampleProgram, "gridSize"),
+    static_cast<GLuint>(nx), static_cast<GLuint>(ny));
+  glUniform2i(glGetUniformLocation(m_resampleProgram, "bucketCount"),
+    static_cast<GLint>(bx), static_cast<GLint>(by));
+  glUniform2f(glGetUniformLocation(m_resampleProgram, "bucketMin"),
+    static_cast<GLfloat>(minX), static_cast<GLfloat>(minY));
+  glUniform1f(glGetUniformLocation(m_resampleProgram, "bucketSize"),
+    static_cast<GLfloat>(size));
+  glDispatchCompute(
+    static_cast<GLuint>((nx + RESAMPLE_GROUP_SIZE - 1) / RESAMPLE_GROUP_SIZE),
+    static_cast<GLuint>((ny + RESAMPLE_GROUP_SIZE - 1) / RESAMPLE_GROUP_SIZE), 1);
+  glUseProgram(0);
+
+  std::vector<GLfloat> results(4 * nx * ny);
+  glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_buffers[RESULTS_BINDING]);
+  glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0,
+    results.size() * sizeof(GLfloat), &results[0]);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+  //====================================================================
+  // Build the grid in the same order as resample_mesh() and check it
+  // against the samples the same way.
+  std::vector< std::array<double, 2> > values(nx * ny);
+  std::vector<bool> valid(nx * ny, false);
+  for (size_t j = 0; j < ny; j++) {
+    for (size_t i = 0; i < nx; i++) {
+      size_t g = j * nx + i;
+      if (results[4 * g + 2] == 0) { continue; }
+      valid[g] = true;
+      values[g][0] = results[4 * g + 0];
+      values[g][1] = results[4 * g + 1];
+      std::array< std::array<double, 2>, 2 > element;
+      element[0][0] = static_cast<double>(i) / (nx - 1);
+      element[0][1] = static_cast<double>(j) / (ny - 1);
+      element[1] = values[g];
+      grid.push_back(element);
+    }
+  }
+  report.gridPoints = grid.size();
+  check_resampled_grid(mesh, nx, ny, values, valid, report);
+
+  return true;
+}
+
+double max_mesh_difference(const MeshDescription &a, const MeshDescription &b)
+{
+  if (a.size() != b.size()) { return HUGE_VAL; }
+  double maxDiff = 0;
+  for (size_t i = 0; i < a.size(); i++) {
+    for (size_t k = 0; k < 2; k++) {
+      double dx = a[i][k][0] - b[i][k][0];
+      double dy = a[i][k][1] - b[i][k][1];
+      maxDiff = std::max(maxDiff, sqrt(dx * dx + dy * dy));
+    }
+  }
+  return maxDiff;
+}
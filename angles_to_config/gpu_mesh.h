@@ -0,0 +1,78 @@
+/** @file
+    @brief Finds and resamples distortion meshes with OpenGL compute
+           shaders, for the interactive tools that have a context.
+
+    @date 2016
+
+    @author
+    Russ Taylor working through ReliaSolve.com for Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "types.h"
+#include "mapping_set.h"
+#include "resample.h"
+#include "distortion_config.h"
+
+// Library/third-party includes
+#include <GL/glew.h>
+
+// Standard includes
+#include <cstddef>
+
+/// Does the per-point work of findMesh() and resample_mesh() on the GPU.
+/// The projection of each point onto the screen and the nearest-neighbor
+/// search and affine fit at each grid point are independent of each
+/// other, so they run one per shader invocation.  They are done in single
+/// precision, so the results are close to the CPU's but not identical;
+/// use max_mesh_difference() to check them.
+///   This must be constructed, used and destroyed on a thread whose
+/// OpenGL context is current, after glewInit() has been called.  It
+/// needs OpenGL 4.3 (or ARB_compute_shader with
+/// ARB_shader_storage_buffer_object); ok() is false if those aren't
+/// there or the shaders don't build.
+class GpuMeshBuilder : public MeshBackend {
+public:
+  GpuMeshBuilder();
+  ~GpuMeshBuilder();
+
+  bool ok() const { return (m_projectProgram != 0) && (m_resampleProgram != 0); }
+
+  bool findMesh(const MappingSet &set, ScreenDescription const &screen,
+    MeshDescription &mesh);
+
+  bool resampleMesh(const MeshDescription &mesh, size_t nx, size_t ny,
+    MeshDescription &grid, ResampleReport &report);
+
+private:
+  GpuMeshBuilder(const GpuMeshBuilder &);
+  GpuMeshBuilder &operator=(const GpuMeshBuilder &);
+
+  /// Fill a storage buffer and bind it to the binding point.
+  void upload(GLuint buffer, GLuint binding, size_t bytes, const void *data);
+
+  GLuint m_projectProgram;
+  GLuint m_resampleProgram;
+  GLuint m_buffers[4];
+};
+
+/// The largest distance between corresponding input or output locations
+/// in two meshes, or a huge value if they have different sizes.
+extern double max_mesh_difference(const MeshDescription &a,
+  const MeshDescription &b);
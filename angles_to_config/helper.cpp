@@ -26,82 +26,214 @@
 // Internal Includes
 #include "types.h"
 #include "helper.h"
+#include "neighbor_index.h"
+#include "mapping_set.h"
+#include "parallel.h"
 
 // Standard includes
 #include <string>
+#include <sstream>
 #include <iomanip>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
 #include <cmath>
-#include <map>
+#include <algorithm>
+#include <queue>
 
-std::vector<Mapping> read_from_infile(std::istream &in)
+bool read_file_contents(const std::string &fileName, std::vector<char> &contents)
+{
+  contents.clear();
+  FILE *f = fopen(fileName.c_str(), "rb");
+  if (f == NULL) { return false; }
+
+  // Size the buffer up front when we can tell how large the file is,
+  // then read it in large chunks.
+  if (fseek(f, 0, SEEK_END) == 0) {
+    long size = ftell(f);
+    if (size > 0) { contents.reserve(static_cast<size_t>(size) + 1); }
+    fseek(f, 0, SEEK_SET);
+  }
+  const size_t CHUNK = 1 << 20;
+  size_t got;
+  do {
+    size_t start = contents.size();
+    contents.resize(start + CHUNK);
+    got = fread(&contents[start], 1, CHUNK, f);
+    contents.resize(start + got);
+  } while (got == CHUNK);
+
+  bool ret = (ferror(f) == 0);
+  fclose(f);
+  return ret;
+}
+
+static bool is_space(char c)
+{
+  return (c == ' ') || (c == '\t') || (c == '\n') || (c == '\r') ||
+    (c == '\f') || (c == '\v');
+}
+
+std::vector<Mapping> parse_mapping(const char *data, size_t length,
+  const std::string &sourceName)
 {
   std::vector<Mapping> mapping;
+  if (length == 0) { return mapping; }
+
+  // The buffer may or may not end with a terminator; anything after
+  // the first one is ignored.
+  const char *end = static_cast<const char *>(std::memchr(data, '\0', length));
+  if (end == NULL) { end = data + length; }
+
+  // Pre-size the mapping assuming one entry per line.
+  mapping.reserve(std::count(data, end, '\n') + 1);
+
+  // The entries are four white-space-separated numbers each, which may
+  // be on one line or split across several.  strtod() needs a
+  // terminated string, so each token is copied into a small buffer
+  // before it is converted.
+  double values[4];
+  size_t numValues = 0;
+  size_t line = 1;
+  size_t entryLine = 1; //< Line on which the current entry started
+  const char *p = data;
+  char token[64];
+  std::string longToken;
+  while (true) {
+    while ((p < end) && is_space(*p)) {
+      if (*p == '\n') { line++; }
+      p++;
+    }
+    if (p >= end) { break; }
+
+    const char *tokEnd = p;
+    while ((tokEnd < end) && !is_space(*tokEnd)) { tokEnd++; }
+    size_t tokLen = tokEnd - p;
+    const char *tok = token;
+    if (tokLen < sizeof(token)) {
+      std::memcpy(token, p, tokLen);
+      token[tokLen] = '\0';
+    } else {
+      longToken.assign(p, tokEnd);
+      tok = longToken.c_str();
+    }
 
-  while (!in.eof()) {
-    // Read the mapping info from the input file.
-    Mapping map;
-    in >> map.xyLatLong.longitude >> map.xyLatLong.latitude >> map.xyLatLong.x >> map.xyLatLong.y;
-    mapping.push_back(map);
+    char *numEnd;
+    double val = strtod(tok, &numEnd);
+    if ((tokLen == 0) || (numEnd != tok + tokLen)) {
+      std::cerr << "Error: " << sourceName << " line " << line
+        << ": expected a number, found '" << std::string(p, tokEnd)
+        << "'" << std::endl;
+      return std::vector<Mapping>();
+    }
+    p = tokEnd;
+
+    if (numValues == 0) { entryLine = line; }
+    values[numValues++] = val;
+    if (numValues == 4) {
+      mapping.push_back(Mapping(
+        XYLatLong(values[2], values[3], values[1], values[0]), XYZ()));
+      numValues = 0;
+    }
+  }
+  if (numValues != 0) {
+    std::cerr << "Error: " << sourceName << " line " << entryLine
+      << ": incomplete entry (found " << numValues
+      << " of 4 values)" << std::endl;
+    return std::vector<Mapping>();
   }
-  // There will have been one extra added, when running into EOF.
-  mapping.pop_back();
 
   return mapping;
 }
 
+std::vector<Mapping> read_from_infile(std::istream &in)
+{
+  // Read the whole stream in one go and then parse it.
+  std::ostringstream contents;
+  contents << in.rdbuf();
+  std::string s = contents.str();
+  return parse_mapping(s.c_str(), s.size() + 1, "standard input");
+}
+
+void compute_angle_terms(const std::vector<Mapping> &mapping,
+  std::vector<AngleTerms> &terms)
+{
+  terms.clear();
+  terms.reserve(mapping.size());
+  for (size_t i = 0; i < mapping.size(); i++) {
+    // Convert to radians the same way convert_to_normalized_and_meters()
+    // does so that the results match exactly.
+    double latitude = mapping[i].xyLatLong.latitude;
+    double longitude = mapping[i].xyLatLong.longitude;
+    latitude *= MY_PI / 180;
+    longitude *= MY_PI / 180;
+    terms.push_back(AngleTerms(latitude, longitude));
+  }
+}
 
 bool convert_to_normalized_and_meters(
   std::vector<Mapping> &mapping, double toMeters, double depth,
   double left, double bottom, double right, double top,
-  bool useFieldAngles)
+  bool useFieldAngles, const std::vector<AngleTerms> *angleTerms)
 {
-  for (size_t i = 0; i < mapping.size(); i++) {
-    //  Convert the input coordinates from its input space into meters
-    // and then convert (using the screen dimensions) into normalized screen units.
-    mapping[i].xyLatLong.x *= toMeters;
-    mapping[i].xyLatLong.x = (mapping[i].xyLatLong.x - left) / (right - left);
-    mapping[i].xyLatLong.y *= toMeters;
-    mapping[i].xyLatLong.y = (mapping[i].xyLatLong.y - bottom) / (top - bottom);
-
-    // Convert the input latitude and longitude from degrees to radians.
-    mapping[i].xyLatLong.latitude *= MY_PI / 180;
-    mapping[i].xyLatLong.longitude *= MY_PI / 180;
-
-    if (useFieldAngles) {
-      // These are expressed as angles with respect to a screen that is
-      // straight ahead, independent in X and Y.  The -Z axis is straight
-      // ahead.  Positive rotation in longitude points towards +X,
-      // positive rotation in latitude points towards +Y.
-      mapping[i].xyz.x =  depth * tan(mapping[i].xyLatLong.longitude);
-      mapping[i].xyz.y =  depth * tan(mapping[i].xyLatLong.latitude);
-      mapping[i].xyz.z = -depth;
-    } else {
-      // Compute the 3D coordinate of the point w.r.t. the eye at the origin.
-      // longitude = 0, latitude = 0 points along the -Z axis in eye space.
-      // Positive rotation in longitude is towards -X and positive rotation in
-      // latitude points towards +Y.
-      double theta = mapping[i].xyLatLong.longitude;
-      double phi = MY_PI / 2 - mapping[i].xyLatLong.latitude;
-      mapping[i].xyz.y = depth * cos(phi);
-      mapping[i].xyz.z = -depth * cos(theta) * sin(phi);
-      mapping[i].xyz.x = -depth * (-sin(theta)) * sin(phi);
-    }
+  MappingSet set(mapping);
+  if (!convert_to_normalized_and_meters(set, toMeters, depth,
+        left, bottom, right, top, useFieldAngles, angleTerms)) {
+    return false;
+  }
+  set.copyTo(mapping);
+  return true;
+}
+
+bool convert_to_normalized_and_meters(
+  MappingSet &set, double toMeters, double depth,
+  double left, double bottom, double right, double top,
+  bool useFieldAngles, const std::vector<AngleTerms> *angleTerms)
+{
+  if (angleTerms && (angleTerms->size() != set.size())) {
+    std::cerr << "convert_to_normalized_and_meters(): Error: "
+      << angleTerms->size() << " angle terms for " << set.size()
+      << " points" << std::endl;
+    return false;
   }
 
-  // Make sure that the normalized screen coordinates are all within the range 0 to 1.
-  for (size_t i = 0; i < mapping.size(); i++) {
-    if ((mapping[i].xyLatLong.x < 0) || (mapping[i].xyLatLong.x > 1)) {
-      std::cerr << "Warning: Point " << i << " (line " << i+1 << " in the file):"
-        << " x out of range [0,1]: "
-        << mapping[i].xyLatLong.x << " (increase bounds on -screen or don't specify it)"
-        << std::endl;
+  //  Convert the input coordinates from its input space into meters
+  // and then convert (using the screen dimensions) into normalized screen
+  // units, convert the input latitude and longitude from degrees to
+  // radians, compute the 3D location of each point, and check that the
+  // normalized screen coordinates are all within the range 0 to 1, all
+  // in one pass.
+  RangeReport report;
+  convert_mapping_set(set, toMeters, depth, left, bottom, right, top,
+    useFieldAngles, angleTerms, report);
+
+  // Summarize the points that were out of range, listing only the first
+  // few of them, and write it all at once.
+  if (!report.empty()) {
+    std::ostringstream msg;
+    msg << "Warning: Of " << set.size() << " points, ";
+    if (report.xCount > 0) {
+      msg << report.xCount << " have x out of range [0,1] (from "
+        << report.xMin << " to " << report.xMax << ")";
     }
-    if ((mapping[i].xyLatLong.y < 0) || (mapping[i].xyLatLong.y > 1)) {
-      std::cerr << "Warning: Point " << i << " (line " << i + 1 << " in the file):"
-        << " y out of range [0,1]: "
-        << mapping[i].xyLatLong.y << " (increase bounds on -screen or don't specify it)"
-        << std::endl;
+    if ((report.xCount > 0) && (report.yCount > 0)) {
+      msg << " and ";
     }
+    if (report.yCount > 0) {
+      msg << report.yCount << " have y out of range [0,1] (from "
+        << report.yMin << " to " << report.yMax << ")";
+    }
+    msg << " (increase bounds on -screen or don't specify it)\n";
+    for (size_t s = 0; s < report.samples.size(); s++) {
+      size_t i = report.samples[s];
+      msg << "  Point " << i << " (line " << i + 1 << " in the file): x "
+        << set.x[i] << ", y " << set.y[i] << "\n";
+    }
+    if (report.count > report.samples.size()) {
+      msg << "  ... and " << report.count - report.samples.size()
+        << " more\n";
+    }
+    std::cerr << msg.str();
   }
 
   return true;
@@ -111,7 +243,28 @@ bool findScreen(const std::vector<Mapping> &mapping,
   double left, double bottom, double right, double top,
   ScreenDescription &screen, bool verbose)
 {
-  if (mapping.size() == 0) {
+  MappingSet set(mapping);
+  return findScreen(set, left, bottom, right, top, screen, verbose);
+}
+
+bool findScreen(const MappingSet &set,
+  double left, double bottom, double right, double top,
+  ScreenDescription &screen, bool verbose)
+{
+  MappingSetList sets(1, &set);
+  return findScreen(sets, left, bottom, right, top, screen, verbose);
+}
+
+bool findScreen(const MappingSetList &sets,
+  double left, double bottom, double right, double top,
+  ScreenDescription &screen, bool verbose)
+{
+  // Find the first point, in the first set that has any.
+  size_t firstSet = 0;
+  while ((firstSet < sets.size()) && sets[firstSet]->empty()) {
+    firstSet++;
+  }
+  if (firstSet == sets.size()) {
     std::cerr << "findScreen(): Error: No points in mapping" 
       << std::endl;
     return false;
@@ -119,39 +272,51 @@ bool findScreen(const std::vector<Mapping> &mapping,
 
   //====================================================================
   // Figure out the X screen-space extents.
-  // The X screen-space extents are defined by the lines perpendicular to the
-  // Y axis passing through:
-  //  left: the point location whose reprojection into the Y = 0 plane has the most -
-  //        positive angle(note that this may not be the point with the largest
-  //        longitudinal coordinate, because of the impact of changing latitude on
-  //        X - Z position).
-  //  right : the point location whose reprojection into the Y = 0 plane has the most -
-  //        negative angle(note that this may not be the point with the smallest
-  //        longitudinal coordinate, because of the impact of changing latitude on
-  //        X - Z position).
-  XYZ &screenLeft = screen.screenLeft;
-  XYZ &screenRight = screen.screenRight;;
-  screenLeft = screenRight = mapping[0].xyz;
+  // The X screen-space extents are defined by the lines perpendicular to the
+  // Y axis passing through:
+  //  left: the point location whose reprojection into the Y = 0 plane has the most -
+  //        positive angle(note that this may not be the point with the largest
+  //        longitudinal coordinate, because of the impact of changing latitude on
+  //        X - Z position).
+  //  right : the point location whose reprojection into the Y = 0 plane has the most -
+  //        negative angle(note that this may not be the point with the smallest
+  //        longitudinal coordinate, because of the impact of changing latitude on
+  //        X - Z position).
+  //   The rotation of each point is computed once, and we keep the
+  // rotations of the extreme points found so far to compare against.
+  const MappingSet *leftSet = sets[firstSet];
+  const MappingSet *rightSet = sets[firstSet];
+  size_t leftIndex = 0, rightIndex = 0;
+  double leftRotation = atan2(-leftSet->X[0], -leftSet->Z[0]);
+  double rightRotation = leftRotation;
   if (verbose) {
     std::cerr << "First point rotation about Y (degrees): "
-      << screenLeft.rotationAboutY() * 180 / MY_PI << std::endl;
+      << leftRotation * 180 / MY_PI << std::endl;
   }
-  for (size_t i = 0; i < mapping.size(); i++) {
-    if (mapping[i].xyz.rotationAboutY() > screenLeft.rotationAboutY()) {
-      screenLeft = mapping[i].xyz;
-    }
-    if (mapping[i].xyz.rotationAboutY() < screenRight.rotationAboutY()) {
-      screenRight = mapping[i].xyz;
+  for (size_t s = firstSet; s < sets.size(); s++) {
+    const MappingSet &set = *sets[s];
+    for (size_t i = 0; i < set.size(); i++) {
+      double rotation = atan2(-set.X[i], -set.Z[i]);
+      if (rotation > leftRotation) {
+        leftSet = &set; leftIndex = i; leftRotation = rotation;
+      }
+      if (rotation < rightRotation) {
+        rightSet = &set; rightIndex = i; rightRotation = rotation;
+      }
     }
   }
+  XYZ &screenLeft = screen.screenLeft;
+  XYZ &screenRight = screen.screenRight;
+  screenLeft = leftSet->xyz(leftIndex);
+  screenRight = rightSet->xyz(rightIndex);
   if (verbose) {
     std::cerr << "Horizontal angular range: "
-      << 180 / MY_PI * (screenLeft.rotationAboutY() - screenRight.rotationAboutY())
+      << 180 / MY_PI * (leftRotation - rightRotation)
       << std::endl;
   }
-  if (screenLeft.rotationAboutY() - screenRight.rotationAboutY() >= MY_PI) {
+  if (leftRotation - rightRotation >= MY_PI) {
     std::cerr << "findScreen(): Error: Field of view > 180 degrees: found " <<
-      180 / MY_PI * (screenLeft.rotationAboutY() - screenRight.rotationAboutY())
+      180 / MY_PI * (leftRotation - rightRotation)
       << std::endl;
     return false;
   }
@@ -194,19 +359,19 @@ bool findScreen(const std::vector<Mapping> &mapping,
   // Figure out the Y screen-space extents.
   // The Y screen-space extents are symmetric and correspond to the lines parallel
   //  to the screen X axis that are within the plane of the X line specifying the
-  //  axis extents at the largest magnitude angle up or down from the horizontal.
-  // Find the highest-magnitude Y value of all points when they are
-  // projected into the plane of the screen.
-  double &maxY = screen.maxY;
-  maxY = fabs(mapping[0].xyz.projectOntoPlane(A, B, C, D).y);
-  for (size_t i = 1; i < mapping.size(); i++) {
-    double Y = fabs(mapping[i].xyz.projectOntoPlane(A, B, C, D).y);
-    if (Y > maxY) { maxY = Y; }
-  }
+  //  axis extents at the largest magnitude angle up or down from the horizontal.
+  // Find the highest-magnitude Y value of all points when they are
+  // projected into the plane of the screen.
+  double &maxY = screen.maxY;
+  maxY = fabs(sets[firstSet]->xyz(0).projectOntoPlane(A, B, C, D).y);
+  update_max_abs_projected_y(*sets[firstSet], 1, A, B, C, D, maxY);
+  for (size_t s = firstSet + 1; s < sets.size(); s++) {
+    update_max_abs_projected_y(*sets[s], 0, A, B, C, D, maxY);
+  }
   if (verbose) {
     std::cerr << "Maximum-magnitude Y projection: " << maxY << std::endl;
   }
-
+
   //====================================================================
   // Figure out the monocular horizontal field of view for the screen.
   // Find the distance between the left and right points projected
@@ -258,9 +423,9 @@ bool findScreen(const std::vector<Mapping> &mapping,
   // of X is played by the -Z axis and the part of Y is played by the
   // -X axis.  A is associated with the X axis and C with the Z axis.
   // Here is the code we are inverting to go from angle to overlap...
-  //  double overlapFrac = m_params.m_displayConfiguration.getOverlapPercent();
-  //  const auto hfov = m_params.m_displayConfiguration.getHorizontalFOV();
-  //  const auto angularOverlap = hfov * overlapFrac;
+  //  double overlapFrac = m_params.m_displayConfiguration.getOverlapPercent();
+  //  const auto hfov = m_params.m_displayConfiguration.getHorizontalFOV();
+  //  const auto angularOverlap = hfov * overlapFrac;
   //  rotateEyesApart = (hfov - angularOverlap) / 2;
   // Here is the inversion:
   //  rotateEyesApart = (hfov - (hfov * overlapFrac)) / 2;
@@ -312,7 +477,15 @@ bool findMesh(const std::vector<Mapping> &mapping,
   double left, double bottom, double right, double top,
   ScreenDescription const &screen, MeshDescription &mesh, bool verbose)
 {
-  if (mapping.size() == 0) {
+  MappingSet set(mapping);
+  return findMesh(set, left, bottom, right, top, screen, mesh, verbose);
+}
+
+bool findMesh(const MappingSet &set,
+  double left, double bottom, double right, double top,
+  ScreenDescription const &screen, MeshDescription &mesh, bool verbose)
+{
+  if (set.size() == 0) {
     std::cerr << "findMesh(): Error: No points in mapping"
       << std::endl;
     return false;
@@ -344,22 +517,30 @@ bool findMesh(const std::vector<Mapping> &mapping,
   double yOutOffset = screen.maxY; // Negative of negative maxY is maxY
   double yOutScale = 1 / (2 * screen.maxY);
 
-  for (size_t i = 0; i < mapping.size(); i++) {
+  // Project the 3D points back into the plane of the screen and determine
+  // the normalized coordinates in the coordinate system with the lower left
+  // corner at (0,0) and the upper right at (1,1).  Because we oversized the
+  // screen, these will all be in this range.  Otherwise, they might not be.
+  //   This is done a block at a time into buffers on the stack so that
+  // the only memory we need is the mesh itself.
+  const size_t BLOCK = 64;
+  double projX[BLOCK], projY[BLOCK];
+  mesh.reserve(set.size());
+  for (size_t i = 0; i < set.size(); i++) {
+    if (i % BLOCK == 0) {
+      project_onto_plane(set, i, std::min(BLOCK, set.size() - i),
+        A, B, C, D, projX, projY);
+    }
 
     // Input point coordinates are already normalized.
-    double xNormIn = mapping[i].xyLatLong.x;
-    double yNormIn = mapping[i].xyLatLong.y;
+    double xNormIn = set.x[i];
+    double yNormIn = set.y[i];
     std::array<double, 2> in;
     in[0] = xNormIn;
     in[1] = yNormIn;
 
-    // Project the 3D points back into the plane of the screen and determine
-    // the normalized coordinates in the coordinate system with the lower left
-    // corner at (0,0) and the upper right at (1,1).  Because we oversized the
-    // screen, these will all be in this range.  Otherwise, they might not be.
-    XYZ onScreen = mapping[i].xyz.projectOntoPlane(A, B, C, D);
-    double xNormOut = (onScreen.x + xOutOffset) * xOutScale;
-    double yNormOut = (onScreen.y + yOutOffset) * yOutScale;
+    double xNormOut = (projX[i % BLOCK] + xOutOffset) * xOutScale;
+    double yNormOut = (projY[i % BLOCK] + yOutOffset) * yOutScale;
     std::array<double, 2> out;
     out[0] = xNormOut;
     out[1] = yNormOut;
@@ -426,74 +607,136 @@ static bool neighbor_error(
   return dotProduct < minDotProduct;
 }
 
-static double point_distance(double x1, double y1, double x2, double y2) {
-  return std::sqrt((x2 - x1) * (x2 - x1) + (y2 - y1) * (y2 - y1));
-}
-
-/// Finds out how many neighbors of the specified index
-/// in the mapping violate the strictures of the
+/// Finds out how many of the specified neighbors of the specified
+/// index in the mapping violate the strictures of the
 /// remove_invalid_points_based_on_angle function.
-/// Checks up to 8 nearest neighbors in angle space.
 /// @return How many neighbor angle differences are too large.
 static size_t neighbor_errors(
-  const std::vector<Mapping> &mapping, size_t index,
-  double xx, double xy,
-  double yx, double yy, double minDotProduct)
+  const std::vector<Mapping> &mapping, size_t which,
+  std::vector<size_t> const &neighbors,
+  double xx, double xy, double yx, double yy, double minDotProduct)
 {
-  // Sort all points other than the one we're looking for
-  // based on distance from the one we are looking for.
-  typedef std::multimap<double, size_t> PointDistanceIndexMap;
-  PointDistanceIndexMap map;
-  for (size_t i = 0; i < mapping.size(); i++) {
-    if (i != index) {
-      map.insert(std::make_pair(
-        point_distance(
-        mapping[index].xyLatLong.longitude,
-        mapping[index].xyLatLong.latitude,
-        mapping[i].xyLatLong.longitude,
-        mapping[i].xyLatLong.latitude
-        ), i));
-    }
-  }
-
-  // Check the first 8 points on the list (if there are that many)
-  // and count up how many violate the angle condition.
   size_t ret = 0;
-  PointDistanceIndexMap::const_iterator it = map.begin();
-  for (size_t i = 0; (i < map.size()) && (i < 8); i++) {
-    if (neighbor_error(mapping, index, it->second,
+  for (size_t i = 0; i < neighbors.size(); i++) {
+    if (neighbor_error(mapping, which, neighbors[i],
         xx, xy, yx, yy, minDotProduct)) {
       ret++;
     }
-    it++;
   }
   return ret;
 }
 
-/// Looks through the mapping to see if there is a point whose
-/// neighbor angles violate the strictures of the
-/// remove_invalid_points_based_on_angle function.
-/// @return index of the point that has the largest number
-/// of invalid neighbor angles if one is found, size of mapping
-/// if not.
-static size_t find_index_of_angle_worst_offender(
-  std::vector<Mapping> &mapping, double xx, double xy,
-  double yx, double yy, double minDotProduct)
-{
-  size_t worstIndex = 0;
-  size_t worstCount = neighbor_errors(mapping, 0,
-    xx, xy, yx, yy, minDotProduct);
-  for (size_t i = 1; i < mapping.size(); i++) {
-    size_t count = neighbor_errors(mapping, i,
-      xx, xy, yx, yy, minDotProduct);
-    if (count > worstCount) {
-      worstCount = count;
-      worstIndex = i;
+/// Cached neighbor information for each point in the mapping, used
+/// to keep track of the worst offender as points are removed
+/// without re-checking every point each time.
+class AngleOffenderTracker {
+public:
+  AngleOffenderTracker(const std::vector<Mapping> &mapping,
+      NeighborIndex &index, double xx, double xy,
+      double yx, double yy, double minDotProduct)
+    : m_mapping(mapping), m_index(index)
+    , m_xx(xx), m_xy(xy), m_yx(yx), m_yy(yy)
+    , m_minDotProduct(minDotProduct)
+    , m_neighbors(mapping.size())
+    , m_reverse(mapping.size())
+    , m_counts(mapping.size(), 0)
+  {
+    for (size_t i = 0; i < m_mapping.size(); i++) {
+      if (m_index.contains(i)) {
+        m_index.nearest(i, NUM_NEIGHBORS, m_neighbors[i]);
+        for (size_t n = 0; n < m_neighbors[i].size(); n++) {
+          m_reverse[m_neighbors[i][n]].push_back(i);
+        }
+        evaluate(i);
+      }
     }
   }
-  if (worstCount == 0) { return mapping.size(); }
-  return worstIndex;
-}
+
+  /// @return index of the point that has the largest number
+  /// of invalid neighbor angles (the lowest such index if there
+  /// is a tie) if one is found, size of mapping if not.
+  size_t worstOffender()
+  {
+    // Entries in the heap go stale when their point is removed or
+    // re-evaluated; skip any that no longer match.
+    while (!m_heap.empty()) {
+      HeapEntry top = m_heap.top();
+      if (m_index.contains(top.index) && (m_counts[top.index] == top.count)) {
+        return (top.count > 0) ? top.index : m_mapping.size();
+      }
+      m_heap.pop();
+    }
+    return m_mapping.size();
+  }
+
+  /// Remove a point, re-evaluating only the points whose set of
+  /// nearest neighbors included it.  Nobody else's neighbors change.
+  void remove(size_t which)
+  {
+    m_index.remove(which);
+    for (size_t n = 0; n < m_neighbors[which].size(); n++) {
+      unlink(m_neighbors[which][n], which);
+    }
+    m_neighbors[which].clear();
+
+    std::vector<size_t> affected;
+    affected.swap(m_reverse[which]);
+    for (size_t a = 0; a < affected.size(); a++) {
+      size_t p = affected[a];
+      std::vector<size_t> &neighbors = m_neighbors[p];
+      for (size_t n = 0; n < neighbors.size(); n++) {
+        if (neighbors[n] != which) { unlink(neighbors[n], p); }
+      }
+      m_index.nearest(p, NUM_NEIGHBORS, neighbors);
+      for (size_t n = 0; n < neighbors.size(); n++) {
+        m_reverse[neighbors[n]].push_back(p);
+      }
+      evaluate(p);
+    }
+  }
+
+private:
+  static const size_t NUM_NEIGHBORS = 8;
+
+  struct HeapEntry {
+    size_t count;
+    size_t index;
+    // Most errors first, then lowest index.
+    bool operator<(HeapEntry const &o) const {
+      if (count != o.count) { return count < o.count; }
+      return index > o.index;
+    }
+  };
+
+  void evaluate(size_t which)
+  {
+    m_counts[which] = neighbor_errors(m_mapping, which, m_neighbors[which],
+      m_xx, m_xy, m_yx, m_yy, m_minDotProduct);
+    HeapEntry e;
+    e.count = m_counts[which];
+    e.index = which;
+    m_heap.push(e);
+  }
+
+  /// Remove the statement that p has n as a neighbor.
+  void unlink(size_t n, size_t p)
+  {
+    std::vector<size_t> &r = m_reverse[n];
+    std::vector<size_t>::iterator it = std::find(r.begin(), r.end(), p);
+    if (it != r.end()) {
+      *it = r.back();
+      r.pop_back();
+    }
+  }
+
+  const std::vector<Mapping> &m_mapping;
+  NeighborIndex &m_index;
+  double m_xx, m_xy, m_yx, m_yy, m_minDotProduct;
+  std::vector< std::vector<size_t> > m_neighbors; //< Nearest neighbors of each point
+  std::vector< std::vector<size_t> > m_reverse;   //< Points that have each as a neighbor
+  std::vector<size_t> m_counts;                   //< Neighbor errors for each point
+  std::priority_queue<HeapEntry> m_heap;
+};
 
 int remove_invalid_points_based_on_angle(
   std::vector<Mapping> &mapping, double xx, double xy,
@@ -506,21 +749,159 @@ int remove_invalid_points_based_on_angle(
   // of the angle.
   double minDotProduct = cos(maxAngleDegrees / 180.0 * MY_PI);
 
+  // Build a spatial index over the points in angle space so that we
+  // can find their neighbors quickly.  Points are removed from the
+  // index rather than from the mapping as we go, so that the indices
+  // stay valid; the mapping is compacted once at the end.
+  std::vector<NeighborIndex::Point> angles(mapping.size());
+  for (size_t i = 0; i < mapping.size(); i++) {
+    angles[i][0] = mapping[i].xyLatLong.longitude;
+    angles[i][1] = mapping[i].xyLatLong.latitude;
+  }
+  NeighborIndex index(angles);
+  AngleOffenderTracker tracker(mapping, index, xx, xy, yx, yy, minDotProduct);
+
   // We remove the worst offender from the list each time,
   // then re-start.  Assuming that we get the actual outlier,
   // as opposed to one of its neighbors, this avoids trimming
   // too many points from the vector.
-  bool foundOutlier;
-  do {
-    foundOutlier = false;
-    size_t off = find_index_of_angle_worst_offender(
-      mapping, xx, xy, yx, yy, minDotProduct);
-    if (off < mapping.size()) {
-      mapping.erase(mapping.begin() + off);
-      foundOutlier = true;
-      ret++;
+  size_t off;
+  while ((off = tracker.worstOffender()) < mapping.size()) {
+    tracker.remove(off);
+    ret++;
+  }
+
+  // Keep only the points that are still in the index, preserving
+  // their order.
+  size_t kept = 0;
+  for (size_t i = 0; i < mapping.size(); i++) {
+    if (index.contains(i)) {
+      mapping[kept++] = mapping[i];
+    }
+  }
+  mapping.resize(kept);
+
+  return ret;
+}
+
+int remove_invalid_points_locally(
+  std::vector<Mapping> &mapping, double xx, double xy,
+  double yx, double yy, double maxAngleDegrees, size_t numThreads,
+  size_t *numSweeps)
+{
+  double minDotProduct = cos(maxAngleDegrees / 180.0 * MY_PI);
+  size_t n = mapping.size();
+  if (numSweeps) { *numSweeps = 0; }
+
+  // Points are handled in blocks so that each job has enough work to
+  // be worth handing to a thread.
+  const size_t BLOCK = 1024;
+  size_t numBlocks = (n + BLOCK - 1) / BLOCK;
+
+  // Build the neighbor graph once, from the same index and with the
+  // same number of neighbors as the greedy version uses.  Unlike that
+  // version, the graph is not updated as points are removed.
+  const size_t NUM_NEIGHBORS = 8;
+  std::vector<NeighborIndex::Point> angles(n);
+  for (size_t i = 0; i < n; i++) {
+    angles[i][0] = mapping[i].xyLatLong.longitude;
+    angles[i][1] = mapping[i].xyLatLong.latitude;
+  }
+  NeighborIndex index(angles);
+  std::vector< std::vector<size_t> > neighbors(n);
+  run_in_parallel(numBlocks, numThreads, [&](size_t b) {
+    size_t end = std::min(n, (b + 1) * BLOCK);
+    for (size_t i = b * BLOCK; i < end; i++) {
+      index.nearest(i, NUM_NEIGHBORS, neighbors[i]);
+    }
+  });
+
+  // A point's score is the number of its remaining neighbors that it
+  // disagrees with.  neighbor_error() gives the same answer whichever
+  // of the two points comes first, so every bad pair is seen by each
+  // point that has the other as a neighbor.  In each sweep we remove
+  // every point that scores at least as high as all of the neighbors it
+  // disagrees with.  Tied points go together, which clears a cluster of
+  // outliers in a few sweeps rather than one tie at a time.  The point
+  // with the highest score always goes, so each sweep makes progress;
+  // we stop when no scores are left.
+  //   A run of disagreeing points whose scores fall off along it loses
+  // only its top point each sweep, so it could take a sweep per point.
+  // After MAX_SWEEPS we hand whatever is left to the greedy version.
+  const size_t MAX_SWEEPS = 16;
+  std::vector<unsigned char> alive(n, 1);
+  std::vector<size_t> score(n, 0);
+  std::vector<unsigned char> doomed(n, 0);
+  int ret = 0;
+  bool finished = false;
+  for (size_t sweep = 0; sweep < MAX_SWEEPS; sweep++) {
+    run_in_parallel(numBlocks, numThreads, [&](size_t b) {
+      size_t end = std::min(n, (b + 1) * BLOCK);
+      for (size_t i = b * BLOCK; i < end; i++) {
+        score[i] = 0;
+        if (!alive[i]) { continue; }
+        std::vector<size_t> const &nb = neighbors[i];
+        for (size_t k = 0; k < nb.size(); k++) {
+          if (alive[nb[k]] && neighbor_error(mapping, i, nb[k],
+                xx, xy, yx, yy, minDotProduct)) {
+            score[i]++;
+          }
+        }
+      }
+    });
+
+    std::vector<size_t> removed(numBlocks, 0);
+    run_in_parallel(numBlocks, numThreads, [&](size_t b) {
+      size_t end = std::min(n, (b + 1) * BLOCK);
+      for (size_t i = b * BLOCK; i < end; i++) {
+        doomed[i] = 0;
+        if (score[i] == 0) { continue; }
+        bool highest = true;
+        std::vector<size_t> const &nb = neighbors[i];
+        for (size_t k = 0; highest && (k < nb.size()); k++) {
+          size_t j = nb[k];
+          if (!alive[j] || (score[j] <= score[i])) {
+            continue;
+          }
+          if (neighbor_error(mapping, i, j, xx, xy, yx, yy, minDotProduct)) {
+            highest = false;
+          }
+        }
+        if (highest) {
+          doomed[i] = 1;
+          removed[b]++;
+        }
+      }
+    });
+
+    size_t count = 0;
+    for (size_t b = 0; b < numBlocks; b++) { count += removed[b]; }
+    if (count == 0) {
+      finished = true;
+      break;
     }
-  } while (foundOutlier);
+    if (numSweeps) { (*numSweeps)++; }
+    for (size_t i = 0; i < n; i++) {
+      if (doomed[i]) { alive[i] = 0; }
+    }
+    ret += static_cast<int>(count);
+  }
+
+  // Keep only the points that survived, preserving their order.
+  size_t kept = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (alive[i]) {
+      mapping[kept++] = mapping[i];
+    }
+  }
+  mapping.resize(kept);
+
+  if (!finished) {
+    int more = remove_invalid_points_based_on_angle(mapping,
+      xx, xy, yx, yy, maxAngleDegrees);
+    if (more < 0) { return more; }
+    ret += more;
+  }
 
   return ret;
 }
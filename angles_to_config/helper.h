@@ -26,12 +26,27 @@
 #pragma once
 
 #include "types.h"
+#include "mapping_set.h"
 #include <iostream>
 #include <vector>
+#include <string>
 
 // Returns empty mapping if it fails to read anything.
 extern std::vector<Mapping> read_from_infile(std::istream &in);
 
+/// Read the entire contents of a file into a buffer.
+/// @return false if the file could not be opened or read.
+extern bool read_file_contents(const std::string &fileName,
+  std::vector<char> &contents);
+
+/// Parse a table of longitude, latitude, x, y entries from a buffer.
+/// Reports the line number of any malformed entry on std::cerr
+/// using the source name to say where it came from.
+///   Returns empty mapping if it fails to read anything or if there
+/// is a malformed entry.
+extern std::vector<Mapping> parse_mapping(const char *data, size_t length,
+  const std::string &sourceName);
+
 /// This removes invalid points from the mesh if the angle
 /// between the vector from a point to its neighbor in lat/long
 /// space (when transformed by the specified mapping into screen
@@ -45,16 +60,68 @@ extern int remove_invalid_points_based_on_angle(
   std::vector<Mapping> &mapping, double xx, double xy,
   double yx, double yy, double maxAngleDegrees);
 
+/// Which of the functions above and below removes the points that
+/// fail the angle test.
+enum OutlierMode {
+  OUTLIERS_GREEDY,  //!< remove_invalid_points_based_on_angle()
+  OUTLIERS_LOCAL    //!< remove_invalid_points_locally()
+};
+
+/// Uses the same test as remove_invalid_points_based_on_angle(), but
+/// finds each point's neighbors only once, scores all of the points in
+/// parallel on up to numThreads threads, and removes in each sweep every
+/// point that no neighbor it disagrees with outscores, so tied points go
+/// together.  This takes a few sweeps of near-linear work rather than one
+/// search per removed point, so it is much faster for large meshes.  It
+/// does not look for new neighbors as points are removed, so it can keep
+/// or remove somewhat different points than the greedy version.  If
+/// points still fail the test after 16 sweeps, the greedy version
+/// removes the rest.  If numSweeps is not NULL, it is set to the number
+/// of sweeps that removed points.
+///   @return -1 on error, the number of points that were
+/// removed from the mesh otherwise.
+extern int remove_invalid_points_locally(
+  std::vector<Mapping> &mapping, double xx, double xy,
+  double yx, double yy, double maxAngleDegrees, size_t numThreads = 1,
+  size_t *numSweeps = NULL);
+
+/// Compute the angle terms for each entry in a mapping whose angles
+/// are still in degrees (as read from the input file).
+extern void compute_angle_terms(const std::vector<Mapping> &mapping,
+  std::vector<AngleTerms> &terms);
+
+/// If angleTerms is not NULL, it must have one entry per mapping entry
+/// and the 3D locations are computed from it rather than by evaluating
+/// the trigonometric functions of the angles.
 extern bool convert_to_normalized_and_meters(
   std::vector<Mapping> &mapping, double toMeters, double depth,
   double left, double bottom, double right, double top,
-  bool useFieldAngles = false);
+  bool useFieldAngles = false,
+  const std::vector<AngleTerms> *angleTerms = NULL);
+extern bool convert_to_normalized_and_meters(
+  MappingSet &set, double toMeters, double depth,
+  double left, double bottom, double right, double top,
+  bool useFieldAngles = false,
+  const std::vector<AngleTerms> *angleTerms = NULL);
 
 extern bool findScreen(const std::vector<Mapping> &mapping,
   double left, double bottom, double right, double top,
   ScreenDescription &screen, bool verbose = false);
+extern bool findScreen(const MappingSet &set,
+  double left, double bottom, double right, double top,
+  ScreenDescription &screen, bool verbose = false);
+
+/// Find the screen that encloses all of the points in all of the sets,
+/// as if they had been concatenated into one set in order.  Empty sets
+/// are skipped.
+extern bool findScreen(const MappingSetList &sets,
+  double left, double bottom, double right, double top,
+  ScreenDescription &screen, bool verbose = false);
 
 extern bool findMesh(const std::vector<Mapping> &mapping,
   double left, double bottom, double right, double top,
   ScreenDescription const &screen, MeshDescription &mesh, bool verbose = false);
+extern bool findMesh(const MappingSet &set,
+  double left, double bottom, double right, double top,
+  ScreenDescription const &screen, MeshDescription &mesh, bool verbose = false);
 
@@ -0,0 +1,215 @@
+/** @file
+    @brief Binary cache of cleaned-up mappings so that repeated runs on
+           the same input files can skip parsing and angle verification.
+
+    @date 2016
+
+    @author
+    Russ Taylor working through ReliaSolve.com for Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Internal Includes
+#include "mapping_cache.h"
+#include "helper.h"
+#include "file_util.h"
+
+// Standard includes
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+
+static const char CACHE_MAGIC[8] = { 'A', '2', 'C', 'M', 'A', 'P', '1', '\0' };
+static const uint32_t CACHE_VERSION = 2;
+static const uint32_t CACHE_BYTE_ORDER = 0x01020304;
+static const uint32_t CACHE_NUM_ARRAYS = 10;
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t byteOrder;   //!< CACHE_BYTE_ORDER as written by the creator
+  uint64_t key;
+  uint64_t count;       //!< Number of points
+  uint32_t numArrays;
+  uint32_t headerBytes; //!< Offset of the first array
+} CacheHeader;
+
+std::string mapping_cache_name(const std::string &inputFileName)
+{
+  return inputFileName + ".a2c";
+}
+
+// 64-bit FNV-1a hash, which can be extended a piece at a time.
+static const uint64_t FNV_OFFSET = 14695981039346656037ULL;
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t length)
+{
+  const unsigned char *p = static_cast<const unsigned char *>(data);
+  for (size_t i = 0; i < length; i++) {
+    hash ^= p[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+uint64_t mapping_cache_key(const char *data, size_t length,
+  bool verifyAngles, double xx, double xy, double yx, double yy,
+  double maxAngleDegrees, bool localOutliers)
+{
+  uint64_t hash = fnv1a(FNV_OFFSET, &CACHE_VERSION, sizeof(CACHE_VERSION));
+  uint64_t len = length;
+  hash = fnv1a(hash, &len, sizeof(len));
+  hash = fnv1a(hash, data, length);
+  unsigned char verify = verifyAngles ? 1 : 0;
+  hash = fnv1a(hash, &verify, sizeof(verify));
+  if (verifyAngles) {
+    double params[5] = { xx, xy, yx, yy, maxAngleDegrees };
+    hash = fnv1a(hash, params, sizeof(params));
+    unsigned char mode = localOutliers ? 1 : 0;
+    hash = fnv1a(hash, &mode, sizeof(mode));
+  }
+  return hash;
+}
+
+bool read_mapping_cache(const std::string &fileName, uint64_t key,
+  std::vector<Mapping> &mapping, std::vector<AngleTerms> &terms)
+{
+  // Map the file and copy each array straight out of it.
+  Mapped_File contents;
+  if (!contents.open(fileName)) {
+    return false;
+  }
+
+  CacheHeader header;
+  if (contents.size() < sizeof(header)) {
+    std::cerr << "Warning: Cache file " << fileName << " is truncated, ignoring"
+      << std::endl;
+    return false;
+  }
+  memcpy(&header, contents.data(), sizeof(header));
+  if ((memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0) ||
+      (header.version != CACHE_VERSION) ||
+      (header.byteOrder != CACHE_BYTE_ORDER) ||
+      (header.numArrays != CACHE_NUM_ARRAYS) ||
+      (header.headerBytes != sizeof(header))) {
+    std::cerr << "Warning: " << fileName << " is not a cache file that"
+      << " this version can read, ignoring" << std::endl;
+    return false;
+  }
+  if (header.key != key) {
+    // Written for a different input file or different settings.
+    return false;
+  }
+  // Check the count against the file size before multiplying, so that a
+  // corrupt count cannot wrap around to a size that matches.
+  const size_t maxCount = (contents.size() - sizeof(header)) /
+    (CACHE_NUM_ARRAYS * sizeof(double));
+  if (header.count > maxCount) {
+    std::cerr << "Warning: Cache file " << fileName << " is truncated, ignoring"
+      << std::endl;
+    return false;
+  }
+  size_t count = static_cast<size_t>(header.count);
+  if (contents.size() != sizeof(header) + CACHE_NUM_ARRAYS * count * sizeof(double)) {
+    std::cerr << "Warning: Cache file " << fileName << " has the wrong size,"
+      << " ignoring" << std::endl;
+    return false;
+  }
+
+  // Copy each array out into its field.
+  const unsigned char *base = contents.data() + sizeof(header);
+  const size_t arrayBytes = count * sizeof(double);
+  mapping.resize(count);
+  terms.resize(count);
+  double v;
+#define READ_ARRAY(n, dest) \
+  for (size_t i = 0; i < count; i++) { \
+    memcpy(&v, base + (n) * arrayBytes + i * sizeof(double), sizeof(v)); \
+    dest = v; \
+  }
+  READ_ARRAY(0, mapping[i].xyLatLong.x);
+  READ_ARRAY(1, mapping[i].xyLatLong.y);
+  READ_ARRAY(2, mapping[i].xyLatLong.latitude);
+  READ_ARRAY(3, mapping[i].xyLatLong.longitude);
+  READ_ARRAY(4, terms[i].tanLong);
+  READ_ARRAY(5, terms[i].tanLat);
+  READ_ARRAY(6, terms[i].sinTheta);
+  READ_ARRAY(7, terms[i].cosTheta);
+  READ_ARRAY(8, terms[i].sinPhi);
+  READ_ARRAY(9, terms[i].cosPhi);
+#undef READ_ARRAY
+
+  return true;
+}
+
+bool write_mapping_cache(const std::string &fileName, uint64_t key,
+  const std::vector<Mapping> &mapping, const std::vector<AngleTerms> &terms)
+{
+  if (terms.size() != mapping.size()) {
+    std::cerr << "write_mapping_cache(): Error: " << terms.size()
+      << " angle terms for " << mapping.size() << " points" << std::endl;
+    return false;
+  }
+  size_t count = mapping.size();
+
+  CacheHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+  header.version = CACHE_VERSION;
+  header.byteOrder = CACHE_BYTE_ORDER;
+  header.key = key;
+  header.count = count;
+  header.numArrays = CACHE_NUM_ARRAYS;
+  header.headerBytes = sizeof(header);
+
+  // Lay the whole file out in memory and write it in one go.
+  std::vector<char> contents(sizeof(header) + CACHE_NUM_ARRAYS * count * sizeof(double));
+  memcpy(contents.data(), &header, sizeof(header));
+  char *base = contents.data() + sizeof(header);
+  const size_t arrayBytes = count * sizeof(double);
+  double v;
+#define WRITE_ARRAY(n, src) \
+  for (size_t i = 0; i < count; i++) { \
+    v = src; \
+    memcpy(base + (n) * arrayBytes + i * sizeof(double), &v, sizeof(v)); \
+  }
+  WRITE_ARRAY(0, mapping[i].xyLatLong.x);
+  WRITE_ARRAY(1, mapping[i].xyLatLong.y);
+  WRITE_ARRAY(2, mapping[i].xyLatLong.latitude);
+  WRITE_ARRAY(3, mapping[i].xyLatLong.longitude);
+  WRITE_ARRAY(4, terms[i].tanLong);
+  WRITE_ARRAY(5, terms[i].tanLat);
+  WRITE_ARRAY(6, terms[i].sinTheta);
+  WRITE_ARRAY(7, terms[i].cosTheta);
+  WRITE_ARRAY(8, terms[i].sinPhi);
+  WRITE_ARRAY(9, terms[i].cosPhi);
+#undef WRITE_ARRAY
+
+  std::string tempName;
+  FILE *f = open_replacement_file(fileName, tempName);
+  if (f == NULL) {
+    std::cerr << "write_mapping_cache(): Error: Could not open "
+      << tempName << " for writing" << std::endl;
+    return false;
+  }
+  bool ok = (fwrite(contents.data(), 1, contents.size(), f) == contents.size());
+  if (!finish_replacement_file(f, ok, tempName, fileName)) {
+    std::cerr << "write_mapping_cache(): Error: Could not write "
+      << fileName << std::endl;
+    return false;
+  }
+  return true;
+}
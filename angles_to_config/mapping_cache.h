@@ -0,0 +1,68 @@
+/** @file
+    @brief Binary cache of cleaned-up mappings so that repeated runs on
+           the same input files can skip parsing and angle verification.
+
+    @date 2016
+
+    @author
+    Russ Taylor working through ReliaSolve.com for Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "types.h"
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <stdint.h>
+
+//  The cache file holds a fixed-size header followed by one array of
+// doubles per field, each with one entry per point and in this order:
+// x, y, latitude, longitude (all as read from the input file), then the
+// AngleTerms fields tanLong, tanLat, sinTheta, cosTheta, sinPhi, cosPhi.
+// Every array starts on an 8-byte boundary so that the file can be
+// memory mapped and used in place.  Values are stored in the byte order
+// of the machine that wrote them; the header records which that was so
+// that files from another machine are rejected rather than misread.
+//   The screen-space values are stored before scaling and the angles
+// before conversion to radians, so the same file serves for any
+// -mm, -screen, -eye, -depth_meters or -latlong setting.
+
+/// Name of the cache file that goes with an input file.
+extern std::string mapping_cache_name(const std::string &inputFileName);
+
+/// Compute the key that a cache file must match to be used: a hash of
+/// the input file's contents along with the settings that change which
+/// points are kept.  localOutliers is true for -outlier_mode local.
+extern uint64_t mapping_cache_key(const char *data, size_t length,
+  bool verifyAngles, double xx, double xy, double yx, double yy,
+  double maxAngleDegrees, bool localOutliers = false);
+
+/// Read a mapping and its angle terms from a cache file.
+/// @return false if the file does not exist, is not a valid cache file,
+/// or was written for a different key.  Only reports on std::cerr if
+/// the file exists but is damaged.
+extern bool read_mapping_cache(const std::string &fileName, uint64_t key,
+  std::vector<Mapping> &mapping, std::vector<AngleTerms> &terms);
+
+/// Write a mapping and its angle terms to a cache file.  The file is
+/// written under a temporary name and then moved into place so that
+/// concurrent runs never see a partial file.
+/// @return false (with a message on std::cerr) on failure.
+extern bool write_mapping_cache(const std::string &fileName, uint64_t key,
+  const std::vector<Mapping> &mapping, const std::vector<AngleTerms> &terms);
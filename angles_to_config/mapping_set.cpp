@@ -0,0 +1,267 @@
+/** @file
+    @brief Structure-of-arrays storage for a mapping, along with the
+           per-point kernels that operate on it.
+
+    @date 2016
+
+    @author
+    Russ Taylor working through ReliaSolve.com for Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Internal Includes
+#include "mapping_set.h"
+
+// Standard includes
+#include <cmath>
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define A2C_SIMD_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define A2C_SIMD_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define A2C_SIMD_NEON
+#endif
+
+void MappingSet::resize(size_t count)
+{
+  x.resize(count); y.resize(count);
+  latitude.resize(count); longitude.resize(count);
+  X.resize(count); Y.resize(count); Z.resize(count);
+}
+
+void MappingSet::reserve(size_t count)
+{
+  x.reserve(count); y.reserve(count);
+  latitude.reserve(count); longitude.reserve(count);
+  X.reserve(count); Y.reserve(count); Z.reserve(count);
+}
+
+void MappingSet::assign(std::vector<Mapping> const &mapping)
+{
+  resize(mapping.size());
+  for (size_t i = 0; i < mapping.size(); i++) {
+    x[i] = mapping[i].xyLatLong.x;
+    y[i] = mapping[i].xyLatLong.y;
+    latitude[i] = mapping[i].xyLatLong.latitude;
+    longitude[i] = mapping[i].xyLatLong.longitude;
+    X[i] = mapping[i].xyz.x;
+    Y[i] = mapping[i].xyz.y;
+    Z[i] = mapping[i].xyz.z;
+  }
+}
+
+void MappingSet::assign(std::vector<Mapping> const &mapping, bool reflect,
+  size_t boundsFirst, double &minX, double &minY, double &maxX, double &maxY)
+{
+  resize(mapping.size());
+  if (mapping.size() > boundsFirst) {
+    minX = maxX = mapping[boundsFirst].xyLatLong.x;
+    minY = maxY = mapping[boundsFirst].xyLatLong.y;
+  }
+
+  double sign = reflect ? -1 : 1;
+  for (size_t i = 0; i < mapping.size(); i++) {
+    double px = mapping[i].xyLatLong.x;
+    double py = mapping[i].xyLatLong.y;
+    if (i >= boundsFirst) {
+      if (px < minX) { minX = px; }
+      if (px > maxX) { maxX = px; }
+      if (py < minY) { minY = py; }
+      if (py > maxY) { maxY = py; }
+    }
+    x[i] = px * sign;
+    y[i] = py;
+    latitude[i] = mapping[i].xyLatLong.latitude;
+    longitude[i] = mapping[i].xyLatLong.longitude * sign;
+    X[i] = mapping[i].xyz.x;
+    Y[i] = mapping[i].xyz.y;
+    Z[i] = mapping[i].xyz.z;
+  }
+}
+
+void MappingSet::copyTo(std::vector<Mapping> &mapping) const
+{
+  mapping.resize(size());
+  for (size_t i = 0; i < mapping.size(); i++) {
+    mapping[i].xyLatLong = XYLatLong(x[i], y[i], latitude[i], longitude[i]);
+    mapping[i].xyz = XYZ(X[i], Y[i], Z[i]);
+  }
+}
+
+//====================================================================
+// Add a normalized screen coordinate to the range of those out of range
+// if it is outside [0,1], returning whether it was.
+static bool note_out_of_range(double v, size_t &count, double &vMin, double &vMax)
+{
+  if (!((v < 0) || (v > 1))) { return false; }
+  if (count == 0) {
+    vMin = vMax = v;
+  } else {
+    if (v < vMin) { vMin = v; }
+    if (v > vMax) { vMax = v; }
+  }
+  count++;
+  return true;
+}
+
+void convert_mapping_set(MappingSet &set, double toMeters,
+  double depth, double left, double bottom, double right, double top,
+  bool useFieldAngles, const std::vector<AngleTerms> *angleTerms,
+  RangeReport &report)
+{
+  report = RangeReport();
+  double xRange = right - left;
+  double yRange = top - bottom;
+  const double toRadians = MY_PI / 180;
+  for (size_t i = 0; i < set.size(); i++) {
+    // Each step does the same operations, in the same order, as the
+    // Mapping version of convert_to_normalized_and_meters().
+    double x = set.x[i] * toMeters;
+    x = (x - left) / xRange;
+    double y = set.y[i] * toMeters;
+    y = (y - bottom) / yRange;
+    set.x[i] = x;
+    set.y[i] = y;
+    bool outX = note_out_of_range(x, report.xCount, report.xMin, report.xMax);
+    bool outY = note_out_of_range(y, report.yCount, report.yMin, report.yMax);
+    if (outX || outY) {
+      if (report.count < RangeReport::MAX_SAMPLES) {
+        report.samples.push_back(i);
+      }
+      report.count++;
+    }
+
+    double latitude = set.latitude[i] * toRadians;
+    double longitude = set.longitude[i] * toRadians;
+    set.latitude[i] = latitude;
+    set.longitude[i] = longitude;
+    if (angleTerms) {
+      const AngleTerms &t = (*angleTerms)[i];
+      if (useFieldAngles) {
+        set.X[i] = depth * t.tanLong;
+        set.Y[i] = depth * t.tanLat;
+        set.Z[i] = -depth;
+      } else {
+        set.Y[i] = depth * t.cosPhi;
+        set.Z[i] = -depth * t.cosTheta * t.sinPhi;
+        set.X[i] = -depth * (-t.sinTheta) * t.sinPhi;
+      }
+    } else if (useFieldAngles) {
+      set.X[i] = depth * tan(longitude);
+      set.Y[i] = depth * tan(latitude);
+      set.Z[i] = -depth;
+    } else {
+      double theta = longitude;
+      double phi = MY_PI / 2 - latitude;
+      set.Y[i] = depth * cos(phi);
+      set.Z[i] = -depth * cos(theta) * sin(phi);
+      set.X[i] = -depth * (-sin(theta)) * sin(phi);
+    }
+  }
+}
+
+// Project count points starting at (x, y, z) onto the plane.  See
+// project_onto_plane().
+static void project_range(const double *x, const double *y, const double *z,
+  size_t count, double A, double B, double C, double D,
+  double *projX, double *projY)
+{
+  // See XYZ::projectOntoPlane() for the derivation.
+  size_t i = 0;
+#if defined(A2C_SIMD_AVX2)
+  __m256d a = _mm256_set1_pd(A);
+  __m256d b = _mm256_set1_pd(B);
+  __m256d c = _mm256_set1_pd(C);
+  __m256d negD = _mm256_set1_pd(-D);
+  for (; i + 4 <= count; i += 4) {
+    __m256d px = _mm256_loadu_pd(x + i);
+    __m256d py = _mm256_loadu_pd(y + i);
+    __m256d pz = _mm256_loadu_pd(z + i);
+    __m256d dot = _mm256_add_pd(_mm256_add_pd(
+      _mm256_mul_pd(a, px), _mm256_mul_pd(b, py)), _mm256_mul_pd(c, pz));
+    __m256d s = _mm256_div_pd(negD, dot);
+    if (projX) { _mm256_storeu_pd(projX + i, _mm256_mul_pd(s, px)); }
+    if (projY) { _mm256_storeu_pd(projY + i, _mm256_mul_pd(s, py)); }
+  }
+#elif defined(A2C_SIMD_SSE2)
+  __m128d a = _mm_set1_pd(A);
+  __m128d b = _mm_set1_pd(B);
+  __m128d c = _mm_set1_pd(C);
+  __m128d negD = _mm_set1_pd(-D);
+  for (; i + 2 <= count; i += 2) {
+    __m128d px = _mm_loadu_pd(x + i);
+    __m128d py = _mm_loadu_pd(y + i);
+    __m128d pz = _mm_loadu_pd(z + i);
+    __m128d dot = _mm_add_pd(_mm_add_pd(
+      _mm_mul_pd(a, px), _mm_mul_pd(b, py)), _mm_mul_pd(c, pz));
+    __m128d s = _mm_div_pd(negD, dot);
+    if (projX) { _mm_storeu_pd(projX + i, _mm_mul_pd(s, px)); }
+    if (projY) { _mm_storeu_pd(projY + i, _mm_mul_pd(s, py)); }
+  }
+#elif defined(A2C_SIMD_NEON)
+  float64x2_t a = vdupq_n_f64(A);
+  float64x2_t b = vdupq_n_f64(B);
+  float64x2_t c = vdupq_n_f64(C);
+  float64x2_t negD = vdupq_n_f64(-D);
+  for (; i + 2 <= count; i += 2) {
+    float64x2_t px = vld1q_f64(x + i);
+    float64x2_t py = vld1q_f64(y + i);
+    float64x2_t pz = vld1q_f64(z + i);
+    float64x2_t dot = vaddq_f64(vaddq_f64(
+      vmulq_f64(a, px), vmulq_f64(b, py)), vmulq_f64(c, pz));
+    float64x2_t s = vdivq_f64(negD, dot);
+    if (projX) { vst1q_f64(projX + i, vmulq_f64(s, px)); }
+    if (projY) { vst1q_f64(projY + i, vmulq_f64(s, py)); }
+  }
+#endif
+  for (; i < count; i++) {
+    double s = -D / (A*x[i] + B*y[i] + C*z[i]);
+    if (projX) { projX[i] = s*x[i]; }
+    if (projY) { projY[i] = s*y[i]; }
+  }
+}
+
+void project_onto_plane(MappingSet const &set, size_t first, size_t count,
+  double A, double B, double C, double D, double *projX, double *projY)
+{
+  if (count == 0) { return; }
+  project_range(&set.X[first], &set.Y[first], &set.Z[first], count,
+    A, B, C, D, projX, projY);
+}
+
+void update_max_abs_projected_y(MappingSet const &set, size_t first,
+  double A, double B, double C, double D, double &maxY)
+{
+  // Project a block at a time into a buffer on the stack, then go
+  // through the block in order so that the comparisons happen exactly
+  // as they would one point at a time.
+  const size_t BLOCK = 64;
+  double projY[BLOCK];
+  for (size_t start = first; start < set.size(); start += BLOCK) {
+    size_t count = std::min(BLOCK, set.size() - start);
+    project_onto_plane(set, start, count, A, B, C, D, NULL, projY);
+    for (size_t i = 0; i < count; i++) {
+      double Y = fabs(projY[i]);
+      if (Y > maxY) { maxY = Y; }
+    }
+  }
+}
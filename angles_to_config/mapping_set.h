@@ -0,0 +1,130 @@
+/** @file
+    @brief Structure-of-arrays storage for a mapping, along with the
+           per-point kernels that operate on it.
+
+    @date 2016
+
+    @author
+    Russ Taylor working through ReliaSolve.com for Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "types.h"
+#include <vector>
+#include <cstddef>
+
+/// Holds the same information as a std::vector<Mapping>, but with one
+/// array per field so that the per-point calculations can run on
+/// several points at once.  Entry i of each array belongs to point i.
+class MappingSet {
+public:
+  // Screen-space to/from angle-space entries (see XYLatLong)
+  std::vector<double> x;
+  std::vector<double> y;
+  std::vector<double> latitude;
+  std::vector<double> longitude;
+
+  // Associated 3D coordinates (see XYZ)
+  std::vector<double> X;
+  std::vector<double> Y;
+  std::vector<double> Z;
+
+  MappingSet() {}
+  explicit MappingSet(std::vector<Mapping> const &mapping) { assign(mapping); }
+
+  size_t size() const { return x.size(); }
+  bool empty() const { return x.empty(); }
+  void resize(size_t count);
+  void reserve(size_t count);
+
+  /// Replace the contents with those of a mapping vector.
+  void assign(std::vector<Mapping> const &mapping);
+
+  /// Replace the contents with those of a mapping vector in the same
+  /// pass that finds the bounds of the screen coordinates of the points
+  /// from index boundsFirst on (before any reflection).  If reflect is
+  /// set, the longitudes and screen X coordinates are negated, reflecting
+  /// the points around X=0.  The bounds are not changed if there are no
+  /// points from boundsFirst on.
+  void assign(std::vector<Mapping> const &mapping, bool reflect,
+    size_t boundsFirst, double &minX, double &minY, double &maxX,
+    double &maxY);
+
+  /// Copy the contents into a mapping vector, replacing what was there.
+  void copyTo(std::vector<Mapping> &mapping) const;
+
+  XYZ xyz(size_t i) const { return XYZ(X[i], Y[i], Z[i]); }
+};
+
+/// A list of sets that are to be treated as a single set holding all of
+/// their points in order, without copying them into one.
+typedef std::vector<MappingSet const *> MappingSetList;
+
+//====================================================================
+// Kernels.  The projection onto the screen plane, which is the only
+// one run many times per point, uses AVX2 when the compiler is
+// targeting it (see ANGLES_TO_CONFIG_USE_AVX2 in the CMakeLists.txt
+// file), SSE2 on other x86 builds, NEON on 64-bit ARM and a scalar
+// loop otherwise.  Every version does the same IEEE operations in the
+// same order as the scalar loop, so they all produce identical
+// results.  The conversion pass needs trigonometric functions and
+// calls the standard library for each point so that its results match
+// the AoS code exactly.
+
+/// Describes the points whose normalized screen coordinates fell outside
+/// of [0,1], keeping the indices of only the first few of them.
+class RangeReport {
+public:
+  static const size_t MAX_SAMPLES = 10;
+
+  size_t count = 0;                 //< How many were out of range in either
+  size_t xCount = 0, yCount = 0;    //< How many were out of range in each
+  double xMin = 0, xMax = 0;        //< Range of the out-of-range x values
+  double yMin = 0, yMax = 0;        //< Range of the out-of-range y values
+  std::vector<size_t> samples;      //< First points out of range in either
+
+  bool empty() const { return count == 0; }
+};
+
+/// In a single pass over the points: scale the screen coordinates by
+/// toMeters and normalize them so that the specified screen boundaries
+/// map to 0 and 1; convert the latitude and longitude from degrees to
+/// radians; and fill in the 3D location of each point at the specified
+/// depth.  If angleTerms is not NULL, it must have one entry per point
+/// and is used instead of the trigonometric functions.  Fills in a
+/// report of the points that end up outside of the screen.
+extern void convert_mapping_set(MappingSet &set, double toMeters,
+  double depth, double left, double bottom, double right, double top,
+  bool useFieldAngles, const std::vector<AngleTerms> *angleTerms,
+  RangeReport &report);
+
+/// Project the 3D locations of count points, starting at index first,
+/// from the origin onto the plane Ax + By + Cz + D = 0 (see
+/// XYZ::projectOntoPlane()), storing the X and Y coordinates of the
+/// result.  Either output may be NULL if it is not needed; otherwise it
+/// must have room for count entries.
+extern void project_onto_plane(MappingSet const &set, size_t first, size_t count,
+  double A, double B, double C, double D, double *projX, double *projY);
+
+/// Project the 3D locations of the points from index first on onto the
+/// plane Ax + By + Cz + D = 0, and replace maxY with the magnitude of each
+/// projected Y coordinate that is larger than it, going in point order.
+/// Does not allocate any memory.
+extern void update_max_abs_projected_y(MappingSet const &set, size_t first,
+  double A, double B, double C, double D, double &maxY);
@@ -0,0 +1,193 @@
+/** @file
+    @brief Spatial index that finds the nearest neighbors of points
+           in a 2D space and supports removing points from the set.
+
+    @date 2016
+
+    @author
+    Russ Taylor working through ReliaSolve.com for Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Internal Includes
+#include "neighbor_index.h"
+
+// Standard includes
+#include <cmath>
+#include <algorithm>
+#include <utility>
+
+NeighborIndex::NeighborIndex(std::vector<Point> const &points)
+  : m_points(points)
+  , m_alive(points.size(), true)
+  , m_count(points.size())
+  , m_minX(0), m_minY(0)
+  , m_cellW(1), m_cellH(1)
+  , m_nx(1), m_ny(1)
+{
+  if (m_points.empty()) {
+    m_cells.resize(1);
+    return;
+  }
+
+  // Find the bounding box of the points.
+  double maxX, maxY;
+  m_minX = maxX = m_points[0][0];
+  m_minY = maxY = m_points[0][1];
+  for (size_t i = 1; i < m_points.size(); i++) {
+    m_minX = std::min(m_minX, m_points[i][0]);
+    maxX = std::max(maxX, m_points[i][0]);
+    m_minY = std::min(m_minY, m_points[i][1]);
+    maxY = std::max(maxY, m_points[i][1]);
+  }
+
+  // Size the cells so that there are about two points in each one
+  // on average.  Handle the cases where all of the points lie along
+  // a line (or at a single location).
+  const double perCell = 2;
+  double width = maxX - m_minX;
+  double height = maxY - m_minY;
+  double cells = std::max(1.0, m_points.size() / perCell);
+  double cellSize = 1;
+  if ((width > 0) && (height > 0)) {
+    cellSize = std::sqrt(width * height / cells);
+  } else if (std::max(width, height) > 0) {
+    cellSize = std::max(width, height) / cells;
+  }
+
+  // A point set that is very thin along one axis would get tiny
+  // square cells and a huge number of them along the other axis.
+  // Limit the number of cells along each axis and stretch the cells
+  // along any axis that hits the limit.
+  const double maxCells = 4 * std::ceil(std::sqrt(cells)) + 1;
+  m_cellW = m_cellH = cellSize;
+  double nx = std::floor(width / cellSize) + 1;
+  double ny = std::floor(height / cellSize) + 1;
+  if (nx > maxCells) {
+    nx = maxCells;
+    m_cellW = width / nx;
+  }
+  if (ny > maxCells) {
+    ny = maxCells;
+    m_cellH = height / ny;
+  }
+  m_nx = static_cast<size_t>(nx);
+  m_ny = static_cast<size_t>(ny);
+
+  m_cells.resize(m_nx * m_ny);
+  for (size_t i = 0; i < m_points.size(); i++) {
+    m_cells[cellY(m_points[i][1]) * m_nx + cellX(m_points[i][0])].push_back(i);
+  }
+}
+
+size_t NeighborIndex::cellX(double x) const
+{
+  double c = std::floor((x - m_minX) / m_cellW);
+  if (!(c > 0)) { return 0; }
+  return std::min(static_cast<size_t>(c), m_nx - 1);
+}
+
+size_t NeighborIndex::cellY(double y) const
+{
+  double c = std::floor((y - m_minY) / m_cellH);
+  if (!(c > 0)) { return 0; }
+  return std::min(static_cast<size_t>(c), m_ny - 1);
+}
+
+void NeighborIndex::remove(size_t index)
+{
+  if (!m_alive[index]) { return; }
+  m_alive[index] = false;
+  m_count--;
+
+  std::vector<size_t> &cell = m_cells[cellY(m_points[index][1]) * m_nx +
+    cellX(m_points[index][0])];
+  std::vector<size_t>::iterator it = std::find(cell.begin(), cell.end(), index);
+  if (it != cell.end()) {
+    *it = cell.back();
+    cell.pop_back();
+  }
+}
+
+void NeighborIndex::nearest(size_t index, size_t k,
+  std::vector<size_t> &neighbors) const
+{
+  search(m_points[index], index, k, neighbors);
+}
+
+void NeighborIndex::nearest(Point const &p, size_t k,
+  std::vector<size_t> &neighbors) const
+{
+  search(p, m_points.size(), k, neighbors);
+}
+
+void NeighborIndex::search(Point const &p, size_t skip, size_t k,
+  std::vector<size_t> &neighbors) const
+{
+  neighbors.clear();
+  if (k == 0) { return; }
+
+  // Sorted list of the best (distance, index) pairs found so far.
+  typedef std::pair<double, size_t> Candidate;
+  std::vector<Candidate> best;
+  best.reserve(k + 1);
+
+  // Search outwards from the cell holding the point, one ring of
+  // cells at a time.  Any point in ring r+1 is at least r of the
+  // narrower cell dimension away from the query point, so once we've
+  // got k points that are closer than that we can stop.  The bound is shrunk slightly to
+  // keep round-off in the distance calculation from dropping a point
+  // that ties with the last one kept.
+  long qx = static_cast<long>(cellX(p[0]));
+  long qy = static_cast<long>(cellY(p[1]));
+  long nx = static_cast<long>(m_nx);
+  long ny = static_cast<long>(m_ny);
+  long maxRing = std::max(std::max(qx, nx - 1 - qx), std::max(qy, ny - 1 - qy));
+  double ringWidth = std::min(m_cellW, m_cellH);
+  for (long r = 0; r <= maxRing; r++) {
+    for (long cy = qy - r; cy <= qy + r; cy++) {
+      if ((cy < 0) || (cy >= ny)) { continue; }
+      // Interior rows of the ring only have cells at their two ends.
+      long step = ((cy == qy - r) || (cy == qy + r)) ? 1 : 2 * r;
+      if (step == 0) { step = 1; }
+      for (long cx = qx - r; cx <= qx + r; cx += step) {
+        if ((cx < 0) || (cx >= nx)) { continue; }
+        std::vector<size_t> const &cell = m_cells[cy * nx + cx];
+        for (size_t c = 0; c < cell.size(); c++) {
+          size_t i = cell[c];
+          if (i == skip) { continue; }
+          double dx = m_points[i][0] - p[0];
+          double dy = m_points[i][1] - p[1];
+          Candidate cand(std::sqrt(dx * dx + dy * dy), i);
+          if ((best.size() < k) || (cand < best.back())) {
+            best.insert(std::upper_bound(best.begin(), best.end(), cand),
+              cand);
+            if (best.size() > k) { best.pop_back(); }
+          }
+        }
+      }
+    }
+    if ((best.size() == k) &&
+        (best.back().first < r * ringWidth * (1 - 1e-9))) {
+      break;
+    }
+  }
+
+  for (size_t i = 0; i < best.size(); i++) {
+    neighbors.push_back(best[i].second);
+  }
+}
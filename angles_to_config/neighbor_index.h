@@ -0,0 +1,80 @@
+/** @file
+    @brief Spatial index that finds the nearest neighbors of points
+           in a 2D space and supports removing points from the set.
+
+    @date 2016
+
+    @author
+    Russ Taylor working through ReliaSolve.com for Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+// Standard includes
+#include <array>
+#include <vector>
+#include <cstddef>
+
+/// Uniform-grid index over a fixed set of 2D points.  Points are
+/// referred to by their index in the vector handed to the constructor;
+/// removing a point leaves the indices of the others unchanged.
+///   Neighbor queries return points sorted by distance, with ties
+/// broken by increasing index, which matches the order that a
+/// std::multimap keyed on distance produces when the points are
+/// inserted in index order.
+class NeighborIndex {
+public:
+  typedef std::array<double, 2> Point;
+
+  NeighborIndex(std::vector<Point> const &points);
+
+  /// Remove a point from the index.  Does nothing if it was already
+  /// removed.
+  void remove(size_t index);
+
+  /// Is the point still in the index?
+  bool contains(size_t index) const { return m_alive[index]; }
+
+  /// Number of points that have not been removed.
+  size_t size() const { return m_count; }
+
+  /// Find up to k of the nearest points to the specified point,
+  /// not including the point itself, among the points that have not
+  /// been removed.  The indices are returned in the neighbors vector,
+  /// nearest first.
+  void nearest(size_t index, size_t k, std::vector<size_t> &neighbors) const;
+
+  /// Same as above, but for an arbitrary location that is not one of
+  /// the indexed points.  No point is excluded from the search.
+  void nearest(Point const &p, size_t k, std::vector<size_t> &neighbors) const;
+
+private:
+  void search(Point const &p, size_t skip, size_t k,
+    std::vector<size_t> &neighbors) const;
+  size_t cellX(double x) const;
+  size_t cellY(double y) const;
+
+  std::vector<Point> m_points;
+  std::vector<bool> m_alive;
+  size_t m_count;
+
+  double m_minX, m_minY;    //< Lower-left corner of the grid
+  double m_cellW, m_cellH;  //< Width and height of each cell
+  size_t m_nx, m_ny;        //< Number of cells in X and Y
+  std::vector< std::vector<size_t> > m_cells; //< Point indices per cell
+};
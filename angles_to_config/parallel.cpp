@@ -0,0 +1,67 @@
+/** @file
+    @brief Runs a set of independent jobs on a pool of threads.
+
+    @date 2016
+
+    @author
+    Russ Taylor working through ReliaSolve.com for Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Internal Includes
+#include "parallel.h"
+
+// Standard includes
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+size_t default_thread_count()
+{
+  unsigned n = std::thread::hardware_concurrency();
+  return (n > 0) ? n : 1;
+}
+
+void run_in_parallel(size_t count, size_t numThreads,
+  std::function<void(size_t)> const &job)
+{
+  size_t threads = std::min(std::max(numThreads, size_t(1)), count);
+  if (threads <= 1) {
+    for (size_t i = 0; i < count; i++) {
+      job(i);
+    }
+    return;
+  }
+
+  // Each thread pulls the next unclaimed job until they are gone.
+  std::atomic<size_t> next(0);
+  auto worker = [&]() {
+    size_t i;
+    while ((i = next++) < count) {
+      job(i);
+    }
+  };
+  std::vector<std::thread> pool;
+  for (size_t t = 1; t < threads; t++) {
+    pool.push_back(std::thread(worker));
+  }
+  worker();
+  for (size_t t = 0; t < pool.size(); t++) {
+    pool[t].join();
+  }
+}
@@ -0,0 +1,40 @@
+/** @file
+    @brief Runs a set of independent jobs on a pool of threads.
+
+    @date 2016
+
+    @author
+    Russ Taylor working through ReliaSolve.com for Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <functional>
+#include <cstddef>
+
+/// Number of threads to use when the user asks for "all of them".
+extern size_t default_thread_count();
+
+/// Call job(i) for each i from 0 up to count - 1, using up to numThreads
+/// threads including the calling one.  Jobs are handed out in order, so
+/// with one thread they run in order on the calling thread.  Returns
+/// once all of the jobs have finished.
+///   The jobs must not depend on one another; any shared state they
+/// touch must be protected by the caller.
+extern void run_in_parallel(size_t count, size_t numThreads,
+  std::function<void(size_t)> const &job);
@@ -0,0 +1,227 @@
+/** @file
+    @brief Resamples a scattered distortion mesh onto a regular grid.
+
+    @date 2016
+
+    @author
+    Russ Taylor working through ReliaSolve.com for Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Internal Includes
+#include "resample.h"
+#include "neighbor_index.h"
+
+// Standard includes
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+bool fit_affine(const MeshDescription &mesh,
+  std::vector<size_t> const &samples, const double *weights,
+  double cx, double cy, AffineFit &fit)
+{
+  fit.cx = cx;
+  fit.cy = cy;
+  double M[3][3] = { { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 } };
+  double R[2][3] = { { 0, 0, 0 }, { 0, 0, 0 } };
+  for (size_t n = 0; n < samples.size(); n++) {
+    std::array< std::array<double, 2>, 2 > const &s = mesh[samples[n]];
+    double v[3] = { 1, s[0][0] - cx, s[0][1] - cy };
+    double w = weights ? weights[n] : 1;
+    for (int r = 0; r < 3; r++) {
+      for (int c = 0; c < 3; c++) {
+        M[r][c] += w * v[r] * v[c];
+      }
+      R[0][r] += w * v[r] * s[1][0];
+      R[1][r] += w * v[r] * s[1][1];
+    }
+  }
+  double det =
+      M[0][0] * (M[1][1] * M[2][2] - M[1][2] * M[2][1])
+    - M[0][1] * (M[1][0] * M[2][2] - M[1][2] * M[2][0])
+    + M[0][2] * (M[1][0] * M[2][1] - M[1][1] * M[2][0]);
+  if (!(fabs(det) > 1e-12 * fabs(M[0][0] * M[1][1] * M[2][2]))) {
+    return false;
+  }
+  for (int o = 0; o < 2; o++) {
+    double const *r = R[o];
+    double detA =
+        r[0] * (M[1][1] * M[2][2] - M[1][2] * M[2][1])
+      - M[0][1] * (r[1] * M[2][2] - M[1][2] * r[2])
+      + M[0][2] * (r[1] * M[2][1] - M[1][1] * r[2]);
+    double detB =
+        M[0][0] * (r[1] * M[2][2] - M[1][2] * r[2])
+      - r[0] * (M[1][0] * M[2][2] - M[1][2] * M[2][0])
+      + M[0][2] * (M[1][0] * r[2] - r[1] * M[2][0]);
+    double detC =
+        M[0][0] * (M[1][1] * r[2] - r[1] * M[2][1])
+      - M[0][1] * (M[1][0] * r[2] - r[1] * M[2][0])
+      + r[0] * (M[1][0] * M[2][1] - M[1][1] * M[2][0]);
+    fit.c[o][0] = detA / det;
+    fit.c[o][1] = detB / det;
+    fit.c[o][2] = detC / det;
+  }
+  return true;
+}
+
+/// Find the output location at a grid point with fit_affine() about the
+/// point, weighting each neighbor by the inverse square of its distance
+/// so that the fit is local.  Falls back to a weighted average if the
+/// neighbors are collinear.
+/// @return false if the neighbors don't surround the grid point.
+static bool fit_grid_point(const MeshDescription &mesh,
+  std::array<double, 2> const &p, std::vector<size_t> const &neighbors,
+  std::array<double, 2> &out)
+{
+  // Make sure that there are samples in all four quadrants around
+  // the point so that we're interpolating rather than extrapolating.
+  bool quadrant[4] = { false, false, false, false };
+  for (size_t n = 0; n < neighbors.size(); n++) {
+    double dx = mesh[neighbors[n]][0][0] - p[0];
+    double dy = mesh[neighbors[n]][0][1] - p[1];
+    if ((dx == 0) && (dy == 0)) {
+      // Exactly on a sample, so use it.
+      out = mesh[neighbors[n]][1];
+      return true;
+    }
+    quadrant[(dx >= 0 ? 1 : 0) + (dy >= 0 ? 2 : 0)] = true;
+  }
+  if (!(quadrant[0] && quadrant[1] && quadrant[2] && quadrant[3])) {
+    return false;
+  }
+
+  std::vector<double> weights(neighbors.size());
+  double wSum = 0, avg[2] = { 0, 0 };
+  for (size_t n = 0; n < neighbors.size(); n++) {
+    std::array< std::array<double, 2>, 2 > const &s = mesh[neighbors[n]];
+    double dx = s[0][0] - p[0];
+    double dy = s[0][1] - p[1];
+    double w = 1 / (dx * dx + dy * dy);
+    weights[n] = w;
+    wSum += w;
+    avg[0] += w * s[1][0];
+    avg[1] += w * s[1][1];
+  }
+
+  // We only need the value at the grid point itself, which is the
+  // constant term of the fit.
+  AffineFit fit;
+  if (!fit_affine(mesh, neighbors, weights.data(), p[0], p[1], fit)) {
+    out[0] = avg[0] / wSum;
+    out[1] = avg[1] / wSum;
+    return true;
+  }
+  out[0] = fit.c[0][0];
+  out[1] = fit.c[1][0];
+  return true;
+}
+
+bool resample_mesh(const MeshDescription &mesh, size_t nx, size_t ny,
+  MeshDescription &grid, ResampleReport &report)
+{
+  grid.clear();
+  report.gridPoints = report.samplesChecked = report.samplesSkipped = 0;
+  report.maxError = report.rmsError = 0;
+  if ((nx < 2) || (ny < 2)) {
+    std::cerr << "resample_mesh(): Error: Grid must be at least 2x2, got "
+      << nx << "x" << ny << std::endl;
+    return false;
+  }
+  if (mesh.size() < RESAMPLE_FIT_NEIGHBORS) {
+    std::cerr << "resample_mesh(): Error: Need at least " << RESAMPLE_FIT_NEIGHBORS
+      << " samples, got " << mesh.size() << std::endl;
+    return false;
+  }
+
+  std::vector<NeighborIndex::Point> points(mesh.size());
+  for (size_t i = 0; i < mesh.size(); i++) {
+    points[i] = mesh[i][0];
+  }
+  NeighborIndex index(points);
+
+  //====================================================================
+  // Fill in each grid point that we can, remembering which ones we did
+  // so that we can check the samples against them.
+  std::vector< std::array<double, 2> > values(nx * ny);
+  std::vector<bool> valid(nx * ny, false);
+  std::vector<size_t> neighbors;
+  for (size_t j = 0; j < ny; j++) {
+    for (size_t i = 0; i < nx; i++) {
+      NeighborIndex::Point p;
+      p[0] = static_cast<double>(i) / (nx - 1);
+      p[1] = static_cast<double>(j) / (ny - 1);
+      index.nearest(p, RESAMPLE_FIT_NEIGHBORS, neighbors);
+      size_t g = j * nx + i;
+      if (fit_grid_point(mesh, p, neighbors, values[g])) {
+        valid[g] = true;
+        std::array< std::array<double, 2>, 2 > element;
+        element[0] = p;
+        element[1] = values[g];
+        grid.push_back(element);
+      }
+    }
+  }
+  report.gridPoints = grid.size();
+
+  check_resampled_grid(mesh, nx, ny, values, valid, report);
+
+  return true;
+}
+
+void check_resampled_grid(const MeshDescription &mesh,
+  size_t nx, size_t ny, std::vector< std::array<double, 2> > const &values,
+  std::vector<bool> const &valid, ResampleReport &report)
+{
+  report.samplesChecked = report.samplesSkipped = 0;
+  report.maxError = report.rmsError = 0;
+
+  // Check each sample against the bilinear interpolation of the grid
+  // cell it lies in, if all four of the cell's corners are present.
+  double sumSq = 0;
+  for (size_t s = 0; s < mesh.size(); s++) {
+    double fx = mesh[s][0][0] * (nx - 1);
+    double fy = mesh[s][0][1] * (ny - 1);
+    if (!(fx >= 0) || !(fy >= 0) || (fx > nx - 1) || (fy > ny - 1)) {
+      report.samplesSkipped++;
+      continue;
+    }
+    size_t i = std::min(static_cast<size_t>(fx), nx - 2);
+    size_t j = std::min(static_cast<size_t>(fy), ny - 2);
+    size_t g00 = j * nx + i, g10 = g00 + 1, g01 = g00 + nx, g11 = g01 + 1;
+    if (!(valid[g00] && valid[g10] && valid[g01] && valid[g11])) {
+      report.samplesSkipped++;
+      continue;
+    }
+    double u = fx - i, v = fy - j;
+    double err2 = 0;
+    for (int o = 0; o < 2; o++) {
+      double interp =
+          (1 - u) * (1 - v) * values[g00][o] + u * (1 - v) * values[g10][o]
+        + (1 - u) * v * values[g01][o] + u * v * values[g11][o];
+      double d = interp - mesh[s][1][o];
+      err2 += d * d;
+    }
+    sumSq += err2;
+    report.maxError = std::max(report.maxError, sqrt(err2));
+    report.samplesChecked++;
+  }
+  if (report.samplesChecked > 0) {
+    report.rmsError = sqrt(sumSq / report.samplesChecked);
+  }
+}
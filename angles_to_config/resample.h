@@ -0,0 +1,83 @@
+/** @file
+    @brief Resamples a scattered distortion mesh onto a regular grid.
+
+    @date 2016
+
+    @author
+    Russ Taylor working through ReliaSolve.com for Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "types.h"
+#include <cstddef>
+#include <array>
+#include <vector>
+
+/// How well a resampled mesh reproduces the samples it came from.
+/// Errors are distances in normalized output (canonical screen)
+/// coordinates.
+typedef struct {
+  size_t gridPoints;      //!< Grid points that could be filled in
+  size_t samplesChecked;  //!< Samples inside a complete grid cell
+  size_t samplesSkipped;  //!< Samples outside any complete grid cell
+  double maxError;
+  double rmsError;
+} ResampleReport;
+
+/// An affine mapping out[o] = c[o][0] + c[o][1] * dx + c[o][2] * dy
+/// from input to output locations, with (dx, dy) the offset of the
+/// input from (cx, cy).
+typedef struct {
+  double cx, cy;
+  double c[2][3];
+} AffineFit;
+
+/// Fit an affine mapping about (cx, cy) to the specified samples of a
+/// mesh in a weighted least-squares sense, solving the normal equations
+/// with Cramer's rule.  If weights is not NULL, it has one weight per
+/// sample; otherwise each sample has a weight of 1.  This is used both
+/// to resample meshes and to simplify them.
+/// @return false if the samples are (nearly) collinear.
+extern bool fit_affine(const MeshDescription &mesh,
+  std::vector<size_t> const &samples, const double *weights,
+  double cx, double cy, AffineFit &fit);
+
+/// Number of nearby samples used in the fit at each grid point.
+static const size_t RESAMPLE_FIT_NEIGHBORS = 12;
+
+/// Resample a mesh onto a regular grid of nx by ny points that evenly
+/// covers the normalized input (physical screen) space from 0 to 1.
+/// The output location at each grid point is found from a weighted
+/// affine fit to the nearby samples.  Grid points that are not
+/// surrounded by samples on all sides are left out rather than
+/// extrapolated, so the result covers the same region as the input.
+///   Each original sample is then compared against the bilinear
+/// interpolation of the grid cell that holds it to fill in the report.
+///   The grid is stored row by row, starting at the bottom left.
+/// @return false (with a message on std::cerr) if the grid is
+/// smaller than 2 by 2 or there are not enough samples.
+extern bool resample_mesh(const MeshDescription &mesh, size_t nx, size_t ny,
+  MeshDescription &grid, ResampleReport &report);
+
+/// Fill in the errors and sample counts in the report for a resampled
+/// grid, given the output location of each grid point (row by row from
+/// the bottom left) and whether it was filled in.
+extern void check_resampled_grid(const MeshDescription &mesh,
+  size_t nx, size_t ny, std::vector< std::array<double, 2> > const &values,
+  std::vector<bool> const &valid, ResampleReport &report);
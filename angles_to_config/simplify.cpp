@@ -0,0 +1,206 @@
+/** @file
+    @brief Removes samples from a distortion mesh where the mapping is
+           close enough to affine that its neighbors describe it.
+
+    @date 2016
+
+    @author
+    Russ Taylor working through ReliaSolve.com for Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Internal Includes
+#include "simplify.h"
+#include "resample.h"
+
+// Standard includes
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+/// Cells with at most this many samples are kept as they are, because
+/// replacing them by their corners would not remove anything.
+static const size_t MIN_MERGE_SAMPLES = 5;
+
+/// Cells this many levels down are kept as they are, which bounds the
+/// recursion when many samples sit on top of each other.
+static const size_t MAX_DEPTH = 16;
+
+/// Distance from a sample's output location to where the fit puts it.
+static double fit_error(const MeshDescription &mesh, size_t sample,
+  AffineFit const &fit)
+{
+  std::array< std::array<double, 2>, 2 > const &s = mesh[sample];
+  double dx = s[0][0] - fit.cx;
+  double dy = s[0][1] - fit.cy;
+  double err2 = 0;
+  for (int o = 0; o < 2; o++) {
+    double d = fit.c[o][0] + fit.c[o][1] * dx + fit.c[o][2] * dy - s[1][o];
+    err2 += d * d;
+  }
+  return sqrt(err2);
+}
+
+/// State shared by all of the cells during one simplification.
+typedef struct {
+  const MeshDescription *mesh;
+  double tolerance;
+  std::vector<bool> keep;
+  size_t mergedCells;
+  double maxError;
+  double sumSq;
+  size_t removed;
+} SimplifyState;
+
+/// Either merge the cell with lower-left corner (x0, y0) and upper-right
+/// corner (x1, y1) holding the specified samples, or split it.
+static void simplify_cell(SimplifyState &st, std::vector<size_t> const &samples,
+  double x0, double y0, double x1, double y1, size_t depth)
+{
+  const MeshDescription &mesh = *st.mesh;
+  if ((samples.size() < MIN_MERGE_SAMPLES) || (depth >= MAX_DEPTH)) {
+    for (size_t n = 0; n < samples.size(); n++) {
+      st.keep[samples[n]] = true;
+    }
+    return;
+  }
+  double cx = (x0 + x1) / 2;
+  double cy = (y0 + y1) / 2;
+
+  //====================================================================
+  // See if all of the samples are close to an affine mapping, and if so
+  // whether the one through the samples nearest the corners is too.
+  bool merge = false;
+  AffineFit fit;
+  if (fit_affine(mesh, samples, NULL, cx, cy, fit)) {
+    merge = true;
+    for (size_t n = 0; merge && (n < samples.size()); n++) {
+      merge = (fit_error(mesh, samples[n], fit) <= st.tolerance);
+    }
+  }
+  std::vector<size_t> corners;
+  if (merge) {
+    const double cornerX[4] = { x0, x1, x0, x1 };
+    const double cornerY[4] = { y0, y0, y1, y1 };
+    for (int c = 0; c < 4; c++) {
+      size_t best = samples[0];
+      double bestDist2 = HUGE_VAL;
+      for (size_t n = 0; n < samples.size(); n++) {
+        double dx = mesh[samples[n]][0][0] - cornerX[c];
+        double dy = mesh[samples[n]][0][1] - cornerY[c];
+        double dist2 = dx * dx + dy * dy;
+        if (dist2 < bestDist2) {
+          bestDist2 = dist2;
+          best = samples[n];
+        }
+      }
+      if (std::find(corners.begin(), corners.end(), best) == corners.end()) {
+        corners.push_back(best);
+      }
+    }
+    merge = fit_affine(mesh, corners, NULL, cx, cy, fit);
+    for (size_t n = 0; merge && (n < samples.size()); n++) {
+      merge = (fit_error(mesh, samples[n], fit) <= st.tolerance);
+    }
+  }
+  if (merge) {
+    for (size_t n = 0; n < corners.size(); n++) {
+      st.keep[corners[n]] = true;
+    }
+    for (size_t n = 0; n < samples.size(); n++) {
+      if (!st.keep[samples[n]]) {
+        double err = fit_error(mesh, samples[n], fit);
+        st.maxError = std::max(st.maxError, err);
+        st.sumSq += err * err;
+        st.removed++;
+      }
+    }
+    st.mergedCells++;
+    return;
+  }
+
+  //====================================================================
+  // Split the cell into four, with samples on a dividing line going to
+  // the cell above or to the right of it.
+  std::vector<size_t> quadrants[4];
+  for (size_t n = 0; n < samples.size(); n++) {
+    double x = mesh[samples[n]][0][0];
+    double y = mesh[samples[n]][0][1];
+    quadrants[(x >= cx ? 1 : 0) + (y >= cy ? 2 : 0)].push_back(samples[n]);
+  }
+  simplify_cell(st, quadrants[0], x0, y0, cx, cy, depth + 1);
+  simplify_cell(st, quadrants[1], cx, y0, x1, cy, depth + 1);
+  simplify_cell(st, quadrants[2], x0, cy, cx, y1, depth + 1);
+  simplify_cell(st, quadrants[3], cx, cy, x1, y1, depth + 1);
+}
+
+bool simplify_mesh(const MeshDescription &mesh, double tolerance,
+  MeshDescription &simplified, SimplifyReport &report)
+{
+  simplified.clear();
+  report.inputSamples = mesh.size();
+  report.outputSamples = report.mergedCells = 0;
+  report.maxError = report.rmsError = 0;
+  if (!(tolerance > 0)) {
+    std::cerr << "simplify_mesh(): Error: Tolerance must be positive, got "
+      << tolerance << std::endl;
+    return false;
+  }
+  if (mesh.empty()) {
+    return true;
+  }
+
+  //====================================================================
+  // Start with a square cell around all of the samples, so that the
+  // cells stay square as they are split.
+  double x0 = mesh[0][0][0], x1 = x0;
+  double y0 = mesh[0][0][1], y1 = y0;
+  std::vector<size_t> all(mesh.size());
+  for (size_t i = 0; i < mesh.size(); i++) {
+    all[i] = i;
+    x0 = std::min(x0, mesh[i][0][0]);
+    x1 = std::max(x1, mesh[i][0][0]);
+    y0 = std::min(y0, mesh[i][0][1]);
+    y1 = std::max(y1, mesh[i][0][1]);
+  }
+  double size = std::max(x1 - x0, y1 - y0);
+  x1 = x0 + size;
+  y1 = y0 + size;
+
+  SimplifyState st;
+  st.mesh = &mesh;
+  st.tolerance = tolerance;
+  st.keep.assign(mesh.size(), false);
+  st.mergedCells = 0;
+  st.maxError = st.sumSq = 0;
+  st.removed = 0;
+  simplify_cell(st, all, x0, y0, x1, y1, 0);
+
+  for (size_t i = 0; i < mesh.size(); i++) {
+    if (st.keep[i]) {
+      simplified.push_back(mesh[i]);
+    }
+  }
+  report.outputSamples = simplified.size();
+  report.mergedCells = st.mergedCells;
+  report.maxError = st.maxError;
+  if (st.removed > 0) {
+    report.rmsError = sqrt(st.sumSq / st.removed);
+  }
+  return true;
+}
@@ -0,0 +1,59 @@
+/** @file
+    @brief Removes samples from a distortion mesh where the mapping is
+           close enough to affine that its neighbors describe it.
+
+    @date 2016
+
+    @author
+    Russ Taylor working through ReliaSolve.com for Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "types.h"
+#include <cstddef>
+
+/// How much a mesh was simplified and how far the samples it removed are
+/// from the affine mapping that replaced them in their cell.  These are
+/// per-cell fit errors, not the error of interpolating the simplified
+/// mesh, which is triangulated across cells.  Errors are distances in
+/// normalized output (canonical screen) coordinates.
+typedef struct {
+  size_t inputSamples;
+  size_t outputSamples;
+  size_t mergedCells;     //!< Cells replaced by their corner samples
+  double maxError;        //!< Per-cell fit error of the removed samples
+  double rmsError;        //!< Per-cell fit error of the removed samples
+} SimplifyReport;
+
+/// Simplify a mesh by splitting the region of normalized input (physical
+/// screen) space that it covers into a quadtree.  A cell whose samples
+/// are all within tolerance of an affine mapping from input to output is
+/// replaced by the samples in it nearest its four corners, as long as the
+/// affine mapping through those samples also reproduces every sample in
+/// the cell to within tolerance; otherwise it is split into four.  This
+/// leaves few samples where the distortion is nearly linear and all of
+/// them where it curves.  The samples that are kept are unchanged and in
+/// their original order.
+///   The errors in the report are those of the removed samples against
+/// the affine mapping through the samples kept for their cell (see
+/// fit_affine()).
+/// @return false (with a message on std::cerr) if the tolerance is not
+/// positive.
+extern bool simplify_mesh(const MeshDescription &mesh, double tolerance,
+  MeshDescription &simplified, SimplifyReport &report);
@@ -0,0 +1,698 @@
+/** @file
+    @brief Checks the pieces of the AnglesToConfig library against simple
+           reference versions of what they compute, and that the pieces
+           meant to give back their input do so.
+
+    @date 2016
+
+    @author
+    Russ Taylor working through ReliaSolve.com for Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Internal Includes
+#include "helper.h"
+#include "distortion_config.h"
+#include "mapping_cache.h"
+#include "compact_mesh.h"
+#include "displacement_map.h"
+#include "neighbor_index.h"
+#include "resample.h"
+#include "simplify.h"
+
+// Standard includes
+#include <iostream>
+#include <sstream>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <limits>
+#include <stdint.h>
+
+// Each test returns 0 on success and otherwise describes the first
+// problem it found on std::cerr and returns nonzero.
+
+static std::string g_dataFile;  //< Input mapping to build meshes from
+
+// Read the test input file into a mapping.
+static bool read_test_mapping(std::vector<Mapping> &mapping)
+{
+  std::vector<char> contents;
+  if (!read_file_contents(g_dataFile, contents)) {
+    std::cerr << "Could not read " << g_dataFile << std::endl;
+    return false;
+  }
+  mapping = parse_mapping(contents.data(), contents.size(), g_dataFile);
+  if (mapping.empty()) {
+    std::cerr << "No points in " << g_dataFile << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// Build the configuration for the test input file.
+static bool build_test_config(const DistortionConfigOptions &opts,
+  DistortionConfig &config)
+{
+  std::vector<Mapping> mapping;
+  if (!read_test_mapping(mapping)) { return false; }
+  std::vector<std::vector<Mapping> const *> mappings(1, &mapping);
+  std::vector<std::vector<AngleTerms> const *> terms(1, NULL);
+  return build_distortion_config(mappings, terms, opts, config) == 0;
+}
+
+// A mesh over a jittered n by n grid covering [0,1] in input space whose
+// output is the input plus a radial term of the specified strength
+// around the center, which is affine when strength is 0.
+static MeshDescription make_radial_mesh(size_t n, double strength)
+{
+  MeshDescription mesh;
+  uint32_t seed = 12345;
+  for (size_t j = 0; j < n; j++) {
+    for (size_t i = 0; i < n; i++) {
+      double jitter[2];
+      for (int k = 0; k < 2; k++) {
+        seed = seed * 1664525 + 1013904223;
+        jitter[k] = (static_cast<double>(seed >> 8) / (1 << 24) - 0.5) * 0.5;
+      }
+      std::array< std::array<double, 2>, 2 > element;
+      element[0][0] = std::min(1.0, std::max(0.0, (i + jitter[0]) / (n - 1)));
+      element[0][1] = std::min(1.0, std::max(0.0, (j + jitter[1]) / (n - 1)));
+      double dx = element[0][0] - 0.5;
+      double dy = element[0][1] - 0.5;
+      double r2 = dx * dx + dy * dy;
+      element[1][0] = 0.1 + 0.8 * element[0][0] + strength * dx * r2;
+      element[1][1] = 0.2 + 0.7 * element[0][1] + strength * dy * r2;
+      mesh.push_back(element);
+    }
+  }
+  return mesh;
+}
+
+//====================================================================
+// The cache must give back exactly what was written to it, only for
+// the key it was written with, and never when its point count does not
+// match its size.
+static int test_cache()
+{
+  std::vector<Mapping> mapping;
+  if (!read_test_mapping(mapping)) { return 1; }
+  std::vector<AngleTerms> terms;
+  compute_angle_terms(mapping, terms);
+
+  std::string cacheName = "AnglesToConfigTest.a2c";
+  uint64_t key = mapping_cache_key("test", 4, false, 0, 0, 0, 0, 0);
+  if (!write_mapping_cache(cacheName, key, mapping, terms)) { return 2; }
+  std::vector<Mapping> readMapping;
+  std::vector<AngleTerms> readTerms;
+  if (!read_mapping_cache(cacheName, key, readMapping, readTerms)) {
+    std::cerr << "Could not read back " << cacheName << std::endl;
+    return 3;
+  }
+  if ((readMapping.size() != mapping.size()) ||
+      (readTerms.size() != terms.size())) {
+    std::cerr << "Read " << readMapping.size() << " points and "
+      << readTerms.size() << " terms, wrote " << mapping.size() << std::endl;
+    return 4;
+  }
+  for (size_t i = 0; i < mapping.size(); i++) {
+    XYLatLong const &a = mapping[i].xyLatLong;
+    XYLatLong const &b = readMapping[i].xyLatLong;
+    if ((a.x != b.x) || (a.y != b.y) || (a.latitude != b.latitude) ||
+        (a.longitude != b.longitude) ||
+        memcmp(&terms[i], &readTerms[i], sizeof(AngleTerms)) != 0) {
+      std::cerr << "Point " << i << " differs after the cache" << std::endl;
+      return 5;
+    }
+  }
+  if (read_mapping_cache(cacheName, key + 1, readMapping, readTerms)) {
+    std::cerr << "Cache was used with the wrong key" << std::endl;
+    return 6;
+  }
+  if (mapping_cache_key("test", 4, true, 1, 0, 0, 1, 30, false) ==
+      mapping_cache_key("test", 4, true, 1, 0, 0, 1, 30, true)) {
+    std::cerr << "Both outlier modes have the same key" << std::endl;
+    return 7;
+  }
+
+  // Add 2^60 to the point count, which is the same count once it is
+  // multiplied by the ten 8-byte arrays and wrapped to 64 bits.
+  std::vector<char> contents;
+  if (!read_file_contents(cacheName, contents)) { return 8; }
+  const size_t countOffset = 24;
+  uint64_t count;
+  memcpy(&count, contents.data() + countOffset, sizeof(count));
+  count += static_cast<uint64_t>(1) << 60;
+  memcpy(contents.data() + countOffset, &count, sizeof(count));
+  FILE *f = fopen(cacheName.c_str(), "wb");
+  if (f == NULL) { return 9; }
+  fwrite(contents.data(), 1, contents.size(), f);
+  fclose(f);
+  if (read_mapping_cache(cacheName, key, readMapping, readTerms)) {
+    std::cerr << "Cache with a corrupt count was used" << std::endl;
+    return 10;
+  }
+  remove(cacheName.c_str());
+  return 0;
+}
+
+//====================================================================
+// Float meshes must hold the nearest float to each value, and 16-bit
+// meshes must be within half a step of it.
+static int test_compact_mesh()
+{
+  DistortionConfigOptions opts;
+  DistortionConfig config;
+  if (!build_test_config(opts, config)) { return 1; }
+  MeshDescription const &mesh = config.leftMeshes[0];
+
+  CompactMesh compact;
+  compact.assign(mesh, MESH_FLOAT32);
+  MeshDescription back;
+  compact.copyTo(back);
+  if (back.size() != mesh.size()) {
+    std::cerr << "Float mesh has " << back.size() << " of "
+      << mesh.size() << " samples" << std::endl;
+    return 2;
+  }
+  for (size_t i = 0; i < mesh.size(); i++) {
+    for (size_t j = 0; j < 4; j++) {
+      double v = mesh[i][j / 2][j % 2];
+      if (back[i][j / 2][j % 2] != static_cast<float>(v)) {
+        std::cerr << "Float mesh sample " << i << " coordinate " << j
+          << " is " << back[i][j / 2][j % 2] << ", expected " << v << std::endl;
+        return 3;
+      }
+    }
+  }
+
+  compact.assign(mesh, MESH_UINT16);
+  compact.copyTo(back);
+  if (back.size() != mesh.size()) {
+    std::cerr << "16-bit mesh has " << back.size() << " of "
+      << mesh.size() << " samples" << std::endl;
+    return 4;
+  }
+  for (size_t i = 0; i < mesh.size(); i++) {
+    for (size_t j = 0; j < 4; j++) {
+      double v = mesh[i][j / 2][j % 2];
+      double err = fabs(back[i][j / 2][j % 2] - v);
+      if (err > compact.step[j] * 0.5 * (1 + 1e-9)) {
+        std::cerr << "16-bit mesh sample " << i << " coordinate " << j
+          << " is off by " << err << ", step " << compact.step[j] << std::endl;
+        return 5;
+      }
+    }
+  }
+  return 0;
+}
+
+//====================================================================
+// Decode a base-64 string, returning false if it has a bad character.
+static bool decode_base64(std::string const &in, std::vector<unsigned char> &out)
+{
+  static const std::string digits =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  out.clear();
+  uint32_t bits = 0;
+  int count = 0;
+  for (size_t i = 0; i < in.size(); i++) {
+    if (in[i] == '=') { break; }
+    size_t d = digits.find(in[i]);
+    if (d == std::string::npos) { return false; }
+    bits = (bits << 6) | static_cast<uint32_t>(d);
+    count += 6;
+    if (count >= 8) {
+      count -= 8;
+      out.push_back(static_cast<unsigned char>((bits >> count) & 0xff));
+    }
+  }
+  return true;
+}
+
+// The base-64 meshes in the configuration file must decode to the
+// nearest float to each value in the meshes, in order.
+static int test_base64_mesh()
+{
+  DistortionConfigOptions opts;
+  DistortionConfig config;
+  if (!build_test_config(opts, config)) { return 1; }
+  std::ostringstream out;
+  if (write_distortion_config(out, config, MESH_BASE64) != 0) { return 2; }
+  std::string text = out.str();
+
+  size_t pos = text.find("\"mono_point_samples_base64\"");
+  if (pos == std::string::npos) {
+    std::cerr << "No base-64 meshes in the configuration" << std::endl;
+    return 3;
+  }
+  MeshDescription const *meshes[2] =
+    { &config.leftMeshes[0], &config.rightMeshes[0] };
+  pos = text.find('[', pos);
+  for (int eye = 0; eye < 2; eye++) {
+    size_t start = text.find('"', pos + 1);
+    size_t end = text.find('"', start + 1);
+    if ((start == std::string::npos) || (end == std::string::npos)) {
+      std::cerr << "Missing base-64 mesh for eye " << eye << std::endl;
+      return 4;
+    }
+    std::vector<unsigned char> bytes;
+    if (!decode_base64(text.substr(start + 1, end - start - 1), bytes)) {
+      std::cerr << "Bad base-64 mesh for eye " << eye << std::endl;
+      return 5;
+    }
+    MeshDescription const &mesh = *meshes[eye];
+    if (bytes.size() != mesh.size() * 4 * 4) {
+      std::cerr << "Eye " << eye << " decoded to " << bytes.size()
+        << " bytes for " << mesh.size() << " samples" << std::endl;
+      return 6;
+    }
+    for (size_t i = 0; i < mesh.size(); i++) {
+      for (size_t j = 0; j < 4; j++) {
+        const unsigned char *b = &bytes[4 * (4 * i + j)];
+        uint32_t u = b[0] | (b[1] << 8) | (b[2] << 16)
+          | (static_cast<uint32_t>(b[3]) << 24);
+        float f;
+        memcpy(&f, &u, sizeof(f));
+        if (f != static_cast<float>(mesh[i][j / 2][j % 2])) {
+          std::cerr << "Eye " << eye << " sample " << i << " coordinate " << j
+            << " decoded to " << f << std::endl;
+          return 7;
+        }
+      }
+    }
+    pos = end;
+  }
+  return 0;
+}
+
+//====================================================================
+// A 40 by 40 grid of points one degree apart whose screen locations
+// follow their angles, except for a 10 by 10 block whose locations are
+// scattered by up to several grid spacings.  The local filter must
+// remove most of the block in a few sweeps and keep all of the points
+// well away from it.
+static int test_local_outliers()
+{
+  const int n = 40;
+  const int blockMin = 15, blockMax = 24;
+  std::vector<Mapping> mapping;
+  uint32_t seed = 12345;
+  for (int j = 0; j < n; j++) {
+    for (int i = 0; i < n; i++) {
+      double x = i * 0.001;
+      double y = j * 0.001;
+      if ((i >= blockMin) && (i <= blockMax) &&
+          (j >= blockMin) && (j <= blockMax)) {
+        for (int k = 0; k < 2; k++) {
+          seed = seed * 1664525 + 1013904223;
+          double r = (static_cast<double>(seed >> 8) / (1 << 24) - 0.5) * 0.008;
+          if (k == 0) { x += r; } else { y += r; }
+        }
+      }
+      mapping.push_back(Mapping(XYLatLong(x, y, j, i), XYZ()));
+    }
+  }
+
+  size_t sweeps;
+  int removed = remove_invalid_points_locally(mapping, 1, 0, 0, 1, 30, 2,
+    &sweeps);
+  if (removed < 75) {
+    std::cerr << "Removed only " << removed << " points" << std::endl;
+    return 1;
+  }
+  if (sweeps > 6) {
+    std::cerr << "Took " << sweeps << " sweeps" << std::endl;
+    return 2;
+  }
+  size_t far = 0;
+  for (size_t i = 0; i < mapping.size(); i++) {
+    double lat = mapping[i].xyLatLong.latitude;
+    double lon = mapping[i].xyLatLong.longitude;
+    if ((lat < blockMin - 2) || (lat > blockMax + 2) ||
+        (lon < blockMin - 2) || (lon > blockMax + 2)) {
+      far++;
+    }
+  }
+  if (far != n * n - 14 * 14) {
+    std::cerr << "Kept " << far << " of the " << (n * n - 14 * 14)
+      << " points away from the block" << std::endl;
+    return 3;
+  }
+  return 0;
+}
+
+//====================================================================
+// The index must return the same neighbors, in the same order, as
+// sorting all of the remaining points by distance and then index.
+static int test_neighbor_index()
+{
+  MeshDescription mesh = make_radial_mesh(30, 0);
+  std::vector<NeighborIndex::Point> points(mesh.size());
+  for (size_t i = 0; i < mesh.size(); i++) {
+    points[i] = mesh[i][0];
+  }
+  // Stretch the points along X so that the cells are not square, and
+  // add a far-away point so that most of the grid is empty.
+  for (size_t i = 0; i < points.size(); i++) {
+    points[i][0] *= 20;
+  }
+  points.push_back(NeighborIndex::Point{ { 1000, -1000 } });
+  NeighborIndex index(points);
+  std::vector<bool> alive(points.size(), true);
+
+  const size_t k = 12;
+  std::vector<size_t> found;
+  for (int pass = 0; pass < 2; pass++) {
+    for (size_t q = 0; q < points.size(); q += 7) {
+      if (!alive[q]) { continue; }
+      std::vector< std::pair<double, size_t> > all;
+      for (size_t i = 0; i < points.size(); i++) {
+        if ((i == q) || !alive[i]) { continue; }
+        double dx = points[i][0] - points[q][0];
+        double dy = points[i][1] - points[q][1];
+        all.push_back(std::make_pair(dx * dx + dy * dy, i));
+      }
+      std::sort(all.begin(), all.end());
+      index.nearest(q, k, found);
+      size_t expected = std::min(k, all.size());
+      if (found.size() != expected) {
+        std::cerr << "Found " << found.size() << " neighbors of point " << q
+          << ", expected " << expected << std::endl;
+        return 1;
+      }
+      for (size_t n = 0; n < expected; n++) {
+        if (found[n] != all[n].second) {
+          std::cerr << "Neighbor " << n << " of point " << q << " is "
+            << found[n] << ", expected " << all[n].second << std::endl;
+          return 2;
+        }
+      }
+    }
+    // Remove every third point and check again.
+    for (size_t i = 0; i < points.size(); i += 3) {
+      index.remove(i);
+      alive[i] = false;
+    }
+  }
+  return 0;
+}
+
+//====================================================================
+// The value of a half-precision number.
+static float half_to_float(uint16_t h)
+{
+  int exponent = (h >> 10) & 0x1f;
+  int mantissa = h & 0x3ff;
+  float v = (exponent == 0) ? ldexpf(static_cast<float>(mantissa), -24)
+    : ldexpf(static_cast<float>(mantissa | 0x400), exponent - 25);
+  return (h & 0x8000) ? -v : v;
+}
+
+// Every finite half must convert back to itself, values between two
+// halves must go to the nearer one, and values halfway between them to
+// the one with an even mantissa.  Values too large for a half become
+// infinity and NaN stays NaN.
+static int test_half_float()
+{
+  for (uint32_t h = 0; h < 0x7c00; h++) {
+    for (uint32_t sign = 0; sign <= 0x8000; sign += 0x8000) {
+      uint16_t expected = static_cast<uint16_t>(h | sign);
+      float v = half_to_float(expected);
+      if (float_to_half(v) != expected) {
+        std::cerr << "Half 0x" << std::hex << expected << " converted back to 0x"
+          << float_to_half(v) << std::dec << std::endl;
+        return 1;
+      }
+    }
+    if (h == 0x7bff) { break; }
+    float lo = half_to_float(static_cast<uint16_t>(h));
+    float hi = half_to_float(static_cast<uint16_t>(h + 1));
+    float mid = (lo + hi) / 2;
+    uint16_t even = static_cast<uint16_t>((h & 1) ? h + 1 : h);
+    if ((float_to_half(mid) != even) ||
+        (float_to_half(nextafterf(mid, 0)) != h) ||
+        (float_to_half(nextafterf(mid, hi)) != h + 1)) {
+      std::cerr << "Values between halves 0x" << std::hex << h << " and 0x"
+        << h + 1 << std::dec << " rounded the wrong way" << std::endl;
+      return 2;
+    }
+  }
+  // Halfway between the largest half (65504) and 65536 rounds to even,
+  // which is infinity.
+  if ((float_to_half(65519.0f) != 0x7bff) ||
+      (float_to_half(65520.0f) != 0x7c00) ||
+      (float_to_half(1e10f) != 0x7c00) ||
+      (float_to_half(-1e10f) != 0xfc00) ||
+      (float_to_half(1e-10f) != 0)) {
+    std::cerr << "Out-of-range values converted wrongly" << std::endl;
+    return 3;
+  }
+  uint16_t nan = float_to_half(std::numeric_limits<float>::quiet_NaN());
+  if (((nan & 0x7c00) != 0x7c00) || ((nan & 0x3ff) == 0)) {
+    std::cerr << "NaN converted to 0x" << std::hex << nan << std::dec
+      << std::endl;
+    return 4;
+  }
+  return 0;
+}
+
+//====================================================================
+// A displacement map file must have a header that describes its maps,
+// each map must start on an aligned offset after the header and the
+// map before it, with zeros in between, and hold the texels that were
+// baked in the format that was asked for.
+static int test_displacement_map()
+{
+  DistortionConfigOptions opts;
+  opts.displacementMapX = 40;
+  opts.displacementMapY = 30;
+  DistortionConfig config;
+  if (!build_test_config(opts, config)) { return 1; }
+  std::vector<std::vector<float> const *> maps;
+  maps.push_back(&config.leftDisplacementMaps[0]);
+  maps.push_back(&config.rightDisplacementMaps[0]);
+
+  const Displacement_Map_Format formats[2] =
+    { DISPLACEMENT_RG16F, DISPLACEMENT_RG32F };
+  std::string fileName = "AnglesToConfigTest.a2d";
+  for (int f = 0; f < 2; f++) {
+    if (!write_displacement_maps(fileName, formats[f], 40, 30, maps)) {
+      return 2;
+    }
+    std::vector<char> contents;
+    if (!read_file_contents(fileName, contents)) { return 3; }
+    Displacement_Map_Header header;
+    if (contents.size() < sizeof(header)) {
+      std::cerr << fileName << " has only " << contents.size() << " bytes"
+        << std::endl;
+      return 4;
+    }
+    memcpy(&header, contents.data(), sizeof(header));
+    size_t texelBytes = displacement_map_texel_bytes(formats[f]);
+    if ((memcmp(header.magic, DISPLACEMENT_MAP_MAGIC, sizeof(header.magic)) != 0) ||
+        (header.byteOrder != DISPLACEMENT_MAP_BYTE_ORDER) ||
+        (header.format != static_cast<uint32_t>(formats[f])) ||
+        (header.width != 40) || (header.height != 30) ||
+        (header.eyes != 2) || (header.colors != 1) ||
+        (header.mapBytes != 40 * 30 * texelBytes)) {
+      std::cerr << "Wrong header for format " << formats[f] << std::endl;
+      return 5;
+    }
+
+    uint64_t end = sizeof(header);
+    for (unsigned eye = 0; eye < 2; eye++) {
+      uint64_t offset = displacement_map_offset(header, eye, 0);
+      if ((offset % DISPLACEMENT_MAP_ALIGNMENT != 0) || (offset < end) ||
+          (offset + header.mapBytes > contents.size())) {
+        std::cerr << "Map for eye " << eye << " is at " << offset
+          << " in a file of " << contents.size() << " bytes" << std::endl;
+        return 6;
+      }
+      for (uint64_t b = end; b < offset; b++) {
+        if (contents[b] != 0) {
+          std::cerr << "Padding byte " << b << " is not zero" << std::endl;
+          return 7;
+        }
+      }
+      std::vector<float> const &texels = *maps[eye];
+      const char *map = contents.data() + offset;
+      for (size_t v = 0; v < texels.size(); v++) {
+        bool same;
+        if (formats[f] == DISPLACEMENT_RG16F) {
+          uint16_t h = float_to_half(texels[v]);
+          same = (memcmp(map + 2 * v, &h, sizeof(h)) == 0);
+        } else {
+          same = (memcmp(map + 4 * v, &texels[v], sizeof(float)) == 0);
+        }
+        if (!same) {
+          std::cerr << "Value " << v << " of the map for eye " << eye
+            << " differs in format " << formats[f] << std::endl;
+          return 8;
+        }
+      }
+      end = offset + header.mapBytes;
+    }
+    if (contents.size() != end) {
+      std::cerr << fileName << " has " << contents.size() - end
+        << " bytes after its last map" << std::endl;
+      return 9;
+    }
+  }
+  remove(fileName.c_str());
+  return 0;
+}
+
+//====================================================================
+// An affine mesh must resample exactly, and a smoothly curved one to
+// within the error of bilinear interpolation on the grid, which is about
+// (spacing^2 / 8) times the second derivatives (below 1.2 here), or
+// 4e-4.  The report must agree with checking the samples against the
+// grid directly.
+static int test_resample()
+{
+  const double bounds[2] = { 1e-12, 1e-3 };
+  const double strengths[2] = { 0, 0.2 };
+  for (int t = 0; t < 2; t++) {
+    MeshDescription mesh = make_radial_mesh(60, strengths[t]);
+    MeshDescription grid;
+    ResampleReport report;
+    if (!resample_mesh(mesh, 20, 20, grid, report)) { return 1; }
+    if ((report.gridPoints < 16 * 16) ||
+        (report.samplesChecked < mesh.size() / 2)) {
+      std::cerr << "Resampled only " << report.gridPoints
+        << " grid points and checked " << report.samplesChecked
+        << " samples" << std::endl;
+      return 2;
+    }
+    if (!(report.maxError <= bounds[t]) ||
+        !(report.rmsError <= report.maxError)) {
+      std::cerr << "Resample error " << report.maxError << " (RMS "
+        << report.rmsError << ") for strength " << strengths[t]
+        << ", expected at most " << bounds[t] << std::endl;
+      return 3;
+    }
+
+    std::vector< std::array<double, 2> > values(20 * 20);
+    std::vector<bool> valid(20 * 20, false);
+    for (size_t g = 0; g < grid.size(); g++) {
+      size_t i = static_cast<size_t>(grid[g][0][0] * 19 + 0.5);
+      size_t j = static_cast<size_t>(grid[g][0][1] * 19 + 0.5);
+      values[j * 20 + i] = grid[g][1];
+      valid[j * 20 + i] = true;
+    }
+    ResampleReport check;
+    check_resampled_grid(mesh, 20, 20, values, valid, check);
+    if ((check.maxError != report.maxError) ||
+        (check.samplesChecked != report.samplesChecked)) {
+      std::cerr << "Resample report does not match its grid" << std::endl;
+      return 4;
+    }
+  }
+  return 0;
+}
+
+//====================================================================
+// Simplification must keep only original samples, keep the per-cell fit
+// error within tolerance, reduce an affine mesh to a few samples and
+// keep more of a curved one.
+static int test_simplify()
+{
+  const double tolerance = 1e-3;
+  size_t kept[2];
+  const double strengths[2] = { 0, 0.5 };
+  for (int t = 0; t < 2; t++) {
+    MeshDescription mesh = make_radial_mesh(60, strengths[t]);
+    MeshDescription simplified;
+    SimplifyReport report;
+    if (!simplify_mesh(mesh, tolerance, simplified, report)) { return 1; }
+    if ((report.outputSamples != simplified.size()) ||
+        (report.inputSamples != mesh.size())) {
+      std::cerr << "Simplify report counts are wrong" << std::endl;
+      return 2;
+    }
+    if (!(report.maxError <= tolerance)) {
+      std::cerr << "Simplify fit error " << report.maxError
+        << " is over the tolerance " << tolerance << std::endl;
+      return 3;
+    }
+    size_t next = 0;
+    for (size_t i = 0; i < simplified.size(); i++) {
+      while ((next < mesh.size()) && (mesh[next] != simplified[i])) { next++; }
+      if (next == mesh.size()) {
+        std::cerr << "Simplified sample " << i
+          << " is not an input sample in order" << std::endl;
+        return 4;
+      }
+      next++;
+    }
+    kept[t] = simplified.size();
+  }
+  if ((kept[0] > 16) || (kept[1] <= kept[0])) {
+    std::cerr << "Kept " << kept[0] << " samples of the affine mesh and "
+      << kept[1] << " of the curved one" << std::endl;
+    return 5;
+  }
+  return 0;
+}
+
+//====================================================================
+struct Test {
+  const char *name;
+  int (*run)();
+};
+static const Test TESTS[] = {
+  { "base64_mesh", test_base64_mesh },
+  { "cache", test_cache },
+  { "compact_mesh", test_compact_mesh },
+  { "displacement_map", test_displacement_map },
+  { "half_float", test_half_float },
+  { "local_outliers", test_local_outliers },
+  { "neighbor_index", test_neighbor_index },
+  { "resample", test_resample },
+  { "simplify", test_simplify },
+};
+
+int main(int argc, char *argv[])
+{
+  if (argc != 3) {
+    std::cerr << "Usage: " << argv[0] << " test_name input_mapping_file"
+      << std::endl;
+    std::cerr << "  Tests:";
+    for (size_t t = 0; t < sizeof(TESTS) / sizeof(TESTS[0]); t++) {
+      std::cerr << " " << TESTS[t].name;
+    }
+    std::cerr << std::endl;
+    return 1;
+  }
+  g_dataFile = argv[2];
+  for (size_t t = 0; t < sizeof(TESTS) / sizeof(TESTS[0]); t++) {
+    if (std::string(TESTS[t].name) == argv[1]) {
+      int ret = TESTS[t].run();
+      if (ret != 0) {
+        std::cerr << "Test " << argv[1] << " failed (" << ret << ")"
+          << std::endl;
+      }
+      return ret;
+    }
+  }
+  std::cerr << "Unknown test " << argv[1] << std::endl;
+  return 1;
+}
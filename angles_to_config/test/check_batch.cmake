@@ -0,0 +1,31 @@
+# Runs PROGRAM with the arguments in ARGS (a list) in WORK_DIR and fails
+# unless the SHA-256 hash of each file in FILES after the run is the
+# one in the same place in FILE_HASHES.  The files are removed first so
+# that ones left over from an earlier run cannot pass.
+
+foreach(f ${FILES})
+  file(REMOVE "${WORK_DIR}/${f}")
+endforeach()
+
+execute_process(COMMAND "${PROGRAM}" ${ARGS}
+  WORKING_DIRECTORY "${WORK_DIR}"
+  OUTPUT_FILE "${OUTPUT}"
+  RESULT_VARIABLE result)
+if (NOT result EQUAL 0)
+  message(FATAL_ERROR "${PROGRAM} ${ARGS} failed: ${result}")
+endif()
+
+list(LENGTH FILES count)
+math(EXPR last "${count} - 1")
+foreach(i RANGE ${last})
+  list(GET FILES ${i} f)
+  list(GET FILE_HASHES ${i} expected)
+  if (NOT EXISTS "${WORK_DIR}/${f}")
+    message(FATAL_ERROR "${PROGRAM} ${ARGS} did not write ${f}")
+  endif()
+  file(SHA256 "${WORK_DIR}/${f}" hash)
+  if (NOT hash STREQUAL expected)
+    message(FATAL_ERROR "${PROGRAM} ${ARGS} wrote ${f} with hash"
+      " ${hash}, expected ${expected}")
+  endif()
+endforeach()
@@ -0,0 +1,36 @@
+# Runs PROGRAM with the arguments in ARGS (a list) in WORK_DIR and fails
+# unless the SHA-256 hash of what it writes to standard output is
+# EXPECTED.  If CACHE_FILES is given, those files are removed first and
+# the program is run twice, so that the second run reads the cache files
+# that the first one wrote.
+
+if (CACHE_FILES)
+  foreach(f ${CACHE_FILES})
+    file(REMOVE "${WORK_DIR}/${f}")
+  endforeach()
+  set(RUNS 1 2)
+else()
+  set(RUNS 1)
+endif()
+
+foreach(run ${RUNS})
+  execute_process(COMMAND "${PROGRAM}" ${ARGS}
+    WORKING_DIRECTORY "${WORK_DIR}"
+    OUTPUT_FILE "${OUTPUT}"
+    RESULT_VARIABLE result)
+  if (NOT result EQUAL 0)
+    message(FATAL_ERROR "Run ${run} of ${PROGRAM} ${ARGS} failed: ${result}")
+  endif()
+  file(SHA256 "${OUTPUT}" hash)
+  if (NOT hash STREQUAL EXPECTED)
+    message(FATAL_ERROR "Run ${run} of ${PROGRAM} ${ARGS} wrote ${OUTPUT}"
+      " with hash ${hash}, expected ${EXPECTED}")
+  endif()
+endforeach()
+if (CACHE_FILES)
+  foreach(f ${CACHE_FILES})
+    if (NOT EXISTS "${WORK_DIR}/${f}")
+      message(FATAL_ERROR "${PROGRAM} ${ARGS} did not write ${f}")
+    endif()
+  endforeach()
+endif()
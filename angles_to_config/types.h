@@ -110,6 +110,35 @@ public:
   Mapping() {};
 };
 
+/// Trigonometric functions of a mapping entry's angles.  These are
+/// the only part of the entry's 3D location that does not scale with
+/// the depth, so keeping them lets the location be found for any depth
+/// using only multiplications.  The tangents are used for field angles
+/// and the sines and cosines for latitude/longitude, with theta being
+/// the longitude and phi being the angle down from the +Y axis.
+class AngleTerms {
+public:
+  double tanLong;
+  double tanLat;
+  double sinTheta;
+  double cosTheta;
+  double sinPhi;
+  double cosPhi;
+
+  /// Angles are in radians.
+  AngleTerms(double latitude, double longitude)
+  {
+    double phi = MY_PI / 2 - latitude;
+    tanLong = tan(longitude);
+    tanLat = tan(latitude);
+    sinTheta = sin(longitude);
+    cosTheta = cos(longitude);
+    sinPhi = sin(phi);
+    cosPhi = cos(phi);
+  }
+  AngleTerms() { tanLong = tanLat = sinTheta = sinPhi = 0; cosTheta = cosPhi = 1; }
+};
+
 // Description of a screen
 typedef struct {
   double hFOVDegrees;
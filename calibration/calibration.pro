@@ -16,6 +16,7 @@ INCLUDEPATH += /usr/local/include
 INCLUDEPATH += C:/usr/local/include
 
 INCLUDEPATH += ../shaders
+INCLUDEPATH += ../render_common
 
 # Avoid some warnings on Windows
 DEFINES += _CRT_SECURE_NO_WARNINGS=1
@@ -27,10 +28,20 @@ DEFINES += GLEW_STATIC
 SOURCES += main.cpp\
         mainwindow.cpp \
     opengl_widget.cpp \
-    ../shaders/undistort_shader.cpp
+    line_strip_buffer.cpp \
+    offscreen_target.cpp \
+    ../shaders/undistort_shader.cpp \
+    ../render_common/displacement_map_file.cpp \
+    ../render_common/file_util.cpp \
+    ../render_common/json_stream.cpp
 
 HEADERS  += mainwindow.h \
     opengl_widget.h \
-    ../shaders/undistort_shader.h
+    line_strip_buffer.h \
+    offscreen_target.h \
+    ../shaders/undistort_shader.h \
+    ../render_common/displacement_map_file.h \
+    ../render_common/file_util.h \
+    ../render_common/json_stream.h
 
 FORMS    += mainwindow.ui
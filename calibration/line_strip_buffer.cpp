@@ -0,0 +1,127 @@
+/** @file
+    @brief Implementation
+
+    @date 2016
+
+    @author
+    Russell Taylor
+    <russ@reliasolve.com>
+    <http://sensics.com>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "line_strip_buffer.h"
+#include <vector>
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+class Line_Strip_Buffer_Private
+{
+public:
+    Line_Strip_Buffer_Private()
+        : d_buffer(0), d_dirty(true) {};
+
+    // Make sure that GLEW has been initialized, returning true if
+    // vertex buffer objects are available.
+    static bool haveBuffers();
+
+    std::vector<GLfloat>    d_vertices; //< x, y for each vertex
+    std::vector<GLint>      d_firsts;   //< Index of the first vertex in each strip
+    std::vector<GLsizei>    d_counts;   //< Number of vertices in each strip
+    GLuint                  d_buffer;   //< Buffer object, 0 if none made yet
+    bool                    d_dirty;    //< Buffer needs to be reloaded
+};
+
+bool Line_Strip_Buffer_Private::haveBuffers()
+{
+    static bool initialized = false;
+    if (!initialized) {
+        glewInit();
+        initialized = true;
+    }
+    return GLEW_VERSION_1_5 != 0;
+}
+
+Line_Strip_Buffer::Line_Strip_Buffer()
+  : d_p(new Line_Strip_Buffer_Private)
+{
+}
+
+Line_Strip_Buffer::~Line_Strip_Buffer()
+{
+    if (d_p->d_buffer != 0) {
+        glDeleteBuffers(1, &d_p->d_buffer);
+    }
+    delete d_p;
+}
+
+void Line_Strip_Buffer::clear()
+{
+    d_p->d_vertices.clear();
+    d_p->d_firsts.clear();
+    d_p->d_counts.clear();
+    d_p->d_dirty = true;
+}
+
+void Line_Strip_Buffer::beginStrip()
+{
+    d_p->d_firsts.push_back(static_cast<GLint>(d_p->d_vertices.size() / 2));
+    d_p->d_counts.push_back(0);
+    d_p->d_dirty = true;
+}
+
+void Line_Strip_Buffer::addVertex(float x, float y)
+{
+    if (d_p->d_counts.empty()) {
+        beginStrip();
+    }
+    d_p->d_vertices.push_back(x);
+    d_p->d_vertices.push_back(y);
+    d_p->d_counts.back()++;
+    d_p->d_dirty = true;
+}
+
+void Line_Strip_Buffer::draw()
+{
+    if (d_p->d_counts.empty()) {
+        return;
+    }
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    if (Line_Strip_Buffer_Private::haveBuffers()) {
+        if (d_p->d_buffer == 0) {
+            glGenBuffers(1, &d_p->d_buffer);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, d_p->d_buffer);
+        if (d_p->d_dirty) {
+            glBufferData(GL_ARRAY_BUFFER,
+                d_p->d_vertices.size() * sizeof(GLfloat),
+                &d_p->d_vertices[0], GL_STATIC_DRAW);
+            d_p->d_dirty = false;
+        }
+        glVertexPointer(2, GL_FLOAT, 0, 0);
+        glMultiDrawArrays(GL_LINE_STRIP, &d_p->d_firsts[0], &d_p->d_counts[0],
+            static_cast<GLsizei>(d_p->d_counts.size()));
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    } else {
+        // No buffer objects, so draw each strip from our own memory.
+        glVertexPointer(2, GL_FLOAT, 0, &d_p->d_vertices[0]);
+        for (size_t i = 0; i < d_p->d_counts.size(); i++) {
+            glDrawArrays(GL_LINE_STRIP, d_p->d_firsts[i], d_p->d_counts[i]);
+        }
+    }
+    glDisableClientState(GL_VERTEX_ARRAY);
+}
@@ -0,0 +1,62 @@
+/** @file
+    @brief Header
+
+    @date 2016
+
+    @author
+    Russell Taylor
+    <russ@reliasolve.com>
+    <http://sensics.com>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+// Forward declaration to portions declared in the .cpp file, to avoid
+// #include conflicts with other source code.
+class Line_Strip_Buffer_Private;
+
+// A set of 2D line strips that is built once and then drawn many times.
+// The vertices are kept in a vertex buffer object on the graphics card
+// and all of the strips are drawn with a single call.  If vertex buffer
+// objects are not available, they are drawn from client memory.
+class Line_Strip_Buffer
+{
+public:
+    Line_Strip_Buffer();
+    ~Line_Strip_Buffer();
+
+    // Remove all of the strips.
+    void clear();
+
+    // Start a new strip; the vertices added after this belong to it.
+    void beginStrip();
+
+    // Add a vertex to the current strip.
+    void addVertex(float x, float y);
+
+    // Draw all of the strips using the current color, copying them to
+    // the graphics card first if they have changed since the last draw.
+    // Must be called with the OpenGL context current.
+    void draw();
+
+private:
+    Line_Strip_Buffer_Private   *d_p;  //< Private objects requiring GL/GLEW
+
+    // Not copyable, because we own the buffer object.
+    Line_Strip_Buffer(const Line_Strip_Buffer &);
+    Line_Strip_Buffer &operator=(const Line_Strip_Buffer &);
+};
@@ -0,0 +1,144 @@
+/** @file
+    @brief Implementation
+
+    @date 2016
+
+    @author
+    Russell Taylor
+    <russ@reliasolve.com>
+    <http://sensics.com>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "offscreen_target.h"
+#include <stdio.h>
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+class Offscreen_Target_Private
+{
+public:
+    Offscreen_Target_Private()
+        : d_framebuffer(0), d_texture(0), d_width(0), d_height(0)
+        , d_previous(0) {};
+
+    // Release the framebuffer and texture, if we have them.
+    void destroy();
+
+    GLuint  d_framebuffer;  //< Framebuffer object, 0 if none
+    GLuint  d_texture;      //< Color texture attached to it
+    int     d_width, d_height;
+    GLint   d_previous;     //< Framebuffer bound before bind()
+};
+
+void Offscreen_Target_Private::destroy()
+{
+    if (d_framebuffer != 0) {
+        glDeleteFramebuffers(1, &d_framebuffer);
+        d_framebuffer = 0;
+    }
+    if (d_texture != 0) {
+        glDeleteTextures(1, &d_texture);
+        d_texture = 0;
+    }
+    d_width = d_height = 0;
+}
+
+Offscreen_Target::Offscreen_Target()
+  : d_p(new Offscreen_Target_Private)
+{
+}
+
+Offscreen_Target::~Offscreen_Target()
+{
+    d_p->destroy();
+    delete d_p;
+}
+
+bool Offscreen_Target::setSize(int width, int height)
+{
+    if ((d_p->d_framebuffer != 0) &&
+        (width == d_p->d_width) && (height == d_p->d_height)) {
+        return true;
+    }
+    d_p->destroy();
+    if ((width <= 0) || (height <= 0)) {
+        return false;
+    }
+
+    static bool initialized = false;
+    if (!initialized) {
+        glewInit();
+        initialized = true;
+    }
+    if (!GLEW_VERSION_3_0 && !GLEW_ARB_framebuffer_object) {
+        return false;
+    }
+
+    glGenTextures(1, &d_p->d_texture);
+    glBindTexture(GL_TEXTURE_2D, d_p->d_texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0,
+        GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    GLint previous;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+    glGenFramebuffers(1, &d_p->d_framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, d_p->d_framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+        GL_TEXTURE_2D, d_p->d_texture, 0);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, previous);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "Offscreen_Target::setSize(): Framebuffer incomplete (0x%x)\n",
+            status);
+        d_p->destroy();
+        return false;
+    }
+
+    d_p->d_width = width;
+    d_p->d_height = height;
+    return true;
+}
+
+void Offscreen_Target::bind()
+{
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &d_p->d_previous);
+    glBindFramebuffer(GL_FRAMEBUFFER, d_p->d_framebuffer);
+}
+
+void Offscreen_Target::release()
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, d_p->d_previous);
+}
+
+void Offscreen_Target::drawTexturedRectangle(float x0, float y0, float x1, float y1,
+                                             float s0, float t0, float s1, float t1)
+{
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, d_p->d_texture);
+    glBegin(GL_QUADS);
+    glTexCoord2f(s0, t0); glVertex2f(x0, y0);
+    glTexCoord2f(s1, t0); glVertex2f(x1, y0);
+    glTexCoord2f(s1, t1); glVertex2f(x1, y1);
+    glTexCoord2f(s0, t1); glVertex2f(x0, y1);
+    glEnd();
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
@@ -0,0 +1,64 @@
+/** @file
+    @brief Header
+
+    @date 2016
+
+    @author
+    Russell Taylor
+    <russ@reliasolve.com>
+    <http://sensics.com>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+// Forward declaration to portions declared in the .cpp file, to avoid
+// #include conflicts with other source code.
+class Offscreen_Target_Private;
+
+// A color texture wrapped in a framebuffer object, so that an image
+// can be rendered into it once and then used as a texture by later
+// passes.
+class Offscreen_Target
+{
+public:
+    Offscreen_Target();
+    ~Offscreen_Target();
+
+    // Make sure the target exists and has the specified size in pixels,
+    // which clears its contents if the size changes.  Returns false if
+    // framebuffer objects are not available or the target could not be
+    // made.  Must be called with the OpenGL context current.
+    bool setSize(int width, int height);
+
+    // Send rendering into the target rather than to the framebuffer
+    // that was in use, and then back to that framebuffer.
+    void bind();
+    void release();
+
+    // Draw a rectangle with the specified corners (in the current
+    // coordinate system) textured with the specified part of the target
+    // (in texture coordinates), using texture unit 0.
+    void drawTexturedRectangle(float x0, float y0, float x1, float y1,
+                               float s0, float t0, float s1, float t1);
+
+private:
+    Offscreen_Target_Private    *d_p;  //< Private objects requiring GL/GLEW
+
+    // Not copyable, because we own the framebuffer objects.
+    Offscreen_Target(const Offscreen_Target &);
+    Offscreen_Target &operator=(const Offscreen_Target &);
+};
@@ -26,6 +26,7 @@
 
 
 #include "opengl_widget.h"
+#include "json_stream.h"
 
 
 
@@ -42,6 +43,7 @@
 #endif
 
 #define CONFIG_FILE "HMD_Config.json"
+#define DISPLACEMENT_MAP_FILE "HMD_Displacement.a2cdisp"
 
 //----------------------------------------------------------------------
 // Helper functions
@@ -55,7 +57,18 @@ OpenGL_Widget::OpenGL_Widget(QWidget *parent)
     , d_k1_green(0)
     , d_k1_blue(0)
     , fullscreen(false)
+    , d_geometry_valid(false)
+    , d_geometry_fullscreen(false)
+    , d_geometry_width(-1)
+    , d_geometry_height(-1)
+    , d_geometry_undistorted(false)
+    , d_shader(NULL)
+    , d_target_current(false)
+    , d_gpu_distortion(true)
+    , d_use_displacement_map(false)
 {
+    d_geometry_k1[0] = d_geometry_k1[1] = d_geometry_k1[2] = 0;
+
     using namespace std;
     cout << "Distortion estimation for HMD using K1 (quadratic) term" << endl
          << "The program always runs on the last screen, full screen" << endl
@@ -69,12 +82,19 @@ OpenGL_Widget::OpenGL_Widget(QWidget *parent)
          << "  f/F:    Toggle fullscreen on/off" << endl
          << "  c/C:    Reset center of projection" << endl
          << "  v/V:    Reset distortion values to 0" << endl
+         << "  d/D:    Toggle between GPU and CPU distortion" << endl
+         << "  m/M:    Toggle GPU distortion using the displacement map ("
+         << DISPLACEMENT_MAP_FILE << ")" << endl
          << "  ESC/Q: Quit the application" << endl
          << endl;
 }
 
 OpenGL_Widget::~OpenGL_Widget()
 {
+    // The shader and the geometry buffers delete their objects,
+    // which needs our context.
+    makeCurrent();
+    delete d_shader;
 }
 
 void OpenGL_Widget::initializeGL()
@@ -93,6 +113,13 @@ void OpenGL_Widget::initializeGL()
     // Makes the colors for the primitives be what we want.
     glDisable(GL_LIGHTING);
 
+    // Load the shader that does distortion correction on the GPU.
+    d_shader = new Undistort_Shader();
+    if (!d_shader->isValid()) {
+        fprintf(stderr, "OpenGL_Widget::initializeGL(): Could not load distortion"
+            " shader, distorting on the CPU\n");
+    }
+
 }
 
 // The distortion is with respect to a center of projection, which
@@ -116,12 +143,8 @@ void OpenGL_Widget::initializeGL()
 //          = (-1 + sqrt(1 + 4*K1*Rcorr)) / (2*K1)
 //    K1 > 0
 
-QPointF OpenGL_Widget::transformPoint(QPointF p, QPoint cop, unsigned color)
+float OpenGL_Widget::scaledK1(unsigned color) const
 {
-    QPointF ret = p;
-    QPointF offset = p - cop;
-    float r2 = offset.x() * offset.x() + offset.y() * offset.y();
-    float r = sqrt(r2);
     float k1;
     switch (color) {
     case 0:
@@ -131,10 +154,32 @@ QPointF OpenGL_Widget::transformPoint(QPointF p, QPoint cop, unsigned color)
         k1 = d_k1_green;
         break;
     case 2:
+    default:
         k1 = d_k1_blue;
         break;
     }
-    k1 = k1 / ((d_width / 4.0)*(d_width / 4.0) * 16);
+    return k1 / ((d_width / 4.0)*(d_width / 4.0) * 16);
+}
+
+const std::vector<QPointF> &OpenGL_Widget::unitCircle(float radius)
+{
+    std::vector<QPointF> &points = d_unit_circles[radius];
+    if (points.empty()) {
+        float step = 1 / radius;
+        for (float r = 0; r <= 2*M_PI; r += step) {
+            points.push_back(QPointF(cos(r), sin(r)));
+        }
+    }
+    return points;
+}
+
+QPointF OpenGL_Widget::transformPoint(QPointF p, QPoint cop, unsigned color)
+{
+    QPointF ret = p;
+    QPointF offset = p - cop;
+    float r2 = offset.x() * offset.x() + offset.y() * offset.y();
+    float r = sqrt(r2);
+    float k1 = scaledK1(color);
 
     //We will calculate the transformed point
     //by calculating the new location using the
@@ -149,91 +194,92 @@ QPointF OpenGL_Widget::transformPoint(QPointF p, QPoint cop, unsigned color)
     return ret;
 }
 
-void OpenGL_Widget::drawCorrectedLine(QPoint begin, QPoint end,
+void OpenGL_Widget::addCorrectedLine(QPoint begin, QPoint end,
                                       QPoint cop, unsigned color)
 {
+    Line_Strip_Buffer &lines = d_color_lines[color];
+    lines.beginStrip();
+
     QPointF offset = end - begin;
     float len = sqrt(offset.x() * offset.x() + offset.y() * offset.y());
     QPointF offset_dir = offset / len;
-    glBegin(GL_LINE_STRIP);
     for (float s = 0; s <=len; s++) {
         QPointF p = begin + s*offset_dir;
-        QPointF tp = transformPoint(p, cop, color);
-        glVertex2f(tp.x(), tp.y());
+        QPointF tp = d_geometry_undistorted ? p : transformPoint(p, cop, color);
+        lines.addVertex(tp.x(), tp.y());
     }
-    glEnd();
 }
 
-void OpenGL_Widget::drawCorrectedCircle(QPoint center, float radius,
+void OpenGL_Widget::addCorrectedCircle(QPoint center, float radius,
                                       QPoint cop, unsigned color)
 {
-    glBegin(GL_LINE_STRIP);
-    float step = 1 / radius;
-    for (float r = 0; r <= 2*M_PI; r += step) {
-        QPointF p(center.x() + radius * cos(r),
-                   center.y() + radius * sin(r));
-        QPointF tp = transformPoint(p, cop, color);
-        glVertex2f(tp.x(), tp.y());
-    }
-    glEnd();
+    const std::vector<QPointF> &unit = unitCircle(radius);
+    Line_Strip_Buffer &lines = d_color_lines[color];
+    lines.beginStrip();
+    if (center == cop) {
+        // Every point is the same distance from the center of projection,
+        // so the whole circle is scaled by the same amount.
+        float k1 = d_geometry_undistorted ? 0 : scaledK1(color);
+        float scale = radius * (1 - k1 * radius * radius);
+        for (size_t i = 0; i < unit.size(); i++) {
+            lines.addVertex(cop.x() + scale * unit[i].x(), cop.y() + scale * unit[i].y());
+        }
+    } else {
+        for (size_t i = 0; i < unit.size(); i++) {
+            QPointF p(center.x() + radius * unit[i].x(),
+                       center.y() + radius * unit[i].y());
+            QPointF tp = d_geometry_undistorted ? p : transformPoint(p, cop, color);
+            lines.addVertex(tp.x(), tp.y());
+        }
+    }
 }
 
-void OpenGL_Widget::drawCorrectedLines(QPoint begin, QPoint end, QPoint cop)
+void OpenGL_Widget::addCorrectedLines(QPoint begin, QPoint end, QPoint cop)
 {
-    float bright = 0.5f;
-    glColor3f(bright, 0.0, 0.0);
-    drawCorrectedLine(begin, end, cop, 0);
-
-    glColor3f(0.0, bright, 0.0);
-    drawCorrectedLine(begin, end, cop, 1);
-
-    glColor3f(0.0, 0.0, bright);
-    drawCorrectedLine(begin, end, cop, 2);
+    addCorrectedLine(begin, end, cop, 0);
+    // Without correction all of the colors would be the same.
+    if (!d_geometry_undistorted) {
+        addCorrectedLine(begin, end, cop, 1);
+        addCorrectedLine(begin, end, cop, 2);
+    }
 }
 
-void OpenGL_Widget::drawCorrectedCircles(QPoint center, float radius, QPoint cop)
+void OpenGL_Widget::addCorrectedCircles(QPoint center, float radius, QPoint cop)
 {
-    float bright = 0.5f;
-    glColor3f(bright, 0.0, 0.0);
-    drawCorrectedCircle(center, radius, cop, 0);
-
-    glColor3f(0.0, bright, 0.0);
-    drawCorrectedCircle(center, radius, cop, 1);
+    addCorrectedCircle(center, radius, cop, 0);
+    if (!d_geometry_undistorted) {
+        addCorrectedCircle(center, radius, cop, 1);
+        addCorrectedCircle(center, radius, cop, 2);
+    }
+}
 
-    glColor3f(0.0, 0.0, bright);
-    drawCorrectedCircle(center, radius, cop, 2);
+// Add one cross-hair line, as its own two-vertex strip.
+static void addLine(Line_Strip_Buffer &lines, float x0, float y0,
+                    float x1, float y1)
+{
+    lines.beginStrip();
+    lines.addVertex(x0, y0);
+    lines.addVertex(x1, y1);
 }
 
-void OpenGL_Widget::drawCrossHairs()
+void OpenGL_Widget::addCrossHairs()
 {
     // Draw two perpendicular lines through the center of
     // projection on the left eye, and the right eye.
-    glColor3f(1.0, 1.0, 1.0);
-
     if (fullscreen){
-        glBegin(GL_LINES);
-        glVertex2f(0, d_cop.y());
-        glVertex2f(d_width, d_cop.y());
-        glVertex2f(d_cop.x(), 0);
-        glVertex2f(d_cop.x(), d_height);
-        glEnd();
+        addLine(d_cross_hairs, 0, d_cop.y(), d_width, d_cop.y());
+        addLine(d_cross_hairs, d_cop.x(), 0, d_cop.x(), d_height);
     }
     else{
-        glBegin(GL_LINES);
-        glVertex2f(0, d_cop_l.y());
-        glVertex2f(d_width / 2, d_cop_l.y());
-        glVertex2f(d_cop_l.x(), 0);
-        glVertex2f(d_cop_l.x(), d_height);
-
-        glVertex2f(d_width / 2, d_cop_r.y());
-        glVertex2f(d_width, d_cop_r.y());
-        glVertex2f(d_cop_r.x(), 0);
-        glVertex2f(d_cop_r.x(), d_height);
-        glEnd();
+        addLine(d_cross_hairs, 0, d_cop_l.y(), d_width / 2, d_cop_l.y());
+        addLine(d_cross_hairs, d_cop_l.x(), 0, d_cop_l.x(), d_height);
+
+        addLine(d_cross_hairs, d_width / 2, d_cop_r.y(), d_width, d_cop_r.y());
+        addLine(d_cross_hairs, d_cop_r.x(), 0, d_cop_r.x(), d_height);
     }
 }
 
-void OpenGL_Widget::drawGrid()
+void OpenGL_Widget::addGrid()
 {
     // Draw a set of vertical grid lines to the right and left
     // of the center of projection for each eye.  Draw a red,
@@ -250,12 +296,12 @@ void OpenGL_Widget::drawGrid()
             if (d_cop.x() + r < d_width) {
                 QPoint begin(d_cop.x() + r, 0);
                 QPoint end(d_cop.x() + r, d_height);
-                drawCorrectedLines(begin, end, d_cop);
+                addCorrectedLines(begin, end, d_cop);
             }
             if (d_cop.x() - r >= 0) {
                 QPoint begin(d_cop.x() - r, 0);
                 QPoint end(d_cop.x() - r, d_height);
-                drawCorrectedLines(begin, end, d_cop);
+                addCorrectedLines(begin, end, d_cop);
             }
         }
 
@@ -265,12 +311,12 @@ void OpenGL_Widget::drawGrid()
             if (d_cop.y() + r < d_height) {
                 QPoint begin(0, d_cop.y() + r);
                 QPoint end(d_width, d_cop.y() + r);
-                drawCorrectedLines(begin, end, d_cop);
+                addCorrectedLines(begin, end, d_cop);
             }
             if (d_cop.y() - r >= 0) {
                 QPoint begin(0, d_cop.y() - r);
                 QPoint end(d_width, d_cop.y() - r);
-                drawCorrectedLines(begin, end, d_cop);
+                addCorrectedLines(begin, end, d_cop);
             }
         }
     }
@@ -282,24 +328,24 @@ void OpenGL_Widget::drawGrid()
             if (d_cop_l.x() + r < d_width / 2) {
                 QPoint begin(d_cop_l.x() + r, 0);
                 QPoint end(d_cop_l.x() + r, d_height);
-                drawCorrectedLines(begin, end, d_cop_l);
+                addCorrectedLines(begin, end, d_cop_l);
             }
             if (d_cop_l.x() - r >= 0) {
                 QPoint begin(d_cop_l.x() - r, 0);
                 QPoint end(d_cop_l.x() - r, d_height);
-                drawCorrectedLines(begin, end, d_cop_l);
+                addCorrectedLines(begin, end, d_cop_l);
             }
 
             // Vertical lines, right eye
             if (d_cop_r.x() + r < d_width) {
                 QPoint begin(d_cop_r.x() + r, 0);
                 QPoint end(d_cop_r.x() + r, d_height - 1);
-                drawCorrectedLines(begin, end, d_cop_r);
+                addCorrectedLines(begin, end, d_cop_r);
             }
             if (d_cop_r.x() - r >= d_width / 2) {
                 QPoint begin(d_cop_r.x() - r, 0);
                 QPoint end(d_cop_r.x() - r, d_height - 1);
-                drawCorrectedLines(begin, end, d_cop_r);
+                addCorrectedLines(begin, end, d_cop_r);
             }
         }
 
@@ -309,41 +355,41 @@ void OpenGL_Widget::drawGrid()
             if (d_cop_l.y() + r < d_height) {
                 QPoint begin(0, d_cop_l.y() + r);
                 QPoint end(d_width / 2 - 1, d_cop_l.y() + r);
-                drawCorrectedLines(begin, end, d_cop_l);
+                addCorrectedLines(begin, end, d_cop_l);
             }
             if (d_cop_l.y() - r >= 0) {
                 QPoint begin(0, d_cop_l.y() - r);
                 QPoint end(d_width / 2 - 1, d_cop_l.y() - r);
-                drawCorrectedLines(begin, end, d_cop_l);
+                addCorrectedLines(begin, end, d_cop_l);
             }
 
             // Horizontal lines, right eye
             if (d_cop_r.y() + r < d_height) {
                 QPoint begin(d_width / 2, d_cop_r.y() + r);
                 QPoint end(d_width - 1, d_cop_r.y() + r);
-                drawCorrectedLines(begin, end, d_cop_r);
+                addCorrectedLines(begin, end, d_cop_r);
             }
             if (d_cop_r.y() - r >= 0) {
                 QPoint begin(d_width / 2, d_cop_r.y() - r);
                 QPoint end(d_width - 1, d_cop_r.y() - r);
-                drawCorrectedLines(begin, end, d_cop_r);
+                addCorrectedLines(begin, end, d_cop_r);
             }
         }
     }
 
 }
 
-void OpenGL_Widget::drawCircles()
+void OpenGL_Widget::addCircles()
 {
     if (fullscreen){
-        drawCorrectedCircles(d_cop, 0.1 * d_width / 4, d_cop);
-        drawCorrectedCircles(d_cop, 0.7 * d_width / 4, d_cop);
+        addCorrectedCircles(d_cop, 0.1 * d_width / 4, d_cop);
+        addCorrectedCircles(d_cop, 0.7 * d_width / 4, d_cop);
     }
     else{
-        drawCorrectedCircles(d_cop_l, 0.1 * d_width / 4, d_cop_l);
-        drawCorrectedCircles(d_cop_r, 0.1 * d_width / 4, d_cop_r);
-        drawCorrectedCircles(d_cop_l, 0.7 * d_width / 4, d_cop_l);
-        drawCorrectedCircles(d_cop_r, 0.7 * d_width / 4, d_cop_r);
+        addCorrectedCircles(d_cop_l, 0.1 * d_width / 4, d_cop_l);
+        addCorrectedCircles(d_cop_r, 0.1 * d_width / 4, d_cop_r);
+        addCorrectedCircles(d_cop_l, 0.7 * d_width / 4, d_cop_l);
+        addCorrectedCircles(d_cop_r, 0.7 * d_width / 4, d_cop_r);
     }
 }
 
@@ -364,10 +410,125 @@ void OpenGL_Widget::paintGL()
     glDisable(GL_DEPTH_TEST);
     glDisable(GL_TEXTURE_2D);
 
-    drawCrossHairs();
-    drawGrid();
-    drawCircles();
+    // Draw each color at less than full brightness, so that they
+    // add up to white where they overlap.
+    float bright = 0.5f;
+    bool useGPU = d_gpu_distortion && (d_shader != NULL) && d_shader->isValid() &&
+        d_target.setSize(d_width, d_height);
+    if (updateGeometry(useGPU)) {
+        d_target_current = false;
+    }
+
+    if (useGPU) {
+        // Render the undistorted lines into the target only when they
+        // have changed, then distort the target onto the window.
+        if (!d_target_current) {
+            d_target.bind();
+            glClear(GL_COLOR_BUFFER_BIT);
+            glColor3f(bright, bright, bright);
+            d_color_lines[0].draw();
+            d_target.release();
+            d_target_current = true;
+        }
+        if (fullscreen) {
+            drawDistortedRegion(0, d_width - 1, d_cop, 0);
+        } else {
+            drawDistortedRegion(0, d_width / 2, d_cop_l, 0);
+            drawDistortedRegion(d_width / 2, d_width - 1, d_cop_r, 1);
+        }
+    } else {
+        glColor3f(bright, 0.0, 0.0);
+        d_color_lines[0].draw();
+        glColor3f(0.0, bright, 0.0);
+        d_color_lines[1].draw();
+        glColor3f(0.0, 0.0, bright);
+        d_color_lines[2].draw();
+    }
+
+    // The cross hairs are not distorted.
+    glColor3f(1.0, 1.0, 1.0);
+    d_cross_hairs.draw();
+}
+
+void OpenGL_Widget::drawDistortedRegion(int left, int right, QPoint cop,
+                                        int eye)
+{
+    // The window's coordinates go from 0 to one less than its size in
+    // each direction (see resizeGL()), and the target covers it.
+    float sx = 1.0f / (d_width - 1);
+    float sy = 1.0f / (d_height - 1);
+
+    // All colors share the center of projection and have only a K1
+    // term, which is scaled by the width in pixels (see scaledK1()).
+    Undistort_Shader::Parameters params;
+    float k1[3] = { d_k1_red, d_k1_green, d_k1_blue };
+    for (int c = 0; c < 3; c++) {
+        params.color[c].centerX = cop.x() * sx;
+        params.color[c].centerY = cop.y() * sy;
+        params.color[c].k.push_back(k1[c]);
+    }
+    params.radius = d_width;
+    params.viewWidth = d_width - 1;
+    params.viewHeight = d_height - 1;
+
+    // Each eye samples only its own part of the target, so that lines
+    // the distortion pushes across the seam don't show up in the other
+    // eye.  In split screen the left eye's lines stop one pixel short of
+    // the seam (see addGrid()).
+    int sourceRight = (!fullscreen && (eye == 0)) ? right - 1 : right;
+    params.sourceLeft = left * sx;
+    params.sourceBottom = 0;
+    params.sourceRight = sourceRight * sx;
+    params.sourceTop = 1;
+
+    // The eye's map covers its part of the window.
+    if (d_use_displacement_map) {
+        params.displacementEye = eye;
+        params.mapLeft = left * sx;
+        params.mapBottom = 0;
+        params.mapWidth = (right - left) * sx;
+        params.mapHeight = 1;
+    }
+    d_shader->setParameters(params);
+    d_shader->useShader();
+    d_target.drawTexturedRectangle(left, 0, right, d_height - 1,
+                                   left * sx, 0, right * sx, 1);
+    d_shader->stopUsingShader();
+}
+
+bool OpenGL_Widget::updateGeometry(bool undistorted)
+{
+    // Without correction, the K1 values don't affect the lines.
+    bool k1Same = undistorted ||
+        ((d_geometry_k1[0] == d_k1_red) && (d_geometry_k1[1] == d_k1_green) &&
+        (d_geometry_k1[2] == d_k1_blue));
+    if (d_geometry_valid && k1Same && (d_geometry_undistorted == undistorted) &&
+        (d_geometry_cop_l == d_cop_l) && (d_geometry_cop_r == d_cop_r) &&
+        (d_geometry_cop == d_cop) && (d_geometry_fullscreen == fullscreen) &&
+        (d_geometry_width == d_width) && (d_geometry_height == d_height)) {
+        return false;
+    }
 
+    d_geometry_undistorted = undistorted;
+    d_cross_hairs.clear();
+    for (unsigned color = 0; color < 3; color++) {
+        d_color_lines[color].clear();
+    }
+    addCrossHairs();
+    addGrid();
+    addCircles();
+
+    d_geometry_k1[0] = d_k1_red;
+    d_geometry_k1[1] = d_k1_green;
+    d_geometry_k1[2] = d_k1_blue;
+    d_geometry_cop_l = d_cop_l;
+    d_geometry_cop_r = d_cop_r;
+    d_geometry_cop = d_cop;
+    d_geometry_fullscreen = fullscreen;
+    d_geometry_width = d_width;
+    d_geometry_height = d_height;
+    d_geometry_valid = true;
+    return true;
 }
 
 
@@ -391,6 +552,9 @@ void OpenGL_Widget::resizeGL(int width, int height)
     glOrtho(0, d_width-1, 0, d_height-1, 5.0, 15.0);
     glMatrixMode(GL_MODELVIEW);
 
+    // The circle radii depend on the window width.
+    d_unit_circles.clear();
+
     setDeftCOPVals();
 }
 
@@ -534,6 +698,28 @@ void OpenGL_Widget::keyPressEvent(QKeyEvent *event)
         d_k1_blue = 0.0;
 
         break;
+    case Qt::Key_D:
+        d_gpu_distortion = !d_gpu_distortion;
+        printf("Distorting on the %s\n", d_gpu_distortion ? "GPU" : "CPU");
+        break;
+    case Qt::Key_M:
+        // Load the map the first time it is needed.  It only affects
+        // GPU distortion.
+        if (!d_use_displacement_map && (d_shader != NULL) && d_shader->isValid()) {
+            makeCurrent();
+            if (!d_shader->hasDisplacementMap() &&
+                !d_shader->loadDisplacementMap(DISPLACEMENT_MAP_FILE)) {
+                fprintf(stderr, "Could not load displacement map from %s\n",
+                    DISPLACEMENT_MAP_FILE);
+                break;
+            }
+            d_use_displacement_map = true;
+        } else {
+            d_use_displacement_map = false;
+        }
+        printf("Distorting %s\n", d_use_displacement_map ?
+            "with the displacement map" : "with K1");
+        break;
     }
 
     printf("R = %g, G = %g, B = %g;\n", d_k1_red, d_k1_green, d_k1_blue);
@@ -619,41 +805,86 @@ bool OpenGL_Widget::saveConfigToJson(QString filename)
         relative_cop = pixelToRelative(d_cop_l);
     }
 
-    fprintf(f, "{\n");
-    fprintf(f, "    \"hmd\": {\n");
-    fprintf(f, "        \"distortion\": {\n");
-    fprintf(f, "            \"k1_red\": %g,\n", d_k1_red);
-    fprintf(f, "            \"k1_green\": %g,\n", d_k1_green);
-    fprintf(f, "            \"k1_blue\": %g\n", d_k1_blue);
-    fprintf(f, "        },\n");
-    fprintf(f, "        \"eyes\": [\n");
-    fprintf(f, "            {\n");
-    fprintf(f, "                \"center_proj_x\": %f,\n", relative_cop.x());
-    fprintf(f, "                \"center_proj_y\": %f\n",  relative_cop.y());
-    fprintf(f, "            }\n");
-    fprintf(f, "        ],\n");
-    fprintf(f, "        \"fullscreen\": %d\n", (int)fullscreen);
-    /*
-    else{
-        fprintf(f, "    {\n");
-        fprintf(f, "      \"Center_of_projection_pixels_x\": %d,\n", d_cop_l.x() / d_width);
-        fprintf(f, "      \"Center_of_projection_pixels_y\": %d\n",  d_cop_l.y() / d_height);
-        fprintf(f, "    },\n");
-        fprintf(f, "    {\n");
-        // Center of projection with respect to the lower-left corner of the frame.
-        fprintf(f, "      \"Center_of_projection_pixels_x\": %d,\n", d_cop_r.x() - d_width / 2);
-        fprintf(f, "      \"Center_of_projection_pixels_y\": %d\n", d_cop_r.y());
-        fprintf(f, "    }\n");
-
+    JsonWriter json(f);
+    json.beginObject();
+    json.key("hmd");
+    json.beginObject();
+    json.key("distortion");
+    json.beginObject();
+    json.key("k1_red");     json.value(d_k1_red);
+    json.key("k1_green");   json.value(d_k1_green);
+    json.key("k1_blue");    json.value(d_k1_blue);
+    json.endObject();
+    json.key("eyes");
+    json.beginArray();
+    json.beginObject();
+    json.key("center_proj_x");  json.value(relative_cop.x(), "%f");
+    json.key("center_proj_y");  json.value(relative_cop.y(), "%f");
+    json.endObject();
+    json.endArray();
+    json.key("fullscreen");     json.value((int)fullscreen);
+    json.endObject();
+    json.endObject();
+
+    bool ok = json.ok();
+    if (fclose(f) != 0) { ok = false; }
+    if (!ok) {
+        fprintf(stderr, "OpenGL_Widget::saveConfigToJson(): Can't write %s",
+                filename.toStdString().c_str());
     }
-    */
+    return ok;
+}
 
-    fprintf(f, "    }\n");
-    fprintf(f, "}\n");
+//----------------------------------------------------------------------
+// Pulls the distortion terms and the first eye's center of projection
+// out of a configuration file.  They can be under "hmd" at the top level
+// (as saveConfigToJson() writes them) or under "display.hmd" (as in
+// RenderManager and AnglesToConfig configurations).  Everything else,
+// including any distortion meshes, is skipped without being parsed.
+
+class CalibrationConfigHandler : public JsonHandler {
+public:
+    CalibrationConfigHandler()
+        : k1_red(0), k1_green(0), k1_blue(0), cop_x(0), cop_y(0)
+        , have_k1_red(false), have_k1_green(false), have_k1_blue(false)
+        , have_cop_x(false), have_cop_y(false)
+    {}
+
+    double k1_red, k1_green, k1_blue;
+    double cop_x, cop_y;
+    bool have_k1_red, have_k1_green, have_k1_blue;
+    bool have_cop_x, have_cop_y;
+
+    virtual bool wanted(const JsonPath &path)
+    {
+        size_t first = (!path.empty() && path[0] == "display") ? 1 : 0;
+        size_t depth = path.size() - first;
+        if (depth == 0) { return true; }
+        if (path[first] != "hmd") { return false; }
+        if (depth == 1) { return true; }
+        const std::string &section = path[first + 1];
+        if (section == "distortion") {
+            return (depth == 2) || ((depth == 3) &&
+                (path[first + 2].compare(0, 3, "k1_") == 0));
+        }
+        if (section == "eyes") {
+            return (depth == 2) || ((depth == 3) && (path[first + 2] == "0"))
+                || ((depth == 4) && (path[first + 2] == "0") &&
+                    (path[first + 3].compare(0, 12, "center_proj_") == 0));
+        }
+        return false;
+    }
 
-    fclose(f);
-    return true;
-}
+    virtual void number(const JsonPath &path, double value)
+    {
+        const std::string &name = path.back();
+        if (name == "k1_red") { k1_red = value; have_k1_red = true; }
+        else if (name == "k1_green") { k1_green = value; have_k1_green = true; }
+        else if (name == "k1_blue") { k1_blue = value; have_k1_blue = true; }
+        else if (name == "center_proj_x") { cop_x = value; have_cop_x = true; }
+        else if (name == "center_proj_y") { cop_y = value; have_cop_y = true; }
+    }
+};
 
 bool OpenGL_Widget::loadConfigFromJson(QString filename)
 {
@@ -664,83 +895,34 @@ bool OpenGL_Widget::loadConfigFromJson(QString filename)
         return false;
     }
 
-    // Lines and parameters to read
-    char line[1024];
-    char param[1024];
-    float val;
-    QPointF cop;
-
-    // Skip the first three lines.
-    char* unused;
-    unused = fgets(line, sizeof(line), f);
-    unused = fgets(line, sizeof(line), f);
-    unused = fgets(line, sizeof(line), f);
-
-    // Try and read the red term
-    if (fgets(line, sizeof(line), f) == NULL) {
-        fprintf(stderr, "OpenGL_Widget::loadConfigFromJson(): Can't read red line");
-        return false;
-    }
-    if (sscanf(line, "%s %g", param, &val) != 2)  {
-        fprintf(stderr, "OpenGL_Widget::loadConfigFromJson(): Bad red line: %s",
-            line);
-        return false;
-    }
-    d_k1_red = val;
-
-    // Try and read the green term
-    if (fgets(line, sizeof(line), f) == NULL) {
-        fprintf(stderr, "OpenGL_Widget::loadConfigFromJson(): Can't read green line");
-        return false;
-    }
-    if (sscanf(line, "%s %g", param, &val) != 2)  {
-        fprintf(stderr, "OpenGL_Widget::loadConfigFromJson(): Bad green line: %s",
-            line);
-        return false;
-    }
-    d_k1_green = val;
-
-    // Try and read the blue term
-    if (fgets(line, sizeof(line), f) == NULL) {
-        fprintf(stderr, "OpenGL_Widget::loadConfigFromJson(): Can't read blue line");
-        return false;
-    }
-    if (sscanf(line, "%s %g", param, &val) != 2)  {
-        fprintf(stderr, "OpenGL_Widget::loadConfigFromJson(): Bad blue line: %s",
-            line);
-        return false;
-    }
-    d_k1_blue = val;
-
-    // Skip the next three lines
-    unused = fgets(line, sizeof(line), f);
-    unused = fgets(line, sizeof(line), f);
-    unused = fgets(line, sizeof(line), f);
-
-    // Try and read the eye X COP term
-    if (fgets(line, sizeof(line), f) == NULL) {
-        fprintf(stderr, "OpenGL_Widget::loadConfigFromJson(): Can't read COP x line");
+    CalibrationConfigHandler config;
+    JsonReader reader(f);
+    bool ok = reader.parse(config);
+    fclose(f);
+    if (!ok) {
+        fprintf(stderr, "OpenGL_Widget::loadConfigFromJson(): Can't parse %s: %s\n",
+            filename.toStdString().c_str(), reader.error().c_str());
         return false;
     }
-    if (sscanf(line, "%s %f", param, &val) != 2)  {
-        fprintf(stderr, "OpenGL_Widget::loadConfigFromJson(): Bad COP x line: %s",
-            line);
+    if (!config.have_cop_x || !config.have_cop_y) {
+        fprintf(stderr, "OpenGL_Widget::loadConfigFromJson(): No center of"
+            " projection for the first eye in %s\n",
+            filename.toStdString().c_str());
         return false;
     }
-    cop.setX(val);
 
-    // Try and read the eye Y COP term
-    if (fgets(line, sizeof(line), f) == NULL) {
-        fprintf(stderr, "OpenGL_Widget::loadConfigFromJson(): Can't read COP y line");
-        return false;
+    // Configurations that describe the distortion with meshes rather
+    // than with coefficients leave the current ones alone.
+    if (config.have_k1_red) { d_k1_red = config.k1_red; }
+    if (config.have_k1_green) { d_k1_green = config.k1_green; }
+    if (config.have_k1_blue) { d_k1_blue = config.k1_blue; }
+    if (!config.have_k1_red || !config.have_k1_green || !config.have_k1_blue) {
+        fprintf(stderr, "OpenGL_Widget::loadConfigFromJson(): %s does not"
+            " have all of k1_red, k1_green and k1_blue; keeping the current"
+            " values for those it lacks\n", filename.toStdString().c_str());
     }
-    if (sscanf(line, "%s %f", param, &val) != 2)  {
-        fprintf(stderr, "OpenGL_Widget::loadConfigFromJson(): Bad COP y line: %s",
-            line);
-        return false;
-    }
-    cop.setY(val);
 
+    QPointF cop(config.cop_x, config.cop_y);
     if (fullscreen){
         d_cop = relativeToPixel(cop);
     }
@@ -751,6 +933,5 @@ bool OpenGL_Widget::loadConfigFromJson(QString filename)
         d_cop_r = QPoint(d_width - d_cop_l.x(), d_cop_l.y());
     }
 
-    fclose(f);
     return true;
 }
@@ -27,6 +27,10 @@
 #include "opengl_widget.h"
 #include <QGLWidget>
 #include "undistort_shader.h"
+#include "line_strip_buffer.h"
+#include "offscreen_target.h"
+#include <vector>
+#include <map>
 
 // There are three different indices of refraction for the three
 // different wavelengths in the head-mounted display (R, G, B).
@@ -92,37 +96,67 @@ protected:
 
     //------------------------------------------------------
     // Used as options in the rendering, depending on our
-    // mode.
-    void drawCrossHairs();
-    void drawGrid();
-    void drawCircles();
+    // mode.  These add their lines to the geometry buffers,
+    // which are drawn by paintGL().
+    void addCrossHairs();
+    void addGrid();
+    void addCircles();
+
+    /// Rebuild the geometry buffers if anything they depend on
+    // (the K1 values, centers of projection, fullscreen mode or
+    // window size) has changed since they were built.  If
+    // undistorted is true, the lines are built without distortion
+    // correction (which the shader will apply) and only into the
+    // first color's buffer, and changes to the K1 values don't
+    // require a rebuild.  Returns true if they were rebuilt.
+    bool updateGeometry(bool undistorted);
+
+    /// Draw part of the offscreen target onto the window with the
+    // distortion shader, using the specified center of projection.
+    // The part spans the window's height and goes from left to right
+    // (in pixels).  When the displacement map is in use, the eye
+    // (0 for left, 1 for right) selects which of its maps to use.
+    void drawDistortedRegion(int left, int right, QPoint cop, int eye);
 
     //------------------------------------------------------
-    // Helper functions for the draw routines.
+    // Helper functions for the add routines.
 
-    /// Draw a line from the specified begin point to the
+    /// Add a line from the specified begin point to the
     // specified end, doing distortion correcton.  The line
-    // is drawn in short segments, with the correction applied
+    // is made of short segments, with the correction applied
     // to each segment endpoint.  The color index tells whether
-    // we use red (0), green (1), or blue (2) correction factors.
+    // we use red (0), green (1), or blue (2) correction factors
+    // and which geometry buffer the line goes into.
     // It uses the specified center of projection.
-    void drawCorrectedLine(QPoint begin, QPoint end,
+    void addCorrectedLine(QPoint begin, QPoint end,
                            QPoint cop, unsigned color);
-    void drawCorrectedCircle(QPoint center, float radius,
+    void addCorrectedCircle(QPoint center, float radius,
                            QPoint cop, unsigned color);
 
-    /// Draw a set of 3 colored lines from the specified begin
+    /// Add a set of 3 colored lines from the specified begin
     // point to the specified end, doing distortion correcton.
-    void drawCorrectedLines(QPoint begin, QPoint end, QPoint cop);
-    void drawCorrectedCircles(QPoint center, float radius, QPoint cop);
+    void addCorrectedLines(QPoint begin, QPoint end, QPoint cop);
+    void addCorrectedCircles(QPoint center, float radius, QPoint cop);
 
     /// Transform the specified pixel coordinate by the
     // color-correction distortion matrix using the appropriate
     // distortion correction.  The color index tells whether
     // we use red (0), green (1), or blue (2) correction factors.
     // It uses the specified center of projection.
+    //   There is no lookup table in front of this.  It is called only
+    // when the geometry is rebuilt after K1 or a center of projection
+    // changes, and only when distorting on the CPU.  The GPU path,
+    // which is the default, builds the lines undistorted and applies
+    // K1 per pixel in Undistort_Shader.
     QPointF transformPoint(QPointF p, QPoint cop, unsigned color);
 
+    /// K1 for the specified color, scaled to work on pixel offsets.
+    float scaledK1(unsigned color) const;
+
+    /// Points on the unit circle at the angular spacing used to
+    // draw a circle of the specified radius, cached by radius.
+    const std::vector<QPointF> &unitCircle(float radius);
+
     // Set default values for center of projection
     // Also used to reset center during execution to default values
     void setDeftCOPVals();
@@ -140,4 +174,28 @@ private:
     float  d_k1_green;      //< Quadratic term for distortion of green
     float  d_k1_blue;       //< Quadratic term for distortion of blue
     bool fullscreen;
+
+    std::map<float, std::vector<QPointF> > d_unit_circles; //< Cleared on resize
+
+    // Geometry buffers, one per color plus the white cross hairs, and
+    // the state they were built for.
+    Line_Strip_Buffer d_color_lines[3];
+    Line_Strip_Buffer d_cross_hairs;
+    bool   d_geometry_valid;            //< False until they are first built
+    float  d_geometry_k1[3];
+    QPoint d_geometry_cop_l, d_geometry_cop_r, d_geometry_cop;
+    bool   d_geometry_fullscreen;
+    int    d_geometry_width, d_geometry_height;
+    bool   d_geometry_undistorted;
+
+    // GPU distortion: the undistorted lines are drawn into the
+    // offscreen target when they change, and the shader distorts it
+    // onto the window each frame.  If the shader or the target can't
+    // be made, or d_gpu_distortion is turned off, the lines are instead
+    // distorted on the CPU, which is also useful to validate the shader.
+    Undistort_Shader *d_shader;
+    Offscreen_Target d_target;
+    bool   d_target_current;            //< Target holds the current geometry
+    bool   d_gpu_distortion;            //< Use the shader when it is available
+    bool   d_use_displacement_map;      //< Shader uses the loaded map, not K1
 };
@@ -0,0 +1,100 @@
+/** @file
+    @brief Layout of the packed per-pixel displacement maps that
+           AnglesToConfig bakes from its meshes, and a reader that
+           memory-maps them.
+
+    @date 2016
+
+    @author
+    Russ Taylor working through ReliaSolve.com for Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Internal Includes
+#include "displacement_map_file.h"
+
+// Standard includes
+#include <cstdio>
+#include <cstring>
+
+Displacement_Map_File::Displacement_Map_File()
+{
+  memset(&d_header, 0, sizeof(d_header));
+}
+
+Displacement_Map_File::~Displacement_Map_File()
+{
+  close();
+}
+
+void Displacement_Map_File::close()
+{
+  d_file.close();
+  memset(&d_header, 0, sizeof(d_header));
+}
+
+bool Displacement_Map_File::open(const std::string &fileName)
+{
+  close();
+
+  // Map the whole file.
+  if (!d_file.open(fileName)) {
+    fprintf(stderr, "Displacement_Map_File::open(): Can't map %s\n",
+      fileName.c_str());
+    return false;
+  }
+  const unsigned char *data = d_file.data();
+  size_t size = d_file.size();
+
+  // Make sure it is a displacement map that we can use.
+  Displacement_Map_Header h;
+  if (size < sizeof(h)) {
+    fprintf(stderr, "Displacement_Map_File::open(): %s is too short\n",
+      fileName.c_str());
+    close();
+    return false;
+  }
+  memcpy(&h, data, sizeof(h));
+  size_t texelBytes = displacement_map_texel_bytes(h.format);
+  if ((memcmp(h.magic, DISPLACEMENT_MAP_MAGIC, sizeof(h.magic)) != 0) ||
+      (h.byteOrder != DISPLACEMENT_MAP_BYTE_ORDER) || (texelBytes == 0) ||
+      (h.eyes != 2) || ((h.colors != 1) && (h.colors != 3)) ||
+      (h.width < 2) || (h.height < 2) ||
+      (h.mapBytes != static_cast<uint64_t>(h.width) * h.height * texelBytes)) {
+    fprintf(stderr, "Displacement_Map_File::open(): %s is not a displacement"
+      " map written on a machine like this one\n", fileName.c_str());
+    close();
+    return false;
+  }
+  if (displacement_map_offset(h, h.eyes - 1, h.colors - 1) + h.mapBytes > size) {
+    fprintf(stderr, "Displacement_Map_File::open(): %s is truncated\n",
+      fileName.c_str());
+    close();
+    return false;
+  }
+  d_header = h;
+  return true;
+}
+
+const void *Displacement_Map_File::map(unsigned eye, unsigned color) const
+{
+  if (!isOpen() || (eye >= d_header.eyes) || (color >= 3)) {
+    return NULL;
+  }
+  if (d_header.colors == 1) { color = 0; }
+  return d_file.data() + displacement_map_offset(d_header, eye, color);
+}
@@ -0,0 +1,119 @@
+/** @file
+    @brief Layout of the packed per-pixel displacement maps that
+           AnglesToConfig bakes from its meshes, and a reader that
+           memory-maps them.
+
+    @date 2016
+
+    @author
+    Russ Taylor working through ReliaSolve.com for Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include "file_util.h"
+#include <string>
+#include <cstddef>
+#include <stdint.h>
+
+// A displacement map file holds one map per color per eye: the left
+// eye's red, green and blue (or its single mono map), then the right
+// eye's.  Each map is width by height texels, in rows from the bottom,
+// ready to hand to glTexImage2D() (or to glTexSubImage3D() as one layer
+// of an eye's array texture) as GL_RG with GL_HALF_FLOAT or GL_FLOAT.
+// Texel (i, j) is for normalized screen location (i / (width - 1),
+// j / (height - 1)), so the corners of the map are exactly on the
+// corners of the screen; a shader finds the texture coordinate for
+// screen location p as (p * (size - 1) + 0.5) / size.
+// Its red and green values are how far, in normalized coordinates,
+// the undistorted image is sampled from p in x and y.  Texels the mesh
+// doesn't reach hold DISPLACEMENT_MAP_OUTSIDE, which sends the sample
+// off the image so that they draw black.
+//   The header is followed by padding, and each map starts on a multiple
+// of DISPLACEMENT_MAP_ALIGNMENT bytes from the start of the file, so
+// that each can be mapped or streamed into a buffer by itself.  All
+// values are in the byte order of the machine that wrote the file,
+// which byteOrder records.
+
+static const char DISPLACEMENT_MAP_MAGIC[8] =
+  { 'A', '2', 'C', 'D', 'I', 'S', 'P', '1' };
+static const uint32_t DISPLACEMENT_MAP_BYTE_ORDER = 0x01020304;
+static const uint32_t DISPLACEMENT_MAP_ALIGNMENT = 4096;
+static const float DISPLACEMENT_MAP_OUTSIDE = 4.0f;
+
+enum Displacement_Map_Format {
+  DISPLACEMENT_RG16F = 1,   //< Two half floats per texel
+  DISPLACEMENT_RG32F = 2    //< Two floats per texel
+};
+
+typedef struct {
+  char magic[8];
+  uint32_t byteOrder;   //< DISPLACEMENT_MAP_BYTE_ORDER as written
+  uint32_t format;      //< A Displacement_Map_Format
+  uint32_t width, height;
+  uint32_t eyes;        //< Always 2
+  uint32_t colors;      //< 1 for mono, 3 for red, green and blue
+  uint64_t mapBytes;    //< Texel bytes in each map
+} Displacement_Map_Header;
+
+// Bytes per texel in a format, or 0 if it is not one we know.
+inline size_t displacement_map_texel_bytes(uint32_t format)
+{
+  switch (format) {
+  case DISPLACEMENT_RG16F: return 2 * 2;
+  case DISPLACEMENT_RG32F: return 2 * 4;
+  default: return 0;
+  }
+}
+
+// Offset in the file of the map for a color in an eye.
+inline uint64_t displacement_map_offset(const Displacement_Map_Header &h,
+  unsigned eye, unsigned color)
+{
+  uint64_t stride = (h.mapBytes + DISPLACEMENT_MAP_ALIGNMENT - 1) /
+    DISPLACEMENT_MAP_ALIGNMENT * DISPLACEMENT_MAP_ALIGNMENT;
+  return DISPLACEMENT_MAP_ALIGNMENT + (eye * h.colors + color) * stride;
+}
+
+// Maps a displacement map file into memory read-only, so that the maps
+// can be uploaded straight from it without reading it all first.
+class Displacement_Map_File
+{
+public:
+  Displacement_Map_File();
+  ~Displacement_Map_File();
+
+  // Map the file, checking that its header is one we can use and that
+  // it is long enough to hold its maps.  Returns false (after reporting
+  // why on stderr) on failure.
+  bool open(const std::string &fileName);
+  void close();
+  bool isOpen() const { return d_file.isOpen(); }
+
+  const Displacement_Map_Header &header() const { return d_header; }
+
+  // The texels of a color in an eye, valid until the file is closed.
+  // Mono files give their single map for every color.
+  const void *map(unsigned eye, unsigned color) const;
+
+private:
+  Displacement_Map_File(const Displacement_Map_File &);
+  Displacement_Map_File &operator=(const Displacement_Map_File &);
+
+  Displacement_Map_Header d_header;
+  Mapped_File d_file;
+};
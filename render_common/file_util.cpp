@@ -0,0 +1,171 @@
+/** @file
+    @brief Helpers for the binary files that the tools cache and share:
+           replacing a file without readers ever seeing a partial one,
+           and mapping a file into memory read-only.
+
+    @date 2016
+
+    @author
+    Russ Taylor working through ReliaSolve.com for Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Internal Includes
+#include "file_util.h"
+
+// Library/third-party includes
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <process.h>
+#define getpid _getpid
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Standard includes
+#include <atomic>
+#include <cerrno>
+#include <sstream>
+
+FILE *open_replacement_file(const std::string &fileName, std::string &tempName)
+{
+  // The process ID keeps other processes' names apart and the counter
+  // keeps our own threads' apart.  The exclusive create catches a name
+  // left behind by a process that had the same ID.
+  static std::atomic<unsigned> counter(0);
+  for (int attempt = 0; attempt < 100; attempt++) {
+    std::ostringstream name;
+    name << fileName << "." << getpid() << "." << counter++ << ".tmp";
+    tempName = name.str();
+#ifdef _WIN32
+    int fd = _open(tempName.c_str(), _O_WRONLY | _O_CREAT | _O_EXCL | _O_BINARY,
+      _S_IREAD | _S_IWRITE);
+    if (fd < 0) {
+      if (errno == EEXIST) { continue; }
+      return NULL;
+    }
+    FILE *f = _fdopen(fd, "wb");
+    if (f == NULL) { _close(fd); }
+#else
+    int fd = ::open(tempName.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+    if (fd < 0) {
+      if (errno == EEXIST) { continue; }
+      return NULL;
+    }
+    FILE *f = fdopen(fd, "wb");
+    if (f == NULL) { ::close(fd); }
+#endif
+    if (f == NULL) { remove(tempName.c_str()); }
+    return f;
+  }
+  return NULL;
+}
+
+bool finish_replacement_file(FILE *f, bool ok, const std::string &tempName,
+  const std::string &fileName)
+{
+  if (fclose(f) != 0) { ok = false; }
+#ifdef _WIN32
+  ok = ok && (MoveFileExA(tempName.c_str(), fileName.c_str(),
+    MOVEFILE_REPLACE_EXISTING) != 0);
+#else
+  ok = ok && (rename(tempName.c_str(), fileName.c_str()) == 0);
+#endif
+  if (!ok) { remove(tempName.c_str()); }
+  return ok;
+}
+
+Mapped_File::Mapped_File()
+  : d_data(NULL)
+  , d_size(0)
+#ifdef _WIN32
+  , d_file(INVALID_HANDLE_VALUE)
+  , d_mapping(NULL)
+#endif
+{
+}
+
+Mapped_File::~Mapped_File()
+{
+  close();
+}
+
+void Mapped_File::close()
+{
+#ifdef _WIN32
+  if (d_data) { UnmapViewOfFile(d_data); }
+  if (d_mapping) { CloseHandle(d_mapping); }
+  if (d_file != INVALID_HANDLE_VALUE) { CloseHandle(d_file); }
+  d_mapping = NULL;
+  d_file = INVALID_HANDLE_VALUE;
+#else
+  if (d_data) { munmap(const_cast<unsigned char *>(d_data), d_size); }
+#endif
+  d_data = NULL;
+  d_size = 0;
+}
+
+bool Mapped_File::open(const std::string &fileName)
+{
+  close();
+
+#ifdef _WIN32
+  d_file = CreateFileA(fileName.c_str(), GENERIC_READ,
+    FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+    FILE_ATTRIBUTE_NORMAL, NULL);
+  LARGE_INTEGER size;
+  if ((d_file == INVALID_HANDLE_VALUE) || !GetFileSizeEx(d_file, &size)) {
+    close();
+    return false;
+  }
+  d_size = static_cast<size_t>(size.QuadPart);
+  if (d_size > 0) {
+    d_mapping = CreateFileMappingA(d_file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (d_mapping) {
+      d_data = static_cast<const unsigned char *>(
+        MapViewOfFile(d_mapping, FILE_MAP_READ, 0, 0, 0));
+    }
+  }
+#else
+  int fd = ::open(fileName.c_str(), O_RDONLY);
+  struct stat info;
+  if ((fd < 0) || (fstat(fd, &info) != 0)) {
+    if (fd >= 0) { ::close(fd); }
+    return false;
+  }
+  d_size = static_cast<size_t>(info.st_size);
+  if (d_size > 0) {
+    void *p = mmap(NULL, d_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (p != MAP_FAILED) { d_data = static_cast<const unsigned char *>(p); }
+  }
+  ::close(fd);
+#endif
+  if (d_data == NULL) {
+    close();
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,72 @@
+/** @file
+    @brief Helpers for the binary files that the tools cache and share:
+           replacing a file without readers ever seeing a partial one,
+           and mapping a file into memory read-only.
+
+    @date 2016
+
+    @author
+    Russ Taylor working through ReliaSolve.com for Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include <string>
+#include <cstdio>
+#include <cstddef>
+
+// Open a new file with a unique name in the same directory as fileName,
+// to be written and then moved over fileName by finish_replacement_file().
+// Concurrent writers each get their own file.  Returns NULL on failure;
+// tempName is set either way so that it can be reported.
+FILE *open_replacement_file(const std::string &fileName, std::string &tempName);
+
+// Close a file from open_replacement_file() and, if ok is true and the
+// close succeeds, move it over fileName in one step, so that readers see
+// either the old file or the new one and never a missing one.  The
+// temporary file is removed on failure.  Returns true on success.
+bool finish_replacement_file(FILE *f, bool ok, const std::string &tempName,
+  const std::string &fileName);
+
+// Maps a whole file into memory read-only.
+class Mapped_File
+{
+public:
+  Mapped_File();
+  ~Mapped_File();
+
+  // Returns false if the file can't be opened or mapped.  Empty files
+  // can't be mapped.
+  bool open(const std::string &fileName);
+  void close();
+  bool isOpen() const { return d_data != NULL; }
+
+  // The contents, valid until the file is closed.
+  const unsigned char *data() const { return d_data; }
+  size_t size() const { return d_size; }
+
+private:
+  Mapped_File(const Mapped_File &);
+  Mapped_File &operator=(const Mapped_File &);
+
+  const unsigned char *d_data;
+  size_t d_size;
+#ifdef _WIN32
+  void *d_file;                 //< HANDLEs for the file and its mapping
+  void *d_mapping;
+#endif
+};
@@ -0,0 +1,266 @@
+/** @file
+    @brief Records how long each part of a frame takes on the CPU and
+           the GPU, shows a summary and writes the history to a file.
+
+    @date 2016
+
+    @author
+    Russ Taylor working through ReliaSolve.com for Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Internal Includes
+#include "frame_timer.h"
+#include "font.h"
+
+// Library/third-party includes
+#include <GL/glew.h>
+
+// Standard includes
+#include <iostream>
+#include <cstdio>
+
+static double elapsedMs(std::chrono::steady_clock::time_point start,
+  std::chrono::steady_clock::time_point end)
+{
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+Frame_Timer::Frame_Timer(double refreshHz, bool keepHistory)
+  : d_periodMs(1000.0 / refreshHz)
+  , d_frameCount(0)
+  , d_keepHistory(keepHistory)
+  , d_haveLastFrameEnd(false)
+  , d_totalMissed(0)
+  , d_haveQueries(false)
+  , d_activeEye(MAX_EYES)
+  , d_fontOffset(0)
+{
+  for (size_t s = 0; s < QUERY_FRAMES; s++) {
+    d_queryRecord[s] = 0;
+    for (size_t e = 0; e < MAX_EYES; e++) {
+      d_queries[s][e] = 0;
+      d_queryUsed[s][e] = false;
+    }
+  }
+  if (GLEW_VERSION_3_3 || GLEW_ARB_timer_query) {
+    glGenQueries(static_cast<GLsizei>(QUERY_FRAMES * MAX_EYES), &d_queries[0][0]);
+    d_haveQueries = true;
+  }
+}
+
+Frame_Timer::~Frame_Timer()
+{
+  if (d_haveQueries) {
+    glDeleteQueries(static_cast<GLsizei>(QUERY_FRAMES * MAX_EYES), &d_queries[0][0]);
+  }
+}
+
+void Frame_Timer::collectQueries(size_t slot)
+{
+  for (size_t e = 0; e < MAX_EYES; e++) {
+    if (d_queryUsed[slot][e]) {
+      GLuint64 ns = 0;
+      glGetQueryObjectui64v(d_queries[slot][e], GL_QUERY_RESULT, &ns);
+      record(d_queryRecord[slot]).gpuMs[e] = ns * 1e-6;
+      d_queryUsed[slot][e] = false;
+    }
+  }
+}
+
+void Frame_Timer::beginFrame()
+{
+  // Reuse the queries from QUERY_FRAMES frames ago, which should be
+  // long finished by now.
+  size_t frame = d_frameCount++;
+  size_t slot = frame % QUERY_FRAMES;
+  collectQueries(slot);
+  d_queryRecord[slot] = frame;
+
+  // The oldest frame in the ring is finished; keep it if we're asked to
+  // and then reuse its record.
+  FrameRecord &r = record(frame);
+  if (d_keepHistory && (frame >= RING_FRAMES)) {
+    d_history.push_back(r);
+  }
+  r.frameMs = 0;
+  for (size_t p = 0; p < NUM_PHASES; p++) {
+    r.phaseMs[p] = 0;
+  }
+  for (size_t e = 0; e < MAX_EYES; e++) {
+    r.gpuMs[e] = -1;
+  }
+  r.missedVsyncs = 0;
+}
+
+void Frame_Timer::endFrame()
+{
+  Clock::time_point now = Clock::now();
+  if (d_haveLastFrameEnd && (d_frameCount > 0)) {
+    FrameRecord &r = record(d_frameCount - 1);
+    r.frameMs = elapsedMs(d_lastFrameEnd, now);
+    if (r.frameMs > 1.5 * d_periodMs) {
+      r.missedVsyncs = static_cast<unsigned>(r.frameMs / d_periodMs + 0.5) - 1;
+      d_totalMissed += r.missedVsyncs;
+    }
+  }
+  d_lastFrameEnd = now;
+  d_haveLastFrameEnd = true;
+}
+
+void Frame_Timer::beginPhase(Phase phase)
+{
+  d_phaseStart[phase] = Clock::now();
+}
+
+void Frame_Timer::endPhase(Phase phase)
+{
+  if (d_frameCount > 0) {
+    record(d_frameCount - 1).phaseMs[phase] +=
+      elapsedMs(d_phaseStart[phase], Clock::now());
+  }
+}
+
+void Frame_Timer::beginEyePass(size_t eye)
+{
+  if (!d_haveQueries || (eye >= MAX_EYES) || (d_frameCount == 0)) {
+    d_activeEye = MAX_EYES;
+    return;
+  }
+  size_t slot = (d_frameCount - 1) % QUERY_FRAMES;
+  glBeginQuery(GL_TIME_ELAPSED, d_queries[slot][eye]);
+  d_queryUsed[slot][eye] = true;
+  d_activeEye = eye;
+}
+
+void Frame_Timer::endEyePass()
+{
+  if (d_activeEye < MAX_EYES) {
+    glEndQuery(GL_TIME_ELAPSED);
+    d_activeEye = MAX_EYES;
+  }
+}
+
+void Frame_Timer::drawOverlay()
+{
+  // Average over the frames before this one, which is still going.
+  size_t end = (d_frameCount == 0) ? 0 : d_frameCount - 1;
+  size_t begin = (end > OVERLAY_FRAMES) ? end - OVERLAY_FRAMES : 0;
+  double frameSum = 0, frameMax = 0;
+  double phaseSum[NUM_PHASES] = { 0 };
+  double gpuSum[MAX_EYES] = { 0 };
+  size_t gpuCount[MAX_EYES] = { 0 };
+  for (size_t i = begin; i < end; i++) {
+    const FrameRecord &r = record(i);
+    frameSum += r.frameMs;
+    if (r.frameMs > frameMax) { frameMax = r.frameMs; }
+    for (size_t p = 0; p < NUM_PHASES; p++) {
+      phaseSum[p] += r.phaseMs[p];
+    }
+    for (size_t e = 0; e < MAX_EYES; e++) {
+      if (r.gpuMs[e] >= 0) {
+        gpuSum[e] += r.gpuMs[e];
+        gpuCount[e]++;
+      }
+    }
+  }
+  double count = (end > begin) ? static_cast<double>(end - begin) : 1;
+
+  char lines[3][128];
+  sprintf(lines[0], "Frame ms: %5.2f avg %5.2f max (budget %5.2f), missed vsyncs %u",
+    frameSum / count, frameMax, d_periodMs, d_totalMissed);
+  sprintf(lines[1], "CPU ms: update %5.2f render %5.2f present %5.2f mesh %5.2f",
+    phaseSum[UPDATE] / count, phaseSum[RENDER] / count,
+    phaseSum[PRESENT] / count, phaseSum[MESH_UPDATE] / count);
+  if (gpuCount[0] + gpuCount[1] > 0) {
+    sprintf(lines[2], "GPU ms: left %5.2f right %5.2f",
+      gpuCount[0] ? gpuSum[0] / gpuCount[0] : 0.0,
+      gpuCount[1] ? gpuSum[1] / gpuCount[1] : 0.0);
+  } else {
+    sprintf(lines[2], "GPU ms: not available");
+  }
+
+  // Generate the font the first time we are called.
+  if (d_fontOffset == 0) {
+    d_fontOffset = loadFont(nullptr);
+  }
+
+  // Draw in normalized viewport coordinates without lighting or depth,
+  // putting everything back afterwards.
+  glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT | GL_TRANSFORM_BIT);
+  glDisable(GL_LIGHTING);
+  glDisable(GL_DEPTH_TEST);
+  glDisable(GL_TEXTURE_2D);
+  glMatrixMode(GL_PROJECTION);
+  glPushMatrix();
+  glLoadIdentity();
+  glOrtho(0, 1, 0, 1, -1, 1);
+  glMatrixMode(GL_MODELVIEW);
+  glPushMatrix();
+  glLoadIdentity();
+
+  // Set the color before setting the raster position, because it acts like glVertex
+  glColor3d(1, 1, 0);
+  for (int i = 0; i < 3; i++) {
+    glRasterPos2d(0.25, 0.31 - 0.03 * i);
+    drawStringInFont(d_fontOffset, lines[i]);
+  }
+
+  glMatrixMode(GL_MODELVIEW);
+  glPopMatrix();
+  glMatrixMode(GL_PROJECTION);
+  glPopMatrix();
+  glPopAttrib();
+}
+
+bool Frame_Timer::writeCSV(const std::string &fileName)
+{
+  for (size_t s = 0; s < QUERY_FRAMES; s++) {
+    collectQueries(s);
+  }
+
+  FILE *f = fopen(fileName.c_str(), "w");
+  if (f == NULL) {
+    std::cerr << "Frame_Timer::writeCSV(): Could not open " << fileName
+      << " for writing" << std::endl;
+    return false;
+  }
+  fprintf(f, "frame,frame_ms,update_ms,render_ms,present_ms,mesh_update_ms,"
+    "gpu_left_ms,gpu_right_ms,missed_vsyncs\n");
+  // The frames that have left the ring, if they were kept, and then
+  // those still in it.
+  size_t first = (d_frameCount > RING_FRAMES) ? d_frameCount - RING_FRAMES : 0;
+  if (d_keepHistory) { first = 0; }
+  for (size_t i = first; i < d_frameCount; i++) {
+    const FrameRecord &r = (i < d_history.size()) ? d_history[i] : record(i);
+    fprintf(f, "%u,%.3f,%.3f,%.3f,%.3f,%.3f,", static_cast<unsigned>(i),
+      r.frameMs, r.phaseMs[UPDATE], r.phaseMs[RENDER], r.phaseMs[PRESENT],
+      r.phaseMs[MESH_UPDATE]);
+    for (size_t e = 0; e < MAX_EYES; e++) {
+      if (r.gpuMs[e] >= 0) { fprintf(f, "%.3f", r.gpuMs[e]); }
+      fprintf(f, ",");
+    }
+    fprintf(f, "%u\n", r.missedVsyncs);
+  }
+  bool ok = !ferror(f);
+  if (fclose(f) != 0) { ok = false; }
+  if (!ok) {
+    std::cerr << "Frame_Timer::writeCSV(): Could not write " << fileName
+      << std::endl;
+  }
+  return ok;
+}
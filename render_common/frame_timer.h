@@ -0,0 +1,130 @@
+/** @file
+    @brief Records how long each part of a frame takes on the CPU and
+           the GPU, shows a summary and writes the history to a file.
+
+    @date 2016
+
+    @author
+    Russ Taylor working through ReliaSolve.com for Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstddef>
+
+// Times each frame of a render loop.  CPU time is measured for each
+// phase of the frame (begin/endPhase() can be called more than once per
+// phase in a frame; the times add up).  GPU time is measured for each
+// eye's pass with GL_TIME_ELAPSED queries when the driver has them.
+// Their results are read a few frames later so that we never wait for
+// the GPU.  A frame is counted as missing vsyncs when the time between
+// the ends of successive frames is more than half a refresh period
+// longer than expected, and the number of refreshes it covered is
+// recorded.
+//   Only the most recent frames, which the overlay averages over, are
+// kept unless keepHistory is set, in which case every frame is kept for
+// writeCSV().
+//   The methods that use OpenGL (the constructor, destructor,
+// begin/endEyePass(), drawOverlay(), writeCSV() and beginFrame()) must be
+// called with the context current and after glewInit().
+class Frame_Timer
+{
+public:
+  enum Phase {
+    UPDATE,       //< context.update() and GetRenderInfo()
+    RENDER,       //< Rendering all eyes
+    PRESENT,      //< PresentRenderBuffers()
+    MESH_UPDATE,  //< UpdateDistortionMeshes()
+    NUM_PHASES
+  };
+  static const size_t MAX_EYES = 2;
+
+  // The refresh rate of the display sets the frame budget.
+  explicit Frame_Timer(double refreshHz = 60, bool keepHistory = false);
+  ~Frame_Timer();
+
+  // Bracket each frame.
+  void beginFrame();
+  void endFrame();
+
+  // Bracket work done in a phase of the current frame.
+  void beginPhase(Phase phase);
+  void endPhase(Phase phase);
+
+  // Bracket the GPU commands for one eye.  Passes can't be nested.
+  void beginEyePass(size_t eye);
+  void endEyePass();
+
+  // Draw the averages over recent frames into the lower middle of
+  // the current viewport (where it can be seen through the lens),
+  // using the bitmap font.  Call it outside of an eye pass, so that its
+  // own cost is not counted as the eye's GPU time.
+  void drawOverlay();
+
+  // Write one line per frame, with a header line, to the named file.
+  // Without keepHistory, only the most recent frames are written.
+  // Returns false (after reporting why on std::cerr) on failure.
+  bool writeCSV(const std::string &fileName);
+
+private:
+  typedef std::chrono::steady_clock Clock;
+
+  typedef struct {
+    double  frameMs;                //< Time since the end of the previous frame
+    double  phaseMs[NUM_PHASES];    //< CPU time in each phase
+    double  gpuMs[MAX_EYES];        //< GPU time for each eye, -1 if not measured
+    unsigned missedVsyncs;
+  } FrameRecord;
+
+  // Queries are kept for this many frames before their results are read.
+  static const size_t QUERY_FRAMES = 4;
+
+  // How many recent frames the overlay averages over.
+  static const size_t OVERLAY_FRAMES = 60;
+
+  // The recent frames are kept in a ring that is long enough to hold
+  // the ones the overlay averages over, the one in progress and the
+  // ones whose GPU times are still being measured.
+  static const size_t RING_FRAMES = OVERLAY_FRAMES + QUERY_FRAMES + 1;
+
+  double                  d_periodMs;     //< Expected time between frames
+  FrameRecord             d_ring[RING_FRAMES];
+  size_t                  d_frameCount;   //< Frames begun so far
+  bool                    d_keepHistory;
+  std::vector<FrameRecord> d_history;     //< Frames that have left the ring
+  Clock::time_point       d_phaseStart[NUM_PHASES];
+  Clock::time_point       d_lastFrameEnd;
+  bool                    d_haveLastFrameEnd;
+  unsigned                d_totalMissed;
+
+  bool      d_haveQueries;
+  unsigned  d_queries[QUERY_FRAMES][MAX_EYES];
+  bool      d_queryUsed[QUERY_FRAMES][MAX_EYES];
+  size_t    d_queryRecord[QUERY_FRAMES];  //< Frame whose queries are in each slot
+  size_t    d_activeEye;                  //< Eye whose pass is being timed
+
+  int       d_fontOffset;     //< Display lists for the font, 0 until loaded
+
+  // The record for a frame that is still in the ring.
+  FrameRecord &record(size_t frame) { return d_ring[frame % RING_FRAMES]; }
+
+  // Read back the GPU times for the queries in a slot, if any.
+  void collectQueries(size_t slot);
+};
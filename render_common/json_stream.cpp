@@ -0,0 +1,415 @@
+/** @file
+    @brief Streaming reader and writer for Json files, which handle one
+           value at a time rather than building a document in memory.
+
+    @date 2016
+
+    @author
+    Russ Taylor working through ReliaSolve.com for Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Internal Includes
+#include "json_stream.h"
+
+// Standard includes
+#include <cstdlib>
+#include <cstring>
+#include <clocale>
+
+// The C library converts numbers using the decimal point of the current
+// locale, which GUI toolkits set from the user's environment, but Json
+// always uses '.'.
+static char localeDecimalPoint()
+{
+  const char *p = localeconv()->decimal_point;
+  return (p && p[0]) ? p[0] : '.';
+}
+
+//====================================================================
+// JsonReader
+
+JsonReader::JsonReader(FILE *f)
+  : d_file(f)
+  , d_pos(0)
+  , d_len(0)
+  , d_line(1)
+{
+}
+
+int JsonReader::peek()
+{
+  if (d_pos == d_len) {
+    d_len = fread(d_buffer, 1, sizeof(d_buffer), d_file);
+    d_pos = 0;
+    if (d_len == 0) { return EOF; }
+  }
+  return static_cast<unsigned char>(d_buffer[d_pos]);
+}
+
+int JsonReader::get()
+{
+  int c = peek();
+  if (c != EOF) {
+    d_pos++;
+    if (c == '\n') { d_line++; }
+  }
+  return c;
+}
+
+void JsonReader::skipSpace()
+{
+  for (int c = peek(); (c == ' ') || (c == '\t') || (c == '\r') || (c == '\n');
+       c = peek()) {
+    get();
+  }
+}
+
+bool JsonReader::fail(const std::string &message)
+{
+  if (d_error.empty()) {
+    d_error = message + " on line " + std::to_string(d_line);
+  }
+  return false;
+}
+
+bool JsonReader::parse(JsonHandler &handler)
+{
+  d_error.clear();
+  d_path.clear();
+  if (!parseValue(&handler)) { return false; }
+  skipSpace();
+  if (peek() != EOF) {
+    return fail("Unexpected text after the end of the value");
+  }
+  return true;
+}
+
+// A NULL handler means that the value is being skipped.
+bool JsonReader::parseValue(JsonHandler *handler)
+{
+  skipSpace();
+  int c = peek();
+  switch (c) {
+  case '{':
+    return parseContainer(handler, true);
+  case '[':
+    return parseContainer(handler, false);
+  case '"': {
+    if (!handler) { return parseString(NULL); }
+    std::string s;
+    if (!parseString(&s)) { return false; }
+    handler->string(d_path, s);
+    return true;
+  }
+  case 't':
+    if (!parseLiteral("true")) { return false; }
+    if (handler) { handler->boolean(d_path, true); }
+    return true;
+  case 'f':
+    if (!parseLiteral("false")) { return false; }
+    if (handler) { handler->boolean(d_path, false); }
+    return true;
+  case 'n':
+    if (!parseLiteral("null")) { return false; }
+    if (handler) { handler->null(d_path); }
+    return true;
+  case EOF:
+    return fail("Unexpected end of file");
+  default:
+    if ((c == '-') || ((c >= '0') && (c <= '9'))) {
+      if (!handler) { return parseNumber(NULL); }
+      double v;
+      if (!parseNumber(&v)) { return false; }
+      handler->number(d_path, v);
+      return true;
+    }
+    return fail(std::string("Unexpected character '") +
+      static_cast<char>(c) + "'");
+  }
+}
+
+bool JsonReader::parseContainer(JsonHandler *handler, bool isObject)
+{
+  char close = isObject ? '}' : ']';
+  get();
+  if (handler) {
+    if (isObject) { handler->beginObject(d_path); }
+    else { handler->beginArray(d_path); }
+  }
+  skipSpace();
+  if (peek() == close) {
+    get();
+  } else {
+    for (size_t index = 0; ; index++) {
+      //  Find the name of the member or element, see whether the handler
+      // wants it, and read it (skipping it if not).
+      if (isObject) {
+        skipSpace();
+        if (peek() != '"') { return fail("Expected a key"); }
+        std::string key;
+        if (!parseString(handler ? &key : NULL)) { return false; }
+        skipSpace();
+        if (get() != ':') { return fail("Expected ':' after a key"); }
+        d_path.push_back(key);
+      } else {
+        d_path.push_back(handler ? std::to_string(index) : std::string());
+      }
+      JsonHandler *h = (handler && handler->wanted(d_path)) ? handler : NULL;
+      if (!parseValue(h)) { return false; }
+      d_path.pop_back();
+
+      skipSpace();
+      int c = get();
+      if (c == close) { break; }
+      if (c != ',') {
+        return fail(std::string("Expected ',' or '") + close + "'");
+      }
+    }
+  }
+  if (handler) {
+    if (isObject) { handler->endObject(d_path); }
+    else { handler->endArray(d_path); }
+  }
+  return true;
+}
+
+// Append the UTF-8 encoding of a code point.
+static void appendUTF8(std::string &s, unsigned long cp)
+{
+  if (cp < 0x80) {
+    s += static_cast<char>(cp);
+  } else if (cp < 0x800) {
+    s += static_cast<char>(0xc0 | (cp >> 6));
+    s += static_cast<char>(0x80 | (cp & 0x3f));
+  } else if (cp < 0x10000) {
+    s += static_cast<char>(0xe0 | (cp >> 12));
+    s += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+    s += static_cast<char>(0x80 | (cp & 0x3f));
+  } else {
+    s += static_cast<char>(0xf0 | (cp >> 18));
+    s += static_cast<char>(0x80 | ((cp >> 12) & 0x3f));
+    s += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+    s += static_cast<char>(0x80 | (cp & 0x3f));
+  }
+}
+
+// A NULL value means that the string is being skipped.
+bool JsonReader::parseString(std::string *value)
+{
+  get();  // The opening quote
+  unsigned long highSurrogate = 0;
+  for (;;) {
+    int c = get();
+    if (c == EOF) { return fail("Unterminated string"); }
+    if (c == '"') { return true; }
+    if (c != '\\') {
+      if (value) { *value += static_cast<char>(c); }
+      continue;
+    }
+    c = get();
+    char plain = 0;
+    switch (c) {
+    case '"': plain = '"'; break;
+    case '\\': plain = '\\'; break;
+    case '/': plain = '/'; break;
+    case 'b': plain = '\b'; break;
+    case 'f': plain = '\f'; break;
+    case 'n': plain = '\n'; break;
+    case 'r': plain = '\r'; break;
+    case 't': plain = '\t'; break;
+    case 'u': {
+      unsigned long cp = 0;
+      for (int i = 0; i < 4; i++) {
+        int h = get();
+        cp <<= 4;
+        if ((h >= '0') && (h <= '9')) { cp |= h - '0'; }
+        else if ((h >= 'a') && (h <= 'f')) { cp |= h - 'a' + 10; }
+        else if ((h >= 'A') && (h <= 'F')) { cp |= h - 'A' + 10; }
+        else { return fail("Bad \\u escape in string"); }
+      }
+      // Characters outside the basic plane come as a pair of escapes.
+      if ((cp >= 0xd800) && (cp < 0xdc00)) {
+        highSurrogate = cp;
+        continue;
+      }
+      if ((cp >= 0xdc00) && (cp < 0xe000) && highSurrogate) {
+        cp = 0x10000 + ((highSurrogate - 0xd800) << 10) + (cp - 0xdc00);
+      }
+      highSurrogate = 0;
+      if (value) { appendUTF8(*value, cp); }
+      continue;
+    }
+    default:
+      return fail("Bad escape in string");
+    }
+    if (value) { *value += plain; }
+  }
+}
+
+// A NULL value means that the number is being skipped.
+bool JsonReader::parseNumber(double *value)
+{
+  char text[64];
+  size_t len = 0;
+  for (int c = peek(); ((c >= '0') && (c <= '9')) || (c == '-') || (c == '+') ||
+       (c == '.') || (c == 'e') || (c == 'E'); c = peek()) {
+    get();
+    if (value) {
+      if (len + 1 >= sizeof(text)) { return fail("Number too long"); }
+      text[len++] = static_cast<char>(c);
+    }
+  }
+  if (!value) { return true; }
+  text[len] = '\0';
+
+  char point = localeDecimalPoint();
+  if (point != '.') {
+    char *p = strchr(text, '.');
+    if (p) { *p = point; }
+  }
+  char *end;
+  *value = strtod(text, &end);
+  if ((len == 0) || (*end != '\0')) {
+    return fail(std::string("Bad number '") + text + "'");
+  }
+  return true;
+}
+
+bool JsonReader::parseLiteral(const char *word)
+{
+  for (const char *w = word; *w; w++) {
+    if (get() != *w) {
+      return fail(std::string("Expected '") + word + "'");
+    }
+  }
+  return true;
+}
+
+//====================================================================
+// JsonWriter
+
+JsonWriter::JsonWriter(FILE *f, int indent)
+  : d_file(f)
+  , d_indent(indent)
+  , d_afterKey(false)
+{
+}
+
+void JsonWriter::newline()
+{
+  fprintf(d_file, "\n%*s", static_cast<int>(d_indent * d_empty.size()), "");
+}
+
+// Members of an object come after their key on the same line; elements
+// of an array each start a new line.
+void JsonWriter::beforeValue()
+{
+  if (d_afterKey) {
+    d_afterKey = false;
+    return;
+  }
+  if (!d_empty.empty()) {
+    if (!d_empty.back()) { fputc(',', d_file); }
+    d_empty.back() = false;
+    newline();
+  }
+}
+
+void JsonWriter::beginObject()
+{
+  beforeValue();
+  fputc('{', d_file);
+  d_empty.push_back(true);
+}
+
+void JsonWriter::beginArray()
+{
+  beforeValue();
+  fputc('[', d_file);
+  d_empty.push_back(true);
+}
+
+void JsonWriter::end(char close)
+{
+  bool empty = d_empty.back();
+  d_empty.pop_back();
+  if (!empty) { newline(); }
+  fputc(close, d_file);
+  if (d_empty.empty()) { fputc('\n', d_file); }
+}
+
+void JsonWriter::endObject() { end('}'); }
+void JsonWriter::endArray() { end(']'); }
+
+void JsonWriter::key(const std::string &name)
+{
+  beforeValue();
+  writeString(name);
+  fputs(": ", d_file);
+  d_afterKey = true;
+}
+
+void JsonWriter::value(double v, const char *format)
+{
+  beforeValue();
+  char text[64];
+  snprintf(text, sizeof(text), format, v);
+  char point = localeDecimalPoint();
+  if (point != '.') {
+    char *p = strchr(text, point);
+    if (p) { *p = '.'; }
+  }
+  fputs(text, d_file);
+}
+
+void JsonWriter::value(int v)
+{
+  beforeValue();
+  fprintf(d_file, "%d", v);
+}
+
+void JsonWriter::value(bool v)
+{
+  beforeValue();
+  fputs(v ? "true" : "false", d_file);
+}
+
+void JsonWriter::value(const std::string &v)
+{
+  beforeValue();
+  writeString(v);
+}
+
+void JsonWriter::writeString(const std::string &s)
+{
+  fputc('"', d_file);
+  for (size_t i = 0; i < s.size(); i++) {
+    unsigned char c = static_cast<unsigned char>(s[i]);
+    switch (c) {
+    case '"': fputs("\\\"", d_file); break;
+    case '\\': fputs("\\\\", d_file); break;
+    case '\n': fputs("\\n", d_file); break;
+    case '\r': fputs("\\r", d_file); break;
+    case '\t': fputs("\\t", d_file); break;
+    default:
+      if (c < 0x20) { fprintf(d_file, "\\u%04x", c); }
+      else { fputc(c, d_file); }
+    }
+  }
+  fputc('"', d_file);
+}
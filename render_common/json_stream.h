@@ -0,0 +1,136 @@
+/** @file
+    @brief Streaming reader and writer for Json files, which handle one
+           value at a time rather than building a document in memory.
+
+    These are used only by the distortionizer calibration tool to load
+    and save its configurations.  AnglesToConfig writes its output by
+    hand so that it stays byte-for-byte the same, and DebugAnglesToConfig
+    has to hand RenderManager a whole document that it edits with jsoncpp,
+    which RenderManager already depends on.
+
+    @date 2016
+
+    @author
+    Russ Taylor working through ReliaSolve.com for Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstddef>
+
+/// The keys of the objects (and the indices, as decimal strings, of the
+/// arrays) leading from the top of a Json file to a value.
+typedef std::vector<std::string> JsonPath;
+
+/// Receives the values that JsonReader finds, in file order.  The
+/// display configurations this is used for can hold meshes with hundreds
+/// of thousands of numbers, so the handler says which parts it wants and
+/// the reader skips the rest without converting anything in them.
+class JsonHandler {
+public:
+  virtual ~JsonHandler() {}
+
+  /// Whether the value at the path should be reported; if not, the
+  /// value and everything inside it is skipped.  Called for each object
+  /// member and array element before its value.
+  virtual bool wanted(const JsonPath &) { return true; }
+
+  virtual void beginObject(const JsonPath &) {}
+  virtual void endObject(const JsonPath &) {}
+  virtual void beginArray(const JsonPath &) {}
+  virtual void endArray(const JsonPath &) {}
+  virtual void number(const JsonPath &, double) {}
+  virtual void string(const JsonPath &, const std::string &) {}
+  virtual void boolean(const JsonPath &, bool) {}
+  virtual void null(const JsonPath &) {}
+};
+
+/// Reads a Json file a buffer at a time, calling a handler for each
+/// value that it wants.
+class JsonReader {
+public:
+  /// The file must stay open until parse() returns.
+  explicit JsonReader(FILE *f);
+
+  /// Read the single value that makes up the file.
+  /// @return false if the file is not valid Json, with the reason and
+  /// line number in error().
+  bool parse(JsonHandler &handler);
+
+  const std::string &error() const { return d_error; }
+
+private:
+  int peek();
+  int get();
+  void skipSpace();
+  bool fail(const std::string &message);
+
+  bool parseValue(JsonHandler *handler);
+  bool parseContainer(JsonHandler *handler, bool isObject);
+  bool parseString(std::string *value);
+  bool parseNumber(double *value);
+  bool parseLiteral(const char *word);
+
+  FILE *d_file;
+  char d_buffer[65536];
+  size_t d_pos;
+  size_t d_len;
+  size_t d_line;
+  JsonPath d_path;
+  std::string d_error;
+};
+
+/// Writes a Json file one value at a time, putting each member and
+/// element on its own line and indenting those inside each object or
+/// array.  Numbers are always written with '.' as the decimal point.
+class JsonWriter {
+public:
+  explicit JsonWriter(FILE *f, int indent = 4);
+
+  void beginObject();
+  void endObject();
+  void beginArray();
+  void endArray();
+
+  /// Start an object member; its value comes next.
+  void key(const std::string &name);
+
+  /// Numbers are printed with the printf() format, which must print a
+  /// single double.
+  void value(double v, const char *format = "%g");
+  void value(int v);
+  void value(bool v);
+  void value(const std::string &v);
+  void value(const char *v) { value(std::string(v)); }
+
+  /// Whether everything so far was written.
+  bool ok() const { return !ferror(d_file); }
+
+private:
+  void beforeValue();
+  void newline();
+  void end(char close);
+  void writeString(const std::string &s);
+
+  FILE *d_file;
+  int d_indent;
+  std::vector<bool> d_empty;  //< Whether each open container is empty
+  bool d_afterKey;
+};
@@ -0,0 +1,359 @@
+/** @file
+    @brief Streams a sequence of pattern images to textures, decoding
+           them on a worker thread and uploading them through pixel
+           buffer objects so that the render loop never waits.
+
+    @date 2016
+
+    @author
+    Russ Taylor working through ReliaSolve.com for Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Internal Includes
+#include "pattern_stream.h"
+
+// Library/third-party includes
+#include <GL/glew.h>
+
+// Standard includes
+#include <iostream>
+#include <cstdio>
+#include <cctype>
+#include <algorithm>
+
+// Read the next number in a PGM or PPM header, skipping whitespace and
+// comments.  The single whitespace character after it is consumed, which
+// after the last number leaves the file at the start of the pixels.
+static bool readHeaderNumber(FILE *f, int &value)
+{
+  int c = fgetc(f);
+  while ((c != EOF) && (isspace(c) || (c == '#'))) {
+    if (c == '#') {
+      while ((c != EOF) && (c != '\n')) { c = fgetc(f); }
+    } else {
+      c = fgetc(f);
+    }
+  }
+  if ((c == EOF) || !isdigit(c)) { return false; }
+  value = 0;
+  while ((c != EOF) && isdigit(c)) {
+    if (value > 1000000) { return false; }
+    value = value * 10 + (c - '0');
+    c = fgetc(f);
+  }
+  return (c != EOF) && isspace(c);
+}
+
+// Open a binary PGM or PPM file and read its header.  Returns NULL
+// (after reporting why) if it can't be opened or is not one.
+static FILE *openImage(const std::string &fileName, int &channels,
+  int &width, int &height, int &maxval)
+{
+  FILE *f = fopen(fileName.c_str(), "rb");
+  if (f == NULL) {
+    std::cerr << "Pattern_Stream: Can't open " << fileName << std::endl;
+    return NULL;
+  }
+  char magic[2];
+  if ((fread(magic, 1, 2, f) != 2) || (magic[0] != 'P') ||
+      ((magic[1] != '5') && (magic[1] != '6')) ||
+      !readHeaderNumber(f, width) || !readHeaderNumber(f, height) ||
+      !readHeaderNumber(f, maxval) || (width < 1) || (height < 1) ||
+      (maxval < 1) || (maxval > 65535)) {
+    std::cerr << "Pattern_Stream: " << fileName
+      << " is not a binary PGM or PPM file" << std::endl;
+    fclose(f);
+    return NULL;
+  }
+  channels = (magic[1] == '5') ? 1 : 3;
+  return f;
+}
+
+bool Pattern_Stream::readHeader(const std::string &fileName, int &width,
+  int &height)
+{
+  int channels, maxval;
+  FILE *f = openImage(fileName, channels, width, height, maxval);
+  if (f == NULL) { return false; }
+  fclose(f);
+  return true;
+}
+
+bool Pattern_Stream::decode(const std::string &fileName, int width,
+  int height, unsigned char *rgba)
+{
+  int channels, w, h, maxval;
+  FILE *f = openImage(fileName, channels, w, h, maxval);
+  if (f == NULL) { return false; }
+  if ((w != width) || (h != height)) {
+    std::cerr << "Pattern_Stream: " << fileName << " changed size to "
+      << w << "x" << h << std::endl;
+    fclose(f);
+    return false;
+  }
+
+  // Gray images fill all three colors.  Samples are one byte, or two
+  // (most significant first) when the maximum is more than 255.
+  size_t sampleBytes = (maxval > 255) ? 2 : 1;
+  std::vector<unsigned char> row(w * channels * sampleBytes);
+  for (int y = 0; y < h; y++) {
+    if (fread(row.data(), 1, row.size(), f) != row.size()) {
+      std::cerr << "Pattern_Stream: " << fileName << " is truncated" << std::endl;
+      fclose(f);
+      return false;
+    }
+    unsigned char *out = rgba + static_cast<size_t>(h - 1 - y) * w * 4;
+    for (int x = 0; x < w; x++) {
+      for (int c = 0; c < 3; c++) {
+        size_t s = (x * channels + (channels == 3 ? c : 0)) * sampleBytes;
+        unsigned v = (sampleBytes == 2) ? ((row[s] << 8) | row[s + 1]) : row[s];
+        out[4 * x + c] = static_cast<unsigned char>(
+          (v * 255 + maxval / 2) / maxval);
+      }
+      out[4 * x + 3] = 255;
+    }
+  }
+  fclose(f);
+  return true;
+}
+
+Pattern_Stream::Pattern_Stream(std::vector<std::string> const &fileNames,
+  size_t slots)
+  : d_fileNames(fileNames)
+  , d_ok(false)
+  , d_slotBytes(0)
+  , d_buffer(0)
+  , d_memory(NULL)
+  , d_stop(false)
+  , d_uploadSlot(0)
+  , d_fence(NULL)
+  , d_fenceSlot(0)
+  , d_fenceIndex(-1)
+  , d_backIndex(-1)
+  , d_front(0)
+  , d_backReady(false)
+  , d_advance(true)
+  , d_shown(-1)
+{
+  d_textures[0] = d_textures[1] = 0;
+  d_sizes[0][0] = d_sizes[0][1] = d_sizes[1][0] = d_sizes[1][1] = 0;
+  if (d_fileNames.empty()) {
+    std::cerr << "Pattern_Stream: No images" << std::endl;
+    return;
+  }
+  for (size_t i = 0; i < d_fileNames.size(); i++) {
+    int w, h;
+    if (!readHeader(d_fileNames[i], w, h)) { return; }
+    d_widths.push_back(w);
+    d_heights.push_back(h);
+    d_slotBytes = std::max(d_slotBytes, static_cast<size_t>(w) * h * 4);
+  }
+  Slot empty = { FREE, -1 };
+  d_slots.assign(std::max(slots, static_cast<size_t>(2)), empty);
+
+  // Map the slots for as long as we have them, so that the decoder can
+  // write straight into the buffer that the uploads come from.
+  size_t total = d_slots.size() * d_slotBytes;
+  if (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) {
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT |
+      GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &d_buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, d_buffer);
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, total, NULL, flags);
+    d_memory = static_cast<unsigned char *>(
+      glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, total, flags));
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    if (d_memory == NULL) {
+      glDeleteBuffers(1, &d_buffer);
+      d_buffer = 0;
+    }
+  }
+  if (d_memory == NULL) {
+    std::cerr << "Pattern_Stream: No persistently-mapped buffers, uploads"
+      " may stall" << std::endl;
+    d_fallback.resize(total);
+    d_memory = d_fallback.data();
+  }
+
+  GLint previous;
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous);
+  glGenTextures(2, d_textures);
+  for (size_t t = 0; t < 2; t++) {
+    glBindTexture(GL_TEXTURE_2D, d_textures[t]);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  }
+  glBindTexture(GL_TEXTURE_2D, previous);
+
+  d_ok = true;
+  d_decoder = std::thread(&Pattern_Stream::decodeLoop, this);
+}
+
+Pattern_Stream::~Pattern_Stream()
+{
+  if (d_decoder.joinable()) {
+    {
+      std::lock_guard<std::mutex> guard(d_lock);
+      d_stop = true;
+    }
+    d_changed.notify_all();
+    d_decoder.join();
+  }
+  if (d_fence) {
+    glDeleteSync(static_cast<GLsync>(d_fence));
+  }
+  if (d_buffer) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, d_buffer);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteBuffers(1, &d_buffer);
+  }
+  if (d_textures[0]) {
+    glDeleteTextures(2, d_textures);
+  }
+}
+
+void Pattern_Stream::decodeLoop()
+{
+  // Images go into the slots in ring order, which is the order they
+  // are uploaded in.  One that can't be decoded is skipped.
+  size_t slot = 0;
+  size_t index = 0;
+  size_t failures = 0;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> guard(d_lock);
+      d_changed.wait(guard, [&] { return d_stop || (d_slots[slot].state == FREE); });
+      if (d_stop) { return; }
+      d_slots[slot].state = DECODING;
+    }
+    bool ok = decode(d_fileNames[index], d_widths[index], d_heights[index],
+      d_memory + slot * d_slotBytes);
+    {
+      std::lock_guard<std::mutex> guard(d_lock);
+      if (ok) {
+        d_slots[slot].index = static_cast<int>(index);
+        d_slots[slot].state = FILLED;
+      } else {
+        d_slots[slot].state = FREE;
+      }
+    }
+    if (ok) {
+      failures = 0;
+      slot = (slot + 1) % d_slots.size();
+    } else if (++failures >= d_fileNames.size()) {
+      std::cerr << "Pattern_Stream: None of the images can be decoded"
+        << std::endl;
+      return;
+    }
+    index = (index + 1) % d_fileNames.size();
+  }
+}
+
+void Pattern_Stream::finishUpload(size_t slot, int index)
+{
+  {
+    std::lock_guard<std::mutex> guard(d_lock);
+    d_slots[slot].state = FREE;
+  }
+  d_changed.notify_all();
+  d_backIndex = index;
+  d_backReady = true;
+}
+
+void Pattern_Stream::swapIfWanted()
+{
+  if (d_advance && d_backReady) {
+    d_front = 1 - d_front;
+    d_shown = d_backIndex;
+    d_backReady = false;
+    d_advance = false;
+  }
+}
+
+bool Pattern_Stream::next()
+{
+  d_advance = true;
+  swapIfWanted();
+  return !d_advance;
+}
+
+void Pattern_Stream::update()
+{
+  if (!d_ok) { return; }
+
+  // See whether the copy in progress has finished, without waiting.
+  if (d_fence) {
+    GLenum result = glClientWaitSync(static_cast<GLsync>(d_fence),
+      GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    if (result == GL_TIMEOUT_EXPIRED) { return; }
+    glDeleteSync(static_cast<GLsync>(d_fence));
+    d_fence = NULL;
+    finishUpload(d_fenceSlot, d_fenceIndex);
+  }
+  swapIfWanted();
+  if (d_backReady) { return; }
+
+  // Start copying the next decoded image into the back texture.
+  size_t slot = d_uploadSlot;
+  int index;
+  {
+    std::lock_guard<std::mutex> guard(d_lock);
+    if (d_slots[slot].state != FILLED) { return; }
+    d_slots[slot].state = UPLOADING;
+    index = d_slots[slot].index;
+  }
+  d_uploadSlot = (slot + 1) % d_slots.size();
+
+  size_t back = 1 - d_front;
+  int w = d_widths[index];
+  int h = d_heights[index];
+  size_t offset = slot * d_slotBytes;
+  const GLvoid *pixels = d_memory + offset;
+  if (d_buffer) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, d_buffer);
+    pixels = reinterpret_cast<const GLvoid *>(offset);
+  }
+  GLint previous;
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous);
+  glBindTexture(GL_TEXTURE_2D, d_textures[back]);
+  if ((d_sizes[back][0] == w) && (d_sizes[back][1] == h)) {
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE,
+      pixels);
+  } else {
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA,
+      GL_UNSIGNED_BYTE, pixels);
+    d_sizes[back][0] = w;
+    d_sizes[back][1] = h;
+  }
+  glBindTexture(GL_TEXTURE_2D, previous);
+
+  // The slot can be reused once the copy out of it has finished; from
+  // ordinary memory, that is already the case.
+  if (d_buffer) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    d_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    d_fenceSlot = slot;
+    d_fenceIndex = index;
+  } else {
+    finishUpload(slot, index);
+    swapIfWanted();
+  }
+}
@@ -0,0 +1,134 @@
+/** @file
+    @brief Streams a sequence of pattern images to textures, decoding
+           them on a worker thread and uploading them through pixel
+           buffer objects so that the render loop never waits.
+
+    @date 2016
+
+    @author
+    Russ Taylor working through ReliaSolve.com for Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Shows a sequence of images, one at a time, from a texture.  The images
+// are binary PGM (P5) or PPM (P6) files, which any image tool can write;
+// they are shown with their first row at the top.
+//   A worker thread decodes the images in order, looping back to the
+// first after the last, into a ring of slots in one pixel buffer object
+// that stays mapped the whole time (OpenGL 4.4 or ARB_buffer_storage).
+// Each call to update() starts at most one copy from a decoded slot into
+// the back texture and checks, without waiting, whether the copy before
+// it has finished; next() switches to the back texture once it holds the
+// next image.  So switching images costs the render loop a bind and a
+// fence check, however large the images are.  Without persistent
+// mapping, the slots are in ordinary memory and the copy is done by
+// glTexImage2D() from there, which can stall.
+//   All methods, including the constructor and destructor, must be
+// called with the OpenGL context current and after glewInit().
+class Pattern_Stream
+{
+public:
+  // The slots must be at least 2 for decoding to overlap uploading.
+  // The headers of all of the files are read to size the slots, and
+  // ok() is false (after reporting why) if any can't be used.
+  Pattern_Stream(std::vector<std::string> const &fileNames, size_t slots = 3);
+  ~Pattern_Stream();
+
+  bool ok() const { return d_ok; }
+
+  // Do the OpenGL work for the stream: call once per frame.
+  void update();
+
+  // Ask to show the next image.  It is shown once it has been uploaded,
+  // which is usually already the case.  Returns true if it was.
+  bool next();
+
+  // The texture holding the image being shown, or 0 before the first
+  // one is ready, and its index in the sequence and size.
+  unsigned texture() const { return d_shown >= 0 ? d_textures[d_front] : 0; }
+  int shown() const { return d_shown; }
+  int width() const { return d_sizes[d_front][0]; }
+  int height() const { return d_sizes[d_front][1]; }
+
+  // Read the size of a PGM or PPM file from its header, returning false
+  // (after reporting why) if it is not one we can decode.
+  static bool readHeader(const std::string &fileName, int &width, int &height);
+
+  // Decode a PGM or PPM file of the specified size into RGBA rows from
+  // the bottom, as OpenGL wants them.  Returns false (after reporting
+  // why) on failure.
+  static bool decode(const std::string &fileName, int width, int height,
+    unsigned char *rgba);
+
+private:
+  enum SlotState { FREE, DECODING, FILLED, UPLOADING };
+  typedef struct {
+    SlotState state;
+    int       index;        //< Which image is in it
+  } Slot;
+
+  std::vector<std::string>  d_fileNames;
+  std::vector<int>          d_widths, d_heights;
+  bool      d_ok;
+  size_t    d_slotBytes;    //< Big enough for the largest image
+
+  // The slots, either in a persistently-mapped buffer or in memory.
+  unsigned  d_buffer;       //< Pixel buffer object, 0 if not persistent
+  unsigned char *d_memory;  //< Start of the slots
+  std::vector<unsigned char> d_fallback;
+
+  // Shared with the decode thread, under the lock.
+  std::mutex                d_lock;
+  std::condition_variable   d_changed;
+  std::vector<Slot>         d_slots;
+  bool                      d_stop;
+
+  // Used only by the render thread.
+  size_t    d_uploadSlot;   //< Next slot to upload, in ring order
+  void      *d_fence;       //< GLsync for the upload in progress, if any
+  size_t    d_fenceSlot;    //< Slot being uploaded
+  int       d_fenceIndex;   //< Image being uploaded
+  unsigned  d_textures[2];
+  int       d_sizes[2][2];  //< Allocated width and height of each texture
+  int       d_backIndex;    //< Image in the back texture
+  size_t    d_front;        //< Texture being shown
+  bool      d_backReady;    //< Back texture holds the next image
+  bool      d_advance;      //< next() is waiting for the back texture
+  int       d_shown;        //< Image being shown, -1 if none yet
+
+  std::thread d_decoder;
+  void decodeLoop();
+
+  // Free the slot of an upload whose copy is done, which leaves its
+  // image in the back texture.
+  void finishUpload(size_t slot, int index);
+
+  // Show the back texture if next() is waiting for it and it is ready.
+  void swapIfWanted();
+
+  // Not copyable, because we own the buffer, textures and thread.
+  Pattern_Stream(const Pattern_Stream &);
+  Pattern_Stream &operator=(const Pattern_Stream &);
+};
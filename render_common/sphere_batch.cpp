@@ -0,0 +1,284 @@
+/** @file
+    @brief Draws many copies of a sphere from one cached vertex buffer.
+
+    @date 2016
+
+    @author
+    Russ Taylor working through ReliaSolve.com for Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Internal Includes
+#include "sphere_batch.h"
+
+// Library/third-party includes
+#include <GL/glew.h>
+
+// Standard includes
+#include <iostream>
+#include <vector>
+#include <cmath>
+
+// Attribute locations used by the instancing shader.
+static const GLuint POSITION_ATTRIBUTE = 0;
+static const GLuint CENTER_ATTRIBUTE = 1;
+
+// The unit-sphere position is also its normal.  Lighting follows the
+// fixed-function equation for GL_LIGHT0 with GL_COLOR_MATERIAL setting
+// the ambient and diffuse material and no specular term.
+static const char *VERTEX_SHADER =
+  "#version 120\n"
+  "attribute vec3 position;\n"
+  "attribute vec2 center;\n"
+  "uniform float radius;\n"
+  "uniform bool lighting;\n"
+  "void main()\n"
+  "{\n"
+  "  vec4 p = vec4(position * radius + vec3(center, 0.0), 1.0);\n"
+  "  gl_Position = gl_ModelViewProjectionMatrix * p;\n"
+  "  if (lighting) {\n"
+  "    vec3 n = normalize(gl_NormalMatrix * position);\n"
+  "    vec3 eye = (gl_ModelViewMatrix * p).xyz;\n"
+  "    vec4 lightPos = gl_LightSource[0].position;\n"
+  "    vec3 l = normalize(lightPos.xyz - eye * lightPos.w);\n"
+  "    vec3 light = gl_LightModel.ambient.rgb + gl_LightSource[0].ambient.rgb\n"
+  "      + gl_LightSource[0].diffuse.rgb * max(dot(n, l), 0.0);\n"
+  "    gl_FrontColor = vec4(gl_Color.rgb * light, gl_Color.a);\n"
+  "  } else {\n"
+  "    gl_FrontColor = gl_Color;\n"
+  "  }\n"
+  "}\n";
+
+static const char *FRAGMENT_SHADER =
+  "#version 120\n"
+  "void main()\n"
+  "{\n"
+  "  gl_FragColor = gl_Color;\n"
+  "}\n";
+
+// Compile a shader, returning 0 (after reporting why) on failure.
+static GLuint compileShader(GLenum type, const char *source)
+{
+  GLuint shader = glCreateShader(type);
+  glShaderSource(shader, 1, &source, NULL);
+  glCompileShader(shader);
+  GLint status;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+  if (status == GL_FALSE) {
+    char log[1024];
+    glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+    std::cerr << "Sphere_Batch: Could not compile shader: " << log << std::endl;
+    glDeleteShader(shader);
+    return 0;
+  }
+  return shader;
+}
+
+// Build the instancing program, returning 0 on failure.
+static GLuint makeProgram()
+{
+  GLuint vertex = compileShader(GL_VERTEX_SHADER, VERTEX_SHADER);
+  GLuint fragment = compileShader(GL_FRAGMENT_SHADER, FRAGMENT_SHADER);
+  if ((vertex == 0) || (fragment == 0)) {
+    if (vertex) { glDeleteShader(vertex); }
+    if (fragment) { glDeleteShader(fragment); }
+    return 0;
+  }
+
+  GLuint program = glCreateProgram();
+  glAttachShader(program, vertex);
+  glAttachShader(program, fragment);
+  glBindAttribLocation(program, POSITION_ATTRIBUTE, "position");
+  glBindAttribLocation(program, CENTER_ATTRIBUTE, "center");
+  glLinkProgram(program);
+  glDeleteShader(vertex);
+  glDeleteShader(fragment);
+
+  GLint status;
+  glGetProgramiv(program, GL_LINK_STATUS, &status);
+  if (status == GL_FALSE) {
+    char log[1024];
+    glGetProgramInfoLog(program, sizeof(log), NULL, log);
+    std::cerr << "Sphere_Batch: Could not link shader: " << log << std::endl;
+    glDeleteProgram(program);
+    return 0;
+  }
+  return program;
+}
+
+Sphere_Batch::Sphere_Batch(unsigned slices, unsigned stacks)
+  : d_vertexBuffer(0)
+  , d_indexBuffer(0)
+  , d_centerBuffer(0)
+  , d_program(0)
+  , d_radiusParam(-1)
+  , d_lightingParam(-1)
+  , d_numIndices(0)
+  , d_numCenters(0)
+{
+  if (slices < 3) { slices = 3; }
+  if (stacks < 2) { stacks = 2; }
+
+  // Vertices go from the +Z pole to the -Z pole, one ring per stack,
+  // with the first vertex of each ring repeated at its end.
+  const double PI = 3.14159265358979323846;
+  std::vector<GLfloat> vertices;
+  vertices.reserve(3 * (stacks + 1) * (slices + 1));
+  for (unsigned i = 0; i <= stacks; i++) {
+    double phi = PI * i / stacks;
+    double z = cos(phi);
+    double r = sin(phi);
+    for (unsigned j = 0; j <= slices; j++) {
+      double theta = 2 * PI * j / slices;
+      vertices.push_back(static_cast<GLfloat>(r * cos(theta)));
+      vertices.push_back(static_cast<GLfloat>(r * sin(theta)));
+      vertices.push_back(static_cast<GLfloat>(z));
+    }
+  }
+
+  // Two triangles for each quad between neighboring rings.
+  std::vector<GLuint> indices;
+  indices.reserve(6 * stacks * slices);
+  for (unsigned i = 0; i < stacks; i++) {
+    for (unsigned j = 0; j < slices; j++) {
+      GLuint a = i * (slices + 1) + j;
+      GLuint b = a + slices + 1;
+      indices.push_back(a);
+      indices.push_back(b);
+      indices.push_back(a + 1);
+      indices.push_back(a + 1);
+      indices.push_back(b);
+      indices.push_back(b + 1);
+    }
+  }
+  d_numIndices = indices.size();
+
+  glGenBuffers(1, &d_vertexBuffer);
+  glBindBuffer(GL_ARRAY_BUFFER, d_vertexBuffer);
+  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat),
+    &vertices[0], GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  glGenBuffers(1, &d_indexBuffer);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, d_indexBuffer);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint),
+    &indices[0], GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+  // Instanced drawing needs per-instance attributes.
+  if (GLEW_VERSION_3_3) {
+    d_program = makeProgram();
+    if (d_program) {
+      d_radiusParam = glGetUniformLocation(d_program, "radius");
+      d_lightingParam = glGetUniformLocation(d_program, "lighting");
+      glGenBuffers(1, &d_centerBuffer);
+    }
+  }
+}
+
+Sphere_Batch::~Sphere_Batch()
+{
+  if (d_program) { glDeleteProgram(d_program); }
+  if (d_centerBuffer) { glDeleteBuffers(1, &d_centerBuffer); }
+  if (d_indexBuffer) { glDeleteBuffers(1, &d_indexBuffer); }
+  if (d_vertexBuffer) { glDeleteBuffers(1, &d_vertexBuffer); }
+}
+
+void Sphere_Batch::setCenters(std::vector<float> const &xy)
+{
+  d_centers = xy;
+  d_numCenters = xy.size() / 2;
+  if (d_centerBuffer && (d_numCenters > 0)) {
+    glBindBuffer(GL_ARRAY_BUFFER, d_centerBuffer);
+    glBufferData(GL_ARRAY_BUFFER, 2 * d_numCenters * sizeof(GLfloat),
+      &xy[0], GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+}
+
+void Sphere_Batch::draw(double radius)
+{
+  if (d_numCenters == 0) {
+    return;
+  }
+
+  // Draw them one at a time if we can't do them all at once.
+  if (d_program == 0) {
+    for (size_t i = 0; i < d_numCenters; i++) {
+      drawOne(d_centers[2 * i], d_centers[2 * i + 1], radius);
+    }
+    return;
+  }
+
+  GLint previousProgram;
+  glGetIntegerv(GL_CURRENT_PROGRAM, &previousProgram);
+  glUseProgram(d_program);
+  glUniform1f(d_radiusParam, static_cast<GLfloat>(radius));
+  glUniform1i(d_lightingParam, glIsEnabled(GL_LIGHTING) ? 1 : 0);
+
+  glBindBuffer(GL_ARRAY_BUFFER, d_vertexBuffer);
+  glEnableVertexAttribArray(POSITION_ATTRIBUTE);
+  glVertexAttribPointer(POSITION_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, 0, 0);
+  glBindBuffer(GL_ARRAY_BUFFER, d_centerBuffer);
+  glEnableVertexAttribArray(CENTER_ATTRIBUTE);
+  glVertexAttribPointer(CENTER_ATTRIBUTE, 2, GL_FLOAT, GL_FALSE, 0, 0);
+  glVertexAttribDivisor(CENTER_ATTRIBUTE, 1);
+
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, d_indexBuffer);
+  glDrawElementsInstanced(GL_TRIANGLES, static_cast<GLsizei>(d_numIndices),
+    GL_UNSIGNED_INT, 0, static_cast<GLsizei>(d_numCenters));
+
+  // Put things back the way we found them.
+  glVertexAttribDivisor(CENTER_ATTRIBUTE, 0);
+  glDisableVertexAttribArray(CENTER_ATTRIBUTE);
+  glDisableVertexAttribArray(POSITION_ATTRIBUTE);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glUseProgram(previousProgram);
+}
+
+void Sphere_Batch::drawOne(double x, double y, double radius)
+{
+  glPushMatrix();
+  glTranslated(x, y, 0);
+  glScaled(radius, radius, radius);
+  drawFixedFunction();
+  glPopMatrix();
+}
+
+void Sphere_Batch::drawFixedFunction()
+{
+  // The scale in the modelview matrix is uniform, so rescaling gets the
+  // normals back to unit length.
+  GLboolean rescale = glIsEnabled(GL_RESCALE_NORMAL);
+  glEnable(GL_RESCALE_NORMAL);
+
+  glBindBuffer(GL_ARRAY_BUFFER, d_vertexBuffer);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glVertexPointer(3, GL_FLOAT, 0, 0);
+  glEnableClientState(GL_NORMAL_ARRAY);
+  glNormalPointer(GL_FLOAT, 0, 0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, d_indexBuffer);
+  glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(d_numIndices),
+    GL_UNSIGNED_INT, 0);
+
+  glDisableClientState(GL_NORMAL_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  if (!rescale) { glDisable(GL_RESCALE_NORMAL); }
+}
@@ -0,0 +1,74 @@
+/** @file
+    @brief Draws many copies of a sphere from one cached vertex buffer.
+
+    @date 2016
+
+    @author
+    Russ Taylor working through ReliaSolve.com for Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include <vector>
+#include <cstddef>
+
+// A sphere that is tessellated once (the way gluSphere() would do it,
+// into slices around the Z axis and stacks along it) and kept in vertex
+// and index buffers on the graphics card.  A set of centers in the XY
+// plane can also be stored there, and then all of the spheres are drawn
+// with a single instanced call.  If instancing (OpenGL 3.3) is not
+// available, each sphere is drawn from the same buffers in turn.
+//   Spheres are drawn in the current color, transformed by the current
+// projection and modelview matrices.  When GL_LIGHTING is enabled they
+// are lit by GL_LIGHT0 as if GL_COLOR_MATERIAL were on and the material
+// had no specular component.
+//   All methods, including the constructor and destructor, must be
+// called with the OpenGL context current and after glewInit().
+class Sphere_Batch
+{
+public:
+  Sphere_Batch(unsigned slices, unsigned stacks);
+  ~Sphere_Batch();
+
+  // Replace the centers drawn by draw() with those in the vector,
+  // which holds an x,y pair for each sphere.
+  void setCenters(std::vector<float> const &xy);
+
+  // Draw a sphere of the specified radius at each center.
+  void draw(double radius);
+
+  // Draw a single sphere of the specified radius at (x, y, 0).
+  void drawOne(double x, double y, double radius);
+
+private:
+  unsigned    d_vertexBuffer;     //< Unit-sphere positions (also normals)
+  unsigned    d_indexBuffer;      //< Triangle indices into the vertices
+  unsigned    d_centerBuffer;     //< Per-instance centers
+  unsigned    d_program;          //< Instancing shader, 0 if not available
+  int         d_radiusParam;      //< Location of the radius uniform
+  int         d_lightingParam;    //< Location of the lighting uniform
+  size_t      d_numIndices;
+  size_t      d_numCenters;
+  std::vector<float>  d_centers;  //< Copy of the centers for drawing one at a time
+
+  // Draw the sphere once at the origin with the fixed-function pipeline.
+  void drawFixedFunction();
+
+  // Not copyable, because we own the buffer objects.
+  Sphere_Batch(const Sphere_Batch &);
+  Sphere_Batch &operator=(const Sphere_Batch &);
+};
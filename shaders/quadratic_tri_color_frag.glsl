@@ -0,0 +1,80 @@
+#version 120
+#extension GL_EXT_texture_array : enable
+
+// Applies a separate radial distortion correction to each color of an
+// undistorted image.  Each output pixel samples each color at
+// (1 + K1 r^2 + K2 r^4 + K3 r^6 + K4 r^8) times its offset from that
+// color's center of projection, where r is the offset in pixels divided
+// by the radius.  With only K1, this is the first-order inverse of the
+// CPU correction, which draws a point at offset d at (1 - K1 r^2) * d.
+// Samples that fall outside the image, or outside sourceRegion (the part
+// of the image that belongs to the eye being drawn), are black.
+//   When useDisplacementMap is set, each color instead samples where its
+// displacement map (baked by AnglesToConfig -displacement_map) says; the
+// maps are the red, green and blue layers of one array texture.  The
+// maps cover the eye's screen, which is the part of the texture described
+// by mapRegion (left, bottom, width, height); their texel (i, j) is for
+// screen location (i, j) / (mapSize - 1) and holds the offset from there
+// to the sample, in screen coordinates.  Drivers without array textures
+// still compile this shader, just without the displacement-map path.
+
+uniform sampler2D sourceTexture; // Undistorted image
+uniform vec4 k[3];              // K1..K4 for red, green, blue
+uniform vec2 center[3];         // Center of projection for each color, in texture coordinates
+uniform float radius;           // Distance in pixels at which r = 1
+uniform vec2 viewSize;          // Size of the texture in pixels
+uniform vec4 sourceRegion;      // Left, bottom, right, top of the eye's image
+#ifdef GL_EXT_texture_array
+uniform sampler2DArray displacementMaps; // Red, green, blue displacement maps
+#endif
+uniform bool useDisplacementMap;
+uniform vec2 mapSize;           // Size of each displacement map in texels
+uniform vec4 mapRegion;         // The eye's part of the texture
+
+vec4 sampleRegion(vec2 source)
+{
+    if (any(lessThan(source, sourceRegion.xy)) || any(greaterThan(source, sourceRegion.zw))) {
+        return vec4(0.0);
+    }
+    return texture2D(sourceTexture, source);
+}
+
+vec4 sampleSource(vec2 coord, vec4 terms, vec2 cop)
+{
+    vec2 offset = coord - cop;
+    vec2 pixels = offset * viewSize / radius;
+    float r2 = dot(pixels, pixels);
+    float scale = 1.0 + r2 * (terms.x + r2 * (terms.y + r2 * (terms.z + r2 * terms.w)));
+    return sampleRegion(cop + scale * offset);
+}
+
+vec4 sampleMapped(vec2 coord, float layer)
+{
+#ifdef GL_EXT_texture_array
+    vec2 screen = (coord - mapRegion.xy) / mapRegion.zw;
+    vec2 texel = (screen * (mapSize - 1.0) + 0.5) / mapSize;
+    vec2 source = screen + texture2DArray(displacementMaps, vec3(texel, layer)).rg;
+    if (any(lessThan(source, vec2(0.0))) || any(greaterThan(source, vec2(1.0)))) {
+        return vec4(0.0);
+    }
+    return sampleRegion(mapRegion.xy + source * mapRegion.zw);
+#else
+    return vec4(0.0);
+#endif
+}
+
+void main()
+{
+    vec2 coord = gl_TexCoord[0].st;
+    if (useDisplacementMap) {
+        gl_FragColor = vec4(sampleMapped(coord, 0.0).r,
+                            sampleMapped(coord, 1.0).g,
+                            sampleMapped(coord, 2.0).b,
+                            1.0);
+        return;
+    }
+    gl_FragColor = vec4(sampleSource(coord, k[0], center[0]).r,
+                        sampleSource(coord, k[1], center[1]).g,
+                        sampleSource(coord, k[2], center[2]).b,
+                        1.0);
+}
@@ -0,0 +1,11 @@
+#version 120
+
+// Passes each vertex through along with its texture coordinate, so
+// that the fragment shader can find where to sample the undistorted
+// image rendered into the texture.
+
+void main()
+{
+    gl_TexCoord[0] = gl_MultiTexCoord0;
+    gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;
+}
@@ -24,8 +24,14 @@
 // limitations under the License.
 
 #include "undistort_shader.h"
+#include "displacement_map_file.h"
+#include "file_util.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fstream>
+#include <sstream>
 #include <GL/glew.h>
 #include <GL/gl.h>
 
@@ -33,30 +39,83 @@ class Undistort_Shader_Private
 {
 public:
     Undistort_Shader_Private()
-        : d_shader_id(Undistort_Shader::NO_SHADER) {};
-
-    // Read a shader string from a file into a string.  Returns an empty
-    // string on failure.
-    std::string readShaderFromFile(std::string filename);
-
-    // Load, compile, and link the shaders.
-    static int loadShaders(const char *vertexShader, const char *fragmentShader);
+        : d_shader_id(Undistort_Shader::NO_SHADER)
+        , d_have_maps(false), d_map_width(1.0f), d_map_height(1.0f) {};
 
     // TODO: Figure out which parameters can be uniform
     GLuint  d_shader_id;        //< The index of our shader program
-    GLint   d_k1RedParam;       //< The location of the K1 param for Red
-    GLint   d_k1GreenParam;     //< The location of the K1 param for Green
-    GLint   d_k1BlueParam;      //< The location of the K1 param for Blue
-    GLint    d_centerParam;
+    GLint    d_kParam;          //< The location of the K terms for all colors
+    GLint    d_centerParam;     //< The location of the centers for all colors
     GLint    d_radiusParam;
+    GLint    d_viewSizeParam;   //< The location of the texture size in pixels
+    GLint    d_sourceRegionParam; //< The location of the eye's part of the image
+    GLint    d_textureParam;    //< The location of the texture sampler
+    GLint    d_useMapParam;     //< The location of the displacement map switch
+    GLint    d_mapSizeParam;    //< The location of the map size in texels
+    GLint    d_mapRegionParam;  //< The location of the eye's part of the texture
+    GLint    d_mapTextureParam; //< The location of the map array sampler
+
+    Undistort_Shader::Parameters    d_params;   //< Values to use in shader
+
+    // Displacement maps, if they have been loaded: one array texture
+    // per eye with a layer for each color, so that a single texture
+    // fetch setup serves all three colors in one pass.
+    bool     d_have_maps;
+    GLuint   d_map_textures[2];
+    float    d_map_width, d_map_height;
+
+    // Whether the parameters select a loaded displacement map.
+    bool usingMaps() const {
+        return d_have_maps && (d_params.displacementEye >= 0) &&
+            (d_params.displacementEye < 2);
+    }
 
-    GLfloat d_k1Red;        // K1 red value to use in shader
-    GLfloat d_k1Green;      // K1 green value to use in shader
-    GLfloat d_k1Blue;       // K1 blue value to use in shader
-    GLfloat d_center[2];    // Center value to use in shader
-    GLfloat d_radius;        // Center value to use in shader
+    void deleteMaps() {
+        if (d_have_maps) {
+            glDeleteTextures(2, d_map_textures);
+            d_have_maps = false;
+        }
+    }
+
+    // Send all of the parameters to the shader.
+    void upload();
 };
 
+void Undistort_Shader_Private::upload()
+{
+    if (d_shader_id == Undistort_Shader::NO_SHADER) {
+        return;
+    }
+
+    // One vec4 of terms and one vec2 center per color.
+    GLfloat k[3][Undistort_Shader::MAX_TERMS];
+    GLfloat center[3][2];
+    for (int c = 0; c < 3; c++) {
+        const Undistort_Shader::ColorParameters &color = d_params.color[c];
+        for (unsigned i = 0; i < Undistort_Shader::MAX_TERMS; i++) {
+            k[c][i] = (i < color.k.size()) ? color.k[i] : 0.0f;
+        }
+        center[c][0] = color.centerX;
+        center[c][1] = color.centerY;
+    }
+
+    // Put back whatever program was in use when we're done.
+    GLint previous;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &previous);
+    glUseProgram(d_shader_id);
+    glUniform4fv(d_kParam, 3, &k[0][0]);
+    glUniform2fv(d_centerParam, 3, &center[0][0]);
+    glUniform1f(d_radiusParam, d_params.radius);
+    glUniform2f(d_viewSizeParam, d_params.viewWidth, d_params.viewHeight);
+    glUniform4f(d_sourceRegionParam, d_params.sourceLeft, d_params.sourceBottom,
+                d_params.sourceRight, d_params.sourceTop);
+    glUniform1i(d_useMapParam, usingMaps() ? 1 : 0);
+    glUniform2f(d_mapSizeParam, d_map_width, d_map_height);
+    glUniform4f(d_mapRegionParam, d_params.mapLeft, d_params.mapBottom,
+                d_params.mapWidth, d_params.mapHeight);
+    glUseProgram(previous);
+}
+
 // XXX List of shader attributes
 struct shader_bind_attribute_list
 {
@@ -98,21 +157,134 @@ std::string Undistort_Shader::readShaderFromFile(std::string filename)
 {
     std::string ret;
 
-    // TODO: Convert this to using only standard library calls.
-    FILE *f = fopen(filename.c_str(), "r");
-    if (f == NULL) { 
+    std::ifstream in(filename.c_str(), std::ios::in | std::ios::binary);
+    if (!in) {
         printf("No shader file with name %s found;", filename.c_str());
         return ret; }
 
-    // Read each line of the file and append it to the string.
-    char line[4096];
-    while (fgets(line, sizeof(line), f) != NULL) {
-        ret += line;
+    // Read the whole file at once.
+    std::ostringstream contents;
+    contents << in.rdbuf();
+    ret = contents.str();
+    return ret;
+}
+
+//----------------------------------------------------------------------
+// Program binary cache.  The file holds a header followed by the
+// program binary as returned by the driver.  The key is a hash of the
+// shader sources and the driver's vendor, renderer and version strings,
+// so changing any of them makes the cache stale.
+
+static const char PROGRAM_CACHE_MAGIC[8] = { 'U', 'D', 'S', 'P', 'R', 'O', 'G', '1' };
+
+typedef struct {
+    char        magic[8];
+    uint64_t    key;
+    uint32_t    format;     //< Binary format reported by the driver
+    uint32_t    length;     //< Bytes of binary after the header
+} ProgramCacheHeader;
+
+// Tells whether the driver can give us program binaries.
+static bool haveProgramBinaries()
+{
+    if (!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary) {
+        return false;
     }
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+}
 
-    // Done; send the result after closing the file.
-    fclose(f);
-    return ret;
+// 64-bit FNV-1a hash of a string, including its terminating NUL so that
+// moving characters from one string to the next changes the key.
+static uint64_t hashString(uint64_t hash, const char *s)
+{
+    do {
+        hash ^= static_cast<unsigned char>(*s);
+        hash *= 1099511628211ULL;
+    } while (*s++ != '\0');
+    return hash;
+}
+
+static uint64_t programCacheKey(const std::string &vertexProgram,
+                                const std::string &fragmentProgram)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    hash = hashString(hash, vertexProgram.c_str());
+    hash = hashString(hash, fragmentProgram.c_str());
+    const GLenum names[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        const GLubyte *value = glGetString(names[i]);
+        hash = hashString(hash, value ? reinterpret_cast<const char *>(value) : "");
+    }
+    return hash;
+}
+
+// Make a program from the cache file if it matches the key.
+// Returns NO_SHADER if it doesn't or if the driver rejects the binary.
+static GLuint loadProgramFromCache(const std::string &filename, uint64_t key)
+{
+    std::ifstream in(filename.c_str(), std::ios::in | std::ios::binary);
+    if (!in) {
+        return Undistort_Shader::NO_SHADER;
+    }
+    ProgramCacheHeader header;
+    if (!in.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+        (memcmp(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic)) != 0) ||
+        (header.key != key)) {
+        return Undistort_Shader::NO_SHADER;
+    }
+    std::vector<char> binary(header.length);
+    if ((header.length == 0) || !in.read(&binary[0], binary.size())) {
+        return Undistort_Shader::NO_SHADER;
+    }
+
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, header.format, &binary[0],
+                    static_cast<GLsizei>(binary.size()));
+    GLint status;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (status == GL_FALSE) {
+        glDeleteProgram(program);
+        return Undistort_Shader::NO_SHADER;
+    }
+    return program;
+}
+
+// Write a linked program to the cache file, under a temporary name that
+// is then moved into place so a partial file is never read.
+static bool saveProgramToCache(const std::string &filename, uint64_t key,
+                               GLuint program)
+{
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return false;
+    }
+    std::vector<char> contents(sizeof(ProgramCacheHeader) + length);
+    ProgramCacheHeader header;
+    memcpy(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic));
+    header.key = key;
+    GLenum format;
+    GLsizei written = 0;
+    glGetProgramBinary(program, length, &written, &format,
+                       &contents[sizeof(header)]);
+    if (written <= 0) {
+        return false;
+    }
+    header.format = format;
+    header.length = written;
+    memcpy(&contents[0], &header, sizeof(header));
+
+    std::string tempName;
+    FILE *f = open_replacement_file(filename, tempName);
+    if (f == NULL) {
+        return false;
+    }
+    size_t size = sizeof(header) + written;
+    bool ok = (fwrite(&contents[0], 1, size, f) == size);
+    ok = finish_replacement_file(f, ok, tempName, filename);
+    return ok;
 }
 
 // Load a pair of vertex and fragment shaders
@@ -122,7 +294,8 @@ std::string Undistort_Shader::readShaderFromFile(std::string filename)
 //  sbal:       list of generic vertex attributes to bind
 // Outputs
 //  handle of the linked shader program, or NO_SHADER if a problem
-int Undistort_Shader::loadShaders(const char *vertexShader, const char *fragmentShader)
+int Undistort_Shader::loadShaders(const char *vertexShader, const char *fragmentShader,
+                                  bool retrievable)
 {
     GLuint program;
     GLint temp;
@@ -154,6 +327,9 @@ int Undistort_Shader::loadShaders(const char *vertexShader, const char *fragment
         }
     }
 
+    if (retrievable) {
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
     glLinkProgram(program);
 
     glDeleteShader(vertexShaderHandle);
@@ -170,7 +346,8 @@ int Undistort_Shader::loadShaders(const char *vertexShader, const char *fragment
 // Undistort_Shader Constructor
 Undistort_Shader::Undistort_Shader(
     std::string vert_shader_file_name
-    , std::string frag_shader_file_name)
+    , std::string frag_shader_file_name
+    , std::string program_cache_file_name)
   : d_p(new Undistort_Shader_Private)
 {
     
@@ -182,16 +359,40 @@ Undistort_Shader::Undistort_Shader(
         return;
     }
     glewInit();
-    // Load, compile, and link the shaders
-    if ((d_p->d_shader_id = loadShaders(vertexProgram.c_str(), fragmentProgram.c_str())) == NO_SHADER) {
-        return;
+
+    // Use the cached program if it was made from these sources by
+    // this driver.
+    bool useCache = !program_cache_file_name.empty() && haveProgramBinaries();
+    uint64_t key = 0;
+    if (useCache) {
+        key = programCacheKey(vertexProgram, fragmentProgram);
+        d_p->d_shader_id = loadProgramFromCache(program_cache_file_name, key);
+    }
+
+    // Load, compile, and link the shaders, caching the result
+    if (d_p->d_shader_id == NO_SHADER) {
+        if ((d_p->d_shader_id = loadShaders(vertexProgram.c_str(), fragmentProgram.c_str(),
+                                            useCache)) == NO_SHADER) {
+            return;
+        }
+        if (useCache && !saveProgramToCache(program_cache_file_name, key, d_p->d_shader_id)) {
+            fprintf(stderr, "Undistort_Shader: Could not write program cache %s\n",
+                program_cache_file_name.c_str());
+        }
     }
 
     
     // Get the uniform variable locations
-    d_p->d_k1RedParam = glGetUniformLocation(d_p->d_shader_id, "k1Red");
-    d_p->d_k1GreenParam = glGetUniformLocation(d_p->d_shader_id, "k1Green");
-    d_p->d_k1BlueParam = glGetUniformLocation(d_p->d_shader_id, "k1Blue");
+    d_p->d_kParam = glGetUniformLocation(d_p->d_shader_id, "k");
+    d_p->d_centerParam = glGetUniformLocation(d_p->d_shader_id, "center");
+    d_p->d_radiusParam = glGetUniformLocation(d_p->d_shader_id, "radius");
+    d_p->d_viewSizeParam = glGetUniformLocation(d_p->d_shader_id, "viewSize");
+    d_p->d_sourceRegionParam = glGetUniformLocation(d_p->d_shader_id, "sourceRegion");
+    d_p->d_textureParam = glGetUniformLocation(d_p->d_shader_id, "sourceTexture");
+    d_p->d_useMapParam = glGetUniformLocation(d_p->d_shader_id, "useDisplacementMap");
+    d_p->d_mapSizeParam = glGetUniformLocation(d_p->d_shader_id, "mapSize");
+    d_p->d_mapRegionParam = glGetUniformLocation(d_p->d_shader_id, "mapRegion");
+    d_p->d_mapTextureParam = glGetUniformLocation(d_p->d_shader_id, "displacementMaps");
     
     // Set the default values
     SetDefaultValues();
@@ -201,9 +402,38 @@ Undistort_Shader::Undistort_Shader(
 // Set the Default Values for the Color Processing
 void Undistort_Shader::SetDefaultValues(void)
 {
-    setK1Red(0.0f);
-    setK1Green(0.0f);
-    setK1Blue(0.0f);
+    setParameters(Parameters());
+}
+
+bool Undistort_Shader::setParameters(const Parameters &params)
+{
+    for (int c = 0; c < 3; c++) {
+        if (params.color[c].k.size() > MAX_TERMS) {
+            fprintf(stderr, "Undistort_Shader::setParameters(): %u terms for color %d,"
+                " at most %u allowed\n", static_cast<unsigned>(params.color[c].k.size()),
+                c, MAX_TERMS);
+            return false;
+        }
+    }
+    d_p->d_params = params;
+    d_p->upload();
+    return true;
+}
+
+const Undistort_Shader::Parameters &Undistort_Shader::getParameters() const
+{
+    return d_p->d_params;
+}
+
+// Set the K1 parameter for one color, leaving the others alone
+static void setK1(Undistort_Shader::Parameters &params, int color, float val)
+{
+    std::vector<float> &k = params.color[color].k;
+    if (k.empty()) {
+        k.push_back(val);
+    } else {
+        k[0] = val;
+    }
 }
 
 // Set the K1 parameter for the Red channel
@@ -211,11 +441,8 @@ void Undistort_Shader::SetDefaultValues(void)
 //  val:    The value to use in the shader
 void Undistort_Shader::setK1Red(float val)
 {
-    d_p->d_k1Red = val;
-    glUseProgram(d_p->d_shader_id);
-    glUniform1f(d_p->d_k1RedParam, d_p->d_k1Red);
-    // TODO: Push and pop to go back to the original.
-    glUseProgram(0);
+    setK1(d_p->d_params, 0, val);
+    d_p->upload();
 }
 
 // Set the K1 parameter for the Green channel
@@ -223,11 +450,8 @@ void Undistort_Shader::setK1Red(float val)
 //  val:    The value to use in the shader
 void Undistort_Shader::setK1Green(float val)
 {
-    d_p->d_k1Green = val;
-    glUseProgram(d_p->d_shader_id);
-    glUniform1f(d_p->d_k1GreenParam, d_p->d_k1Green);
-    // TODO: Push and pop to go back to the original.
-    glUseProgram(0);
+    setK1(d_p->d_params, 1, val);
+    d_p->upload();
 }
 
 // Set the K1 parameter for the Blue channel
@@ -235,11 +459,39 @@ void Undistort_Shader::setK1Green(float val)
 //  val:    The value to use in the shader
 void Undistort_Shader::setK1Blue(float val)
 {
-    d_p->d_k1Blue = val;
-    glUseProgram(d_p->d_shader_id);
-    glUniform1f(d_p->d_k1BlueParam, d_p->d_k1Blue);
-    // TODO: Push and pop to go back to the original.
-    glUseProgram(0);
+    setK1(d_p->d_params, 2, val);
+    d_p->upload();
+}
+
+// Set the center of projection for all colors
+// Input
+//  x, y:   The center in texture coordinates
+void Undistort_Shader::setCenter(float x, float y)
+{
+    for (int c = 0; c < 3; c++) {
+        d_p->d_params.color[c].centerX = x;
+        d_p->d_params.color[c].centerY = y;
+    }
+    d_p->upload();
+}
+
+// Set the distance from the center at which r = 1
+// Input
+//  val:    The distance in pixels
+void Undistort_Shader::setRadius(float val)
+{
+    d_p->d_params.radius = val;
+    d_p->upload();
+}
+
+// Set the size of the texture being distorted
+// Input
+//  width, height:  The size in pixels
+void Undistort_Shader::setViewSize(float width, float height)
+{
+    d_p->d_params.viewWidth = width;
+    d_p->d_params.viewHeight = height;
+    d_p->upload();
 }
 
 // Use the shader for rendering (set up the program)
@@ -248,11 +500,91 @@ void Undistort_Shader::useShader()
     
     glUseProgram(d_p->d_shader_id);
 
+    // The undistorted image is always on texture unit 0, and the
+    // displacement maps for the eye go on unit 1.
+    glUniform1i(d_p->d_textureParam, 0);
+    glUniform1i(d_p->d_mapTextureParam, 1);
+    if (d_p->usingMaps()) {
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D_ARRAY,
+            d_p->d_map_textures[d_p->d_params.displacementEye]);
+        glActiveTexture(GL_TEXTURE0);
+    }
+}
 
-/* TODO Uniform parameters
-    glUniform1i(locCM, 0);
-    glUniform1i(locAL, 1);
-*/
+// Go back to fixed-function rendering
+void Undistort_Shader::stopUsingShader()
+{
+    glUseProgram(0);
+    if (d_p->usingMaps()) {
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        glActiveTexture(GL_TEXTURE0);
+    }
+}
+
+bool Undistort_Shader::loadDisplacementMap(const std::string &fileName)
+{
+    if (!isValid()) {
+        return false;
+    }
+    if (!GLEW_VERSION_3_0 && !(GLEW_EXT_texture_array && GLEW_ARB_texture_rg &&
+                               GLEW_ARB_texture_float && GLEW_ARB_half_float_pixel)) {
+        fprintf(stderr, "Undistort_Shader::loadDisplacementMap(): No floating-point"
+            " RG array textures\n");
+        return false;
+    }
+    if (d_p->d_mapTextureParam < 0) {
+        fprintf(stderr, "Undistort_Shader::loadDisplacementMap(): Shader was"
+            " compiled without array textures\n");
+        return false;
+    }
+    Displacement_Map_File file;
+    if (!file.open(fileName)) {
+        return false;
+    }
+    const Displacement_Map_Header &h = file.header();
+    bool half = (h.format == DISPLACEMENT_RG16F);
+
+    // Each color's map becomes a layer of its eye's array texture; a
+    // mono file's one map fills all three.  Each map's rows are a
+    // multiple of four bytes, so the default unpack alignment works.
+    d_p->deleteMaps();
+    glGenTextures(2, d_p->d_map_textures);
+    GLint previous;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D_ARRAY, &previous);
+    GLsizei width = static_cast<GLsizei>(h.width);
+    GLsizei height = static_cast<GLsizei>(h.height);
+    GLenum type = half ? GL_HALF_FLOAT : GL_FLOAT;
+    for (unsigned eye = 0; eye < 2; eye++) {
+        glBindTexture(GL_TEXTURE_2D_ARRAY, d_p->d_map_textures[eye]);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, half ? GL_RG16F : GL_RG32F,
+            width, height, 3, 0, GL_RG, type, NULL);
+        for (unsigned c = 0; c < 3; c++) {
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, c, width, height, 1,
+                GL_RG, type, file.map(eye, c));
+        }
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, previous);
+    d_p->d_have_maps = true;
+    d_p->d_map_width = static_cast<float>(h.width);
+    d_p->d_map_height = static_cast<float>(h.height);
+    d_p->upload();
+    return true;
+}
+
+bool Undistort_Shader::hasDisplacementMap() const
+{
+    return d_p->d_have_maps;
+}
+
+bool Undistort_Shader::isValid() const
+{
+    return d_p->d_shader_id != NO_SHADER;
 }
 
 // Destructor
@@ -261,4 +593,5 @@ Undistort_Shader::~Undistort_Shader()
     if (d_p->d_shader_id != NO_SHADER) {
         glDeleteProgram(d_p->d_shader_id);
     }
+    d_p->deleteMaps();
 }
@@ -25,6 +25,7 @@
 
 #pragma once
 #include <string>
+#include <vector>
 
 // Forward declaration to portions declared in the .cpp file, to avoid
 // #include conflicts with other source code.
@@ -33,25 +34,101 @@ class Undistort_Shader_Private;
 class Undistort_Shader
 {
 public:
+    // The linked program is cached in the program cache file (if its
+    // name is not empty and the driver can provide program binaries),
+    // and later runs use the cached program rather than compiling and
+    // linking when the shader sources and the driver (vendor, renderer
+    // and version) are unchanged.  A missing or stale cache file is
+    // replaced.
     Undistort_Shader(
         std::string vert_shader_file_name = "./quadratic_tri_color_vert.glsl",
-        std::string frag_shader_file_name = "./quadratic_tri_color_frag.glsl");
+        std::string frag_shader_file_name = "./quadratic_tri_color_frag.glsl",
+        std::string program_cache_file_name = "./quadratic_tri_color_program.bin");
     ~Undistort_Shader();
 
     // Use the shader for rendering.
     void useShader();
 
-    // Set individual shader parameters
-    // XXX window/texture size?  COP.  K params for each color.
+    // Go back to fixed-function rendering.
+    void stopUsingShader();
 
-    // Set the Parameters for the shader
+    // Tells whether the shader loaded and linked.
+    bool isValid() const;
+
+    // Most polynomial terms per color that the shader handles.
+    static const unsigned MAX_TERMS = 4;
+
+    // Distortion for one color.  Each output pixel samples this color
+    // of the undistorted image at (1 + K1 r^2 + K2 r^4 + ...) times its
+    // offset from the center of projection, where r is the length of
+    // that offset in pixels divided by the radius.  Terms past the end
+    // of k are zero.
+    class ColorParameters {
+    public:
+        ColorParameters() : centerX(0.5f), centerY(0.5f) {};
+        float centerX, centerY;     //< Center of projection, in texture coordinates
+        std::vector<float> k;       //< K1, K2, ... up to MAX_TERMS of them
+    };
+
+    // Everything the shader needs.  Colors are red, green, and blue.
+    class Parameters {
+    public:
+        Parameters() : radius(1.0f), viewWidth(1.0f), viewHeight(1.0f)
+            , sourceLeft(0.0f), sourceBottom(0.0f), sourceRight(1.0f), sourceTop(1.0f)
+            , displacementEye(-1), mapLeft(0.0f), mapBottom(0.0f)
+            , mapWidth(1.0f), mapHeight(1.0f) {};
+        ColorParameters color[3];
+        float radius;               //< Distance in pixels at which r = 1
+        float viewWidth, viewHeight; //< Size of the texture being distorted, in pixels
+
+        // Part of the texture that holds the image for the eye being
+        // drawn, in texture coordinates.  Samples outside it are black,
+        // so that one eye's image does not bleed into the other's when
+        // both share a texture.
+        float sourceLeft, sourceBottom, sourceRight, sourceTop;
+
+        // When displacementEye is 0 (left) or 1 (right) and displacement
+        // maps have been loaded, each color is sampled where that eye's
+        // map says rather than with the terms above.  The eye's screen
+        // covers the mapWidth by mapHeight part of the texture starting
+        // at (mapLeft, mapBottom), in texture coordinates.
+        int displacementEye;
+        float mapLeft, mapBottom, mapWidth, mapHeight;
+    };
+
+    // Set all of the shader parameters at once, binding the program only
+    // once to do so.  Returns false without changing anything if a color
+    // has more than MAX_TERMS terms.
+    bool setParameters(const Parameters &params);
+    const Parameters &getParameters() const;
+
+    // Set individual shader parameters.  Each of these uploads all of
+    // them, so use setParameters() when changing several.
     void setK1Red(float val);
     void setK1Green(float val);
     void setK1Blue(float val);
 
+    // Set the center of projection for all colors in texture coordinates,
+    // the distance in pixels at which r = 1, and the size of the texture
+    // being distorted in pixels.
+    void setCenter(float x, float y);
+    void setRadius(float val);
+    void setViewSize(float width, float height);
+
     // Sets the values back to their defaults.
     void SetDefaultValues(void);
 
+    // Load the per-pixel displacement maps that AnglesToConfig bakes
+    // with -displacement_map (see displacement_map_file.h) into
+    // textures, replacing any that were loaded before.  Each eye's maps
+    // go into one array texture with a layer per color, which the shader
+    // samples for all three colors in a single pass.  The file is
+    // memory-mapped and each map is uploaded straight from it.  Returns
+    // false if the file can't be used or the driver does not have
+    // floating-point RG array textures.
+    bool loadDisplacementMap(const std::string &fileName);
+    bool hasDisplacementMap() const;
+
     // No shader yet loaded.
     static const int NO_SHADER = 9999;
 
@@ -60,8 +137,10 @@ protected:
     // string on failure.
     std::string readShaderFromFile(std::string filename);
 
-    // Load, compile, and link the shaders.
-    static int loadShaders(const char *vertexShader, const char *fragmentShader);
+    // Load, compile, and link the shaders.  If retrievable is true, the
+    // driver is told that we will ask for the program binary.
+    static int loadShaders(const char *vertexShader, const char *fragmentShader,
+                           bool retrievable = false);
 
 private:
     Undistort_Shader_Private   *d_p;  //< Private objects requiring GL/GLEW
@@ -26,6 +26,14 @@ out vec4 color;
 
 layout (binding = 0) uniform sampler2D s;
 
+// When useDisplacementMap is nonzero, each color is sampled where this
+// eye's displacement map for that color says rather than with K1 (see
+// render_common/displacement_map_file.h for the file they come from).
+// The red, green and blue maps are layers 0, 1 and 2 of one array.
+layout (binding = 1) uniform sampler2DArray displacementMaps;
+uniform int useDisplacementMap;
+uniform vec2 mapSize;   // Size of each displacement map in texels
+
 vec2 Distort(vec2 p, float k1)
 {
     float r2 = p.x * p.x + p.y * p.y;
@@ -36,6 +44,11 @@ vec2 Distort(vec2 p, float k1)
     return p;
 }
 
+vec2 Displace(vec2 p, float layer)
+{
+    return p + texture(displacementMaps, vec3((p * (mapSize - 1) + 0.5) / mapSize, layer)).rg;
+}
+
 void main()
 {
     vec2 uv_red, uv_green, uv_blue;
@@ -45,9 +58,15 @@ void main()
     // Radial distort around center
     sectorOrigin = fs_in.center.xy;
 
-    uv_red      =  Distort(fs_in.texCoords-sectorOrigin, fs_in.k1_red)      + sectorOrigin;
-    uv_green    =  Distort(fs_in.texCoords-sectorOrigin, fs_in.k1_green)    + sectorOrigin;
-    uv_blue     =  Distort(fs_in.texCoords-sectorOrigin, fs_in.k1_blue)     + sectorOrigin;
+    if (useDisplacementMap != 0) {
+        uv_red      =  Displace(fs_in.texCoords, 0);
+        uv_green    =  Displace(fs_in.texCoords, 1);
+        uv_blue     =  Displace(fs_in.texCoords, 2);
+    } else {
+        uv_red      =  Distort(fs_in.texCoords-sectorOrigin, fs_in.k1_red)      + sectorOrigin;
+        uv_green    =  Distort(fs_in.texCoords-sectorOrigin, fs_in.k1_green)    + sectorOrigin;
+        uv_blue     =  Distort(fs_in.texCoords-sectorOrigin, fs_in.k1_blue)     + sectorOrigin;
+    }
 
     color_red   = texture2D(s, uv_red   );
     color_green = texture2D(s, uv_green );